@@ -0,0 +1,225 @@
+#include "KeyboardLayout.h"
+
+// ASCII tables: {modifier | LAYOUT_DEAD, HID keycode} for characters 0-127.
+// Keycodes are US key positions (0x04 = the key labelled A on a US board).
+
+static constexpr uint8_t US_ASCII[128][2] = {
+  {0x00, 0x00}, {0x00, 0x00}, {0x00, 0x00}, {0x00, 0x00},  // 00 01 02 03
+  {0x00, 0x00}, {0x00, 0x00}, {0x00, 0x00}, {0x00, 0x00},  // 04 05 06 07
+  {0x00, 0x2a}, {0x00, 0x2b}, {0x00, 0x28}, {0x00, 0x00},  // \b \t \n 0B
+  {0x00, 0x00}, {0x00, 0x28}, {0x00, 0x00}, {0x00, 0x00},  // 0C \r 0E 0F
+  {0x00, 0x00}, {0x00, 0x00}, {0x00, 0x00}, {0x00, 0x00},  // 10 11 12 13
+  {0x00, 0x00}, {0x00, 0x00}, {0x00, 0x00}, {0x00, 0x00},  // 14 15 16 17
+  {0x00, 0x00}, {0x00, 0x00}, {0x00, 0x00}, {0x00, 0x29},  // 18 19 1A ESC
+  {0x00, 0x00}, {0x00, 0x00}, {0x00, 0x00}, {0x00, 0x00},  // 1C 1D 1E 1F
+  {0x00, 0x2c}, {0x02, 0x1e}, {0x02, 0x34}, {0x02, 0x20},  // SP ! " #
+  {0x02, 0x21}, {0x02, 0x22}, {0x02, 0x24}, {0x00, 0x34},  // $ % & '
+  {0x02, 0x26}, {0x02, 0x27}, {0x02, 0x25}, {0x02, 0x2e},  // ( ) * +
+  {0x00, 0x36}, {0x00, 0x2d}, {0x00, 0x37}, {0x00, 0x38},  // , - . /
+  {0x00, 0x27}, {0x00, 0x1e}, {0x00, 0x1f}, {0x00, 0x20},  // 0 1 2 3
+  {0x00, 0x21}, {0x00, 0x22}, {0x00, 0x23}, {0x00, 0x24},  // 4 5 6 7
+  {0x00, 0x25}, {0x00, 0x26}, {0x02, 0x33}, {0x00, 0x33},  // 8 9 : ;
+  {0x02, 0x36}, {0x00, 0x2e}, {0x02, 0x37}, {0x02, 0x38},  // < = > ?
+  {0x02, 0x1f}, {0x02, 0x04}, {0x02, 0x05}, {0x02, 0x06},  // @ A B C
+  {0x02, 0x07}, {0x02, 0x08}, {0x02, 0x09}, {0x02, 0x0a},  // D E F G
+  {0x02, 0x0b}, {0x02, 0x0c}, {0x02, 0x0d}, {0x02, 0x0e},  // H I J K
+  {0x02, 0x0f}, {0x02, 0x10}, {0x02, 0x11}, {0x02, 0x12},  // L M N O
+  {0x02, 0x13}, {0x02, 0x14}, {0x02, 0x15}, {0x02, 0x16},  // P Q R S
+  {0x02, 0x17}, {0x02, 0x18}, {0x02, 0x19}, {0x02, 0x1a},  // T U V W
+  {0x02, 0x1b}, {0x02, 0x1c}, {0x02, 0x1d}, {0x00, 0x2f},  // X Y Z [
+  {0x00, 0x31}, {0x00, 0x30}, {0x02, 0x23}, {0x02, 0x2d},  // \ ] ^ _
+  {0x00, 0x35}, {0x00, 0x04}, {0x00, 0x05}, {0x00, 0x06},  // ` a b c
+  {0x00, 0x07}, {0x00, 0x08}, {0x00, 0x09}, {0x00, 0x0a},  // d e f g
+  {0x00, 0x0b}, {0x00, 0x0c}, {0x00, 0x0d}, {0x00, 0x0e},  // h i j k
+  {0x00, 0x0f}, {0x00, 0x10}, {0x00, 0x11}, {0x00, 0x12},  // l m n o
+  {0x00, 0x13}, {0x00, 0x14}, {0x00, 0x15}, {0x00, 0x16},  // p q r s
+  {0x00, 0x17}, {0x00, 0x18}, {0x00, 0x19}, {0x00, 0x1a},  // t u v w
+  {0x00, 0x1b}, {0x00, 0x1c}, {0x00, 0x1d}, {0x02, 0x2f},  // x y z {
+  {0x02, 0x31}, {0x02, 0x30}, {0x02, 0x35}, {0x00, 0x4c},  // | } ~ DEL
+};
+
+static constexpr uint8_t UK_ASCII[128][2] = {
+  {0x00, 0x00}, {0x00, 0x00}, {0x00, 0x00}, {0x00, 0x00},  // 00 01 02 03
+  {0x00, 0x00}, {0x00, 0x00}, {0x00, 0x00}, {0x00, 0x00},  // 04 05 06 07
+  {0x00, 0x2a}, {0x00, 0x2b}, {0x00, 0x28}, {0x00, 0x00},  // \b \t \n 0B
+  {0x00, 0x00}, {0x00, 0x28}, {0x00, 0x00}, {0x00, 0x00},  // 0C \r 0E 0F
+  {0x00, 0x00}, {0x00, 0x00}, {0x00, 0x00}, {0x00, 0x00},  // 10 11 12 13
+  {0x00, 0x00}, {0x00, 0x00}, {0x00, 0x00}, {0x00, 0x00},  // 14 15 16 17
+  {0x00, 0x00}, {0x00, 0x00}, {0x00, 0x00}, {0x00, 0x29},  // 18 19 1A ESC
+  {0x00, 0x00}, {0x00, 0x00}, {0x00, 0x00}, {0x00, 0x00},  // 1C 1D 1E 1F
+  {0x00, 0x2c}, {0x02, 0x1e}, {0x02, 0x1f}, {0x00, 0x32},  // SP ! " #
+  {0x02, 0x21}, {0x02, 0x22}, {0x02, 0x24}, {0x00, 0x34},  // $ % & '
+  {0x02, 0x26}, {0x02, 0x27}, {0x02, 0x25}, {0x02, 0x2e},  // ( ) * +
+  {0x00, 0x36}, {0x00, 0x2d}, {0x00, 0x37}, {0x00, 0x38},  // , - . /
+  {0x00, 0x27}, {0x00, 0x1e}, {0x00, 0x1f}, {0x00, 0x20},  // 0 1 2 3
+  {0x00, 0x21}, {0x00, 0x22}, {0x00, 0x23}, {0x00, 0x24},  // 4 5 6 7
+  {0x00, 0x25}, {0x00, 0x26}, {0x02, 0x33}, {0x00, 0x33},  // 8 9 : ;
+  {0x02, 0x36}, {0x00, 0x2e}, {0x02, 0x37}, {0x02, 0x38},  // < = > ?
+  {0x02, 0x34}, {0x02, 0x04}, {0x02, 0x05}, {0x02, 0x06},  // @ A B C
+  {0x02, 0x07}, {0x02, 0x08}, {0x02, 0x09}, {0x02, 0x0a},  // D E F G
+  {0x02, 0x0b}, {0x02, 0x0c}, {0x02, 0x0d}, {0x02, 0x0e},  // H I J K
+  {0x02, 0x0f}, {0x02, 0x10}, {0x02, 0x11}, {0x02, 0x12},  // L M N O
+  {0x02, 0x13}, {0x02, 0x14}, {0x02, 0x15}, {0x02, 0x16},  // P Q R S
+  {0x02, 0x17}, {0x02, 0x18}, {0x02, 0x19}, {0x02, 0x1a},  // T U V W
+  {0x02, 0x1b}, {0x02, 0x1c}, {0x02, 0x1d}, {0x00, 0x2f},  // X Y Z [
+  {0x00, 0x64}, {0x00, 0x30}, {0x02, 0x23}, {0x02, 0x2d},  // \ ] ^ _
+  {0x00, 0x35}, {0x00, 0x04}, {0x00, 0x05}, {0x00, 0x06},  // ` a b c
+  {0x00, 0x07}, {0x00, 0x08}, {0x00, 0x09}, {0x00, 0x0a},  // d e f g
+  {0x00, 0x0b}, {0x00, 0x0c}, {0x00, 0x0d}, {0x00, 0x0e},  // h i j k
+  {0x00, 0x0f}, {0x00, 0x10}, {0x00, 0x11}, {0x00, 0x12},  // l m n o
+  {0x00, 0x13}, {0x00, 0x14}, {0x00, 0x15}, {0x00, 0x16},  // p q r s
+  {0x00, 0x17}, {0x00, 0x18}, {0x00, 0x19}, {0x00, 0x1a},  // t u v w
+  {0x00, 0x1b}, {0x00, 0x1c}, {0x00, 0x1d}, {0x02, 0x2f},  // x y z {
+  {0x02, 0x64}, {0x02, 0x30}, {0x02, 0x32}, {0x00, 0x4c},  // | } ~ DEL
+};
+
+static constexpr uint8_t DE_ASCII[128][2] = {
+  {0x00, 0x00}, {0x00, 0x00}, {0x00, 0x00}, {0x00, 0x00},  // 00 01 02 03
+  {0x00, 0x00}, {0x00, 0x00}, {0x00, 0x00}, {0x00, 0x00},  // 04 05 06 07
+  {0x00, 0x2a}, {0x00, 0x2b}, {0x00, 0x28}, {0x00, 0x00},  // \b \t \n 0B
+  {0x00, 0x00}, {0x00, 0x28}, {0x00, 0x00}, {0x00, 0x00},  // 0C \r 0E 0F
+  {0x00, 0x00}, {0x00, 0x00}, {0x00, 0x00}, {0x00, 0x00},  // 10 11 12 13
+  {0x00, 0x00}, {0x00, 0x00}, {0x00, 0x00}, {0x00, 0x00},  // 14 15 16 17
+  {0x00, 0x00}, {0x00, 0x00}, {0x00, 0x00}, {0x00, 0x29},  // 18 19 1A ESC
+  {0x00, 0x00}, {0x00, 0x00}, {0x00, 0x00}, {0x00, 0x00},  // 1C 1D 1E 1F
+  {0x00, 0x2c}, {0x02, 0x1e}, {0x02, 0x1f}, {0x00, 0x32},  // SP ! " #
+  {0x02, 0x21}, {0x02, 0x22}, {0x02, 0x23}, {0x02, 0x32},  // $ % & '
+  {0x02, 0x25}, {0x02, 0x26}, {0x02, 0x30}, {0x00, 0x30},  // ( ) * +
+  {0x00, 0x36}, {0x00, 0x38}, {0x00, 0x37}, {0x02, 0x24},  // , - . /
+  {0x00, 0x27}, {0x00, 0x1e}, {0x00, 0x1f}, {0x00, 0x20},  // 0 1 2 3
+  {0x00, 0x21}, {0x00, 0x22}, {0x00, 0x23}, {0x00, 0x24},  // 4 5 6 7
+  {0x00, 0x25}, {0x00, 0x26}, {0x02, 0x37}, {0x02, 0x36},  // 8 9 : ;
+  {0x00, 0x64}, {0x02, 0x27}, {0x02, 0x64}, {0x02, 0x2d},  // < = > ?
+  {0x40, 0x14}, {0x02, 0x04}, {0x02, 0x05}, {0x02, 0x06},  // @ A B C
+  {0x02, 0x07}, {0x02, 0x08}, {0x02, 0x09}, {0x02, 0x0a},  // D E F G
+  {0x02, 0x0b}, {0x02, 0x0c}, {0x02, 0x0d}, {0x02, 0x0e},  // H I J K
+  {0x02, 0x0f}, {0x02, 0x10}, {0x02, 0x11}, {0x02, 0x12},  // L M N O
+  {0x02, 0x13}, {0x02, 0x14}, {0x02, 0x15}, {0x02, 0x16},  // P Q R S
+  {0x02, 0x17}, {0x02, 0x18}, {0x02, 0x19}, {0x02, 0x1a},  // T U V W
+  {0x02, 0x1b}, {0x02, 0x1d}, {0x02, 0x1c}, {0x40, 0x25},  // X Y Z [
+  {0x40, 0x2d}, {0x40, 0x26}, {0x80, 0x35}, {0x02, 0x38},  // \ ] ^ _
+  {0x82, 0x2e}, {0x00, 0x04}, {0x00, 0x05}, {0x00, 0x06},  // ` a b c
+  {0x00, 0x07}, {0x00, 0x08}, {0x00, 0x09}, {0x00, 0x0a},  // d e f g
+  {0x00, 0x0b}, {0x00, 0x0c}, {0x00, 0x0d}, {0x00, 0x0e},  // h i j k
+  {0x00, 0x0f}, {0x00, 0x10}, {0x00, 0x11}, {0x00, 0x12},  // l m n o
+  {0x00, 0x13}, {0x00, 0x14}, {0x00, 0x15}, {0x00, 0x16},  // p q r s
+  {0x00, 0x17}, {0x00, 0x18}, {0x00, 0x19}, {0x00, 0x1a},  // t u v w
+  {0x00, 0x1b}, {0x00, 0x1d}, {0x00, 0x1c}, {0x40, 0x24},  // x y z {
+  {0x40, 0x64}, {0x40, 0x27}, {0x40, 0x30}, {0x00, 0x4c},  // | } ~ DEL
+};
+
+static const LayoutKey UK_EXTRA[] = {
+  {0x00A3, LAYOUT_SHIFT, 0x20},  // £
+  {0x00AC, LAYOUT_SHIFT, 0x35},  // ¬
+  {0x20AC, LAYOUT_ALTGR, 0x21},  // €
+};
+
+static const LayoutKey DE_EXTRA[] = {
+  {0x00A7, LAYOUT_SHIFT, 0x20},  // §
+  {0x00B0, LAYOUT_SHIFT, 0x35},  // °
+  {0x00B2, LAYOUT_ALTGR, 0x1f},  // ²
+  {0x00B3, LAYOUT_ALTGR, 0x20},  // ³
+  {0x00B4, LAYOUT_DEAD, 0x2e},   // ´
+  {0x00B5, LAYOUT_ALTGR, 0x10},  // µ
+  {0x00C4, LAYOUT_SHIFT, 0x34},  // Ä
+  {0x00D6, LAYOUT_SHIFT, 0x33},  // Ö
+  {0x00DC, LAYOUT_SHIFT, 0x2f},  // Ü
+  {0x00DF, 0, 0x2d},             // ß
+  {0x00E4, 0, 0x34},             // ä
+  {0x00F6, 0, 0x33},             // ö
+  {0x00FC, 0, 0x2f},             // ü
+  {0x20AC, LAYOUT_ALTGR, 0x08},  // €
+};
+
+const KeyboardLayout layoutUS = {"US", US_ASCII, nullptr, 0};
+const KeyboardLayout layoutUK = {"UK", UK_ASCII, UK_EXTRA, sizeof(UK_EXTRA) / sizeof(UK_EXTRA[0])};
+const KeyboardLayout layoutDE = {"DE", DE_ASCII, DE_EXTRA, sizeof(DE_EXTRA) / sizeof(DE_EXTRA[0])};
+
+const KeyboardLayout& activeLayout() {
+#if STT_KEYBOARD_LAYOUT == LAYOUT_UK
+  return layoutUK;
+#elif STT_KEYBOARD_LAYOUT == LAYOUT_DE
+  return layoutDE;
+#else
+  return layoutUS;
+#endif
+}
+
+bool layoutLookup(const KeyboardLayout& layout, uint32_t codepoint, uint8_t* modifier,
+                  uint8_t* keycode) {
+  if (codepoint < 128) {
+    if (layout.ascii[codepoint][1] == 0) return false;
+    *modifier = layout.ascii[codepoint][0];
+    *keycode = layout.ascii[codepoint][1];
+    return true;
+  }
+
+  size_t lo = 0;
+  size_t hi = layout.extraCount;
+  while (lo < hi) {
+    size_t mid = (lo + hi) / 2;
+    if (layout.extra[mid].codepoint < codepoint) {
+      lo = mid + 1;
+    } else {
+      hi = mid;
+    }
+  }
+  if (lo == layout.extraCount || layout.extra[lo].codepoint != codepoint) return false;
+  *modifier = layout.extra[lo].modifier;
+  *keycode = layout.extra[lo].keycode;
+  return true;
+}
+
+// U+00A0-U+00FF. An empty string drops the character on purpose.
+static const char* const LATIN1[96] = {
+  " ",   "!",   "c",   "GBP", nullptr, "JPY", "|",   "S",    // A0-A7
+  "\"",  "(c)", "a",   "\"",  "-",   "",    "(R)", "-",     // A8-AF
+  nullptr, "+/-", "2", "3",   "'",   "u",   nullptr, ".",   // B0-B7
+  ",",   "1",   "o",   "\"",  "1/4", "1/2", "3/4", "?",     // B8-BF
+  "A",   "A",   "A",   "A",   "A",   "A",   "AE",  "C",     // C0-C7
+  "E",   "E",   "E",   "E",   "I",   "I",   "I",   "I",     // C8-CF
+  "D",   "N",   "O",   "O",   "O",   "O",   "O",   "x",     // D0-D7
+  "O",   "U",   "U",   "U",   "U",   "Y",   "TH",  "ss",    // D8-DF
+  "a",   "a",   "a",   "a",   "a",   "a",   "ae",  "c",     // E0-E7
+  "e",   "e",   "e",   "e",   "i",   "i",   "i",   "i",     // E8-EF
+  "d",   "n",   "o",   "o",   "o",   "o",   "o",   "/",     // F0-F7
+  "o",   "u",   "u",   "u",   "u",   "y",   "th",  "y",     // F8-FF
+};
+
+struct Transliteration {
+  uint16_t codepoint;
+  const char* ascii;
+};
+
+// Everything else Speech commonly returns, sorted by codepoint
+static const Transliteration OTHER[] = {
+  {0x0131, "i"},   {0x0141, "L"},   {0x0142, "l"},    {0x0152, "OE"},
+  {0x0153, "oe"},  {0x0160, "S"},   {0x0161, "s"},    {0x0178, "Y"},
+  {0x017D, "Z"},   {0x017E, "z"},   {0x200B, ""},     {0x2010, "-"},
+  {0x2011, "-"},   {0x2012, "-"},   {0x2013, "-"},    {0x2014, "-"},
+  {0x2015, "-"},   {0x2018, "'"},   {0x2019, "'"},    {0x201A, "'"},
+  {0x201B, "'"},   {0x201C, "\""},  {0x201D, "\""},   {0x201E, "\""},
+  {0x201F, "\""},  {0x2022, "*"},   {0x2026, "..."},  {0x202F, " "},
+  {0x2032, "'"},   {0x2033, "\""},  {0x2039, "'"},    {0x203A, "'"},
+  {0x20AC, "EUR"}, {0x2122, "(TM)"}, {0x2212, "-"},   {0xFEFF, ""},
+};
+
+const char* transliterate(uint32_t codepoint) {
+  if (codepoint < 0xA0) return nullptr;
+  if (codepoint <= 0xFF) return LATIN1[codepoint - 0xA0];
+
+  size_t lo = 0;
+  size_t hi = sizeof(OTHER) / sizeof(OTHER[0]);
+  while (lo < hi) {
+    size_t mid = (lo + hi) / 2;
+    if (OTHER[mid].codepoint < codepoint) {
+      lo = mid + 1;
+    } else {
+      hi = mid;
+    }
+  }
+  if (lo < sizeof(OTHER) / sizeof(OTHER[0]) && OTHER[lo].codepoint == codepoint) {
+    return OTHER[lo].ascii;
+  }
+  return nullptr;
+}
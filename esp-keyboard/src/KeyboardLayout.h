@@ -0,0 +1,53 @@
+#ifndef KEYBOARD_LAYOUT_H
+#define KEYBOARD_LAYOUT_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Host keyboard layouts. The HID keyboard sends key positions, so typing a
+// character means pressing whatever key the host's layout puts it on.
+#define LAYOUT_US 0
+#define LAYOUT_UK 1
+#define LAYOUT_DE 2
+
+#ifndef STT_KEYBOARD_LAYOUT
+#define STT_KEYBOARD_LAYOUT LAYOUT_US
+#endif
+
+// Modifier bits as they appear in the boot report, plus a flag for dead keys
+// (which only produce their character when followed by a space)
+static const uint8_t LAYOUT_SHIFT = 0x02;  // left shift
+static const uint8_t LAYOUT_ALTGR = 0x40;  // right alt
+static const uint8_t LAYOUT_DEAD = 0x80;   // not a modifier: follow with space
+static const uint8_t LAYOUT_MODIFIERS = 0x7F;
+
+// A non-ASCII character the layout has its own key for
+struct LayoutKey {
+  uint16_t codepoint;
+  uint8_t modifier;
+  uint8_t keycode;
+};
+
+struct KeyboardLayout {
+  const char* name;
+  const uint8_t (*ascii)[2];  // {modifier | LAYOUT_DEAD, keycode}; keycode 0 = untypeable
+  const LayoutKey* extra;     // sorted by codepoint
+  size_t extraCount;
+};
+
+extern const KeyboardLayout layoutUS;
+extern const KeyboardLayout layoutUK;
+extern const KeyboardLayout layoutDE;
+
+// The layout selected with STT_KEYBOARD_LAYOUT
+const KeyboardLayout& activeLayout();
+
+// Finds the key for a codepoint the layout can type directly.
+bool layoutLookup(const KeyboardLayout& layout, uint32_t codepoint, uint8_t* modifier,
+                  uint8_t* keycode);
+
+// ASCII spelling of a common non-ASCII character (typographic punctuation,
+// accented Latin letters), or nullptr if there is none.
+const char* transliterate(uint32_t codepoint);
+
+#endif
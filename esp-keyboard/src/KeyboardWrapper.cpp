@@ -5,6 +5,7 @@ uint8_t const desc_hid_report[] = {
 };
 
 volatile bool KeyboardWrapper::reportConsumed = true;
+volatile uint32_t KeyboardWrapper::reportCompleteMicros = 0;
 
 static volatile uint32_t callbackCount = 0;
 
@@ -18,13 +19,14 @@ static void ledPulse(uint8_t pin, int count) {
   }
 }
 
-KeyboardWrapper::KeyboardWrapper() {
+KeyboardWrapper::KeyboardWrapper() : scheduler(activeLayout()) {
 }
 
 void KeyboardWrapper::onReportComplete(uint8_t instance, uint8_t const* report, uint16_t len) {
   (void)instance;
   (void)report;
   (void)len;
+  reportCompleteMicros = micros();
   callbackCount++;
   reportConsumed = true;
 }
@@ -65,98 +67,137 @@ bool KeyboardWrapper::isReady() {
   return TinyUSBDevice.mounted() && usb_hid.ready();
 }
 
-void KeyboardWrapper::sendKey(uint8_t keycode, uint8_t modifier) {
-  if (!usb_hid.ready() || !TinyUSBDevice.mounted()) return;
-  
+void KeyboardWrapper::sendReport(const KeyReport& report) {
   if (TinyUSBDevice.suspended()) {
     TinyUSBDevice.remoteWakeup();
   }
 
-  uint8_t keycodes[6] = {keycode, 0, 0, 0, 0, 0};
-  usb_hid.keyboardReport(0, modifier, keycodes);
+  reportConsumed = false;
+  reportSubmitMicros = micros();
+  reportPending = true;
+  if (pendingUtterance != 0 && pendingReports == 0) {
+    trace.record(TRACE_FIRST_HID_REPORT, pendingUtterance, reportSubmitMicros);
+  }
+  pendingReports++;
+  usb_hid.keyboardReport(0, report.modifier, (uint8_t*)report.keys);
+}
+
+void KeyboardWrapper::onReportLatency(uint32_t us) {
+  latency.add(us);
+  avgLatencyUs += ((int32_t)us - (int32_t)avgLatencyUs) / 8;
+  if (!STT_KEYBOARD_ADAPTIVE) return;
+
+  uint32_t target = avgLatencyUs * 2;
+  if (target < MIN_HOLD_US) target = MIN_HOLD_US;
+  if (target > MAX_HOLD_US) target = MAX_HOLD_US;
+  if (target > holdUs) {
+    holdUs = target;
+    fastReports = 0;
+  } else if (++fastReports >= SHRINK_AFTER) {
+    holdUs -= (holdUs - target + 3) / 4;
+    fastReports = 0;
+  }
+}
+
+void KeyboardWrapper::onReportTimeout() {
+  latency.timeouts++;
+  fastReports = 0;
+  if (!STT_KEYBOARD_ADAPTIVE) return;
+  holdUs = holdUs * 2 > MAX_HOLD_US ? MAX_HOLD_US : holdUs * 2;
 }
 
 void KeyboardWrapper::task() {
-  if (!TinyUSBDevice.mounted() || !pendingStr) return;
-  
-  // State machine for non-blocking character sending
-  switch (keyState) {
-    case IDLE:
-      if (pendingStr[pendingIndex] == '\0') {
-        // Done with string - show status with LED
-        // Quick blink = callbacks working, Long blink = timeouts
-        if (callbackCount > 0) {
-          ledPulse(D8, 2);  // 2 quick blinks = callbacks work
-        } else {
-          digitalWrite(D8, HIGH);
-          delay(1500);  // Long blink = all timeouts
-          digitalWrite(D8, LOW);
-        }
-        pendingStr = nullptr;
-        pendingIndex = 0;
-        return;
-      }
-      
-      // Send next character
-      if (usb_hid.ready() && (millis() - lastCharComplete >= CHAR_SPACING_MS)) {
-        uint8_t c = (uint8_t)pendingStr[pendingIndex];
-        
-        if (c <= 127) {
-          uint8_t const conv_table[128][2] = { HID_ASCII_TO_KEYCODE };
-          uint8_t keycode = conv_table[c][1];
-          
-          if (keycode != 0) {
-            uint8_t modifier = conv_table[c][0] ? KEYBOARD_MODIFIER_LEFTSHIFT : 0;
-            reportConsumed = false;
-            sendKey(keycode, modifier);
-            keyState = PRESS_SENT;
-            return;
-          }
-        }
-        
-        // move to next character
-        pendingIndex++;
-      }
-      break;
-      
-    case PRESS_SENT:
-      if (reportConsumed && usb_hid.ready()) {
-        stateTimer = millis();
-        keyState = PRESS_WAIT;
-      }
-      break;
-      
-    case PRESS_WAIT:
-      if (millis() - stateTimer >= PRESS_HOLD_MS) {
-        reportConsumed = false;
-        usb_hid.keyboardRelease(0);
-        keyState = RELEASE_SENT;
-      }
-      break;
-      
-    case RELEASE_SENT:
-      if (reportConsumed && usb_hid.ready()) {
-        stateTimer = millis();
-        keyState = RELEASE_WAIT;
-      }
-      break;
-      
-    case RELEASE_WAIT:
-      if (millis() - stateTimer >= RELEASE_HOLD_MS) {
-        lastCharComplete = millis();
-        keyState = IDLE;
-        pendingIndex++;
-      }
-      break;
+  if (!TinyUSBDevice.mounted()) return;
+
+  // Pick up the next message once the previous one is fully typed
+  if (!pendingStr) {
+    if (localPending) {
+      pendingStr = localText;
+      pendingFromQueue = false;
+    } else if ((pendingStr = queue.front()) != nullptr) {
+      pendingFromQueue = true;
+    } else {
+      return;
+    }
+    pendingUtterance = pendingFromQueue ? queue.frontTag() : 0;
+    pendingReports = 0;
+    scheduler.begin(pendingStr);
+    callbackCount = 0;
+  }
+
+  // Wait for the host to take the previous report, then hold it for the
+  // current adaptive time so slow hosts still see every state
+  uint32_t sinceSubmit = micros() - reportSubmitMicros;
+  if (reportPending) {
+    if (reportConsumed) {
+      onReportLatency(reportCompleteMicros - reportSubmitMicros);
+    } else if (sinceSubmit < REPORT_TIMEOUT_US) {
+      return;
+    } else {
+      onReportTimeout();
+    }
+    reportPending = false;
+  }
+  if (sinceSubmit < holdUs || !usb_hid.ready()) return;
+
+  KeyReport report;
+  if (scheduler.next(&report)) {
+    sendReport(report);
+    return;
+  }
+
+  if (pendingUtterance != 0) {
+    trace.record(TRACE_LAST_HID_REPORT, pendingUtterance, reportSubmitMicros, pendingReports);
+  }
+
+  // Done with string - show status with LED
+  // Quick blink = callbacks working, Long blink = timeouts
+  if (callbackCount > 0) {
+    ledPulse(D8, 2);  // 2 quick blinks = callbacks work
+  } else {
+    digitalWrite(D8, HIGH);
+    delay(1500);  // Long blink = all timeouts
+    digitalWrite(D8, LOW);
+  }
+  if (pendingFromQueue) {
+    queue.pop();
+  } else {
+    localPending = false;
+  }
+  pendingStr = nullptr;
+}
+
+void KeyboardWrapper::printStats(Print& out) {
+  out.printf("Report latency: %lu reports, %lu timeouts, p50 <= %lu us, p99 <= %lu us, max %lu us\n",
+             (unsigned long)latency.samples, (unsigned long)latency.timeouts,
+             (unsigned long)latency.percentileUs(50), (unsigned long)latency.percentileUs(99),
+             (unsigned long)latency.maxUs);
+  for (uint8_t b = 0; b < LatencyHistogram::BUCKETS; b++) {
+    if (latency.counts[b] == 0) continue;
+    if (b + 1 < LatencyHistogram::BUCKETS) {
+      out.printf("  < %6lu us: %lu\n", (unsigned long)LatencyHistogram::bucketLimitUs(b),
+                 (unsigned long)latency.counts[b]);
+    } else {
+      out.printf("  >=%6lu us: %lu\n", (unsigned long)LatencyHistogram::bucketLimitUs(b - 1),
+                 (unsigned long)latency.counts[b]);
+    }
   }
+  out.printf("Report hold: %lu us (avg latency %lu us, %s)\n", (unsigned long)holdUs,
+             (unsigned long)avgLatencyUs, STT_KEYBOARD_ADAPTIVE ? "adaptive" : "fixed");
+  out.printf("Queue: %u/%u, high water %lu, %lu received, %lu dropped, %lu truncated\n",
+             (unsigned)queue.depth(), (unsigned)queue.capacity(), (unsigned long)queue.highWater,
+             (unsigned long)queue.pushed, (unsigned long)queue.dropped,
+             (unsigned long)queue.truncated);
 }
 
 void KeyboardWrapper::print(const char* str) {
-  // Queue the string for non-blocking sending
-  pendingStr = str;
-  pendingIndex = 0;
-  keyState = IDLE;
-  callbackCount = 0;
+  // Copy the string for non-blocking sending; it is typed before any queued
+  // ESP-NOW messages. Appends to a previous print() that has not started yet
+  // and is dropped while one is still being typed.
+  if (localPending && pendingStr == localText) return;
+  if (!localPending) localText[0] = '\0';
+  strlcat(localText, str, sizeof(localText));
+  localPending = true;
 }
 
 void KeyboardWrapper::print(String str) {
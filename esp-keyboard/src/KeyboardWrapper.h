@@ -2,6 +2,33 @@
 #define KEYBOARD_WRAPPER_H
 
 #include "Adafruit_TinyUSB.h"
+#include "MessageQueue.h"
+#include "ReportScheduler.h"
+#include "LatencyHistogram.h"
+#include <EspNowTransport.h>
+#include <TraceLog.h>
+
+#ifndef STT_KEYBOARD_MESSAGE_MAX
+// Longest text accepted over ESP-NOW, plus its terminator. Smaller builds
+// keep the prefix that fits, cut at a character boundary.
+#define STT_KEYBOARD_MESSAGE_MAX (espnow_transport::MAX_MESSAGE + 1)
+#endif
+
+#ifndef STT_KEYBOARD_QUEUE_SLOTS
+#define STT_KEYBOARD_QUEUE_SLOTS 4  // messages waiting to be typed (power of two)
+#endif
+
+#ifndef STT_KEYBOARD_REPORT_MS
+#define STT_KEYBOARD_REPORT_MS 8  // starting hold per report; adapted per host
+#endif
+
+#ifndef STT_KEYBOARD_ADAPTIVE
+#define STT_KEYBOARD_ADAPTIVE 1  // 0 keeps the hold fixed at STT_KEYBOARD_REPORT_MS
+#endif
+
+#ifndef STT_KEYBOARD_TRACE_EVENTS
+#define STT_KEYBOARD_TRACE_EVENTS 64  // latency trace ring size (power of two)
+#endif
 
 class KeyboardWrapper {
 public:
@@ -11,25 +38,61 @@ public:
   void print(String str);
   bool isReady();
   void task(); // Must be called in loop() for non-blocking operation
+
+  // Queues text to be typed after anything already queued. Safe to call from
+  // the ESP-NOW receive callback; it must be the only caller.
+  bool enqueue(const char* text, size_t len, uint32_t utterance = 0) {
+    return queue.push(text, len, utterance);
+  }
+
+  typedef MessageQueue<STT_KEYBOARD_QUEUE_SLOTS, STT_KEYBOARD_MESSAGE_MAX> TextQueue;
+  const TextQueue& messages() const { return queue; }
+
+  // Submit-to-completion latency of every report, and the hold it drives
+  const LatencyHistogram& reportLatency() const { return latency; }
+  uint32_t reportHoldUs() const { return holdUs; }
+  void resetStats() { latency.reset(); }
+  void printStats(Print& out);
+
+  // Latency trace: the ESP-NOW callback records message arrival, task()
+  // records the first and last HID report of each message
+  TraceLog<STT_KEYBOARD_TRACE_EVENTS> trace;
   
   // Track when host has consumed the report
   static volatile bool reportConsumed;
+  static volatile uint32_t reportCompleteMicros;
   static void onReportComplete(uint8_t instance, uint8_t const* report, uint16_t len);
 
 private:
   Adafruit_USBD_HID usb_hid;
-  void sendKey(uint8_t keycode, uint8_t modifier = 0);
-  
-  // State for non-blocking character sending
-  enum KeyState { IDLE, PRESS_SENT, PRESS_WAIT, RELEASE_SENT, RELEASE_WAIT };
-  KeyState keyState = IDLE;
+  void sendReport(const KeyReport& report);
+  void onReportLatency(uint32_t us);
+  void onReportTimeout();
+
+  // State for non-blocking character sending: one report in flight at a
+  // time, the next built when the host has consumed it
+  ReportScheduler scheduler;
+  TextQueue queue;
   const char* pendingStr = nullptr;
-  size_t pendingIndex = 0;
-  unsigned long lastCharComplete = 0;
-  unsigned long stateTimer = 0;
-  static const unsigned long CHAR_SPACING_MS = 10; // Min time between characters
-  static const unsigned long PRESS_HOLD_MS = 16;   // Hold press before release
-  static const unsigned long RELEASE_HOLD_MS = 16; // Hold release before next char
+  bool pendingFromQueue = false;  // pendingStr is queue.front(), pop when typed
+  uint32_t pendingUtterance = 0;  // trace id of pendingStr, 0 for print()
+  uint16_t pendingReports = 0;
+  char localText[128];            // print() from loop(), typed ahead of the queue
+  bool localPending = false;
+
+  // Report pacing. The hold follows twice the smoothed host latency: it
+  // grows as soon as the host slows down or drops a report and shrinks
+  // slowly while it keeps up.
+  uint32_t reportSubmitMicros = 0;
+  bool reportPending = false;     // submitted, latency not yet recorded
+  uint32_t holdUs = STT_KEYBOARD_REPORT_MS * 1000UL;
+  uint32_t avgLatencyUs = 0;
+  uint16_t fastReports = 0;
+  LatencyHistogram latency;
+  static const uint32_t REPORT_TIMEOUT_US = 50000; // Assume consumed if no completion
+  static const uint32_t MIN_HOLD_US = 1000;
+  static const uint32_t MAX_HOLD_US = 32000;
+  static const uint16_t SHRINK_AFTER = 8;          // fast reports before shrinking the hold
 };
 
 #endif
\ No newline at end of file
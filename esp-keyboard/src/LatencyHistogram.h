@@ -0,0 +1,48 @@
+#ifndef LATENCY_HISTOGRAM_H
+#define LATENCY_HISTOGRAM_H
+
+#include <stdint.h>
+
+// Power-of-two latency buckets: bucket 0 is < 128 us, bucket n covers
+// [64 << n, 128 << n) us and the last bucket takes everything slower.
+class LatencyHistogram {
+public:
+  static const uint8_t BUCKETS = 12;  // up to ~131 ms
+
+  void reset() {
+    for (uint8_t i = 0; i < BUCKETS; i++) counts[i] = 0;
+    samples = 0;
+    timeouts = 0;
+    maxUs = 0;
+  }
+
+  void add(uint32_t us) {
+    uint8_t b = 0;
+    while (b < BUCKETS - 1 && us >= bucketLimitUs(b)) b++;
+    counts[b]++;
+    samples++;
+    if (us > maxUs) maxUs = us;
+  }
+
+  // Upper bound of bucket b
+  static uint32_t bucketLimitUs(uint8_t b) { return 128UL << b; }
+
+  // Smallest bucket limit that covers at least pct percent of samples
+  uint32_t percentileUs(uint8_t pct) const {
+    if (samples == 0) return 0;
+    uint32_t want = (samples * pct + 99) / 100;
+    uint32_t seen = 0;
+    for (uint8_t b = 0; b < BUCKETS - 1; b++) {
+      seen += counts[b];
+      if (seen >= want) return bucketLimitUs(b);
+    }
+    return maxUs;
+  }
+
+  uint32_t counts[BUCKETS] = {};
+  uint32_t samples = 0;
+  uint32_t timeouts = 0;  // reports never confirmed by the host
+  uint32_t maxUs = 0;
+};
+
+#endif
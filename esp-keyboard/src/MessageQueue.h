@@ -0,0 +1,87 @@
+#ifndef MESSAGE_QUEUE_H
+#define MESSAGE_QUEUE_H
+
+#include <atomic>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+// Lock-free single-producer/single-consumer queue of preallocated text slots.
+//
+// The producer (the ESP-NOW receive callback, on the WiFi task) copies each
+// message into the next free slot; the consumer (the typing engine, on the
+// loop task) reads the oldest slot in place and releases it only once it has
+// finished typing it, so a message can never change underneath the keyboard.
+// When every slot is full new messages are dropped and counted rather than
+// overwriting queued text; the receive callback reports the free slots back
+// to the mic so it holds further messages until there is room.
+template <size_t Slots, size_t SlotSize>
+class MessageQueue {
+  // Keeps the free-running counters valid across wraparound
+  static_assert(Slots > 0 && (Slots & (Slots - 1)) == 0, "Slots must be a power of two");
+
+public:
+  // Producer side. Copies len bytes (truncated to fit) plus a terminator;
+  // tag is an opaque value kept with the message (the utterance id).
+  bool push(const char* text, size_t len, uint32_t tag = 0) {
+    uint32_t h = head.load(std::memory_order_relaxed);
+    uint32_t t = tail.load(std::memory_order_acquire);
+    if (h - t >= Slots) {
+      dropped++;
+      return false;
+    }
+
+    if (len > SlotSize - 1) {
+      len = SlotSize - 1;
+      truncated++;
+    }
+    char* slot = slots[h % Slots];
+    memcpy(slot, text, len);
+    slot[len] = '\0';
+    tags[h % Slots] = tag;
+    head.store(h + 1, std::memory_order_release);
+
+    pushed++;
+    uint32_t depth = h + 1 - t;
+    if (depth > highWater) highWater = depth;
+    return true;
+  }
+
+  // Consumer side. The oldest message, or nullptr when empty. Stays valid
+  // until pop().
+  const char* front() const {
+    uint32_t t = tail.load(std::memory_order_relaxed);
+    if (head.load(std::memory_order_acquire) == t) return nullptr;
+    return slots[t % Slots];
+  }
+
+  // Consumer side. The tag pushed with front().
+  uint32_t frontTag() const { return tags[tail.load(std::memory_order_relaxed) % Slots]; }
+
+  // Consumer side. Releases the slot returned by front().
+  void pop() {
+    uint32_t t = tail.load(std::memory_order_relaxed);
+    if (head.load(std::memory_order_acquire) == t) return;
+    tail.store(t + 1, std::memory_order_release);
+  }
+
+  size_t depth() const {
+    return head.load(std::memory_order_acquire) - tail.load(std::memory_order_acquire);
+  }
+  static size_t capacity() { return Slots; }
+
+  // Written by the producer only; read anywhere for diagnostics.
+  volatile uint32_t pushed = 0;
+  volatile uint32_t dropped = 0;    // queue was full
+  volatile uint32_t truncated = 0;  // message longer than a slot
+  volatile uint32_t highWater = 0;  // deepest the queue has been
+
+private:
+  char slots[Slots][SlotSize];
+  uint32_t tags[Slots];
+  // Free-running counters; only head % Slots indexes the storage.
+  std::atomic<uint32_t> head{0};
+  std::atomic<uint32_t> tail{0};
+};
+
+#endif
@@ -0,0 +1,111 @@
+#include "ReportScheduler.h"
+
+#include <string.h>
+
+void ReportScheduler::begin(const char* str) {
+  text = str;
+  index = 0;
+  decoder.reset();
+  pendingHead = 0;
+  pendingCount = 0;
+  heldCount = 0;
+  modifier = 0;
+}
+
+void ReportScheduler::pushChar(uint32_t codepoint) {
+  uint8_t mod;
+  uint8_t keycode;
+  if (!layoutLookup(layout, codepoint, &mod, &keycode)) return;
+  if (pendingCount == sizeof(pending) / sizeof(pending[0])) return;
+  pending[pendingCount++] = {(uint8_t)(mod & LAYOUT_MODIFIERS), keycode};
+
+  // A dead key waits for the next key; space makes it type itself
+  if ((mod & LAYOUT_DEAD) && layoutLookup(layout, ' ', &mod, &keycode) &&
+      pendingCount < sizeof(pending) / sizeof(pending[0])) {
+    pending[pendingCount++] = {mod, keycode};
+  }
+}
+
+void ReportScheduler::expand(uint32_t codepoint) {
+  uint8_t mod;
+  uint8_t keycode;
+  if (layoutLookup(layout, codepoint, &mod, &keycode)) {
+    pushChar(codepoint);
+    return;
+  }
+  const char* ascii = transliterate(codepoint);
+  if (!ascii) return;
+  while (*ascii != '\0') {
+    pushChar((uint8_t)*ascii++);
+  }
+}
+
+bool ReportScheduler::nextKeystroke(Keystroke* key) {
+  while (pendingHead == pendingCount) {
+    pendingHead = 0;
+    pendingCount = 0;
+
+    uint32_t codepoints[2];
+    uint8_t n;
+    if (text[index] != '\0') {
+      n = decoder.feed((uint8_t)text[index++], codepoints);
+    } else if (decoder.finish(&codepoints[0])) {
+      n = 1;
+    } else {
+      return false;
+    }
+    for (uint8_t i = 0; i < n; i++) expand(codepoints[i]);
+  }
+  *key = pending[pendingHead];
+  return true;
+}
+
+void ReportScheduler::fill(KeyReport* report) const {
+  report->modifier = modifier;
+  memset(report->keys, 0, sizeof(report->keys));
+  memcpy(report->keys, held, heldCount);
+}
+
+bool ReportScheduler::next(KeyReport* report) {
+  if (!text) return false;
+
+  Keystroke key;
+  if (!nextKeystroke(&key)) {
+    if (heldCount == 0 && modifier == 0) {
+      text = nullptr;
+      return false;
+    }
+    // Let go of everything before reporting done
+    heldCount = 0;
+    modifier = 0;
+    fill(report);
+    return true;
+  }
+
+  if (key.modifier != modifier && heldCount > 0) {
+    heldCount = 0;
+    fill(report);
+    return true;
+  }
+
+  for (uint8_t i = 0; i < heldCount; i++) {
+    if (held[i] == key.keycode) {
+      // Repeated key: release it (keeping the others) and press it next time
+      memmove(held + i, held + i + 1, heldCount - i - 1);
+      heldCount--;
+      fill(report);
+      return true;
+    }
+  }
+
+  if (heldCount == sizeof(held)) {
+    // Out of slots: the oldest key goes up in the same report
+    memmove(held, held + 1, heldCount - 1);
+    heldCount--;
+  }
+  held[heldCount++] = key.keycode;
+  modifier = key.modifier;
+  pendingHead++;
+  fill(report);
+  return true;
+}
@@ -0,0 +1,67 @@
+#ifndef REPORT_SCHEDULER_H
+#define REPORT_SCHEDULER_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "KeyboardLayout.h"
+#include "Utf8Decoder.h"
+
+// One boot-protocol keyboard report
+struct KeyReport {
+  uint8_t modifier;
+  uint8_t keys[6];
+};
+
+// Turns text into a sequence of 6-key rollover reports.
+//
+// Each report presses exactly one new key and keeps the previous ones held,
+// so the host sees a single key-down per report and the typing order can
+// never depend on how it orders keys within a report. A held key is only
+// released when the same key is needed again (the host must see it go up
+// first) or when the modifier changes (so held keys are not re-shifted).
+// Compared with a press report plus a release report per character this
+// roughly halves the report count, and lets reports go out back to back.
+//
+// Text is UTF-8. Each character is typed with the layout's own key if it has
+// one, otherwise as its ASCII transliteration; anything else is skipped.
+class ReportScheduler {
+public:
+  explicit ReportScheduler(const KeyboardLayout& keyboardLayout) : layout(keyboardLayout) {}
+
+  void begin(const char* str);
+
+  // Fills report with the next report to send. Returns false once the text
+  // has been typed and every key released.
+  bool next(KeyReport* report);
+
+  bool active() const { return text != nullptr; }
+
+private:
+  struct Keystroke {
+    uint8_t modifier;
+    uint8_t keycode;
+  };
+
+  bool nextKeystroke(Keystroke* key);
+  void expand(uint32_t codepoint);
+  void pushChar(uint32_t codepoint);
+  void fill(KeyReport* report) const;
+
+  const KeyboardLayout& layout;
+  const char* text = nullptr;
+  size_t index = 0;
+  Utf8Decoder decoder;
+
+  // Keystrokes for the character being typed (a transliteration or a dead
+  // key plus space can take several)
+  Keystroke pending[10];
+  uint8_t pendingHead = 0;
+  uint8_t pendingCount = 0;
+
+  uint8_t held[6];
+  uint8_t heldCount = 0;
+  uint8_t modifier = 0;
+};
+
+#endif
@@ -0,0 +1,68 @@
+#ifndef UTF8_DECODER_H
+#define UTF8_DECODER_H
+
+#include <stdint.h>
+
+// Byte-at-a-time UTF-8 decoder. Malformed input (stray continuation bytes,
+// truncated or overlong sequences, surrogates) decodes to U+FFFD and never
+// swallows the following valid character.
+class Utf8Decoder {
+public:
+  static const uint32_t REPLACEMENT = 0xFFFD;
+
+  void reset() { need = 0; }
+
+  // Feeds one byte and stores up to two finished codepoints in out.
+  // Returns how many were stored.
+  uint8_t feed(uint8_t b, uint32_t out[2]) {
+    uint8_t n = 0;
+    if (need > 0) {
+      if ((b & 0xC0) == 0x80) {
+        cp = (cp << 6) | (b & 0x3F);
+        if (--need == 0) out[n++] = valid() ? cp : REPLACEMENT;
+        return n;
+      }
+      // Sequence cut short: report it, then treat b as a fresh start
+      need = 0;
+      out[n++] = REPLACEMENT;
+    }
+
+    if (b < 0x80) {
+      out[n++] = b;
+    } else if ((b & 0xE0) == 0xC0) {
+      start(b & 0x1F, 1, 0x80);
+    } else if ((b & 0xF0) == 0xE0) {
+      start(b & 0x0F, 2, 0x800);
+    } else if ((b & 0xF8) == 0xF0) {
+      start(b & 0x07, 3, 0x10000);
+    } else {
+      out[n++] = REPLACEMENT;
+    }
+    return n;
+  }
+
+  // Call at end of input; returns true (and U+FFFD) if a sequence was cut off.
+  bool finish(uint32_t* out) {
+    if (need == 0) return false;
+    need = 0;
+    *out = REPLACEMENT;
+    return true;
+  }
+
+private:
+  void start(uint32_t bits, uint8_t continuation, uint32_t minimum) {
+    cp = bits;
+    need = continuation;
+    min = minimum;
+  }
+
+  bool valid() const {
+    return cp >= min && cp <= 0x10FFFF && (cp < 0xD800 || cp > 0xDFFF);
+  }
+
+  uint32_t cp = 0;
+  uint32_t min = 0;
+  uint8_t need = 0;
+};
+
+#endif
@@ -1,9 +1,11 @@
 #include "./KeyboardWrapper.h"
+#include <atomic>
 #include <WiFi.h>
 #include <esp_now.h>
 #include <esp_wifi.h>
+#include <EspNowTransport.h>
 
-#include <../include/secrets.h>
+#include <secrets.h>
 
 #ifndef STT_DEBUG
 #define STT_DEBUG 0
@@ -15,16 +17,63 @@
 
 KeyboardWrapper kboard;
 
-// ESP-NOW received data
-volatile bool dataReceived = false;
-char receivedMessage[250];
+// ESP-NOW reassembly; completed messages go straight to the keyboard queue
+static char assemblyBuffer[STT_KEYBOARD_MESSAGE_MAX];
+espnow_transport::Reassembler reassembler(assemblyBuffer, sizeof(assemblyBuffer));
+
+// The mic that sent the last message, which gets the queue status. Its
+// fragments were MAC-acked before the queue saw them, so this is the only way
+// it learns a message was dropped or that it should wait for room.
+static uint8_t micAddress[6];
+static bool micKnown = false;
+static std::atomic<bool> micWaitingForRoom{false};
+static uint8_t lastMessageId = 0;
+static bool lastQueued = false;
+
+static void sendQueueStatus() {
+  espnow_transport::Status status;
+  status.messageId = lastMessageId;
+  status.freeSlots = kboard.messages().capacity() - kboard.messages().depth();
+  status.queued = lastQueued;
+  uint8_t frame[espnow_transport::STATUS_SIZE];
+  size_t len = espnow_transport::encodeStatus(frame, status);
+  micWaitingForRoom = status.freeSlots == 0;
+  esp_now_send(micAddress, frame, len);
+}
+
+static void rememberMic(const uint8_t *mac_addr) {
+  if (micKnown && memcmp(micAddress, mac_addr, sizeof(micAddress)) == 0) return;
+  esp_now_peer_info_t peerInfo = {};
+  memcpy(peerInfo.peer_addr, mac_addr, 6);
+  peerInfo.channel = 0;  // the channel the mic is already using
+  peerInfo.encrypt = false;
+  esp_now_add_peer(&peerInfo);
+  memcpy(micAddress, mac_addr, sizeof(micAddress));
+  micKnown = true;
+}
 
 // ESP-NOW receive callback
 void onDataRecv(const uint8_t *mac_addr, const uint8_t *data, int len) {
-  if (len > 0 && len < sizeof(receivedMessage)) {
-    memcpy(receivedMessage, data, len);
-    receivedMessage[len] = '\0';
-    dataReceived = true;
+  if (len <= 0) return;
+
+  switch (reassembler.accept(data, len)) {
+    case espnow_transport::Reassembler::COMPLETE:
+      kboard.trace.record(TRACE_MESSAGE_RECEIVED, reassembler.messageUtterance(), micros(),
+                          reassembler.messageLength());
+      lastQueued = kboard.enqueue(reassembler.message(), reassembler.messageLength(),
+                                  reassembler.messageUtterance());
+      lastMessageId = reassembler.messageId();
+      rememberMic(mac_addr);
+      sendQueueStatus();
+      break;
+    case espnow_transport::Reassembler::INVALID:
+      // Unframed text from a sender that predates the framing
+      if (!espnow_transport::isFrame(data, len) && (size_t)len < espnow_transport::MAX_FRAME) {
+        kboard.enqueue((const char*)data, len);
+      }
+      break;
+    default:
+      break;
   }
 }
 uint8_t getAPChannel(const char* ssid) {
@@ -50,6 +99,9 @@ void setup() {
   #endif
   kboard.begin();
   digitalWrite(D8, LOW);
+  #if STT_DEBUG
+  Serial.begin(115200);
+  #endif
 
   // Flash LED to indicate startup
   for (int i = 0; i < 3; i++) {
@@ -80,9 +132,36 @@ void setup() {
   esp_now_register_recv_cb(onDataRecv);
 }
 
+#if STT_DEBUG
+// Debug commands over USB serial: 's' prints typing stats, 'r' resets them,
+// 't' dumps the latency trace for stt-endpoint/cmd/tracemerge
+void handleDebugCommand() {
+  while (Serial.available() > 0) {
+    switch (Serial.read()) {
+      case 's':
+        kboard.printStats(Serial);
+        break;
+      case 'r':
+        kboard.resetStats();
+        Serial.println("Stats reset");
+        break;
+      case 't':
+        kboard.trace.dump(Serial, "keyboard");
+        break;
+      default:
+        break;
+    }
+  }
+}
+#endif
+
 void loop() {
   // Call keyboard task for non-blocking character sending
   kboard.task();
+
+  #if STT_DEBUG
+  handleDebugCommand();
+  #endif
   
   #ifdef STT_BUTTON_DEBUG
   if (digitalRead(D10) == LOW) {
@@ -100,18 +179,23 @@ void loop() {
   }
   #endif
 
-  // Handle received ESP-NOW data
-  if (dataReceived) {
-    dataReceived = false;
-    
-    // Flash LED to indicate message received
+  // The mic holds its next message until the queue has room again
+  if (micWaitingForRoom && kboard.messages().depth() < kboard.messages().capacity()) {
+    sendQueueStatus();
+  }
+
+  // Flash LED when ESP-NOW data arrives; the keyboard types it from its queue.
+  // Timed rather than delayed so typing and status replies are never held up.
+  static uint32_t messagesSeen = 0;
+  static uint32_t ledOnAt = 0;
+  static bool ledOn = false;
+  if (kboard.messages().pushed != messagesSeen) {
+    messagesSeen = kboard.messages().pushed;
     digitalWrite(D8, HIGH);
-    delay(50);
+    ledOn = true;
+    ledOnAt = millis();
+  } else if (ledOn && millis() - ledOnAt >= 50) {
     digitalWrite(D8, LOW);
-    delay(50);
-    
-    if (kboard.isReady()) {
-      kboard.print(receivedMessage);
-    }
+    ledOn = false;
   }
 }
\ No newline at end of file
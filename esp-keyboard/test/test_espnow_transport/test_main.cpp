@@ -0,0 +1,378 @@
+// The shared ESP-NOW framing: codec, receiver reassembly and the sender's
+// window, run against a simulated lossy link that also reorders and
+// duplicates frames.
+#include <unity.h>
+
+#include <EspNowTransport.h>
+
+#include <algorithm>
+#include <deque>
+#include <random>
+#include <stdio.h>
+#include <string>
+#include <vector>
+
+using namespace espnow_transport;
+
+void setUp() {}
+void tearDown() {}
+
+static std::string utf8Text(std::mt19937& rng, size_t minBytes) {
+  static const char* pieces[] = {"a", "Z", " ", "\n", "ü", "ß", "€", "–", "中", "😀"};
+  std::string s;
+  while (s.size() < minBytes) s += pieces[rng() % 10];
+  return s;
+}
+
+// Valid UTF-8 from start to end
+static bool wholeCharacters(const std::string& s) {
+  for (size_t i = 0; i < s.size();) {
+    uint8_t lead = (uint8_t)s[i];
+    size_t n = lead < 0x80 ? 1 : lead >= 0xF0 ? 4 : lead >= 0xE0 ? 3 : lead >= 0xC0 ? 2 : 0;
+    if (n == 0 || i + n > s.size()) return false;
+    for (size_t k = 1; k < n; k++) {
+      if (((uint8_t)s[i + k] & 0xC0) != 0x80) return false;
+    }
+    i += n;
+  }
+  return true;
+}
+
+void test_frames_round_trip() {
+  std::mt19937 rng(3);
+  std::string text = utf8Text(rng, 3 * MAX_PAYLOAD + 17);
+  size_t count = fragmentCount(text.size());
+  TEST_ASSERT_EQUAL(4, count);
+
+  std::string joined;
+  uint8_t frame[MAX_FRAME];
+  for (size_t seq = 0; seq < count; seq++) {
+    size_t len = encodeFrame(frame, 200, 0xDEADBEEF, (const uint8_t*)text.data(), text.size(),
+                             (uint8_t)seq);
+    TEST_ASSERT_TRUE(isFrame(frame, len));
+    FrameHeader h;
+    const uint8_t* payload;
+    size_t plen;
+    TEST_ASSERT_TRUE(decodeFrame(frame, len, &h, &payload, &plen));
+    TEST_ASSERT_EQUAL(200, h.messageId);
+    TEST_ASSERT_EQUAL_HEX32(0xDEADBEEF, h.utterance);
+    TEST_ASSERT_EQUAL(seq, h.seq);
+    TEST_ASSERT_EQUAL(count, h.count);
+    joined.append((const char*)payload, plen);
+  }
+  TEST_ASSERT_TRUE(joined == text);
+  TEST_ASSERT_EQUAL(0, encodeFrame(frame, 1, 1, (const uint8_t*)text.data(), text.size(), 4));
+  TEST_ASSERT_EQUAL(HEADER_SIZE, encodeFrame(frame, 1, 1, nullptr, 0, 0));
+}
+
+void test_bad_frames_are_rejected() {
+  uint8_t frame[MAX_FRAME] = {};
+  std::string text(2 * MAX_PAYLOAD, 'x');
+  size_t len = encodeFrame(frame, 1, 1, (const uint8_t*)text.data(), text.size(), 0);
+  FrameHeader h;
+  const uint8_t* payload;
+  size_t plen;
+
+  TEST_ASSERT_FALSE(decodeFrame(frame, len - 1, &h, &payload, &plen));  // short middle fragment
+  TEST_ASSERT_FALSE(decodeFrame(frame, HEADER_SIZE - 1, &h, &payload, &plen));
+  uint8_t copy[MAX_FRAME];
+  memcpy(copy, frame, len);
+  copy[2] = 2;  // seq past count
+  TEST_ASSERT_FALSE(decodeFrame(copy, len, &h, &payload, &plen));
+  copy[2] = 0;
+  copy[3] = MAX_FRAGMENTS + 1;
+  TEST_ASSERT_FALSE(decodeFrame(copy, len, &h, &payload, &plen));
+  copy[3] = 2;
+  copy[0] = 0xA5;  // a continuation byte, but not this format's magic
+  TEST_ASSERT_TRUE(isFrame(copy, len));
+  TEST_ASSERT_FALSE(decodeFrame(copy, len, &h, &payload, &plen));
+
+  // Plain text, even starting with a multi-byte character, is not a frame
+  TEST_ASSERT_FALSE(isFrame((const uint8_t*)"hello", 5));
+  TEST_ASSERT_FALSE(isFrame((const uint8_t*)"über", 5));
+}
+
+void test_status_is_never_taken_for_a_data_frame() {
+  Status out = {200, 3, true};
+  uint8_t frame[MAX_FRAME];
+  size_t len = encodeStatus(frame, out);
+  TEST_ASSERT_EQUAL(STATUS_SIZE, len);
+
+  Status in;
+  TEST_ASSERT_TRUE(decodeStatus(frame, len, &in));
+  TEST_ASSERT_EQUAL_HEX8(200, in.messageId);
+  TEST_ASSERT_EQUAL(3, in.freeSlots);
+  TEST_ASSERT_TRUE(in.queued);
+  out.queued = false;
+  encodeStatus(frame, out);
+  TEST_ASSERT_TRUE(decodeStatus(frame, len, &in));
+  TEST_ASSERT_FALSE(in.queued);
+
+  // A receiver that predates statuses sees a frame it cannot decode rather
+  // than text to type, and neither side mistakes one kind for the other
+  FrameHeader h;
+  const uint8_t* payload;
+  size_t plen;
+  TEST_ASSERT_TRUE(isFrame(frame, len));
+  TEST_ASSERT_FALSE(decodeFrame(frame, len, &h, &payload, &plen));
+  len = encodeFrame(frame, 1, 1, (const uint8_t*)"ok", 2, 0);
+  TEST_ASSERT_FALSE(decodeStatus(frame, len, &in));
+  TEST_ASSERT_FALSE(decodeStatus(frame, STATUS_SIZE, &in));
+}
+
+void test_utf8_prefix_never_splits_a_character() {
+  const char* text = "a€b";  // 'a', 3 bytes, 'b'
+  TEST_ASSERT_EQUAL(1, utf8Prefix(text, 5, 1));
+  TEST_ASSERT_EQUAL(1, utf8Prefix(text, 5, 2));
+  TEST_ASSERT_EQUAL(1, utf8Prefix(text, 5, 3));
+  TEST_ASSERT_EQUAL(4, utf8Prefix(text, 5, 4));
+  TEST_ASSERT_EQUAL(5, utf8Prefix(text, 5, 9));
+}
+
+void test_reassembly_in_any_order_with_duplicates() {
+  std::mt19937 rng(4);
+  std::string text = utf8Text(rng, 10 * MAX_PAYLOAD);
+  size_t count = fragmentCount(text.size());
+  std::vector<std::vector<uint8_t>> frames;
+  uint8_t frame[MAX_FRAME];
+  for (size_t seq = 0; seq < count; seq++) {
+    size_t len = encodeFrame(frame, 9, 77, (const uint8_t*)text.data(), text.size(), (uint8_t)seq);
+    frames.emplace_back(frame, frame + len);
+  }
+  std::vector<std::vector<uint8_t>> order = frames;
+  order.insert(order.end(), frames.begin(), frames.begin() + 3);
+  std::shuffle(order.begin(), order.end(), rng);
+
+  static char buffer[MAX_MESSAGE + 1];
+  Reassembler r(buffer, sizeof(buffer));
+  int completes = 0;
+  for (const std::vector<uint8_t>& f : order) {
+    Reassembler::Result result = r.accept(f.data(), f.size());
+    TEST_ASSERT_NOT_EQUAL(Reassembler::INVALID, result);
+    if (result == Reassembler::COMPLETE) completes++;
+  }
+  TEST_ASSERT_EQUAL(1, completes);
+  TEST_ASSERT_TRUE(std::string(r.message(), r.messageLength()) == text);
+  TEST_ASSERT_EQUAL(77, r.messageUtterance());
+
+  // A retransmit of the finished message, after its ack was lost
+  TEST_ASSERT_EQUAL(Reassembler::DUPLICATE, r.accept(frames[0].data(), frames[0].size()));
+}
+
+void test_new_message_abandons_a_partial_one() {
+  static char buffer[MAX_MESSAGE + 1];
+  Reassembler r(buffer, sizeof(buffer));
+  std::string first(3 * MAX_PAYLOAD, 'a');
+  uint8_t frame[MAX_FRAME];
+  size_t len = encodeFrame(frame, 1, 10, (const uint8_t*)first.data(), first.size(), 0);
+  TEST_ASSERT_EQUAL(Reassembler::INCOMPLETE, r.accept(frame, len));
+
+  // Same message id after a mic reboot, but a new utterance
+  len = encodeFrame(frame, 1, 11, (const uint8_t*)"hi", 2, 0);
+  TEST_ASSERT_EQUAL(Reassembler::COMPLETE, r.accept(frame, len));
+  TEST_ASSERT_EQUAL_STRING("hi", r.message());
+  TEST_ASSERT_EQUAL(1, r.abandoned);
+}
+
+void test_long_message_is_cut_at_a_character() {
+  std::mt19937 rng(6);
+  char small[100];
+  Reassembler r(small, sizeof(small));
+  for (int round = 0; round < 200; round++) {
+    std::string text = utf8Text(rng, 100 + rng() % 600);
+    uint8_t frame[MAX_FRAME];
+    Reassembler::Result result = Reassembler::INCOMPLETE;
+    for (size_t seq = fragmentCount(text.size()); seq-- > 0;) {
+      size_t len = encodeFrame(frame, (uint8_t)round, round, (const uint8_t*)text.data(),
+                               text.size(), (uint8_t)seq);
+      result = r.accept(frame, len);
+    }
+    TEST_ASSERT_EQUAL(Reassembler::COMPLETE, result);
+    std::string got(r.message(), r.messageLength());
+    TEST_ASSERT_LESS_OR_EQUAL(sizeof(small) - 1, got.size());
+    TEST_ASSERT_GREATER_THAN(sizeof(small) - 5, got.size());
+    TEST_ASSERT_TRUE(text.compare(0, got.size(), got) == 0);
+    TEST_ASSERT_TRUE(wholeCharacters(got));
+  }
+  TEST_ASSERT_EQUAL(200, r.truncated);
+}
+
+// Frames take one tick of air time each, back to back; the MAC status for a
+// frame comes rttTicks after it left the air, in send order. Delivered frames
+// wait in a pool and reach the receiver in random order, some of them twice.
+struct LossyLink {
+  float lossRate = 0;
+  float ackLossRate = 0;
+  float duplicateRate = 0;
+  uint32_t rttTicks = 3;
+
+  struct Pending {
+    uint32_t statusAt;
+    bool delivered;
+  };
+  std::deque<Pending> statuses;
+  std::vector<std::vector<uint8_t>> pool;
+  uint32_t airFreeAt = 0;
+  uint32_t framesSent = 0;
+};
+
+struct TransferStats {
+  uint32_t ticks = 0;
+  uint32_t delivered = 0;
+  uint32_t failed = 0;
+  uint32_t retransmits = 0;
+  uint32_t maxInFlight = 0;
+};
+
+// Sends every message through a SendWindow over the link and checks what the
+// receiver completes. Messages whose sender gave up may be lost, but nothing
+// completes twice and nothing completes wrong.
+static TransferStats transfer(LossyLink& link, const std::vector<std::string>& messages,
+                              uint8_t window, uint32_t seed) {
+  std::mt19937 rng(seed);
+  std::uniform_real_distribution<float> chance(0, 1);
+  static char buffer[MAX_MESSAGE + 1];
+  Reassembler receiver(buffer, sizeof(buffer));
+  std::vector<std::string> completed;
+  TransferStats stats;
+  uint32_t now = 0;
+
+  auto releaseOne = [&] {
+    size_t pick = rng() % link.pool.size();
+    std::vector<uint8_t> f = link.pool[pick];
+    link.pool.erase(link.pool.begin() + pick);
+    if (receiver.accept(f.data(), f.size()) == Reassembler::COMPLETE) {
+      completed.push_back(std::string(receiver.message(), receiver.messageLength()));
+    }
+  };
+
+  for (size_t m = 0; m < messages.size(); m++) {
+    const std::string& text = messages[m];
+    uint8_t id = (uint8_t)(m + 1);
+    uint32_t utterance = 1000 + m;
+    SendWindow sender;
+    sender.begin((uint8_t)fragmentCount(text.size()), window);
+
+    while (!sender.done() && !sender.failed()) {
+      uint8_t seq;
+      while (sender.nextToSend(&seq)) {
+        uint8_t frame[MAX_FRAME];
+        size_t len =
+            encodeFrame(frame, id, utterance, (const uint8_t*)text.data(), text.size(), seq);
+        sender.onQueued(seq);
+        uint32_t airEnd = (link.airFreeAt > now ? link.airFreeAt : now) + 1;
+        link.airFreeAt = airEnd;
+        link.framesSent++;
+        bool arrives = chance(rng) >= link.lossRate;
+        if (arrives) {
+          link.pool.emplace_back(frame, frame + len);
+          if (chance(rng) < link.duplicateRate) link.pool.emplace_back(frame, frame + len);
+        }
+        bool acked = arrives && chance(rng) >= link.ackLossRate;
+        link.statuses.push_back({airEnd + link.rttTicks, acked});
+      }
+      if (sender.inFlightFrames() > stats.maxInFlight) stats.maxInFlight = sender.inFlightFrames();
+
+      now++;
+      while (!link.statuses.empty() && link.statuses.front().statusAt <= now) {
+        sender.onStatus(link.statuses.front().delivered);
+        link.statuses.pop_front();
+      }
+      if (!link.pool.empty() && rng() % 2) releaseOne();
+    }
+    // Statuses still owed for frames of a message the sender gave up on
+    while (!link.statuses.empty()) {
+      sender.onStatus(link.statuses.front().delivered);
+      link.statuses.pop_front();
+    }
+    if (sender.failed()) stats.failed++;
+    stats.retransmits += sender.retransmits;
+    // Reordering stays within a message: the next one starts only once every
+    // fragment of this one was acked
+    while (!link.pool.empty()) releaseOne();
+  }
+
+  size_t next = 0;
+  for (const std::string& got : completed) {
+    while (next < messages.size() && messages[next] != got) next++;
+    TEST_ASSERT_LESS_THAN(messages.size(), next);
+    next++;
+  }
+  stats.delivered = completed.size();
+  stats.ticks = now;
+  return stats;
+}
+
+static std::vector<std::string> someMessages(uint32_t seed, int n) {
+  std::mt19937 rng(seed);
+  std::vector<std::string> messages;
+  for (int i = 0; i < n; i++) messages.push_back(utf8Text(rng, 1 + rng() % (MAX_MESSAGE - 4)));
+  return messages;
+}
+
+void test_clean_link_delivers_everything() {
+  LossyLink link;
+  std::vector<std::string> messages = someMessages(11, 30);
+  TransferStats stats = transfer(link, messages, SendWindow::DEFAULT_WINDOW, 1);
+  TEST_ASSERT_EQUAL(messages.size(), stats.delivered);
+  TEST_ASSERT_EQUAL(0, stats.retransmits);
+  TEST_ASSERT_EQUAL(SendWindow::DEFAULT_WINDOW, stats.maxInFlight);
+}
+
+void test_lossy_reordering_link_delivers_everything() {
+  LossyLink link;
+  link.lossRate = 0.15f;
+  link.ackLossRate = 0.1f;
+  link.duplicateRate = 0.1f;
+  std::vector<std::string> messages = someMessages(12, 60);
+  TransferStats stats = transfer(link, messages, SendWindow::DEFAULT_WINDOW, 2);
+
+  TEST_ASSERT_EQUAL(0, stats.failed);
+  TEST_ASSERT_EQUAL(messages.size(), stats.delivered);
+  TEST_ASSERT_GREATER_THAN(0, stats.retransmits);
+  TEST_ASSERT_LESS_OR_EQUAL(SendWindow::DEFAULT_WINDOW, stats.maxInFlight);
+}
+
+void test_dead_link_gives_up_after_the_retries() {
+  LossyLink link;
+  link.lossRate = 1;
+  std::vector<std::string> messages = {"nobody home"};
+  TransferStats stats = transfer(link, messages, 1, 3);
+  TEST_ASSERT_EQUAL(1, stats.failed);
+  TEST_ASSERT_EQUAL(0, stats.delivered);
+  TEST_ASSERT_EQUAL(1 + SendWindow::DEFAULT_RETRIES, link.framesSent);
+}
+
+void test_window_beats_stop_and_wait() {
+  std::vector<std::string> messages = someMessages(13, 20);
+  LossyLink stopAndWait;
+  stopAndWait.lossRate = 0.05f;
+  LossyLink windowed = stopAndWait;
+  uint32_t slow = transfer(stopAndWait, messages, 1, 4).ticks;
+  uint32_t fast = transfer(windowed, messages, SendWindow::DEFAULT_WINDOW, 4).ticks;
+
+  char line[80];
+  snprintf(line, sizeof(line), "ticks: stop-and-wait %u, window %u", (unsigned)slow,
+           (unsigned)fast);
+  TEST_MESSAGE(line);
+  // rtt 3 + air 1: a window of 4 keeps the air busy
+  TEST_ASSERT_LESS_THAN(slow / 2, fast);
+}
+
+int main(int argc, char** argv) {
+  (void)argc;
+  (void)argv;
+  UNITY_BEGIN();
+  RUN_TEST(test_frames_round_trip);
+  RUN_TEST(test_bad_frames_are_rejected);
+  RUN_TEST(test_status_is_never_taken_for_a_data_frame);
+  RUN_TEST(test_utf8_prefix_never_splits_a_character);
+  RUN_TEST(test_reassembly_in_any_order_with_duplicates);
+  RUN_TEST(test_new_message_abandons_a_partial_one);
+  RUN_TEST(test_long_message_is_cut_at_a_character);
+  RUN_TEST(test_clean_link_delivers_everything);
+  RUN_TEST(test_lossy_reordering_link_delivers_everything);
+  RUN_TEST(test_dead_link_gives_up_after_the_retries);
+  RUN_TEST(test_window_beats_stop_and_wait);
+  return UNITY_END();
+}
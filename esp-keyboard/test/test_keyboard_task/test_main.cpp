@@ -0,0 +1,233 @@
+// The whole keyboard sketch on the host: frames come in through the ESP-NOW
+// receive callback and the HID reports go to the HostFakes USB host, which
+// records them so they can be read back as text.
+#include <unity.h>
+
+#include "../../src/main.cpp"
+
+#include <HostFakes.h>
+#include <mutex>
+#include <set>
+#include <string>
+#include <vector>
+
+// Replays the recorded reports on a host with the active layout: each report
+// presses at most one new key, which types the character for that key and
+// the report's modifier
+static std::string hostText() {
+  const KeyboardLayout& layout = activeLayout();
+  std::string text;
+  std::set<uint8_t> held;
+  bool skipSpace = false;
+  for (const fake::HidReport& r : fake::hidReports()) {
+    std::set<uint8_t> now;
+    for (uint8_t key : r.keys) {
+      if (key) now.insert(key);
+    }
+    for (uint8_t key : now) {
+      if (held.count(key)) continue;
+      for (int c = 0; c < 128; c++) {
+        if (layout.ascii[c][1] != key || (layout.ascii[c][0] & LAYOUT_MODIFIERS) != r.modifier) {
+          continue;
+        }
+        // A dead key's character appears with the space that follows it
+        if (c == ' ' && skipSpace) {
+          skipSpace = false;
+        } else {
+          text += (char)c;
+          skipSpace = (layout.ascii[c][0] & LAYOUT_DEAD) != 0;
+        }
+        break;
+      }
+    }
+    held = now;
+  }
+  return text;
+}
+
+// Runs loop() until everything queued has been typed
+static bool typeAll(uint32_t timeoutMs) {
+  uint32_t start = millis();
+  do {
+    loop();
+    delayMicroseconds(50);
+    if (millis() - start > timeoutMs) return false;
+  } while (kboard.messages().depth() > 0);
+  return true;
+}
+
+static const uint8_t mic[6] = {0x02, 0, 0, 0, 0, 0x10};
+static uint8_t nextMessageId = 1;
+
+static void receive(const std::string& text, uint32_t utterance) {
+  uint8_t frame[espnow_transport::MAX_FRAME];
+  uint8_t id = nextMessageId++;
+  size_t count = espnow_transport::fragmentCount(text.size());
+  for (size_t seq = 0; seq < count; seq++) {
+    size_t len = espnow_transport::encodeFrame(frame, id, utterance, (const uint8_t*)text.data(),
+                                               text.size(), (uint8_t)seq);
+    fake::espNowReceive(mic, frame, len);
+  }
+}
+
+// Queue statuses the keyboard sends back to the mic, decoded on the radio
+// thread
+static std::mutex statusMutex;
+static std::vector<espnow_transport::Status> statuses;
+
+static void captureStatuses() {
+  statuses.clear();
+  fake::setEspNowPeer([](const uint8_t* data, size_t len) {
+    espnow_transport::Status status;
+    if (!espnow_transport::decodeStatus(data, len, &status)) return;
+    std::lock_guard<std::mutex> lock(statusMutex);
+    statuses.push_back(status);
+  });
+}
+
+static std::vector<espnow_transport::Status> sentStatuses() {
+  while (!fake::espNowIdle()) delay(1);
+  std::lock_guard<std::mutex> lock(statusMutex);
+  return statuses;
+}
+
+void setUp() {
+  fake::reset();
+}
+
+void tearDown() {}
+
+void test_message_is_typed_in_reports() {
+  receive("Hello, World! 42 + (7 * 6) = \"ok\"", 7);
+  TEST_ASSERT_TRUE(typeAll(3000));
+
+  TEST_ASSERT_EQUAL_STRING("Hello, World! 42 + (7 * 6) = \"ok\"", hostText().c_str());
+  // Every key released at the end
+  fake::HidReport last = fake::hidReports().back();
+  TEST_ASSERT_EQUAL_HEX8(0, last.modifier);
+  for (uint8_t key : last.keys) TEST_ASSERT_EQUAL_HEX8(0, key);
+}
+
+void test_fragments_in_any_order_are_typed_once() {
+  std::string text;
+  while (text.size() < 3 * espnow_transport::MAX_PAYLOAD + 10) text += "the quick brown fox ";
+
+  // Last fragment first, every fragment twice (lost MAC acks), then a
+  // retransmit after the message completed
+  uint8_t frame[espnow_transport::MAX_FRAME];
+  size_t count = espnow_transport::fragmentCount(text.size());
+  uint8_t id = nextMessageId++;
+  for (size_t i = 0; i < 2 * count + 1; i++) {
+    uint8_t seq = (uint8_t)(count - 1 - (i / 2) % count);
+    size_t len = espnow_transport::encodeFrame(frame, id, 99, (const uint8_t*)text.data(),
+                                               text.size(), seq);
+    fake::espNowReceive(mic, frame, len);
+  }
+  TEST_ASSERT_EQUAL(text.size(), reassembler.messageLength());
+  TEST_ASSERT_TRUE(typeAll(10000));
+
+  TEST_ASSERT_TRUE(hostText() == text);
+}
+
+void test_messages_queue_behind_each_other() {
+  receive("first ", 11);
+  receive("second ", 12);
+  receive("third", 13);
+  TEST_ASSERT_TRUE(typeAll(5000));
+  TEST_ASSERT_EQUAL_STRING("first second third", hostText().c_str());
+}
+
+void test_unframed_text_from_an_old_mic() {
+  fake::espNowReceive(mic, (const uint8_t*)"legacy", 6);
+  TEST_ASSERT_TRUE(typeAll(3000));
+  TEST_ASSERT_EQUAL_STRING("legacy", hostText().c_str());
+}
+
+void test_slow_host_lengthens_the_hold() {
+  fake::usbHost.pollUs = 10000;
+  receive("slow host typing", 21);
+  TEST_ASSERT_TRUE(typeAll(5000));
+
+  TEST_ASSERT_EQUAL_STRING("slow host typing", hostText().c_str());
+  TEST_ASSERT_GREATER_THAN(STT_KEYBOARD_REPORT_MS * 1000, kboard.reportHoldUs());
+
+  // Every report was on the host for at least one poll before the next
+  std::vector<fake::HidReport> reports = fake::hidReports();
+  for (size_t i = 1; i < reports.size(); i++) {
+    TEST_ASSERT_GREATER_OR_EQUAL(reports[i - 1].takenMicros, reports[i].submitMicros);
+  }
+}
+
+void test_lost_completions_time_out_without_losing_keys() {
+  fake::usbHost.dropRate = 0.2f;
+  uint32_t timeouts = kboard.reportLatency().timeouts;
+  receive("dropped callbacks", 31);
+  TEST_ASSERT_TRUE(typeAll(10000));
+
+  TEST_ASSERT_EQUAL_STRING("dropped callbacks", hostText().c_str());
+  TEST_ASSERT_GREATER_THAN(timeouts, kboard.reportLatency().timeouts);
+}
+
+void test_suspended_host_is_woken() {
+  fake::usbHost.suspended = true;
+  receive("wake", 41);
+  TEST_ASSERT_TRUE(typeAll(3000));
+  TEST_ASSERT_FALSE(fake::usbHost.suspended);
+  TEST_ASSERT_EQUAL_STRING("wake", hostText().c_str());
+}
+
+void test_queue_room_is_reported_to_the_mic() {
+  captureStatuses();
+  size_t slots = kboard.messages().capacity();
+  uint8_t firstId = nextMessageId;
+  for (size_t i = 0; i < slots; i++) receive("slot ", 50 + i);
+  receive("dropped ", 60);
+
+  std::vector<espnow_transport::Status> sent = sentStatuses();
+  TEST_ASSERT_EQUAL(slots + 1, sent.size());
+  for (size_t i = 0; i < slots; i++) {
+    TEST_ASSERT_EQUAL_HEX8((uint8_t)(firstId + i), sent[i].messageId);
+    TEST_ASSERT_EQUAL(slots - 1 - i, sent[i].freeSlots);
+    TEST_ASSERT_TRUE(sent[i].queued);
+  }
+  // The queue was full: the mic hears that the last message went nowhere
+  TEST_ASSERT_EQUAL_HEX8((uint8_t)(firstId + slots), sent[slots].messageId);
+  TEST_ASSERT_EQUAL(0, sent[slots].freeSlots);
+  TEST_ASSERT_FALSE(sent[slots].queued);
+
+  // Once typing frees a slot the mic is told it may send again, once
+  TEST_ASSERT_TRUE(typeAll(10000));
+  sent = sentStatuses();
+  TEST_ASSERT_EQUAL(slots + 2, sent.size());
+  TEST_ASSERT_GREATER_THAN(0, sent.back().freeSlots);
+
+  std::string typed;
+  for (size_t i = 0; i < slots; i++) typed += "slot ";
+  TEST_ASSERT_EQUAL_STRING(typed.c_str(), hostText().c_str());
+}
+
+void test_message_led_does_not_hold_up_the_loop() {
+  receive("x", 70);
+  uint32_t start = millis();
+  loop();
+  TEST_ASSERT_LESS_THAN(20, millis() - start);
+  TEST_ASSERT_TRUE(typeAll(3000));
+}
+
+int main(int argc, char** argv) {
+  (void)argc;
+  (void)argv;
+  setup();
+
+  UNITY_BEGIN();
+  RUN_TEST(test_message_is_typed_in_reports);
+  RUN_TEST(test_fragments_in_any_order_are_typed_once);
+  RUN_TEST(test_messages_queue_behind_each_other);
+  RUN_TEST(test_unframed_text_from_an_old_mic);
+  RUN_TEST(test_slow_host_lengthens_the_hold);
+  RUN_TEST(test_lost_completions_time_out_without_losing_keys);
+  RUN_TEST(test_suspended_host_is_woken);
+  RUN_TEST(test_queue_room_is_reported_to_the_mic);
+  RUN_TEST(test_message_led_does_not_hold_up_the_loop);
+  return UNITY_END();
+}
@@ -0,0 +1,240 @@
+#include <unity.h>
+
+#include "../../src/KeyboardLayout.h"
+#include "../../src/ReportScheduler.h"
+#include "../../src/Utf8Decoder.h"
+
+#include <map>
+#include <set>
+#include <string>
+#include <utility>
+#include <vector>
+
+static const KeyboardLayout* const layouts[] = {&layoutUS, &layoutUK, &layoutDE};
+
+void setUp() {}
+void tearDown() {}
+
+static std::string utf8(uint32_t cp) {
+  std::string s;
+  if (cp < 0x80) {
+    s += (char)cp;
+  } else if (cp < 0x800) {
+    s += (char)(0xC0 | cp >> 6);
+    s += (char)(0x80 | (cp & 0x3F));
+  } else if (cp < 0x10000) {
+    s += (char)(0xE0 | cp >> 12);
+    s += (char)(0x80 | ((cp >> 6) & 0x3F));
+    s += (char)(0x80 | (cp & 0x3F));
+  } else {
+    s += (char)(0xF0 | cp >> 18);
+    s += (char)(0x80 | ((cp >> 12) & 0x3F));
+    s += (char)(0x80 | ((cp >> 6) & 0x3F));
+    s += (char)(0x80 | (cp & 0x3F));
+  }
+  return s;
+}
+
+static std::vector<uint32_t> decode(const std::string& s) {
+  Utf8Decoder decoder;
+  std::vector<uint32_t> out;
+  uint32_t cps[2];
+  for (char c : s) {
+    uint8_t n = decoder.feed((uint8_t)c, cps);
+    out.insert(out.end(), cps, cps + n);
+  }
+  if (decoder.finish(cps)) out.push_back(cps[0]);
+  return out;
+}
+
+void test_every_printable_ascii_character_has_a_key() {
+  for (const KeyboardLayout* layout : layouts) {
+    for (uint32_t c = ' '; c < 0x7F; c++) {
+      uint8_t modifier;
+      uint8_t keycode;
+      TEST_ASSERT_TRUE_MESSAGE(layoutLookup(*layout, c, &modifier, &keycode), layout->name);
+      TEST_ASSERT_NOT_EQUAL(0, keycode);
+    }
+  }
+}
+
+// A host could not tell two characters apart if they shared a key and
+// modifier, so no two may
+void test_keys_are_unambiguous() {
+  for (const KeyboardLayout* layout : layouts) {
+    std::map<std::pair<uint8_t, uint8_t>, uint32_t> seen;
+    auto claim = [&](uint32_t cp, uint8_t modifier, uint8_t keycode) {
+      TEST_ASSERT_EQUAL_HEX8(0, modifier & LAYOUT_MODIFIERS & ~(LAYOUT_SHIFT | LAYOUT_ALTGR));
+      std::pair<uint8_t, uint8_t> key(modifier & LAYOUT_MODIFIERS, keycode);
+      // Enter types both \n and \r
+      if (seen.count(key) && !(keycode == 0x28 && cp == '\r')) {
+        TEST_FAIL_MESSAGE(layout->name);
+      }
+      seen[key] = cp;
+    };
+    for (uint32_t c = 0; c < 128; c++) {
+      if (layout->ascii[c][1]) claim(c, layout->ascii[c][0], layout->ascii[c][1]);
+    }
+    for (size_t i = 0; i < layout->extraCount; i++) {
+      const LayoutKey& k = layout->extra[i];
+      if (i > 0) TEST_ASSERT_LESS_THAN(k.codepoint, layout->extra[i - 1].codepoint);
+      TEST_ASSERT_GREATER_OR_EQUAL(0x80, k.codepoint);
+      claim(k.codepoint, k.modifier, k.keycode);
+    }
+  }
+}
+
+void test_known_key_positions() {
+  uint8_t modifier;
+  uint8_t keycode;
+  struct {
+    const KeyboardLayout* layout;
+    uint32_t cp;
+    uint8_t modifier;
+    uint8_t keycode;
+  } expected[] = {
+      {&layoutUS, '@', LAYOUT_SHIFT, 0x1f}, {&layoutUS, '"', LAYOUT_SHIFT, 0x34},
+      {&layoutUK, '@', LAYOUT_SHIFT, 0x34}, {&layoutUK, '"', LAYOUT_SHIFT, 0x1f},
+      {&layoutUK, '#', 0, 0x32},            {&layoutUK, 0x00A3, LAYOUT_SHIFT, 0x20},
+      {&layoutDE, 'z', 0, 0x1c},            {&layoutDE, 'y', 0, 0x1d},
+      {&layoutDE, '@', LAYOUT_ALTGR, 0x14}, {&layoutDE, '^', LAYOUT_DEAD, 0x35},
+      {&layoutDE, 0x00FC, 0, 0x2f},         {&layoutDE, 0x20AC, LAYOUT_ALTGR, 0x08},
+  };
+  for (const auto& e : expected) {
+    TEST_ASSERT_TRUE(layoutLookup(*e.layout, e.cp, &modifier, &keycode));
+    TEST_ASSERT_EQUAL_HEX8(e.modifier, modifier);
+    TEST_ASSERT_EQUAL_HEX8(e.keycode, keycode);
+  }
+  TEST_ASSERT_FALSE(layoutLookup(layoutUS, 0x00A3, &modifier, &keycode));
+  TEST_ASSERT_FALSE(layoutLookup(layoutUK, 0x00FC, &modifier, &keycode));
+}
+
+void test_active_layout_follows_the_build_flag() {
+  TEST_ASSERT_EQUAL_STRING(STT_KEYBOARD_LAYOUT == LAYOUT_DE   ? "DE"
+                           : STT_KEYBOARD_LAYOUT == LAYOUT_UK ? "UK"
+                                                              : "US",
+                           activeLayout().name);
+}
+
+void test_transliterations_are_typeable_everywhere() {
+  int mapped = 0;
+  for (uint32_t cp = 0x80; cp < 0x10000; cp++) {
+    const char* ascii = transliterate(cp);
+    if (!ascii) continue;
+    mapped++;
+    for (const char* p = ascii; *p; p++) {
+      TEST_ASSERT_TRUE((uint8_t)*p >= ' ' && (uint8_t)*p < 0x7F);
+    }
+  }
+  TEST_ASSERT_GREATER_THAN(100, mapped);
+
+  TEST_ASSERT_EQUAL_STRING("'", transliterate(0x2019));
+  TEST_ASSERT_EQUAL_STRING("\"", transliterate(0x201C));
+  TEST_ASSERT_EQUAL_STRING("-", transliterate(0x2014));
+  TEST_ASSERT_EQUAL_STRING("...", transliterate(0x2026));
+  TEST_ASSERT_EQUAL_STRING("e", transliterate(0x00E9));
+  TEST_ASSERT_EQUAL_STRING("ss", transliterate(0x00DF));
+  TEST_ASSERT_EQUAL_STRING("", transliterate(0x200B));  // dropped on purpose
+  TEST_ASSERT_NULL(transliterate(0x2603));
+  TEST_ASSERT_NULL(transliterate('a'));
+}
+
+void test_utf8_decodes_every_codepoint() {
+  for (uint32_t cp = 0; cp <= 0x10FFFF; cp++) {
+    if (cp >= 0xD800 && cp <= 0xDFFF) continue;
+    std::vector<uint32_t> out = decode(utf8(cp));
+    TEST_ASSERT_EQUAL(1, out.size());
+    TEST_ASSERT_EQUAL_HEX32(cp, out[0]);
+  }
+}
+
+void test_malformed_utf8_never_swallows_the_next_character() {
+  const uint32_t R = Utf8Decoder::REPLACEMENT;
+  struct {
+    const char* bytes;
+    std::vector<uint32_t> cps;
+  } cases[] = {
+      {"\xC0\x80", {R}},              // overlong NUL
+      {"\xE0\x80\x80", {R}},          // overlong
+      {"\xED\xA0\x80", {R}},          // surrogate
+      {"\xF4\x90\x80\x80", {R}},      // past U+10FFFF
+      {"\x80" "a", {R, 'a'}},         // stray continuation
+      {"\xE2\x82" "a", {R, 'a'}},     // cut short by ASCII
+      {"\xE2\x82\xC3\xA9", {R, 0xE9}},  // cut short by another sequence
+      {"\xFF" "b", {R, 'b'}},
+      {"ok\xE2\x82", {'o', 'k', R}},  // cut off at the end
+  };
+  for (const auto& c : cases) {
+    std::vector<uint32_t> out = decode(c.bytes);
+    TEST_ASSERT_EQUAL_MESSAGE(c.cps.size(), out.size(), c.bytes);
+    for (size_t i = 0; i < out.size(); i++) TEST_ASSERT_EQUAL_HEX32(c.cps[i], out[i]);
+  }
+}
+
+// A host with the given layout: each newly pressed key types the character
+// the layout puts there; a dead key waits for the next key
+static std::string hostTypes(const KeyboardLayout& layout, const char* text) {
+  std::map<std::pair<uint8_t, uint8_t>, uint32_t> chars;
+  std::set<std::pair<uint8_t, uint8_t>> dead;
+  for (uint32_t c = 128; c-- > 0;) {
+    uint8_t keycode = layout.ascii[c][1];
+    if (!keycode) continue;
+    std::pair<uint8_t, uint8_t> key(layout.ascii[c][0] & LAYOUT_MODIFIERS, keycode);
+    chars[key] = c;
+    if (layout.ascii[c][0] & LAYOUT_DEAD) dead.insert(key);
+  }
+  for (size_t i = 0; i < layout.extraCount; i++) {
+    const LayoutKey& k = layout.extra[i];
+    std::pair<uint8_t, uint8_t> key(k.modifier & LAYOUT_MODIFIERS, k.keycode);
+    chars[key] = k.codepoint;
+    if (k.modifier & LAYOUT_DEAD) dead.insert(key);
+  }
+
+  ReportScheduler scheduler(layout);
+  scheduler.begin(text);
+  std::string typed;
+  std::set<uint8_t> held;
+  bool pendingDead = false;
+  KeyReport r;
+  while (scheduler.next(&r)) {
+    std::set<uint8_t> now;
+    for (uint8_t k : r.keys) {
+      if (k) now.insert(k);
+    }
+    for (uint8_t k : now) {
+      if (held.count(k)) continue;
+      std::pair<uint8_t, uint8_t> key(r.modifier, k);
+      TEST_ASSERT_TRUE(chars.count(key));
+      if (pendingDead && chars[key] == ' ') {
+        pendingDead = false;
+        continue;
+      }
+      typed += utf8(chars[key]);
+      pendingDead = dead.count(key) > 0;
+    }
+    held = now;
+  }
+  return typed;
+}
+
+void test_layouts_type_what_they_can_and_spell_out_the_rest() {
+  const char* text = "„Grüße“ – 5 € & ^2 @home…";
+  TEST_ASSERT_EQUAL_STRING("\"Grusse\" - 5 EUR & ^2 @home...", hostTypes(layoutUS, text).c_str());
+  TEST_ASSERT_EQUAL_STRING("\"Grusse\" - 5 € & ^2 @home...", hostTypes(layoutUK, text).c_str());
+  TEST_ASSERT_EQUAL_STRING("\"Grüße\" - 5 € & ^2 @home...", hostTypes(layoutDE, text).c_str());
+}
+
+int main(int argc, char** argv) {
+  (void)argc;
+  (void)argv;
+  UNITY_BEGIN();
+  RUN_TEST(test_every_printable_ascii_character_has_a_key);
+  RUN_TEST(test_keys_are_unambiguous);
+  RUN_TEST(test_known_key_positions);
+  RUN_TEST(test_active_layout_follows_the_build_flag);
+  RUN_TEST(test_transliterations_are_typeable_everywhere);
+  RUN_TEST(test_utf8_decodes_every_codepoint);
+  RUN_TEST(test_malformed_utf8_never_swallows_the_next_character);
+  RUN_TEST(test_layouts_type_what_they_can_and_spell_out_the_rest);
+  return UNITY_END();
+}
@@ -0,0 +1,153 @@
+#include <unity.h>
+
+#include "../../src/MessageQueue.h"
+
+#include <atomic>
+#include <random>
+#include <stdio.h>
+#include <string>
+#include <thread>
+
+void setUp() {}
+void tearDown() {}
+
+void test_messages_come_out_in_order_with_their_tags() {
+  MessageQueue<4, 32> queue;
+  TEST_ASSERT_NULL(queue.front());
+  queue.pop();  // harmless when empty
+  TEST_ASSERT_EQUAL(0, queue.depth());
+
+  TEST_ASSERT_TRUE(queue.push("one", 3, 11));
+  TEST_ASSERT_TRUE(queue.push("two", 3, 22));
+  TEST_ASSERT_EQUAL(2, queue.depth());
+  TEST_ASSERT_EQUAL_STRING("one", queue.front());
+  TEST_ASSERT_EQUAL(11, queue.frontTag());
+  queue.pop();
+  TEST_ASSERT_EQUAL_STRING("two", queue.front());
+  TEST_ASSERT_EQUAL(22, queue.frontTag());
+  queue.pop();
+  TEST_ASSERT_NULL(queue.front());
+  TEST_ASSERT_EQUAL(2, queue.pushed);
+}
+
+void test_full_queue_drops_new_messages() {
+  MessageQueue<2, 16> queue;
+  TEST_ASSERT_TRUE(queue.push("a", 1));
+  TEST_ASSERT_TRUE(queue.push("b", 1));
+  TEST_ASSERT_FALSE(queue.push("c", 1));
+  TEST_ASSERT_EQUAL(1, queue.dropped);
+  TEST_ASSERT_EQUAL(2, queue.highWater);
+
+  // Queued text is untouched by the dropped one
+  TEST_ASSERT_EQUAL_STRING("a", queue.front());
+  queue.pop();
+  TEST_ASSERT_TRUE(queue.push("d", 1));
+  TEST_ASSERT_EQUAL_STRING("b", queue.front());
+  queue.pop();
+  TEST_ASSERT_EQUAL_STRING("d", queue.front());
+}
+
+void test_long_message_is_truncated_to_the_slot() {
+  MessageQueue<2, 8> queue;
+  TEST_ASSERT_TRUE(queue.push("0123456789", 10));
+  TEST_ASSERT_EQUAL_STRING("0123456", queue.front());
+  TEST_ASSERT_EQUAL(1, queue.truncated);
+}
+
+void test_front_is_stable_while_the_producer_refills() {
+  MessageQueue<4, 16> queue;
+  queue.push("typing this", 11);
+  const char* typing = queue.front();
+  for (int i = 0; i < 10; i++) queue.push("later", 5);
+  TEST_ASSERT_EQUAL_STRING("typing this", typing);
+  TEST_ASSERT_EQUAL(4, queue.depth());
+  TEST_ASSERT_EQUAL(7, queue.dropped);
+}
+
+void test_slots_are_reused_across_many_wraps() {
+  MessageQueue<4, 16> queue;
+  char text[16];
+  for (int i = 0; i < 10000; i++) {
+    int n = snprintf(text, sizeof(text), "msg %d", i);
+    TEST_ASSERT_TRUE(queue.push(text, n, i));
+    if (i % 3 == 2) {
+      // Drain in bursts so the depth varies
+      while (queue.front()) queue.pop();
+    }
+  }
+  TEST_ASSERT_LESS_OR_EQUAL(3, queue.highWater);
+  TEST_ASSERT_EQUAL(0, queue.dropped);
+}
+
+// The WiFi task pushes while the loop task types: every message that was not
+// dropped arrives once, in order, intact
+void test_spsc_stress() {
+  static MessageQueue<8, 64> queue;
+  const uint32_t total = 200000;
+  std::atomic<bool> producerDone{false};
+
+  std::thread producer([total, &producerDone] {
+    std::mt19937 rng(7);
+    char text[64];
+    for (uint32_t i = 0; i < total; i++) {
+      // Length and content both derive from i, so a torn slot shows up
+      int len = snprintf(text, sizeof(text), "%u:", (unsigned)i);
+      size_t pad = i % 40;
+      for (size_t k = 0; k < pad; k++) text[len++] = (char)('a' + (i + k) % 26);
+      // Mostly wait for room, as a sender retrying would; sometimes push
+      // into a full queue so drops happen too
+      if (rng() % 8 != 0) {
+        while (queue.depth() == queue.capacity()) std::this_thread::yield();
+      }
+      queue.push(text, len, i);
+    }
+    producerDone = true;
+  });
+
+  uint32_t received = 0;
+  int64_t last = -1;
+  uint32_t bad = 0;
+  std::mt19937 rng(8);
+  // The counters are only read once the producer is done with them
+  while (!producerDone || queue.front()) {
+    const char* text = queue.front();
+    if (!text) {
+      std::this_thread::yield();
+      continue;
+    }
+    uint32_t tag = queue.frontTag();
+    char expect[64];
+    int len = snprintf(expect, sizeof(expect), "%u:", (unsigned)tag);
+    for (size_t k = 0; k < tag % 40; k++) expect[len++] = (char)('a' + (tag + k) % 26);
+    expect[len] = '\0';
+    if (strcmp(text, expect) != 0 || (int64_t)tag <= last) bad++;
+    last = tag;
+    // Take a while over some messages, as typing does
+    if (rng() % 16 == 0) std::this_thread::yield();
+    queue.pop();
+    received++;
+  }
+  producer.join();
+
+  char line[80];
+  snprintf(line, sizeof(line), "received %u, dropped %u, high water %u", (unsigned)received,
+           (unsigned)queue.dropped, (unsigned)queue.highWater);
+  TEST_MESSAGE(line);
+  TEST_ASSERT_EQUAL(0, bad);
+  TEST_ASSERT_EQUAL(total, received + queue.dropped);
+  TEST_ASSERT_EQUAL(received, queue.pushed);
+  TEST_ASSERT_LESS_OR_EQUAL(8, queue.highWater);
+}
+
+int main(int argc, char** argv) {
+  (void)argc;
+  (void)argv;
+  UNITY_BEGIN();
+  RUN_TEST(test_messages_come_out_in_order_with_their_tags);
+  RUN_TEST(test_full_queue_drops_new_messages);
+  RUN_TEST(test_long_message_is_truncated_to_the_slot);
+  RUN_TEST(test_front_is_stable_while_the_producer_refills);
+  RUN_TEST(test_slots_are_reused_across_many_wraps);
+  RUN_TEST(test_spsc_stress);
+  return UNITY_END();
+}
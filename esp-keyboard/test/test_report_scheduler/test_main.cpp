@@ -0,0 +1,171 @@
+#include <unity.h>
+
+#include "../../src/KeyboardWrapper.h"
+#include "../../src/ReportScheduler.h"
+
+#include <random>
+#include <set>
+#include <stdio.h>
+#include <string>
+#include <vector>
+
+void setUp() {}
+void tearDown() {}
+
+static std::vector<KeyReport> schedule(const char* text,
+                                       const KeyboardLayout& layout = layoutUS) {
+  ReportScheduler scheduler(layout);
+  scheduler.begin(text);
+  std::vector<KeyReport> reports;
+  KeyReport r;
+  while (scheduler.next(&r)) {
+    reports.push_back(r);
+    TEST_ASSERT_LESS_THAN(100000, reports.size());
+  }
+  TEST_ASSERT_FALSE(scheduler.active());
+  return reports;
+}
+
+static std::set<uint8_t> keysOf(const KeyReport& r) {
+  std::set<uint8_t> keys;
+  for (uint8_t k : r.keys) {
+    if (k) keys.insert(k);
+  }
+  return keys;
+}
+
+// What a US host types for these reports: each newly pressed key gives the
+// character for that key under the report's modifier. Also checks the
+// scheduler's promise of at most one new key per report, and that a held
+// key is never re-shifted by a modifier change.
+static std::string hostTypes(const std::vector<KeyReport>& reports) {
+  std::string text;
+  std::set<uint8_t> held;
+  uint8_t heldModifier = 0;
+  for (const KeyReport& r : reports) {
+    std::set<uint8_t> now = keysOf(r);
+    int pressed = 0;
+    for (uint8_t key : now) {
+      if (held.count(key)) continue;
+      pressed++;
+      for (int c = 0; c < 128; c++) {
+        uint8_t modifier = layoutUS.ascii[c][0] & LAYOUT_MODIFIERS;
+        if (layoutUS.ascii[c][1] == key && modifier == r.modifier) {
+          text += (char)c;
+          break;
+        }
+      }
+    }
+    TEST_ASSERT_LESS_OR_EQUAL(1, pressed);
+    if (r.modifier != heldModifier) {
+      for (uint8_t key : now) TEST_ASSERT_FALSE(held.count(key));
+    }
+    held = now;
+    heldModifier = r.modifier;
+  }
+  return text;
+}
+
+void test_host_sees_the_same_text() {
+  const char* samples[] = {
+      "hello world",
+      "The quick brown fox jumps over the lazy dog.",
+      "aaa bbb  ccc",
+      "Mississippi bookkeeper",
+      "MiXeD CaSe & {symbols}: ~!@#$%^*()_+",
+      "1234567890-=[]\\;',./`",
+      "line\nbreaks\tand tabs\n",
+  };
+  for (const char* s : samples) {
+    TEST_ASSERT_EQUAL_STRING(s, hostTypes(schedule(s)).c_str());
+  }
+}
+
+void test_random_ascii_types_identically() {
+  std::mt19937 rng(13);
+  for (int round = 0; round < 500; round++) {
+    std::string s;
+    size_t len = rng() % 200;
+    for (size_t i = 0; i < len; i++) s += (char)(' ' + rng() % 95);
+    TEST_ASSERT_TRUE(hostTypes(schedule(s.c_str())) == s);
+  }
+}
+
+void test_distinct_keys_roll_over_six_at_a_time() {
+  std::vector<KeyReport> reports = schedule("abcdefghij");
+  // One report per key, plus the final release
+  TEST_ASSERT_EQUAL(11, reports.size());
+  TEST_ASSERT_EQUAL(6, keysOf(reports[5]).size());
+  // The seventh key pushes the oldest out in the same report
+  TEST_ASSERT_EQUAL(6, keysOf(reports[6]).size());
+  TEST_ASSERT_FALSE(keysOf(reports[6]).count(layoutUS.ascii['a'][1]));
+  TEST_ASSERT_TRUE(keysOf(reports[6]).count(layoutUS.ascii['g'][1]));
+}
+
+void test_repeated_key_is_released_first() {
+  std::vector<KeyReport> reports = schedule("abba");
+  // a, ab, a (b up), ab (b down), b (a up), ab (a down), release
+  TEST_ASSERT_EQUAL(7, reports.size());
+  TEST_ASSERT_EQUAL(1, keysOf(reports[2]).size());
+  TEST_ASSERT_EQUAL_STRING("abba", hostTypes(reports).c_str());
+}
+
+void test_modifier_change_releases_held_keys() {
+  std::vector<KeyReport> reports = schedule("aB");
+  // a, all up, shift+B, release
+  TEST_ASSERT_EQUAL(4, reports.size());
+  TEST_ASSERT_EQUAL(0, keysOf(reports[1]).size());
+  TEST_ASSERT_EQUAL_HEX8(LAYOUT_SHIFT, reports[2].modifier);
+}
+
+void test_everything_is_released_at_the_end() {
+  std::vector<KeyReport> reports = schedule("Shift held at THE END");
+  TEST_ASSERT_EQUAL_HEX8(0, reports.back().modifier);
+  TEST_ASSERT_EQUAL(0, keysOf(reports.back()).size());
+  TEST_ASSERT_EQUAL(0, schedule("").size());
+}
+
+void test_untypeable_characters_are_skipped() {
+  // U+2603 has no key and no transliteration; invalid UTF-8 decodes to U+FFFD
+  TEST_ASSERT_EQUAL_STRING("ab", hostTypes(schedule("a\xE2\x98\x83" "b")).c_str());
+  TEST_ASSERT_EQUAL_STRING("ab", hostTypes(schedule("a\xFF" "b")).c_str());
+}
+
+// Reports per character for ordinary prose, and what that means in chars/s
+// at the default hold and at one report per 1 ms full-speed poll. The old
+// press/release loop held each character for 16 + 16 + 10 ms.
+void test_benchmark_chars_per_second() {
+  std::string prose;
+  while (prose.size() < 5000) {
+    prose += "Speech to text keeps the hands free; long transcripts should appear quickly. ";
+  }
+  size_t reports = schedule(prose.c_str()).size();
+  double perChar = (double)reports / prose.size();
+  double oldRate = 1000.0 / (16 + 16 + 10);
+  double defaultRate = 1000.0 / (perChar * STT_KEYBOARD_REPORT_MS);
+  double pollRate = 1000.0 / perChar;
+
+  char line[120];
+  snprintf(line, sizeof(line),
+           "%.2f reports/char: %.0f chars/s at %d ms, %.0f at 1 ms polls (old loop %.0f)", perChar,
+           defaultRate, STT_KEYBOARD_REPORT_MS, pollRate, oldRate);
+  TEST_MESSAGE(line);
+  // Well under the two reports per character of a press-plus-release cycle
+  TEST_ASSERT_LESS_THAN(1.5, perChar);
+  TEST_ASSERT_GREATER_THAN(2 * oldRate, defaultRate);
+}
+
+int main(int argc, char** argv) {
+  (void)argc;
+  (void)argv;
+  UNITY_BEGIN();
+  RUN_TEST(test_host_sees_the_same_text);
+  RUN_TEST(test_random_ascii_types_identically);
+  RUN_TEST(test_distinct_keys_roll_over_six_at_a_time);
+  RUN_TEST(test_repeated_key_is_released_first);
+  RUN_TEST(test_modifier_change_releases_held_keys);
+  RUN_TEST(test_everything_is_released_at_the_end);
+  RUN_TEST(test_untypeable_characters_are_skipped);
+  RUN_TEST(test_benchmark_chars_per_second);
+  return UNITY_END();
+}
@@ -0,0 +1,326 @@
+#ifndef ESP_NOW_TRANSPORT_H
+#define ESP_NOW_TRANSPORT_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+// Framing shared by stt-mic (sender) and esp-keyboard (receiver) so text of
+// any length survives ESP-NOW's 250-byte frames.
+//
+// Every frame starts with an 8-byte header:
+//
+//   [magic][message id][sequence][fragment count][utterance id, LE32][payload ...]
+//
+// Fragment n carries bytes [n * MAX_PAYLOAD, (n + 1) * MAX_PAYLOAD) of the
+// message, so fragments can arrive in any order and duplicates are harmless.
+// The utterance id ties the text to the mic's latency trace (TraceLog.h).
+// The magic is a UTF-8 continuation byte, which can never start a plain
+// text frame, so the receiver can still accept unframed text from older
+// senders.
+//
+// The receiver answers each completed message with a 4-byte status frame,
+// and sends it again once a full queue has room:
+//
+//   [status magic][message id][free queue slots][flags: bit 0 queued]
+//
+// Every fragment is MAC-acked as it arrives, before the receiver knows
+// whether its queue can take the message, so the sender waits for room
+// instead of sending a message that would be dropped.
+//
+// Nothing here touches the radio; both sides feed frames in and out, which
+// keeps the codec usable in a native build.
+namespace espnow_transport {
+
+static const uint8_t MAGIC = 0xA6;
+static const size_t MAX_FRAME = 250;  // ESP_NOW_MAX_DATA_LEN
+static const size_t HEADER_SIZE = 8;
+static const size_t MAX_PAYLOAD = MAX_FRAME - HEADER_SIZE;
+static const size_t MAX_FRAGMENTS = 32;  // one bit each in a uint32_t
+static const size_t MAX_MESSAGE = MAX_FRAGMENTS * MAX_PAYLOAD;
+
+struct FrameHeader {
+  uint32_t utterance;
+  uint8_t messageId;
+  uint8_t seq;
+  uint8_t count;
+};
+
+static const uint8_t STATUS_MAGIC = 0xA7;
+static const size_t STATUS_SIZE = 4;
+static const uint8_t STATUS_QUEUED = 0x01;
+
+struct Status {
+  uint8_t messageId;
+  uint8_t freeSlots;
+  bool queued;  // false: the queue was full and the message was dropped
+};
+
+inline size_t fragmentCount(size_t messageLen) {
+  return messageLen == 0 ? 1 : (messageLen + MAX_PAYLOAD - 1) / MAX_PAYLOAD;
+}
+
+// True for anything that looks like a frame of any version rather than text
+inline bool isFrame(const uint8_t* data, size_t len) {
+  return len > 0 && (data[0] & 0xC0) == 0x80;
+}
+
+// Longest prefix of text[0, len) that is at most max bytes and does not end
+// inside a UTF-8 sequence, so split or truncated text still decodes.
+inline size_t utf8Prefix(const char* text, size_t len, size_t max) {
+  if (len <= max) return len;
+  size_t cut = max;
+  // Back up over continuation bytes to the start of the split character
+  while (cut > 0 && ((uint8_t)text[cut] & 0xC0) == 0x80) cut--;
+  return cut;
+}
+
+// Writes fragment seq of message into out (at least MAX_FRAME bytes) and
+// returns the frame length, or 0 if seq is out of range.
+inline size_t encodeFrame(uint8_t* out, uint8_t messageId, uint32_t utterance,
+                          const uint8_t* message, size_t messageLen, uint8_t seq) {
+  size_t count = fragmentCount(messageLen);
+  if (count > MAX_FRAGMENTS || seq >= count) return 0;
+
+  size_t offset = (size_t)seq * MAX_PAYLOAD;
+  size_t len = messageLen - offset;
+  if (len > MAX_PAYLOAD) len = MAX_PAYLOAD;
+
+  out[0] = MAGIC;
+  out[1] = messageId;
+  out[2] = seq;
+  out[3] = (uint8_t)count;
+  out[4] = utterance & 0xFF;
+  out[5] = (utterance >> 8) & 0xFF;
+  out[6] = (utterance >> 16) & 0xFF;
+  out[7] = (utterance >> 24) & 0xFF;
+  memcpy(out + HEADER_SIZE, message + offset, len);
+  return HEADER_SIZE + len;
+}
+
+// Validates a frame and points payload into it. Returns false for anything
+// that is not a well-formed frame (including legacy unframed text).
+inline bool decodeFrame(const uint8_t* data, size_t len, FrameHeader* header,
+                        const uint8_t** payload, size_t* payloadLen) {
+  if (len < HEADER_SIZE || len > MAX_FRAME || data[0] != MAGIC) return false;
+  uint8_t seq = data[2];
+  uint8_t count = data[3];
+  if (count == 0 || count > MAX_FRAGMENTS || seq >= count) return false;
+  // Only the last fragment may be short
+  size_t plen = len - HEADER_SIZE;
+  if (seq + 1 < count && plen != MAX_PAYLOAD) return false;
+
+  header->utterance = (uint32_t)data[4] | ((uint32_t)data[5] << 8) |
+                      ((uint32_t)data[6] << 16) | ((uint32_t)data[7] << 24);
+  header->messageId = data[1];
+  header->seq = seq;
+  header->count = count;
+  *payload = data + HEADER_SIZE;
+  *payloadLen = plen;
+  return true;
+}
+
+// Writes a status frame into out (at least STATUS_SIZE bytes) and returns
+// its length.
+inline size_t encodeStatus(uint8_t* out, const Status& status) {
+  out[0] = STATUS_MAGIC;
+  out[1] = status.messageId;
+  out[2] = status.freeSlots;
+  out[3] = status.queued ? STATUS_QUEUED : 0;
+  return STATUS_SIZE;
+}
+
+inline bool decodeStatus(const uint8_t* data, size_t len, Status* status) {
+  if (len != STATUS_SIZE || data[0] != STATUS_MAGIC) return false;
+  status->messageId = data[1];
+  status->freeSlots = data[2];
+  status->queued = (data[3] & STATUS_QUEUED) != 0;
+  return true;
+}
+
+// Receiver side. Collects fragments of one message at a time into a
+// caller-supplied buffer and NUL-terminates the result. A message longer than
+// the buffer keeps the prefix that fits, cut at a character boundary. A frame
+// from a new message abandons the partial one; frames from the message that
+// was just completed (retransmits whose MAC ack was lost) are recognised and
+// ignored.
+// Messages are told apart by id and utterance together: the mic's id counter
+// can repeat after a reboot, but the utterance id is random per press.
+class Reassembler {
+public:
+  enum Result { INCOMPLETE, COMPLETE, DUPLICATE, INVALID };
+
+  Reassembler(char* buffer, size_t capacity) : buf(buffer), cap(capacity) { reset(); }
+
+  void reset() {
+    active = false;
+    haveCompleted = false;
+    received = 0;
+    length = 0;
+    buf[0] = '\0';
+  }
+
+  Result accept(const uint8_t* data, size_t len) {
+    FrameHeader h;
+    const uint8_t* payload;
+    size_t plen;
+    if (!decodeFrame(data, len, &h, &payload, &plen)) return INVALID;
+
+    bool current = active && h.messageId == id && h.utterance == utterance;
+    if (haveCompleted && h.messageId == completedId && h.utterance == completedUtterance &&
+        !current) {
+      return DUPLICATE;
+    }
+
+    if (!current || h.count != count) {
+      if (active) abandoned++;
+      active = true;
+      id = h.messageId;
+      count = h.count;
+      utterance = h.utterance;
+      received = 0;
+      length = 0;
+    }
+
+    uint32_t bit = 1UL << h.seq;
+    if (received & bit) return DUPLICATE;
+    // Leave room for the terminator; bytes past the buffer are not kept
+    size_t offset = (size_t)h.seq * MAX_PAYLOAD;
+    if (offset < cap - 1) {
+      size_t keep = cap - 1 - offset;
+      memcpy(buf + offset, payload, plen < keep ? plen : keep);
+    }
+    received |= bit;
+    if (h.seq + 1 == count) length = offset + plen;
+
+    uint32_t all = count == 32 ? 0xFFFFFFFFUL : (1UL << count) - 1;
+    if (received != all) return INCOMPLETE;
+
+    if (length > cap - 1) {
+      // Only the first cap - 1 bytes were kept; drop a character the cut
+      // split in two
+      length = cap - 1;
+      size_t start = length;
+      while (start > 0 && ((uint8_t)buf[start - 1] & 0xC0) == 0x80) start--;
+      if (start > 0) {
+        uint8_t lead = (uint8_t)buf[start - 1];
+        size_t need = lead >= 0xF0 ? 4 : lead >= 0xE0 ? 3 : lead >= 0xC0 ? 2 : 1;
+        if (start - 1 + need > length) length = start - 1;
+      }
+      truncated++;
+    }
+    buf[length] = '\0';
+    active = false;
+    haveCompleted = true;
+    completedId = id;
+    completedUtterance = utterance;
+    return COMPLETE;
+  }
+
+  const char* message() const { return buf; }
+  size_t messageLength() const { return length; }
+  uint32_t messageUtterance() const { return utterance; }
+  uint8_t messageId() const { return id; }
+
+  uint32_t abandoned = 0;  // partial messages replaced by a newer one
+  uint32_t truncated = 0;  // messages cut to fit the buffer
+
+private:
+  char* buf;
+  size_t cap;
+  bool active;
+  bool haveCompleted;
+  uint8_t id = 0;
+  uint8_t count = 0;
+  uint8_t completedId = 0;
+  uint32_t completedUtterance = 0;
+  uint32_t utterance = 0;
+  uint32_t received;
+  size_t length;
+};
+
+// Sender side bookkeeping for a sliding window with selective retransmit.
+//
+// ESP-NOW reports one send-status callback per esp_now_send(), in the order
+// the frames were queued, and a unicast status is the peer's MAC-layer ack.
+// So the window keeps up to `window` fragments in flight, matches each status
+// to the oldest in-flight fragment, and re-queues only fragments that failed.
+class SendWindow {
+public:
+  static const uint8_t DEFAULT_WINDOW = 4;
+  static const uint8_t DEFAULT_RETRIES = 5;
+
+  void begin(uint8_t fragments, uint8_t window = DEFAULT_WINDOW,
+             uint8_t retries = DEFAULT_RETRIES) {
+    count = fragments;
+    windowSize = window ? window : 1;
+    maxRetries = retries;
+    acked = 0;
+    queued = 0;
+    inFlightHead = 0;
+    inFlightCount = 0;
+    failedFlag = false;
+    retransmits = 0;
+    for (size_t i = 0; i < MAX_FRAGMENTS; i++) attempts[i] = 0;
+  }
+
+  // Next fragment to put on the air, if the window has room.
+  bool nextToSend(uint8_t* seq) {
+    if (failedFlag || inFlightCount >= windowSize) return false;
+    for (uint8_t s = 0; s < count; s++) {
+      uint32_t bit = 1UL << s;
+      if (!(acked & bit) && !(queued & bit)) {
+        *seq = s;
+        return true;
+      }
+    }
+    return false;
+  }
+
+  // The fragment was handed to esp_now_send() successfully.
+  void onQueued(uint8_t seq) {
+    queued |= 1UL << seq;
+    inFlight[(inFlightHead + inFlightCount) % MAX_FRAGMENTS] = seq;
+    inFlightCount++;
+    if (attempts[seq]++ > 0) retransmits++;
+  }
+
+  // The next send-status callback, in order.
+  void onStatus(bool delivered) {
+    if (inFlightCount == 0) return;  // stale status from an aborted message
+    uint8_t seq = inFlight[inFlightHead];
+    inFlightHead = (inFlightHead + 1) % MAX_FRAGMENTS;
+    inFlightCount--;
+    queued &= ~(1UL << seq);
+    if (delivered) {
+      acked |= 1UL << seq;
+    } else if (attempts[seq] > maxRetries) {
+      failedFlag = true;
+    }
+  }
+
+  bool done() const {
+    uint32_t all = count >= 32 ? 0xFFFFFFFFUL : (1UL << count) - 1;
+    return acked == all;
+  }
+  bool failed() const { return failedFlag; }
+  uint8_t inFlightFrames() const { return inFlightCount; }
+
+  uint32_t retransmits = 0;
+
+private:
+  uint8_t count = 0;
+  uint8_t windowSize = DEFAULT_WINDOW;
+  uint8_t maxRetries = DEFAULT_RETRIES;
+  uint32_t acked = 0;
+  uint32_t queued = 0;
+  uint8_t inFlight[MAX_FRAGMENTS];
+  uint8_t inFlightHead = 0;
+  uint8_t inFlightCount = 0;
+  uint8_t attempts[MAX_FRAGMENTS];
+  bool failedFlag = false;
+};
+
+}  // namespace espnow_transport
+
+#endif
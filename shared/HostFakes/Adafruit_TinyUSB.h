@@ -0,0 +1,54 @@
+#ifndef HOST_FAKES_ADAFRUIT_TINYUSB_H
+#define HOST_FAKES_ADAFRUIT_TINYUSB_H
+
+#include "Arduino.h"
+
+#define HID_ITF_PROTOCOL_KEYBOARD 1
+
+// A stand-in descriptor; nothing parses it on the host
+#define TUD_HID_REPORT_DESC_KEYBOARD(...) \
+  0x05, 0x01, 0x09, 0x06, 0xa1, 0x01, 0x05, 0x07, 0x95, 0x06, 0x75, 0x08, 0x81, 0x00, 0xc0
+
+// Defined by the sketch; the fake host calls it when it takes a report
+extern "C" void tud_hid_report_complete_cb(uint8_t instance, uint8_t const* report, uint16_t len);
+
+// The device is mounted and awake unless the test says otherwise
+// (fake::usbHost)
+class Adafruit_USBD_Device {
+public:
+  void setProductDescriptor(const char* s) { (void)s; }
+  void setManufacturerDescriptor(const char* s) { (void)s; }
+  bool isInitialized() { return initialized; }
+  bool begin(uint8_t rhport = 0) {
+    (void)rhport;
+    initialized = true;
+    return true;
+  }
+  bool mounted();
+  bool suspended();
+  bool remoteWakeup();
+  bool detach() { return true; }
+  bool attach() { return true; }
+
+private:
+  bool initialized = false;
+};
+extern Adafruit_USBD_Device TinyUSBDevice;
+
+// Reports go to a fake host that polls every fake::usbHost.pollUs, records
+// them (fake::hidReports()) and calls tud_hid_report_complete_cb()
+class Adafruit_USBD_HID {
+public:
+  void setBootProtocol(uint8_t protocol) { (void)protocol; }
+  void setPollInterval(uint8_t ms) { (void)ms; }
+  void setReportDescriptor(const uint8_t* desc, uint16_t len) {
+    (void)desc;
+    (void)len;
+  }
+  void setStringDescriptor(const char* s) { (void)s; }
+  bool begin() { return true; }
+  bool ready();
+  bool keyboardReport(uint8_t reportId, uint8_t modifier, uint8_t keycode[6]);
+};
+
+#endif
@@ -0,0 +1,180 @@
+#ifndef HOST_FAKES_ARDUINO_H
+#define HOST_FAKES_ARDUINO_H
+
+// The slice of the Arduino-ESP32 core that stt-mic and esp-keyboard use,
+// running on host threads and the host clock. Tests drive the hardware
+// through HostFakes.h.
+
+#include <algorithm>
+#include <stdarg.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+
+#include "driver/gpio.h"
+#include "esp_err.h"
+#include "freertos/FreeRTOS.h"
+
+#define ESP_IDF_VERSION_MAJOR 5
+
+#define IRAM_ATTR
+#define RTC_DATA_ATTR
+
+#define HIGH 0x1
+#define LOW 0x0
+
+#define INPUT 0x01
+#define OUTPUT 0x03
+#define INPUT_PULLUP 0x05
+
+#define RISING 0x01
+#define FALLING 0x02
+#define CHANGE 0x03
+#define ONLOW 0x04
+#define ONHIGH 0x05
+
+#define DEC 10
+#define HEX 16
+
+// Seeed XIAO pin names used by the sketches
+static const uint8_t D8 = 8;
+static const uint8_t D9 = 9;
+static const uint8_t D10 = 10;
+
+using std::max;
+using std::min;
+
+unsigned long millis();
+unsigned long micros();
+void delay(uint32_t ms);
+void delayMicroseconds(uint32_t us);
+
+void pinMode(uint8_t pin, uint8_t mode);
+int digitalRead(uint8_t pin);
+void digitalWrite(uint8_t pin, uint8_t level);
+void attachInterrupt(uint8_t pin, void (*handler)(), int mode);
+void detachInterrupt(uint8_t pin);
+#define digitalPinToInterrupt(p) (p)
+
+uint32_t getCpuFrequencyMhz();
+uint32_t esp_random();
+
+#if defined(__GLIBC__) && !(__GLIBC__ > 2 || (__GLIBC__ == 2 && __GLIBC_MINOR__ >= 38))
+// glibc only has these from 2.38
+size_t strlcpy(char* dst, const char* src, size_t size);
+size_t strlcat(char* dst, const char* src, size_t size);
+#endif
+
+class String {
+public:
+  String() {}
+  String(const char* s) : s(s ? s : "") {}
+  String(const std::string& s) : s(s) {}
+  String(char c) : s(1, c) {}
+  String(int v) : s(std::to_string(v)) {}
+  String(unsigned int v) : s(std::to_string(v)) {}
+  String(long v) : s(std::to_string(v)) {}
+  String(unsigned long v) : s(std::to_string(v)) {}
+  String(unsigned char v) : s(std::to_string(v)) {}
+
+  const char* c_str() const { return s.c_str(); }
+  unsigned int length() const { return (unsigned int)s.size(); }
+  bool operator==(const String& other) const { return s == other.s; }
+  bool operator==(const char* other) const { return s == other; }
+  String& operator+=(const String& other) {
+    s += other.s;
+    return *this;
+  }
+
+  friend String operator+(const String& a, const String& b) { return String(a.s + b.s); }
+  friend String operator+(const char* a, const String& b) { return String(a + b.s); }
+  friend String operator+(const String& a, const char* b) { return String(a.s + b); }
+
+private:
+  std::string s;
+};
+
+class Print {
+public:
+  virtual ~Print() {}
+  virtual size_t write(uint8_t c) = 0;
+  virtual size_t write(const uint8_t* buffer, size_t size) {
+    size_t n = 0;
+    while (size--) n += write(*buffer++);
+    return n;
+  }
+  size_t write(const char* str) { return str ? write((const uint8_t*)str, strlen(str)) : 0; }
+
+  size_t print(const char* str) { return write(str); }
+  size_t print(const String& str) { return write(str.c_str()); }
+  size_t print(char c) { return write((uint8_t)c); }
+  size_t print(unsigned char v, int base = DEC) { return print((unsigned long)v, base); }
+  size_t print(int v, int base = DEC) { return print((long)v, base); }
+  size_t print(unsigned int v, int base = DEC) { return print((unsigned long)v, base); }
+  size_t print(long v, int base = DEC) { return printf(base == HEX ? "%lx" : "%ld", v); }
+  size_t print(unsigned long v, int base = DEC) { return printf(base == HEX ? "%lx" : "%lu", v); }
+  size_t print(long long v, int base = DEC) { return printf(base == HEX ? "%llx" : "%lld", v); }
+  size_t print(unsigned long long v, int base = DEC) {
+    return printf(base == HEX ? "%llx" : "%llu", v);
+  }
+  size_t print(double v, int digits = 2) { return printf("%.*f", digits, v); }
+
+  size_t println() { return write("\r\n"); }
+  template <typename T>
+  size_t println(const T& v) {
+    size_t n = print(v);
+    return n + println();
+  }
+  template <typename T>
+  size_t println(const T& v, int format) {
+    size_t n = print(v, format);
+    return n + println();
+  }
+
+  size_t printf(const char* format, ...) __attribute__((format(printf, 2, 3))) {
+    char small[128];
+    va_list args;
+    va_start(args, format);
+    int len = vsnprintf(small, sizeof(small), format, args);
+    va_end(args);
+    if (len < 0) return 0;
+    if ((size_t)len < sizeof(small)) return write((const uint8_t*)small, len);
+
+    std::string big(len + 1, '\0');
+    va_start(args, format);
+    vsnprintf(&big[0], big.size(), format, args);
+    va_end(args);
+    return write((const uint8_t*)big.data(), len);
+  }
+};
+
+// Serial output is dropped unless fake::serialEcho is set; nothing is ever
+// received
+class HardwareSerial : public Print {
+public:
+  void begin(unsigned long baud) { (void)baud; }
+  void end() {}
+  int available() { return 0; }
+  int read() { return -1; }
+  void flush() {}
+  operator bool() const { return true; }
+
+  size_t write(uint8_t c) override;
+  size_t write(const uint8_t* buffer, size_t size) override;
+  using Print::write;
+};
+extern HardwareSerial Serial;
+
+class EspClass {
+public:
+  // Cycles at the fake's 160 MHz clock
+  uint32_t getCycleCount();
+  uint32_t getFreeHeap();
+  void restart();
+};
+extern EspClass ESP;
+
+#endif
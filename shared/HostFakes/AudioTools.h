@@ -0,0 +1,43 @@
+#ifndef HOST_FAKES_AUDIO_TOOLS_H
+#define HOST_FAKES_AUDIO_TOOLS_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// audio-tools' I2SStream in receive mode, fed from fake::setI2sSource() or a
+// replayed recording (fake::replayRaw()) at the configured sample rate
+enum RxTxMode { UNDEFINED_MODE = 0, TX_MODE, RX_MODE, RXTX_MODE };
+enum I2SFormat { I2S_STD_FORMAT, I2S_LSB_FORMAT, I2S_MSB_FORMAT, I2S_PHILIPS_FORMAT };
+
+struct I2SConfig {
+  RxTxMode rx_tx_mode = RX_MODE;
+  int sample_rate = 44100;
+  int bits_per_sample = 16;
+  int channels = 2;
+  I2SFormat i2s_format = I2S_STD_FORMAT;
+  int pin_bck = -1;
+  int pin_ws = -1;
+  int pin_data = -1;
+  bool use_apll = false;
+  bool auto_clear = true;
+};
+
+class I2SStream {
+public:
+  I2SConfig defaultConfig(RxTxMode mode) {
+    I2SConfig config;
+    config.rx_tx_mode = mode;
+    return config;
+  }
+  bool begin(I2SConfig config);
+  void end() {}
+
+  // Blocks until the samples would have arrived, like a DMA read. Words are
+  // left-justified (sample << 16) for 32-bit configs.
+  size_t readBytes(uint8_t* data, size_t len);
+
+private:
+  I2SConfig cfg;
+};
+
+#endif
@@ -0,0 +1,7 @@
+#ifndef HOST_FAKES_HTTP_CLIENT_H
+#define HOST_FAKES_HTTP_CLIENT_H
+
+// stt-mic speaks HTTP over WiFiClient itself; only the include is needed
+#include "WiFi.h"
+
+#endif
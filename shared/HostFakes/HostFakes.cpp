@@ -0,0 +1,1051 @@
+#include "HostFakes.h"
+
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <random>
+#include <strings.h>
+#include <thread>
+
+#include "Adafruit_TinyUSB.h"
+#include "Arduino.h"
+#include "AudioTools.h"
+#include "WiFi.h"
+#include "esp_heap_caps.h"
+#include "esp_now.h"
+#include "esp_pm.h"
+#include "esp_sleep.h"
+#include "esp_wifi.h"
+
+// Only esp-keyboard defines it
+extern "C" void tud_hid_report_complete_cb(uint8_t instance, uint8_t const* report, uint16_t len)
+    __attribute__((weak));
+
+using Clock = std::chrono::steady_clock;
+
+// Locks and condition variables are allocated once and never destroyed: the
+// fake tasks, radio and USB host are detached threads still blocked on them
+// when the test program exits.
+namespace {
+
+const Clock::time_point bootTime = Clock::now();
+
+uint64_t nowMicros() {
+  return std::chrono::duration_cast<std::chrono::microseconds>(Clock::now() - bootTime).count();
+}
+
+std::mutex& randomMutex = *new std::mutex();
+std::mt19937 randomEngine(1);
+
+float chance() {
+  std::lock_guard<std::mutex> lock(randomMutex);
+  return std::uniform_real_distribution<float>(0, 1)(randomEngine);
+}
+
+uint32_t randomWord() {
+  std::lock_guard<std::mutex> lock(randomMutex);
+  return randomEngine();
+}
+
+}  // namespace
+
+// -------------------- TIME --------------------
+unsigned long millis() { return (unsigned long)(nowMicros() / 1000); }
+unsigned long micros() { return (unsigned long)nowMicros(); }
+void delay(uint32_t ms) { std::this_thread::sleep_for(std::chrono::milliseconds(ms)); }
+void delayMicroseconds(uint32_t us) { std::this_thread::sleep_for(std::chrono::microseconds(us)); }
+
+uint32_t getCpuFrequencyMhz() { return 160; }
+uint32_t esp_random() { return randomWord(); }
+
+#if defined(__GLIBC__) && !(__GLIBC__ > 2 || (__GLIBC__ == 2 && __GLIBC_MINOR__ >= 38))
+size_t strlcpy(char* dst, const char* src, size_t size) {
+  size_t len = strlen(src);
+  if (size > 0) {
+    size_t n = len < size - 1 ? len : size - 1;
+    memcpy(dst, src, n);
+    dst[n] = '\0';
+  }
+  return len;
+}
+
+size_t strlcat(char* dst, const char* src, size_t size) {
+  size_t used = strnlen(dst, size);
+  if (used == size) return size + strlen(src);
+  return used + strlcpy(dst + used, src, size - used);
+}
+#endif
+
+HardwareSerial Serial;
+EspClass ESP;
+
+size_t HardwareSerial::write(uint8_t c) { return write(&c, 1); }
+
+size_t HardwareSerial::write(const uint8_t* buffer, size_t size) {
+  if (fake::serialEcho) fwrite(buffer, 1, size, stdout);
+  return size;
+}
+
+uint32_t EspClass::getCycleCount() { return (uint32_t)(nowMicros() * 160); }
+uint32_t EspClass::getFreeHeap() { return 200000; }
+void EspClass::restart() { abort(); }
+
+// -------------------- TASKS --------------------
+struct FakeTask {
+  std::mutex mutex;
+  std::condition_variable cv;
+  uint32_t notifications = 0;
+};
+
+struct FakeQueue {
+  std::mutex mutex;
+  std::condition_variable cv;
+  size_t length;
+  size_t itemSize;
+  std::deque<std::vector<uint8_t>> items;
+};
+
+static thread_local FakeTask* currentTask = nullptr;
+
+template <typename Predicate>
+static bool waitTicks(std::condition_variable& cv, std::unique_lock<std::mutex>& lock,
+                      TickType_t ticks, Predicate ready) {
+  if (ticks == portMAX_DELAY) {
+    cv.wait(lock, ready);
+    return true;
+  }
+  return cv.wait_for(lock, std::chrono::milliseconds(ticks), ready);
+}
+
+BaseType_t xTaskCreate(TaskFunction_t fn, const char* name, uint32_t stackDepth, void* param,
+                       UBaseType_t priority, TaskHandle_t* created) {
+  (void)name;
+  (void)stackDepth;
+  (void)priority;
+  // Tasks run forever; the handle is never freed
+  FakeTask* task = new FakeTask();
+  std::thread([task, fn, param] {
+    currentTask = task;
+    fn(param);
+  }).detach();
+  if (created) *created = task;
+  return pdPASS;
+}
+
+BaseType_t xTaskCreatePinnedToCore(TaskFunction_t fn, const char* name, uint32_t stackDepth,
+                                   void* param, UBaseType_t priority, TaskHandle_t* created,
+                                   BaseType_t core) {
+  (void)core;
+  return xTaskCreate(fn, name, stackDepth, param, priority, created);
+}
+
+TaskHandle_t xTaskGetCurrentTaskHandle() {
+  if (!currentTask) currentTask = new FakeTask();
+  return currentTask;
+}
+
+void vTaskDelay(TickType_t ticks) { std::this_thread::sleep_for(std::chrono::milliseconds(ticks)); }
+
+uint32_t ulTaskNotifyTake(BaseType_t clearOnExit, TickType_t ticks) {
+  FakeTask* task = xTaskGetCurrentTaskHandle();
+  std::unique_lock<std::mutex> lock(task->mutex);
+  waitTicks(task->cv, lock, ticks, [task] { return task->notifications > 0; });
+  uint32_t value = task->notifications;
+  if (value > 0) task->notifications = clearOnExit ? 0 : value - 1;
+  return value;
+}
+
+BaseType_t xTaskNotifyGive(TaskHandle_t task) {
+  if (!task) return pdFAIL;
+  std::lock_guard<std::mutex> lock(task->mutex);
+  task->notifications++;
+  task->cv.notify_all();
+  return pdPASS;
+}
+
+void vTaskNotifyGiveFromISR(TaskHandle_t task, BaseType_t* higherPriorityTaskWoken) {
+  xTaskNotifyGive(task);
+  if (higherPriorityTaskWoken) *higherPriorityTaskWoken = pdTRUE;
+}
+
+QueueHandle_t xQueueCreate(UBaseType_t length, UBaseType_t itemSize) {
+  FakeQueue* queue = new FakeQueue();
+  queue->length = length;
+  queue->itemSize = itemSize;
+  return queue;
+}
+
+BaseType_t xQueueSend(QueueHandle_t queue, const void* item, TickType_t ticks) {
+  std::unique_lock<std::mutex> lock(queue->mutex);
+  if (!waitTicks(queue->cv, lock, ticks, [queue] { return queue->items.size() < queue->length; })) {
+    return pdFAIL;
+  }
+  const uint8_t* bytes = (const uint8_t*)item;
+  queue->items.emplace_back(bytes, bytes + queue->itemSize);
+  queue->cv.notify_all();
+  return pdPASS;
+}
+
+BaseType_t xQueueReceive(QueueHandle_t queue, void* item, TickType_t ticks) {
+  std::unique_lock<std::mutex> lock(queue->mutex);
+  if (!waitTicks(queue->cv, lock, ticks, [queue] { return !queue->items.empty(); })) {
+    return pdFAIL;
+  }
+  memcpy(item, queue->items.front().data(), queue->itemSize);
+  queue->items.pop_front();
+  queue->cv.notify_all();
+  return pdPASS;
+}
+
+UBaseType_t uxQueueMessagesWaiting(QueueHandle_t queue) {
+  std::lock_guard<std::mutex> lock(queue->mutex);
+  return (UBaseType_t)queue->items.size();
+}
+
+// -------------------- GPIO --------------------
+namespace {
+
+const size_t PIN_COUNT = 64;
+
+std::mutex& gpioMutex = *new std::mutex();
+int pinLevels[PIN_COUNT] = {};
+bool pinLevelsSet = false;
+void (*pinHandlers[PIN_COUNT])() = {};
+int pinModes[PIN_COUNT] = {};
+bool pinInterruptEnabled[PIN_COUNT] = {};
+
+// Pins idle high: the sketches use pull-ups and active-low buttons
+void initPinLevels() {
+  if (pinLevelsSet) return;
+  for (size_t i = 0; i < PIN_COUNT; i++) pinLevels[i] = HIGH;
+  pinLevelsSet = true;
+}
+
+bool triggers(int mode, int before, int after) {
+  switch (mode) {
+    case ONLOW:
+      return after == LOW;
+    case ONHIGH:
+      return after == HIGH;
+    case FALLING:
+      return before == HIGH && after == LOW;
+    case RISING:
+      return before == LOW && after == HIGH;
+    case CHANGE:
+      return before != after;
+    default:
+      return false;
+  }
+}
+
+// Called without gpioMutex held: the handler may disable its own interrupt
+void (*armedHandler(uint8_t pin, int before, int after))() {
+  if (pin >= PIN_COUNT || !pinInterruptEnabled[pin] || !pinHandlers[pin]) return nullptr;
+  return triggers(pinModes[pin], before, after) ? pinHandlers[pin] : nullptr;
+}
+
+}  // namespace
+
+void pinMode(uint8_t pin, uint8_t mode) {
+  (void)pin;
+  (void)mode;
+}
+
+int digitalRead(uint8_t pin) {
+  std::lock_guard<std::mutex> lock(gpioMutex);
+  initPinLevels();
+  return pin < PIN_COUNT ? pinLevels[pin] : LOW;
+}
+
+void digitalWrite(uint8_t pin, uint8_t level) {
+  std::lock_guard<std::mutex> lock(gpioMutex);
+  initPinLevels();
+  if (pin < PIN_COUNT) pinLevels[pin] = level;
+}
+
+void attachInterrupt(uint8_t pin, void (*handler)(), int mode) {
+  void (*fire)() = nullptr;
+  {
+    std::lock_guard<std::mutex> lock(gpioMutex);
+    initPinLevels();
+    if (pin >= PIN_COUNT) return;
+    pinHandlers[pin] = handler;
+    pinModes[pin] = mode;
+    pinInterruptEnabled[pin] = true;
+    fire = armedHandler(pin, pinLevels[pin], pinLevels[pin]);
+  }
+  if (fire && (mode == ONLOW || mode == ONHIGH)) fire();
+}
+
+void detachInterrupt(uint8_t pin) {
+  std::lock_guard<std::mutex> lock(gpioMutex);
+  if (pin < PIN_COUNT) pinHandlers[pin] = nullptr;
+}
+
+esp_err_t gpio_intr_enable(gpio_num_t pin) {
+  void (*fire)() = nullptr;
+  {
+    std::lock_guard<std::mutex> lock(gpioMutex);
+    initPinLevels();
+    if (pin < 0 || (size_t)pin >= PIN_COUNT) return ESP_ERR_INVALID_ARG;
+    pinInterruptEnabled[pin] = true;
+    // Level-triggered: an already active pin interrupts straight away
+    if (pinModes[pin] == ONLOW || pinModes[pin] == ONHIGH) {
+      fire = armedHandler(pin, pinLevels[pin], pinLevels[pin]);
+    }
+  }
+  if (fire) fire();
+  return ESP_OK;
+}
+
+esp_err_t gpio_intr_disable(gpio_num_t pin) {
+  std::lock_guard<std::mutex> lock(gpioMutex);
+  if (pin < 0 || (size_t)pin >= PIN_COUNT) return ESP_ERR_INVALID_ARG;
+  pinInterruptEnabled[pin] = false;
+  return ESP_OK;
+}
+
+esp_err_t gpio_set_intr_type(gpio_num_t pin, gpio_int_type_t type) {
+  static const int modes[] = {0, RISING, FALLING, CHANGE, ONLOW, ONHIGH};
+  std::lock_guard<std::mutex> lock(gpioMutex);
+  if (pin < 0 || (size_t)pin >= PIN_COUNT) return ESP_ERR_INVALID_ARG;
+  pinModes[pin] = modes[type];
+  return ESP_OK;
+}
+
+esp_err_t gpio_wakeup_enable(gpio_num_t, gpio_int_type_t) { return ESP_OK; }
+esp_err_t gpio_wakeup_disable(gpio_num_t) { return ESP_OK; }
+esp_err_t gpio_hold_en(gpio_num_t) { return ESP_OK; }
+esp_err_t gpio_hold_dis(gpio_num_t) { return ESP_OK; }
+void gpio_deep_sleep_hold_en() {}
+void gpio_deep_sleep_hold_dis() {}
+
+// -------------------- POWER AND MEMORY --------------------
+esp_sleep_wakeup_cause_t esp_sleep_get_wakeup_cause() { return fake::wakeupCause; }
+esp_err_t esp_deep_sleep_enable_gpio_wakeup(uint64_t, esp_deepsleep_gpio_wake_up_mode_t) {
+  return ESP_OK;
+}
+esp_err_t esp_sleep_enable_gpio_wakeup() { return ESP_OK; }
+void esp_deep_sleep_start() { fake::deepSleeps++; }
+
+esp_err_t esp_pm_configure(const void* config) {
+  const esp_pm_config_t* pm = (const esp_pm_config_t*)config;
+  if (pm->light_sleep_enable && !fake::lightSleepSupported) return ESP_ERR_NOT_SUPPORTED;
+  return ESP_OK;
+}
+
+void* heap_caps_malloc(size_t size, uint32_t caps) {
+  if ((caps & MALLOC_CAP_SPIRAM) && !fake::psram) return nullptr;
+  return malloc(size);
+}
+size_t heap_caps_get_free_size(uint32_t) { return 200000; }
+size_t heap_caps_get_minimum_free_size(uint32_t) { return 180000; }
+size_t heap_caps_get_largest_free_block(uint32_t) { return 110000; }
+
+// -------------------- WIFI --------------------
+WiFiClass WiFi;
+
+namespace {
+
+std::atomic<wl_status_t> wifiStatus{WL_DISCONNECTED};
+uint8_t fakeBssid[6] = {0x02, 0x00, 0x00, 0x00, 0x00, 0xAA};
+
+}  // namespace
+
+bool WiFiClass::mode(wifi_mode_t mode) {
+  (void)mode;
+  return true;
+}
+
+bool WiFiClass::config(IPAddress local, IPAddress, IPAddress, IPAddress) {
+  fake::wifiStaticIp = local;
+  return true;
+}
+
+wl_status_t WiFiClass::begin(const char* ssid, const char* passphrase, int32_t channel,
+                             const uint8_t* bssid) {
+  (void)ssid;
+  (void)passphrase;
+  (void)channel;
+  (void)bssid;
+  wifiStatus = fake::wifiAvailable ? WL_CONNECTED : WL_DISCONNECTED;
+  return wifiStatus;
+}
+
+bool WiFiClass::disconnect(bool wifiOff) {
+  (void)wifiOff;
+  wifiStatus = WL_DISCONNECTED;
+  return true;
+}
+
+wl_status_t WiFiClass::status() { return wifiStatus; }
+bool WiFiClass::setSleep(wifi_ps_type_t type) {
+  (void)type;
+  return true;
+}
+uint8_t* WiFiClass::BSSID() { return fakeBssid; }
+int32_t WiFiClass::channel() { return fake::wifiChannel; }
+IPAddress WiFiClass::localIP() { return IPAddress(192, 168, 1, 50); }
+IPAddress WiFiClass::gatewayIP() { return IPAddress(192, 168, 1, 1); }
+IPAddress WiFiClass::subnetMask() { return IPAddress(255, 255, 255, 0); }
+IPAddress WiFiClass::dnsIP(uint8_t) { return IPAddress(192, 168, 1, 1); }
+String WiFiClass::macAddress() { return String("02:00:00:00:00:02"); }
+int16_t WiFiClass::scanNetworks() { return fake::wifiAvailable ? 1 : 0; }
+String WiFiClass::SSID(uint8_t) { return String("fake-ssid"); }
+int32_t WiFiClass::channel(uint8_t) { return fake::wifiChannel; }
+void WiFiClass::scanDelete() {}
+
+esp_err_t esp_wifi_get_channel(uint8_t* primary, wifi_second_chan_t* second) {
+  *primary = fake::wifiChannel;
+  *second = WIFI_SECOND_CHAN_NONE;
+  return ESP_OK;
+}
+
+esp_err_t esp_wifi_set_channel(uint8_t primary, wifi_second_chan_t second) {
+  (void)second;
+  fake::wifiChannel = primary;
+  return ESP_OK;
+}
+
+// -------------------- TCP / HTTP SERVER --------------------
+namespace fake {
+
+// Server side of one connection: parses requests as the client writes them
+// and queues each reply to become readable after the link latency
+struct Connection {
+  enum Phase { HEAD, CHUNK_SIZE, CHUNK_DATA, CHUNK_END, TRAILER };
+
+  int id = 0;
+  bool open = true;
+  bool closeAfterReply = false;
+
+  Phase phase = HEAD;
+  std::string line;
+  size_t chunkLeft = 0;
+  HttpRequest request;
+
+  std::deque<std::pair<uint64_t, std::string>> replies;  // due time in us, bytes
+  std::string rx;
+};
+
+}  // namespace fake
+
+namespace {
+
+std::mutex& netMutex = *new std::mutex();
+fake::HttpHandler httpHandler;
+std::vector<fake::HttpRequest> completedRequests;
+std::vector<std::weak_ptr<fake::Connection>> liveConnections;
+int connectCount = 0;
+
+bool headerSays(const std::string& headers, const char* name, const char* value) {
+  fake::HttpRequest probe;
+  probe.headers = headers;
+  return strcasecmp(probe.header(name).c_str(), value) == 0;
+}
+
+// Moves replies whose time has come into the receive buffer. Caller holds
+// netMutex.
+void deliverReplies(fake::Connection& conn) {
+  uint64_t now = nowMicros();
+  while (!conn.replies.empty() && conn.replies.front().first <= now) {
+    conn.rx += conn.replies.front().second;
+    conn.replies.pop_front();
+  }
+  if (conn.closeAfterReply && conn.replies.empty()) conn.open = false;
+}
+
+// Returns true when data completed a request. Caller holds netMutex.
+bool parseRequest(fake::Connection& conn, const uint8_t* data, size_t len) {
+  for (size_t i = 0; i < len;) {
+    char c = (char)data[i];
+    switch (conn.phase) {
+      case fake::Connection::HEAD:
+        if (conn.request.headers.empty()) {
+          conn.request = fake::HttpRequest();
+          conn.request.connection = conn.id;
+          conn.request.startMs = millis();
+        }
+        conn.request.headers += c;
+        i++;
+        if (conn.request.headers.size() >= 4 &&
+            conn.request.headers.compare(conn.request.headers.size() - 4, 4, "\r\n\r\n") == 0) {
+          const std::string& h = conn.request.headers;
+          size_t sp1 = h.find(' ');
+          size_t sp2 = h.find(' ', sp1 + 1);
+          conn.request.method = h.substr(0, sp1);
+          conn.request.path = h.substr(sp1 + 1, sp2 - sp1 - 1);
+          if (headerSays(h, "Transfer-Encoding", "chunked")) {
+            conn.phase = fake::Connection::CHUNK_SIZE;
+          } else {
+            return i == len;
+          }
+        }
+        break;
+
+      case fake::Connection::CHUNK_SIZE:
+      case fake::Connection::TRAILER:
+      case fake::Connection::CHUNK_END:
+        conn.line += c;
+        i++;
+        if (conn.line.size() >= 2 && conn.line.compare(conn.line.size() - 2, 2, "\r\n") == 0) {
+          if (conn.phase == fake::Connection::CHUNK_SIZE) {
+            size_t size = strtoul(conn.line.c_str(), nullptr, 16);
+            if (size == 0) {
+              conn.phase = fake::Connection::TRAILER;
+            } else {
+              conn.request.chunks.push_back(size);
+              conn.chunkLeft = size;
+              conn.phase = fake::Connection::CHUNK_DATA;
+            }
+          } else if (conn.phase == fake::Connection::CHUNK_END) {
+            conn.phase = fake::Connection::CHUNK_SIZE;
+          } else if (conn.line == "\r\n") {
+            conn.line.clear();
+            return true;
+          }
+          conn.line.clear();
+        }
+        break;
+
+      case fake::Connection::CHUNK_DATA: {
+        size_t n = len - i < conn.chunkLeft ? len - i : conn.chunkLeft;
+        conn.request.body.append((const char*)data + i, n);
+        conn.chunkLeft -= n;
+        i += n;
+        if (conn.chunkLeft == 0) conn.phase = fake::Connection::CHUNK_END;
+        break;
+      }
+    }
+  }
+  return false;
+}
+
+std::string defaultHandler(const fake::HttpRequest&) {
+  return fake::httpResponse(200, "{\"text\":\"\"}");
+}
+
+}  // namespace
+
+int WiFiClient::connect(const char* host, uint16_t port) {
+  (void)host;
+  (void)port;
+  stop();
+  if (wifiStatus != WL_CONNECTED) return 0;
+  delay(2 * fake::tcpLink.latencyMs);  // SYN, SYN-ACK
+
+  std::lock_guard<std::mutex> lock(netMutex);
+  conn = std::make_shared<fake::Connection>();
+  conn->id = ++connectCount;
+  liveConnections.push_back(conn);
+  return 1;
+}
+
+size_t WiFiClient::write(const uint8_t* buffer, size_t size) {
+  {
+    std::lock_guard<std::mutex> lock(netMutex);
+    if (!conn || !conn->open) return 0;
+  }
+
+  // A full socket buffer blocks the writer at the link rate
+  fake::TcpLink link = fake::tcpLink;
+  if (link.bytesPerSecond > 0) {
+    delayMicroseconds((uint32_t)((uint64_t)size * 1000000 / link.bytesPerSecond));
+  }
+  if (link.lossRate > 0 && chance() < link.lossRate) {
+    delay(link.retransmitMs);
+  }
+
+  std::unique_lock<std::mutex> lock(netMutex);
+  if (!conn || !conn->open) return 0;
+  if (!parseRequest(*conn, buffer, size)) return size;
+
+  fake::HttpRequest request = conn->request;
+  request.endMs = millis();
+  conn->request.headers.clear();
+  conn->phase = fake::Connection::HEAD;
+  completedRequests.push_back(request);
+  fake::HttpHandler handler = httpHandler ? httpHandler : defaultHandler;
+  std::shared_ptr<fake::Connection> server = conn;
+  lock.unlock();
+
+  std::string reply = handler(request);
+
+  lock.lock();
+  uint64_t due = nowMicros() + (uint64_t)(2 * link.latencyMs + link.serverMs) * 1000;
+  server->replies.emplace_back(due, reply);
+  size_t headEnd = reply.find("\r\n\r\n");
+  if (headerSays(request.headers, "Connection", "close") ||
+      headerSays(reply.substr(0, headEnd), "Connection", "close")) {
+    server->closeAfterReply = true;
+  }
+  return size;
+}
+
+int WiFiClient::available() {
+  std::lock_guard<std::mutex> lock(netMutex);
+  if (!conn) return 0;
+  deliverReplies(*conn);
+  return (int)conn->rx.size();
+}
+
+int WiFiClient::read(uint8_t* buffer, size_t size) {
+  std::lock_guard<std::mutex> lock(netMutex);
+  if (!conn) return -1;
+  deliverReplies(*conn);
+  if (conn->rx.empty()) return -1;
+  size_t n = size < conn->rx.size() ? size : conn->rx.size();
+  memcpy(buffer, conn->rx.data(), n);
+  conn->rx.erase(0, n);
+  return (int)n;
+}
+
+int WiFiClient::read() {
+  uint8_t c;
+  return read(&c, 1) == 1 ? c : -1;
+}
+
+// Like lwIP: still "connected" while unread data is left after a close
+uint8_t WiFiClient::connected() {
+  std::lock_guard<std::mutex> lock(netMutex);
+  if (!conn) return 0;
+  deliverReplies(*conn);
+  return conn->open || !conn->rx.empty() || !conn->replies.empty();
+}
+
+void WiFiClient::stop() {
+  std::lock_guard<std::mutex> lock(netMutex);
+  if (conn) conn->open = false;
+  conn.reset();
+}
+
+namespace fake {
+
+std::string HttpRequest::header(const char* name) const {
+  size_t nameLen = strlen(name);
+  size_t pos = headers.find("\r\n");
+  while (pos != std::string::npos && pos + 2 < headers.size()) {
+    size_t start = pos + 2;
+    size_t end = headers.find("\r\n", start);
+    if (end == std::string::npos) break;
+    if (end - start > nameLen && headers[start + nameLen] == ':' &&
+        strncasecmp(headers.c_str() + start, name, nameLen) == 0) {
+      size_t value = start + nameLen + 1;
+      while (value < end && headers[value] == ' ') value++;
+      return headers.substr(value, end - value);
+    }
+    pos = end;
+  }
+  return "";
+}
+
+void setHttpHandler(HttpHandler handler) {
+  std::lock_guard<std::mutex> lock(netMutex);
+  httpHandler = handler;
+}
+
+std::string httpResponse(int status, const std::string& body, const char* contentType,
+                         bool keepAlive) {
+  char head[256];
+  snprintf(head, sizeof(head),
+           "HTTP/1.1 %d %s\r\nContent-Type: %s\r\nContent-Length: %u\r\nConnection: %s\r\n\r\n",
+           status, status == 200 ? "OK" : "Error", contentType, (unsigned)body.size(),
+           keepAlive ? "keep-alive" : "close");
+  return head + body;
+}
+
+std::vector<HttpRequest> httpRequests() {
+  std::lock_guard<std::mutex> lock(netMutex);
+  return completedRequests;
+}
+
+int tcpConnects() {
+  std::lock_guard<std::mutex> lock(netMutex);
+  return connectCount;
+}
+
+void dropConnections() {
+  std::lock_guard<std::mutex> lock(netMutex);
+  for (std::weak_ptr<Connection>& weak : liveConnections) {
+    if (std::shared_ptr<Connection> conn = weak.lock()) {
+      conn->open = false;
+      conn->replies.clear();
+      conn->rx.clear();
+    }
+  }
+  liveConnections.clear();
+}
+
+}  // namespace fake
+
+// -------------------- ESP-NOW --------------------
+namespace {
+
+struct AirFrame {
+  uint8_t mac[ESP_NOW_ETH_ALEN];
+  std::vector<uint8_t> data;
+  Clock::time_point due;
+};
+
+std::mutex& radioMutex = *new std::mutex();
+std::condition_variable& radioCv = *new std::condition_variable();
+std::deque<AirFrame> air;
+Clock::time_point airFreeAt;
+size_t framesInFlight = 0;
+bool radioStarted = false;
+bool espNowStarted = false;
+esp_now_send_cb_t espNowSendCb = nullptr;
+esp_now_recv_cb_t espNowRecvCb = nullptr;
+fake::EspNowPeer espNowPeer;
+fake::EspNowStats espNowCounters;
+
+// Puts frames on the air one at a time and reports each status in order
+void radioTask() {
+  std::unique_lock<std::mutex> lock(radioMutex);
+  for (;;) {
+    radioCv.wait(lock, [] { return !air.empty(); });
+    Clock::time_point due = air.front().due;
+    radioCv.wait_until(lock, due, [due] { return Clock::now() >= due; });
+    AirFrame frame = air.front();
+    air.pop_front();
+    fake::EspNowLink link = fake::espNowLink;
+    fake::EspNowPeer peer = espNowPeer;
+    esp_now_send_cb_t sendCb = espNowSendCb;
+    lock.unlock();
+
+    bool lost = chance() < link.lossRate;
+    bool ackLost = !lost && chance() < link.ackLossRate;
+    if (!lost && peer) peer(frame.data.data(), frame.data.size());
+    if (sendCb) sendCb(frame.mac, lost || ackLost ? ESP_NOW_SEND_FAIL : ESP_NOW_SEND_SUCCESS);
+
+    lock.lock();
+    if (lost) espNowCounters.lost++;
+    if (ackLost) espNowCounters.acksLost++;
+    framesInFlight--;
+  }
+}
+
+}  // namespace
+
+esp_err_t esp_now_init() {
+  std::lock_guard<std::mutex> lock(radioMutex);
+  espNowStarted = true;
+  if (!radioStarted) {
+    radioStarted = true;
+    std::thread(radioTask).detach();
+  }
+  return ESP_OK;
+}
+
+esp_err_t esp_now_deinit() {
+  std::lock_guard<std::mutex> lock(radioMutex);
+  espNowStarted = false;
+  return ESP_OK;
+}
+
+esp_err_t esp_now_register_send_cb(esp_now_send_cb_t cb) {
+  std::lock_guard<std::mutex> lock(radioMutex);
+  espNowSendCb = cb;
+  return ESP_OK;
+}
+
+esp_err_t esp_now_register_recv_cb(esp_now_recv_cb_t cb) {
+  std::lock_guard<std::mutex> lock(radioMutex);
+  espNowRecvCb = cb;
+  return ESP_OK;
+}
+
+esp_err_t esp_now_add_peer(const esp_now_peer_info_t* peer) {
+  return peer ? ESP_OK : ESP_ERR_ESPNOW_ARG;
+}
+
+esp_err_t esp_now_send(const uint8_t* peerAddr, const uint8_t* data, size_t len) {
+  std::lock_guard<std::mutex> lock(radioMutex);
+  if (!espNowStarted) return ESP_ERR_ESPNOW_NOT_INIT;
+  if (len == 0 || len > ESP_NOW_MAX_DATA_LEN) return ESP_ERR_ESPNOW_ARG;
+  if (framesInFlight >= fake::espNowLink.queueFrames) {
+    espNowCounters.busy++;
+    return ESP_ERR_ESPNOW_NO_MEM;
+  }
+
+  AirFrame frame;
+  memcpy(frame.mac, peerAddr, ESP_NOW_ETH_ALEN);
+  frame.data.assign(data, data + len);
+  Clock::time_point now = Clock::now();
+  frame.due = (airFreeAt > now ? airFreeAt : now) +
+              std::chrono::microseconds(fake::espNowLink.latencyUs);
+  airFreeAt = frame.due;
+  air.push_back(frame);
+  framesInFlight++;
+  espNowCounters.sent++;
+  radioCv.notify_all();
+  return ESP_OK;
+}
+
+// -------------------- I2S --------------------
+namespace {
+
+std::mutex& i2sMutex = *new std::mutex();
+fake::SampleSource i2sSource;
+std::vector<int16_t> i2sRecording;
+uint64_t i2sPosition = 0;
+Clock::time_point i2sNextDue;
+bool i2sRunning = false;
+
+// DMA buffers the driver keeps; older audio is gone by the time a late
+// reader gets there
+const auto DMA_WINDOW = std::chrono::milliseconds(32);
+
+}  // namespace
+
+bool I2SStream::begin(I2SConfig config) {
+  std::lock_guard<std::mutex> lock(i2sMutex);
+  cfg = config;
+  i2sRunning = false;
+  return true;
+}
+
+size_t I2SStream::readBytes(uint8_t* data, size_t len) {
+  size_t wordSize = cfg.bits_per_sample / 8;
+  size_t words = len / wordSize;
+  if (words == 0) return 0;
+  if (fake::i2sShortReads) words = 1 + randomWord() % words;
+
+  Clock::time_point due;
+  uint64_t first;
+  {
+    std::lock_guard<std::mutex> lock(i2sMutex);
+    Clock::time_point now = Clock::now();
+    if (!i2sRunning || i2sNextDue + DMA_WINDOW < now) {
+      i2sNextDue = now;
+      i2sRunning = true;
+    }
+    i2sNextDue += std::chrono::microseconds((uint64_t)words * 1000000 / cfg.sample_rate);
+    due = i2sNextDue;
+    first = i2sPosition;
+    i2sPosition += words;
+  }
+  std::this_thread::sleep_until(due);
+
+  std::lock_guard<std::mutex> lock(i2sMutex);
+  for (size_t i = 0; i < words; i++) {
+    uint64_t n = first + i;
+    int16_t sample = 0;
+    if (i2sSource) {
+      sample = i2sSource(n);
+    } else if (n < i2sRecording.size()) {
+      sample = i2sRecording[n];
+    }
+    if (wordSize == 4) {
+      ((int32_t*)data)[i] = (int32_t)((uint32_t)(uint16_t)sample << 16);
+    } else {
+      ((int16_t*)data)[i] = sample;
+    }
+  }
+  return words * wordSize;
+}
+
+// -------------------- USB HID --------------------
+Adafruit_USBD_Device TinyUSBDevice;
+
+namespace {
+
+std::mutex& usbMutex = *new std::mutex();
+std::condition_variable& usbCv = *new std::condition_variable();
+bool usbBusy = false;
+bool usbHostStarted = false;
+fake::HidReport usbPending;
+std::vector<fake::HidReport> usbReports;
+
+// Takes the pending report at the next poll and reports its completion
+void usbHostTask() {
+  std::unique_lock<std::mutex> lock(usbMutex);
+  for (;;) {
+    usbCv.wait(lock, [] { return usbBusy; });
+    uint32_t pollUs = fake::usbHost.pollUs ? fake::usbHost.pollUs : 1;
+    lock.unlock();
+    delayMicroseconds(pollUs - (uint32_t)(nowMicros() % pollUs));
+
+    lock.lock();
+    fake::HidReport report = usbPending;
+    report.takenMicros = micros();
+    usbReports.push_back(report);
+    bool dropped = chance() < fake::usbHost.dropRate;
+    usbBusy = false;
+    lock.unlock();
+
+    if (!dropped && tud_hid_report_complete_cb) {
+      uint8_t raw[8] = {report.modifier, 0};
+      memcpy(raw + 2, report.keys, 6);
+      tud_hid_report_complete_cb(0, raw, sizeof(raw));
+    }
+    lock.lock();
+  }
+}
+
+}  // namespace
+
+bool Adafruit_USBD_Device::mounted() { return fake::usbHost.mounted; }
+bool Adafruit_USBD_Device::suspended() { return fake::usbHost.suspended; }
+bool Adafruit_USBD_Device::remoteWakeup() {
+  fake::usbHost.suspended = false;
+  return true;
+}
+
+bool Adafruit_USBD_HID::ready() {
+  std::lock_guard<std::mutex> lock(usbMutex);
+  return fake::usbHost.mounted && !usbBusy;
+}
+
+bool Adafruit_USBD_HID::keyboardReport(uint8_t reportId, uint8_t modifier, uint8_t keycode[6]) {
+  (void)reportId;
+  std::lock_guard<std::mutex> lock(usbMutex);
+  if (usbBusy) return false;
+  usbPending.modifier = modifier;
+  memcpy(usbPending.keys, keycode, 6);
+  usbPending.submitMicros = micros();
+  usbBusy = true;
+  if (!usbHostStarted) {
+    usbHostStarted = true;
+    std::thread(usbHostTask).detach();
+  }
+  usbCv.notify_all();
+  return true;
+}
+
+// -------------------- CONTROLS --------------------
+namespace fake {
+
+std::atomic<bool> serialEcho{false};
+bool psram = false;
+bool lightSleepSupported = false;
+esp_sleep_wakeup_cause_t wakeupCause = ESP_SLEEP_WAKEUP_UNDEFINED;
+std::atomic<uint32_t> deepSleeps{0};
+std::atomic<bool> i2sShortReads{false};
+bool wifiAvailable = true;
+uint8_t wifiChannel = 6;
+uint32_t wifiStaticIp = 0;
+TcpLink tcpLink;
+EspNowLink espNowLink;
+UsbHost usbHost;
+
+void setPin(uint8_t pin, int level) {
+  void (*fire)() = nullptr;
+  {
+    std::lock_guard<std::mutex> lock(gpioMutex);
+    initPinLevels();
+    if (pin >= PIN_COUNT) return;
+    int before = pinLevels[pin];
+    pinLevels[pin] = level;
+    fire = armedHandler(pin, before, level);
+  }
+  if (fire) fire();
+}
+
+int pinLevel(uint8_t pin) { return digitalRead(pin); }
+
+bool waitFor(const std::function<bool()>& condition, uint32_t timeoutMs) {
+  unsigned long start = millis();
+  while (!condition()) {
+    if (millis() - start > timeoutMs) return false;
+    delay(1);
+  }
+  return true;
+}
+
+void seed(uint32_t value) {
+  std::lock_guard<std::mutex> lock(randomMutex);
+  randomEngine.seed(value);
+}
+
+void reset() {
+  seed(1);
+  {
+    std::lock_guard<std::mutex> lock(netMutex);
+    tcpLink = TcpLink();
+    httpHandler = nullptr;
+    completedRequests.clear();
+  }
+  {
+    std::lock_guard<std::mutex> lock(radioMutex);
+    espNowLink = EspNowLink();
+    espNowPeer = nullptr;
+    espNowCounters = EspNowStats();
+  }
+  {
+    std::lock_guard<std::mutex> lock(usbMutex);
+    usbHost = UsbHost();
+    usbReports.clear();
+  }
+  {
+    std::lock_guard<std::mutex> lock(i2sMutex);
+    i2sSource = nullptr;
+    i2sRecording.clear();
+    i2sPosition = 0;
+  }
+  i2sShortReads = false;
+  wifiAvailable = true;
+  wifiStaticIp = 0;
+}
+
+void setI2sSource(SampleSource source) {
+  std::lock_guard<std::mutex> lock(i2sMutex);
+  i2sSource = source;
+  i2sRecording.clear();
+  i2sPosition = 0;
+}
+
+bool replayRaw(const char* path) {
+  FILE* f = fopen(path, "rb");
+  if (!f) return false;
+  std::vector<int16_t> samples;
+  uint8_t pair[2];
+  while (fread(pair, 1, 2, f) == 2) {
+    samples.push_back((int16_t)(pair[0] | (pair[1] << 8)));
+  }
+  fclose(f);
+
+  std::lock_guard<std::mutex> lock(i2sMutex);
+  i2sSource = nullptr;
+  i2sRecording.swap(samples);
+  i2sPosition = 0;
+  return true;
+}
+
+uint64_t i2sSamplesRead() {
+  std::lock_guard<std::mutex> lock(i2sMutex);
+  return i2sPosition;
+}
+
+void setEspNowPeer(EspNowPeer peer) {
+  std::lock_guard<std::mutex> lock(radioMutex);
+  espNowPeer = peer;
+}
+
+void espNowReceive(const uint8_t* mac, const uint8_t* data, size_t len) {
+  esp_now_recv_cb_t cb;
+  {
+    std::lock_guard<std::mutex> lock(radioMutex);
+    cb = espNowRecvCb;
+  }
+  if (cb) cb(mac, data, (int)len);
+}
+
+EspNowStats espNowStats() {
+  std::lock_guard<std::mutex> lock(radioMutex);
+  return espNowCounters;
+}
+
+bool espNowIdle() {
+  std::lock_guard<std::mutex> lock(radioMutex);
+  return framesInFlight == 0;
+}
+
+std::vector<HidReport> hidReports() {
+  std::lock_guard<std::mutex> lock(usbMutex);
+  return usbReports;
+}
+
+}  // namespace fake
@@ -0,0 +1,141 @@
+#ifndef HOST_FAKES_H
+#define HOST_FAKES_H
+
+// Test-side controls for the fakes: what the button, microphone, network,
+// radio and USB host do while the sketch code runs on the host.
+//
+// Settings are plain data: change them while no traffic is in flight (in
+// setUp(), or before pressing the button). Everything the fakes record can
+// be read from any thread.
+
+#include <atomic>
+#include <functional>
+#include <stddef.h>
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+#include "esp_sleep.h"
+
+namespace fake {
+
+// -------------------- BOARD --------------------
+// Drives an input pin as if from outside, firing an attached interrupt
+void setPin(uint8_t pin, int level);
+// Last level written by the sketch or set by the test
+int pinLevel(uint8_t pin);
+
+extern std::atomic<bool> serialEcho;  // copy Serial output to stdout
+extern bool psram;                    // MALLOC_CAP_SPIRAM allocations succeed
+extern bool lightSleepSupported;      // esp_pm_configure() accepts light sleep
+extern esp_sleep_wakeup_cause_t wakeupCause;
+extern std::atomic<uint32_t> deepSleeps;
+
+// Polls condition every millisecond until it holds or timeoutMs passes
+bool waitFor(const std::function<bool()>& condition, uint32_t timeoutMs);
+
+// Seeds every random choice the fakes make (loss, short reads, ...)
+void seed(uint32_t value);
+
+// Link settings back to defaults, recordings and counters cleared
+void reset();
+
+// -------------------- MICROPHONE --------------------
+// Sample n of the signal on the I2S line (16-bit range)
+typedef std::function<int16_t(uint64_t n)> SampleSource;
+void setI2sSource(SampleSource source);
+// Replays a 16-bit little-endian mono recording (audio-*.raw), then silence
+bool replayRaw(const char* path);
+uint64_t i2sSamplesRead();
+// Return each read in a random number of words, as the DMA can near an
+// underrun
+extern std::atomic<bool> i2sShortReads;
+
+// -------------------- NETWORK --------------------
+extern bool wifiAvailable;
+extern uint8_t wifiChannel;
+// Address last set with WiFi.config(); 0 while DHCP is in use
+extern uint32_t wifiStaticIp;
+
+struct TcpLink {
+  uint32_t latencyMs = 0;       // one way
+  uint32_t bytesPerSecond = 0;  // 0 = unlimited; writes block to this rate
+  float lossRate = 0;           // chance a write waits out a retransmit
+  uint32_t retransmitMs = 200;
+  uint32_t serverMs = 0;        // request end to response start
+};
+extern TcpLink tcpLink;
+
+// One request the fake server received in full. The chunked body is
+// decoded; chunks holds the size of every chunk in order.
+struct HttpRequest {
+  int connection;  // 1 for the first connect(), and so on
+  std::string method;
+  std::string path;
+  std::string headers;  // raw header block, request line included
+  std::string body;
+  std::vector<size_t> chunks;
+  unsigned long startMs;
+  unsigned long endMs;
+
+  // Value of the named header, "" if absent (names compare case-insensitively)
+  std::string header(const char* name) const;
+};
+
+// Builds the server's reply. The connection stays open for the next request
+// unless the reply or the request says Connection: close.
+typedef std::function<std::string(const HttpRequest&)> HttpHandler;
+void setHttpHandler(HttpHandler handler);
+std::string httpResponse(int status, const std::string& body,
+                         const char* contentType = "application/json", bool keepAlive = false);
+
+std::vector<HttpRequest> httpRequests();
+int tcpConnects();
+// The server closes every open connection, as after an idle timeout
+void dropConnections();
+
+// -------------------- ESP-NOW --------------------
+struct EspNowLink {
+  uint32_t latencyUs = 300;  // air time per frame; frames go out one at a time
+  float lossRate = 0;        // frame never arrives, status FAIL
+  float ackLossRate = 0;     // frame arrives, but status FAIL
+  size_t queueFrames = 8;    // driver queue; esp_now_send() returns NO_MEM when full
+};
+extern EspNowLink espNowLink;
+
+struct EspNowStats {
+  uint32_t sent = 0;
+  uint32_t lost = 0;
+  uint32_t acksLost = 0;
+  uint32_t busy = 0;  // sends refused with ESP_ERR_ESPNOW_NO_MEM
+};
+
+// Receives every frame that arrives, on the radio thread
+typedef std::function<void(const uint8_t* data, size_t len)> EspNowPeer;
+void setEspNowPeer(EspNowPeer peer);
+// Hands a frame to the callback the sketch registered with
+// esp_now_register_recv_cb(), on the caller's thread
+void espNowReceive(const uint8_t* mac, const uint8_t* data, size_t len);
+EspNowStats espNowStats();
+bool espNowIdle();
+
+// -------------------- USB HID HOST --------------------
+struct UsbHost {
+  uint32_t pollUs = 1000;  // interval at which reports are taken
+  float dropRate = 0;      // report taken but its completion never reported
+  bool mounted = true;
+  bool suspended = false;
+};
+extern UsbHost usbHost;
+
+struct HidReport {
+  uint8_t modifier;
+  uint8_t keys[6];
+  unsigned long submitMicros;
+  unsigned long takenMicros;
+};
+std::vector<HidReport> hidReports();
+
+}  // namespace fake
+
+#endif
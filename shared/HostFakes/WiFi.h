@@ -0,0 +1,87 @@
+#ifndef HOST_FAKES_WIFI_H
+#define HOST_FAKES_WIFI_H
+
+#include <memory>
+
+#include "Arduino.h"
+#include "esp_wifi.h"
+
+typedef enum {
+  WL_IDLE_STATUS = 0,
+  WL_NO_SSID_AVAIL = 1,
+  WL_SCAN_COMPLETED = 2,
+  WL_CONNECTED = 3,
+  WL_CONNECT_FAILED = 4,
+  WL_CONNECTION_LOST = 5,
+  WL_DISCONNECTED = 6,
+} wl_status_t;
+
+class IPAddress {
+public:
+  IPAddress() : addr(0) {}
+  IPAddress(uint32_t address) : addr(address) {}
+  IPAddress(uint8_t a, uint8_t b, uint8_t c, uint8_t d)
+      : addr((uint32_t)a | ((uint32_t)b << 8) | ((uint32_t)c << 16) | ((uint32_t)d << 24)) {}
+  operator uint32_t() const { return addr; }
+
+private:
+  uint32_t addr;
+};
+static const IPAddress INADDR_NONE(0u);
+
+// Joins at once, unless fake::wifiAvailable is cleared
+class WiFiClass {
+public:
+  void persistent(bool persistent) { (void)persistent; }
+  bool mode(wifi_mode_t mode);
+  bool config(IPAddress local, IPAddress gateway, IPAddress subnet, IPAddress dns = IPAddress());
+  wl_status_t begin(const char* ssid, const char* passphrase = nullptr, int32_t channel = 0,
+                    const uint8_t* bssid = nullptr);
+  bool disconnect(bool wifiOff = false);
+  wl_status_t status();
+  bool setSleep(wifi_ps_type_t type);
+
+  uint8_t* BSSID();
+  int32_t channel();
+  IPAddress localIP();
+  IPAddress gatewayIP();
+  IPAddress subnetMask();
+  IPAddress dnsIP(uint8_t index = 0);
+  String macAddress();
+
+  int16_t scanNetworks();
+  String SSID(uint8_t index);
+  int32_t channel(uint8_t index);
+  void scanDelete();
+};
+extern WiFiClass WiFi;
+
+namespace fake {
+struct Connection;
+}
+
+// A TCP client connected to the fake HTTP server (fake::setHttpHandler),
+// over the link described by fake::tcpLink
+class WiFiClient {
+public:
+  WiFiClient() {}
+  WiFiClient(const WiFiClient&) = delete;
+  WiFiClient& operator=(const WiFiClient&) = delete;
+  virtual ~WiFiClient() {}
+
+  virtual int connect(const char* host, uint16_t port);
+  virtual size_t write(const uint8_t* buffer, size_t size);
+  size_t write(uint8_t c) { return write(&c, 1); }
+  virtual int available();
+  virtual int read(uint8_t* buffer, size_t size);
+  virtual int read();
+  virtual uint8_t connected();
+  virtual void stop();
+  virtual void flush() {}
+  operator bool() { return connected(); }
+
+private:
+  std::shared_ptr<fake::Connection> conn;
+};
+
+#endif
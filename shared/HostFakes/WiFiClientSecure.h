@@ -0,0 +1,13 @@
+#ifndef HOST_FAKES_WIFI_CLIENT_SECURE_H
+#define HOST_FAKES_WIFI_CLIENT_SECURE_H
+
+#include "WiFi.h"
+
+// No TLS: the bytes go to the same fake server as WiFiClient's
+class WiFiClientSecure : public WiFiClient {
+public:
+  void setInsecure() {}
+  void setCACert(const char* rootCA) { (void)rootCA; }
+};
+
+#endif
@@ -0,0 +1,12 @@
+#ifndef HOST_FAKES_ESP_ERR_H
+#define HOST_FAKES_ESP_ERR_H
+
+typedef int esp_err_t;
+
+#define ESP_OK 0
+#define ESP_FAIL -1
+#define ESP_ERR_NO_MEM 0x101
+#define ESP_ERR_INVALID_ARG 0x102
+#define ESP_ERR_NOT_SUPPORTED 0x106
+
+#endif
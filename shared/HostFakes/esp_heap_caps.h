@@ -0,0 +1,17 @@
+#ifndef HOST_FAKES_ESP_HEAP_CAPS_H
+#define HOST_FAKES_ESP_HEAP_CAPS_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define MALLOC_CAP_8BIT (1 << 2)
+#define MALLOC_CAP_SPIRAM (1 << 10)
+#define MALLOC_CAP_INTERNAL (1 << 11)
+
+// PSRAM requests fail unless fake::psram is set, like a board without it
+void* heap_caps_malloc(size_t size, uint32_t caps);
+size_t heap_caps_get_free_size(uint32_t caps);
+size_t heap_caps_get_minimum_free_size(uint32_t caps);
+size_t heap_caps_get_largest_free_block(uint32_t caps);
+
+#endif
@@ -0,0 +1,17 @@
+#ifndef HOST_FAKES_ESP_PM_H
+#define HOST_FAKES_ESP_PM_H
+
+#include <stdbool.h>
+
+#include "esp_err.h"
+
+typedef struct {
+  int max_freq_mhz;
+  int min_freq_mhz;
+  bool light_sleep_enable;
+} esp_pm_config_t;
+
+// ESP_ERR_NOT_SUPPORTED for light sleep unless fake::lightSleepSupported
+esp_err_t esp_pm_configure(const void* config);
+
+#endif
@@ -0,0 +1,31 @@
+#ifndef HOST_FAKES_ESP_SLEEP_H
+#define HOST_FAKES_ESP_SLEEP_H
+
+#include <stdint.h>
+
+#include "esp_err.h"
+
+typedef enum {
+  ESP_SLEEP_WAKEUP_UNDEFINED = 0,
+  ESP_SLEEP_WAKEUP_ALL,
+  ESP_SLEEP_WAKEUP_EXT0,
+  ESP_SLEEP_WAKEUP_EXT1,
+  ESP_SLEEP_WAKEUP_TIMER,
+  ESP_SLEEP_WAKEUP_TOUCHPAD,
+  ESP_SLEEP_WAKEUP_ULP,
+  ESP_SLEEP_WAKEUP_GPIO,
+} esp_sleep_wakeup_cause_t;
+
+typedef enum {
+  ESP_GPIO_WAKEUP_GPIO_LOW = 0,
+  ESP_GPIO_WAKEUP_GPIO_HIGH = 1,
+} esp_deepsleep_gpio_wake_up_mode_t;
+
+// fake::wakeupCause
+esp_sleep_wakeup_cause_t esp_sleep_get_wakeup_cause();
+esp_err_t esp_deep_sleep_enable_gpio_wakeup(uint64_t mask, esp_deepsleep_gpio_wake_up_mode_t mode);
+esp_err_t esp_sleep_enable_gpio_wakeup();
+// Counts fake::deepSleeps and returns, unlike the real one
+void esp_deep_sleep_start();
+
+#endif
@@ -0,0 +1,20 @@
+#ifndef HOST_FAKES_ESP_WIFI_H
+#define HOST_FAKES_ESP_WIFI_H
+
+#include <stdint.h>
+
+#include "esp_err.h"
+
+typedef enum { WIFI_OFF = 0, WIFI_STA, WIFI_AP, WIFI_AP_STA } wifi_mode_t;
+typedef enum { WIFI_PS_NONE = 0, WIFI_PS_MIN_MODEM, WIFI_PS_MAX_MODEM } wifi_ps_type_t;
+typedef enum {
+  WIFI_SECOND_CHAN_NONE = 0,
+  WIFI_SECOND_CHAN_ABOVE,
+  WIFI_SECOND_CHAN_BELOW,
+} wifi_second_chan_t;
+
+// fake::wifiChannel
+esp_err_t esp_wifi_get_channel(uint8_t* primary, wifi_second_chan_t* second);
+esp_err_t esp_wifi_set_channel(uint8_t primary, wifi_second_chan_t second);
+
+#endif
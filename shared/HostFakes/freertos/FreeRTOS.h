@@ -0,0 +1,26 @@
+#ifndef HOST_FAKES_FREERTOS_H
+#define HOST_FAKES_FREERTOS_H
+
+#include <stdint.h>
+
+// FreeRTOS on host threads: a task is a detached std::thread, a tick is a
+// millisecond of real time, and notifications and queues block on condition
+// variables. Priorities are accepted and ignored.
+typedef int BaseType_t;
+typedef unsigned int UBaseType_t;
+typedef uint32_t TickType_t;
+
+#define pdTRUE 1
+#define pdFALSE 0
+#define pdPASS pdTRUE
+#define pdFAIL pdFALSE
+#define portMAX_DELAY ((TickType_t)0xffffffffUL)
+#define portTICK_PERIOD_MS 1
+#define pdMS_TO_TICKS(ms) ((TickType_t)(ms))
+#define configMAX_PRIORITIES 25
+#define portYIELD_FROM_ISR(woken) ((void)(woken))
+
+#include "freertos/task.h"
+#include "freertos/queue.h"
+
+#endif
@@ -0,0 +1,14 @@
+#ifndef HOST_FAKES_FREERTOS_QUEUE_H
+#define HOST_FAKES_FREERTOS_QUEUE_H
+
+#include "freertos/FreeRTOS.h"
+
+struct FakeQueue;
+typedef FakeQueue* QueueHandle_t;
+
+QueueHandle_t xQueueCreate(UBaseType_t length, UBaseType_t itemSize);
+BaseType_t xQueueSend(QueueHandle_t queue, const void* item, TickType_t ticks);
+BaseType_t xQueueReceive(QueueHandle_t queue, void* item, TickType_t ticks);
+UBaseType_t uxQueueMessagesWaiting(QueueHandle_t queue);
+
+#endif
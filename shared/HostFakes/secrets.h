@@ -0,0 +1,15 @@
+#ifndef HOST_FAKES_SECRETS_H
+#define HOST_FAKES_SECRETS_H
+
+// Settings for the native tests, in place of the gitignored include/secrets.h
+#define STT_MIC_WIFI_SSID "fake-ssid"
+#define STT_MIC_WIFI_PASS "fake-pass"
+#define STT_ENDPOINT_PROTOCOL "http"
+#define STT_ENDPOINT_HOST "stt.test"
+#define STT_ENDPOINT_PORT 8080
+#define STT_ENDPOINT_PATH "/stream"
+#define STT_KEYBOARD_SERVER_MAC {0x02, 0x00, 0x00, 0x00, 0x00, 0x01}
+
+#define STT_WIFI_SSID "fake-ssid"
+
+#endif
@@ -0,0 +1,94 @@
+#ifndef TRACE_LOG_H
+#define TRACE_LOG_H
+
+#include <atomic>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+// Latency trace shared by stt-mic and esp-keyboard.
+//
+// Recording an event is a slot claim and four stores into a RAM ring, cheap
+// enough for the hot path; formatting to text happens later, when the device
+// is idle. Each event carries the utterance id the mic picked at button
+// down, which also travels to the endpoint (X-Dayne-Utterance-Id) and to the
+// keyboard (ESP-NOW frame header), so stt-endpoint/cmd/tracemerge can line
+// the three logs up.
+//
+// Dump format, one event per line:
+//   TRACE <device> <utterance id, 8 hex digits> <stage> <time us> <arg>
+enum TraceStage : uint8_t {
+  TRACE_BUTTON_DOWN = 1,
+  TRACE_CONNECTED,
+  TRACE_FIRST_AUDIO_BYTE,
+  TRACE_LAST_AUDIO_BYTE,
+  TRACE_STATUS_LINE,
+  TRACE_JSON_PARSED,
+  TRACE_ESPNOW_ACKED,
+  TRACE_MESSAGE_RECEIVED,
+  TRACE_FIRST_HID_REPORT,
+  TRACE_LAST_HID_REPORT,
+  TRACE_STAGE_COUNT
+};
+
+inline const char* traceStageName(uint8_t stage) {
+  static const char* const names[TRACE_STAGE_COUNT] = {
+    "unknown",          "button_down", "connected",        "first_audio_byte",
+    "last_audio_byte",  "status_line", "json_parsed",      "espnow_acked",
+    "message_received", "first_hid_report", "last_hid_report",
+  };
+  return stage < TRACE_STAGE_COUNT ? names[stage] : names[0];
+}
+
+struct TraceEvent {
+  uint32_t timeUs;
+  uint32_t utterance;
+  uint16_t arg;  // stage specific: bytes, frames, HTTP status...
+  uint8_t stage;
+};
+
+// Fixed-size ring of events; the oldest are overwritten when it fills up.
+// Any task may record. dump() is meant for one idle-time reader and skips
+// whatever was overwritten since its last call.
+template <size_t Size>
+class TraceLog {
+  static_assert(Size > 0 && (Size & (Size - 1)) == 0, "Size must be a power of two");
+
+public:
+  void record(TraceStage stage, uint32_t utterance, uint32_t timeUs, uint16_t arg = 0) {
+    uint32_t slot = head.fetch_add(1, std::memory_order_relaxed);
+    TraceEvent& e = events[slot & (Size - 1)];
+    e.timeUs = timeUs;
+    e.utterance = utterance;
+    e.arg = arg;
+    e.stage = stage;
+  }
+
+  // Writes every event recorded since the previous dump to out, which is
+  // anything with print(const char*) (Serial, or a host-side adapter).
+  template <typename Out>
+  void dump(Out& out, const char* device) {
+    uint32_t h = head.load(std::memory_order_acquire);
+    if (h - tail > Size) {
+      lost += h - tail - Size;
+      tail = h - Size;
+    }
+    char line[80];
+    for (; tail != h; tail++) {
+      const TraceEvent& e = events[tail & (Size - 1)];
+      snprintf(line, sizeof(line), "TRACE %s %08lx %s %lu %u\n", device,
+               (unsigned long)e.utterance, traceStageName(e.stage), (unsigned long)e.timeUs,
+               (unsigned)e.arg);
+      out.print(line);
+    }
+  }
+
+  uint32_t lost = 0;  // events overwritten before they were dumped
+
+private:
+  TraceEvent events[Size];
+  std::atomic<uint32_t> head{0};
+  uint32_t tail = 0;
+};
+
+#endif
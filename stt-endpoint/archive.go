@@ -0,0 +1,317 @@
+package main
+
+import (
+	"bufio"
+	"compress/gzip"
+	"encoding/binary"
+	"encoding/json"
+	"fmt"
+	"io"
+	"log/slog"
+	"os"
+	"path/filepath"
+	"sync"
+	"sync/atomic"
+	"time"
+)
+
+// Audio archival runs off the request path. Handlers hand decoded audio to
+// an archiver, which queues it for a single writer goroutine and never
+// blocks: when the disk falls behind and the queue's byte budget is used up,
+// audio is dropped and counted instead of stalling recognition.
+//
+// Segments are gzip files named archive-<time>.stta.gz, rotated once they
+// hold segmentBytes of frames. Each frame is
+//
+//	[type][utterance seq, uvarint][payload length, uvarint][payload]
+//
+// where the seq numbers this process's utterances so concurrent uploads can
+// interleave. Types:
+//
+//	'S' start, JSON archiveMeta; repeated at the top of each segment for
+//	    utterances still open, so every segment stands alone
+//	'A' LINEAR16 audio
+//	'G' gap, uvarint byte count of audio dropped here
+//	'E' end, JSON archiveSummary
+//
+// cmd/archivecat lists and extracts utterances.
+const (
+	archiveQueueBytes   = 8 << 20
+	archiveQueueRecords = 4096
+	archiveSegmentBytes = 64 << 20
+)
+
+const (
+	frameStart byte = 'S'
+	frameAudio byte = 'A'
+	frameGap   byte = 'G'
+	frameEnd   byte = 'E'
+)
+
+type archiveMeta struct {
+	UtteranceID string    `json:"utterance_id,omitempty"`
+	Path        string    `json:"path"`
+	SampleRate  int32     `json:"sample_rate"`
+	Encoding    string    `json:"encoding"` // upload encoding; archived audio is always LINEAR16
+	Received    time.Time `json:"received"`
+}
+
+type archiveSummary struct {
+	Bytes   int64 `json:"bytes"`
+	Dropped int64 `json:"dropped"`
+}
+
+type archiveRecord struct {
+	kind  byte
+	seq   uint64
+	meta  *archiveMeta
+	gap   int64 // audio dropped just before this record
+	audio []byte
+	end   archiveSummary
+}
+
+type archiver struct {
+	dir          string
+	segmentBytes int64
+	writeDelay   time.Duration // test knob: simulates a slow disk
+
+	queue       chan archiveRecord
+	queuedBytes atomic.Int64
+	nextSeq     atomic.Uint64
+	dropped     atomic.Int64 // audio bytes
+	done        chan struct{}
+
+	// closeMu lets close() wait out enqueues in progress; a handler that
+	// outlives shutdown then drops its audio instead of sending on a closed
+	// queue
+	closeMu sync.RWMutex
+	closed  bool
+
+	// Writer goroutine state
+	open    map[uint64]*archiveMeta
+	file    *os.File
+	gz      *gzip.Writer
+	out     *bufio.Writer
+	written int64
+}
+
+func newArchiver(dir string, writeDelay time.Duration) *archiver {
+	a := &archiver{
+		dir:          dir,
+		segmentBytes: archiveSegmentBytes,
+		writeDelay:   writeDelay,
+		queue:        make(chan archiveRecord, archiveQueueRecords),
+		done:         make(chan struct{}),
+		open:         make(map[uint64]*archiveMeta),
+	}
+	go a.run()
+	return a
+}
+
+// archiveUtterance is one upload's handle. Only its handler goroutine uses it.
+type archiveUtterance struct {
+	a       *archiver
+	seq     uint64
+	bytes   int64
+	gap     int64
+	dropped int64
+	lost    bool // the start frame did not fit; nothing else is queued
+}
+
+func (a *archiver) begin(meta archiveMeta) *archiveUtterance {
+	u := &archiveUtterance{a: a, seq: a.nextSeq.Add(1)}
+	u.lost = !a.enqueue(archiveRecord{kind: frameStart, seq: u.seq, meta: &meta})
+	return u
+}
+
+// write queues a copy of audio, or counts it as dropped.
+func (u *archiveUtterance) write(audio []byte) {
+	u.bytes += int64(len(audio))
+	n := int64(len(audio))
+	if u.lost || u.a.queuedBytes.Add(n) > archiveQueueBytes {
+		if !u.lost {
+			u.a.queuedBytes.Add(-n)
+		}
+		u.drop(n)
+		return
+	}
+	rec := archiveRecord{kind: frameAudio, seq: u.seq, gap: u.gap, audio: append([]byte(nil), audio...)}
+	if !u.a.enqueue(rec) {
+		u.a.queuedBytes.Add(-n)
+		u.drop(n)
+		return
+	}
+	u.gap = 0
+}
+
+func (u *archiveUtterance) drop(n int64) {
+	u.gap += n
+	u.dropped += n
+	u.a.dropped.Add(n)
+}
+
+// close queues the end frame and logs what was lost to back-pressure.
+func (u *archiveUtterance) close() {
+	if u.dropped > 0 {
+		slog.Warn("archive dropped audio", "seq", u.seq, "dropped", u.dropped, "bytes", u.bytes,
+			"dropped_total", u.a.dropped.Load())
+	}
+	if u.lost {
+		return
+	}
+	u.a.enqueue(archiveRecord{kind: frameEnd, seq: u.seq, gap: u.gap,
+		end: archiveSummary{Bytes: u.bytes, Dropped: u.dropped}})
+}
+
+func (a *archiver) enqueue(rec archiveRecord) bool {
+	a.closeMu.RLock()
+	defer a.closeMu.RUnlock()
+	if a.closed {
+		return false
+	}
+	select {
+	case a.queue <- rec:
+		return true
+	default:
+		return false
+	}
+}
+
+// close drains the queue and finishes the current segment.
+func (a *archiver) close() {
+	a.closeMu.Lock()
+	if !a.closed {
+		a.closed = true
+		close(a.queue)
+	}
+	a.closeMu.Unlock()
+	<-a.done
+}
+
+func (a *archiver) run() {
+	defer close(a.done)
+	for rec := range a.queue {
+		if err := a.writeRecord(rec); err != nil {
+			slog.Error("archive write failed, starting a new segment", "error", err)
+			a.dropped.Add(int64(len(rec.audio)))
+			a.closeSegment()
+		}
+		a.queuedBytes.Add(-int64(len(rec.audio)))
+	}
+	a.closeSegment()
+}
+
+func (a *archiver) writeRecord(rec archiveRecord) error {
+	if a.file == nil || a.written >= a.segmentBytes {
+		a.closeSegment()
+		if err := a.openSegment(); err != nil {
+			return err
+		}
+	}
+	if rec.gap > 0 {
+		if err := a.writeFrame(frameGap, rec.seq, binary.AppendUvarint(nil, uint64(rec.gap))); err != nil {
+			return err
+		}
+	}
+
+	switch rec.kind {
+	case frameStart:
+		a.open[rec.seq] = rec.meta
+		return a.writeStart(rec.seq, rec.meta)
+	case frameAudio:
+		return a.writeFrame(frameAudio, rec.seq, rec.audio)
+	case frameEnd:
+		delete(a.open, rec.seq)
+		payload, _ := json.Marshal(rec.end)
+		if err := a.writeFrame(frameEnd, rec.seq, payload); err != nil {
+			return err
+		}
+		// Make finished utterances readable even if the process dies
+		return a.flush()
+	}
+	return nil
+}
+
+func (a *archiver) openSegment() error {
+	name := fmt.Sprintf("archive-%s.stta.gz", time.Now().Format("20060102-150405.000"))
+	file, err := os.Create(filepath.Join(a.dir, name))
+	if err != nil {
+		return err
+	}
+	a.file = file
+	a.gz = gzip.NewWriter(a.writer())
+	a.out = bufio.NewWriterSize(a.gz, 64<<10)
+	a.written = 0
+	slog.Info("opened archive segment", "path", file.Name())
+
+	for seq, meta := range a.open {
+		if err := a.writeStart(seq, meta); err != nil {
+			return err
+		}
+	}
+	return nil
+}
+
+func (a *archiver) writer() io.Writer {
+	if a.writeDelay > 0 {
+		return slowWriter{a.file, a.writeDelay}
+	}
+	return a.file
+}
+
+func (a *archiver) closeSegment() {
+	if a.file == nil {
+		return
+	}
+	if err := a.flush(); err != nil {
+		slog.Error("failed to flush archive segment", "error", err)
+	}
+	if err := a.gz.Close(); err != nil {
+		slog.Error("failed to finish archive segment", "error", err)
+	}
+	if err := a.file.Close(); err != nil {
+		slog.Error("failed to close archive segment", "error", err)
+	}
+	a.file, a.gz, a.out = nil, nil, nil
+}
+
+func (a *archiver) flush() error {
+	if err := a.out.Flush(); err != nil {
+		return err
+	}
+	return a.gz.Flush()
+}
+
+func (a *archiver) writeStart(seq uint64, meta *archiveMeta) error {
+	payload, err := json.Marshal(meta)
+	if err != nil {
+		return err
+	}
+	return a.writeFrame(frameStart, seq, payload)
+}
+
+func (a *archiver) writeFrame(kind byte, seq uint64, payload []byte) error {
+	var header [1 + 2*binary.MaxVarintLen64]byte
+	header[0] = kind
+	n := 1 + binary.PutUvarint(header[1:], seq)
+	n += binary.PutUvarint(header[n:], uint64(len(payload)))
+	if _, err := a.out.Write(header[:n]); err != nil {
+		return err
+	}
+	if _, err := a.out.Write(payload); err != nil {
+		return err
+	}
+	a.written += int64(n + len(payload))
+	return nil
+}
+
+// slowWriter delays every write, standing in for a slow or contended disk.
+type slowWriter struct {
+	f     *os.File
+	delay time.Duration
+}
+
+func (w slowWriter) Write(p []byte) (int, error) {
+	time.Sleep(w.delay)
+	return w.f.Write(p)
+}
@@ -0,0 +1,263 @@
+package main
+
+import (
+	"bufio"
+	"bytes"
+	"compress/gzip"
+	"encoding/binary"
+	"encoding/json"
+	"io"
+	"os"
+	"path/filepath"
+	"sort"
+	"sync"
+	"testing"
+	"time"
+)
+
+// archivedUtterance is what the segments on disk say about one seq.
+type archivedUtterance struct {
+	meta     archiveMeta
+	starts   []string // segments with a start frame for it
+	audio    []byte
+	gaps     int64
+	end      *archiveSummary
+	segments map[string]bool // segments with its audio
+}
+
+// readArchive parses every segment in dir, oldest first.
+func readArchive(t *testing.T, dir string) (map[uint64]*archivedUtterance, []string) {
+	t.Helper()
+	paths, _ := filepath.Glob(filepath.Join(dir, "archive-*.stta.gz"))
+	sort.Strings(paths)
+	utterances := map[uint64]*archivedUtterance{}
+	for _, path := range paths {
+		f, err := os.Open(path)
+		if err != nil {
+			t.Fatal(err)
+		}
+		gz, err := gzip.NewReader(f)
+		if err != nil {
+			t.Fatalf("%s: %v", path, err)
+		}
+		r := bufio.NewReader(gz)
+		for {
+			kind, err := r.ReadByte()
+			if err == io.EOF {
+				break
+			}
+			seq, err1 := binary.ReadUvarint(r)
+			n, err2 := binary.ReadUvarint(r)
+			payload := make([]byte, n)
+			_, err3 := io.ReadFull(r, payload)
+			if err != nil || err1 != nil || err2 != nil || err3 != nil {
+				t.Fatalf("%s: truncated frame", path)
+			}
+
+			u := utterances[seq]
+			if u == nil {
+				if kind != frameStart {
+					t.Fatalf("%s: frame %c for seq %d before its start", path, kind, seq)
+				}
+				u = &archivedUtterance{segments: map[string]bool{}}
+				utterances[seq] = u
+			}
+			switch kind {
+			case frameStart:
+				json.Unmarshal(payload, &u.meta)
+				u.starts = append(u.starts, path)
+			case frameAudio:
+				if len(u.starts) == 0 || u.starts[len(u.starts)-1] != path {
+					t.Fatalf("%s: audio for seq %d without a start in this segment", path, seq)
+				}
+				u.audio = append(u.audio, payload...)
+				u.segments[path] = true
+			case frameGap:
+				gap, _ := binary.Uvarint(payload)
+				u.gaps += int64(gap)
+			case frameEnd:
+				u.end = &archiveSummary{}
+				json.Unmarshal(payload, u.end)
+			default:
+				t.Fatalf("%s: unknown frame %q", path, kind)
+			}
+		}
+		f.Close()
+	}
+	return utterances, paths
+}
+
+func pattern(seed byte, n int) []byte {
+	b := make([]byte, n)
+	for i := range b {
+		b[i] = seed + byte(i*7)
+	}
+	return b
+}
+
+func TestArchiveInterleavedUtterances(t *testing.T) {
+	dir := t.TempDir()
+	a := newArchiver(dir, 0)
+
+	// Concurrent uploads, each from its own handler goroutine
+	var wg sync.WaitGroup
+	want := map[string][]byte{}
+	for _, id := range []string{"aaaa", "bbbb", "cccc"} {
+		audio := pattern(id[0], 100_000)
+		want[id] = audio
+		wg.Add(1)
+		go func(id string, audio []byte) {
+			defer wg.Done()
+			u := a.begin(archiveMeta{UtteranceID: id, Path: "/stream", SampleRate: 16000, Encoding: encodingULaw})
+			for rest := audio; len(rest) > 0; {
+				n := min(len(rest), 4096)
+				u.write(rest[:n])
+				rest = rest[n:]
+			}
+			u.close()
+		}(id, audio)
+	}
+	wg.Wait()
+	a.close()
+
+	utterances, paths := readArchive(t, dir)
+	if len(paths) != 1 || len(utterances) != 3 {
+		t.Fatalf("%d segments, %d utterances", len(paths), len(utterances))
+	}
+	for _, u := range utterances {
+		if !bytes.Equal(u.audio, want[u.meta.UtteranceID]) {
+			t.Errorf("%s: audio differs", u.meta.UtteranceID)
+		}
+		if u.meta.SampleRate != 16000 || u.meta.Encoding != encodingULaw {
+			t.Errorf("%s: meta %+v", u.meta.UtteranceID, u.meta)
+		}
+		if u.end == nil || u.end.Bytes != 100_000 || u.end.Dropped != 0 || u.gaps != 0 {
+			t.Errorf("%s: end %+v, gaps %d", u.meta.UtteranceID, u.end, u.gaps)
+		}
+	}
+}
+
+func TestArchiveSegmentsStandAlone(t *testing.T) {
+	dir := t.TempDir()
+	// Every file write waits a little, so segment names (by the millisecond)
+	// stay distinct
+	a := newArchiver(dir, 2*time.Millisecond)
+	a.segmentBytes = 20_000
+
+	long := a.begin(archiveMeta{UtteranceID: "long"})
+	short := a.begin(archiveMeta{UtteranceID: "short"})
+	short.write(pattern(1, 5000))
+	short.close()
+	audio := pattern(2, 100_000)
+	for rest := audio; len(rest) > 0; rest = rest[5000:] {
+		long.write(rest[:5000])
+	}
+	long.close()
+	a.close()
+
+	utterances, paths := readArchive(t, dir)
+	if len(paths) < 5 {
+		t.Fatalf("only %d segments for 100 kB at 20 kB each", len(paths))
+	}
+	for _, u := range utterances {
+		if u.meta.UtteranceID != "long" {
+			// Finished before the first rotation: not repeated after it
+			if len(u.starts) != 1 {
+				t.Errorf("short utterance started in %d segments", len(u.starts))
+			}
+			continue
+		}
+		if !bytes.Equal(u.audio, audio) || u.end == nil {
+			t.Fatalf("long utterance: %d bytes, end %+v", len(u.audio), u.end)
+		}
+		// readArchive already checked each segment's audio follows a start
+		// in that segment
+		if len(u.segments) < 5 || len(u.starts) < len(u.segments) {
+			t.Errorf("audio in %d segments, starts in %d", len(u.segments), len(u.starts))
+		}
+	}
+}
+
+func TestArchiveDropsInsteadOfBlocking(t *testing.T) {
+	dir := t.TempDir()
+	// gzip writes its output a few hundred bytes at a time, so this disk
+	// takes seconds over the byte budget
+	a := newArchiver(dir, 5*time.Millisecond)
+
+	const chunk = 32 << 10
+	const over = 4 << 20
+	total := archiveQueueBytes + over
+	u := a.begin(archiveMeta{UtteranceID: "upload"})
+	start := time.Now()
+	for sent := 0; sent < total; sent += chunk {
+		u.write(make([]byte, chunk))
+	}
+	u.close()
+	if took := time.Since(start); took > 250*time.Millisecond {
+		t.Errorf("queueing %d bytes took %v; the handler waited on the disk", total, took)
+	}
+	if u.dropped < over*3/4 || a.dropped.Load() != u.dropped {
+		t.Errorf("dropped %d (archiver total %d), want about %d", u.dropped, a.dropped.Load(), over)
+	}
+	a.close()
+	if q := a.queuedBytes.Load(); q != 0 {
+		t.Errorf("%d bytes still counted as queued after close", q)
+	}
+
+	utterances, _ := readArchive(t, dir)
+	for _, got := range utterances {
+		if got.meta.UtteranceID != "upload" {
+			continue
+		}
+		// What was dropped is marked where it was dropped, so the audio keeps
+		// its timing when extracted
+		if int64(len(got.audio))+got.gaps != int64(total) || got.gaps != u.dropped {
+			t.Errorf("%d bytes archived + %d gap, want %d total", len(got.audio), got.gaps, total)
+		}
+		if got.end == nil || got.end.Dropped != u.dropped || got.end.Bytes != int64(total) {
+			t.Errorf("end %+v", got.end)
+		}
+		return
+	}
+	t.Fatal("upload missing from the archive")
+}
+
+// Shutdown closes the archive while late handlers may still write: their
+// audio is dropped, nothing panics, and everything queued before is on disk
+func TestArchiveCloseRacesLateWriters(t *testing.T) {
+	dir := t.TempDir()
+	a := newArchiver(dir, 0)
+	var wg sync.WaitGroup
+	started := make(chan struct{})
+	for i := 0; i < 8; i++ {
+		wg.Add(1)
+		go func(i int) {
+			defer wg.Done()
+			u := a.begin(archiveMeta{UtteranceID: string(rune('a' + i))})
+			if i == 0 {
+				close(started)
+			}
+			for n := 0; n < 2000; n++ {
+				u.write(pattern(byte(i), 64))
+			}
+			u.close()
+		}(i)
+	}
+	<-started
+	a.close()
+	wg.Wait()
+
+	late := a.begin(archiveMeta{UtteranceID: "late"})
+	late.write(pattern(9, 64))
+	late.close()
+	if !late.lost || late.dropped != 64 {
+		t.Errorf("write after close: lost %v, dropped %d", late.lost, late.dropped)
+	}
+
+	utterances, _ := readArchive(t, dir)
+	for _, u := range utterances {
+		if u.end != nil && int64(len(u.audio))+u.gaps != u.end.Bytes {
+			t.Errorf("%s: %d archived + %d gap != %d", u.meta.UtteranceID, len(u.audio), u.gaps, u.end.Bytes)
+		}
+	}
+}
@@ -0,0 +1,192 @@
+// Command archivecat lists and extracts the utterances in stt-endpoint's
+// audio archive segments (archive-*.stta.gz; the format is described in
+// archive.go).
+//
+// Segments are read in the order given, so an utterance that spans a
+// rotation is joined back together. Audio the endpoint dropped under disk
+// back-pressure is restored as silence so timing is preserved.
+//
+//	go run ./cmd/archivecat /audio/archive-*.stta.gz
+//	go run ./cmd/archivecat -extract out/ /audio/archive-*.stta.gz
+package main
+
+import (
+	"bufio"
+	"compress/gzip"
+	"encoding/binary"
+	"encoding/json"
+	"errors"
+	"flag"
+	"fmt"
+	"io"
+	"log/slog"
+	"os"
+	"path/filepath"
+	"time"
+)
+
+type meta struct {
+	UtteranceID string    `json:"utterance_id"`
+	Path        string    `json:"path"`
+	SampleRate  int32     `json:"sample_rate"`
+	Encoding    string    `json:"encoding"`
+	Received    time.Time `json:"received"`
+}
+
+type summary struct {
+	Bytes   int64 `json:"bytes"`
+	Dropped int64 `json:"dropped"`
+}
+
+type utterance struct {
+	meta     meta
+	audio    int64
+	silence  int64
+	finished bool
+	end      summary
+	out      *os.File
+}
+
+func main() {
+	extract := flag.String("extract", "", "write each utterance as LINEAR16 .raw files into this directory")
+	flag.Parse()
+	if flag.NArg() == 0 {
+		fmt.Fprintln(os.Stderr, "usage: archivecat [-extract dir] segment.stta.gz...")
+		os.Exit(2)
+	}
+
+	a := &archive{extract: *extract, utterances: map[string]*utterance{}, current: map[uint64]string{}}
+	for _, path := range flag.Args() {
+		if err := readSegment(path, a.apply); err != nil {
+			slog.Error("failed to read segment", "path", path, "error", err)
+			os.Exit(1)
+		}
+	}
+
+	for _, key := range a.order {
+		u := a.utterances[key]
+		if u.out != nil {
+			u.out.Close()
+		}
+		state := "complete"
+		if !u.finished {
+			state = "unfinished"
+		}
+		fmt.Printf("%s %-8s %-7s %5d Hz %-9s %8d bytes %8d dropped %s\n",
+			u.meta.Received.Format(time.RFC3339Nano), u.meta.UtteranceID, u.meta.Path,
+			u.meta.SampleRate, u.meta.Encoding, u.audio, u.silence, state)
+	}
+}
+
+// archive is every utterance seen so far. Sequence numbers restart with the
+// endpoint process, so an utterance is keyed by its number and when it
+// arrived; current maps a number to the key of its latest start frame.
+type archive struct {
+	extract    string
+	utterances map[string]*utterance
+	order      []string
+	current    map[uint64]string
+}
+
+func (a *archive) apply(kind byte, seq uint64, payload []byte) error {
+	if kind == 'S' {
+		var m meta
+		if err := json.Unmarshal(payload, &m); err != nil {
+			return err
+		}
+		key := fmt.Sprintf("%d/%s", seq, m.Received.Format(time.RFC3339Nano))
+		a.current[seq] = key
+		if a.utterances[key] != nil {
+			return nil // repeated at the top of a new segment
+		}
+		u := &utterance{meta: m}
+		if a.extract != "" {
+			name := fmt.Sprintf("audio-%s-%d.raw", m.Received.Format("20060102-150405.000"), seq)
+			f, err := os.Create(filepath.Join(a.extract, name))
+			if err != nil {
+				return err
+			}
+			u.out = f
+		}
+		a.utterances[key] = u
+		a.order = append(a.order, key)
+		return nil
+	}
+
+	u := a.utterances[a.current[seq]]
+	if u == nil {
+		return nil // started in a segment that was not given
+	}
+	switch kind {
+	case 'A':
+		u.audio += int64(len(payload))
+		if u.out != nil {
+			if _, err := u.out.Write(payload); err != nil {
+				return err
+			}
+		}
+	case 'G':
+		gap, n := binary.Uvarint(payload)
+		if n <= 0 {
+			return errors.New("bad gap frame")
+		}
+		u.silence += int64(gap)
+		if u.out != nil {
+			if _, err := u.out.Write(make([]byte, gap)); err != nil {
+				return err
+			}
+		}
+	case 'E':
+		u.finished = true
+		return json.Unmarshal(payload, &u.end)
+	}
+	return nil
+}
+
+// readSegment calls frame for every frame in a segment. A segment cut short
+// by a crash ends at its last flush, which is not an error.
+func readSegment(path string, frame func(kind byte, seq uint64, payload []byte) error) error {
+	f, err := os.Open(path)
+	if err != nil {
+		return err
+	}
+	defer f.Close()
+	gz, err := gzip.NewReader(f)
+	if err != nil {
+		return err
+	}
+	r := bufio.NewReader(gz)
+
+	for {
+		kind, err := r.ReadByte()
+		if err == io.EOF || errors.Is(err, io.ErrUnexpectedEOF) {
+			return nil
+		}
+		if err != nil {
+			return err
+		}
+		seq, err := binary.ReadUvarint(r)
+		if err != nil {
+			return truncated(err)
+		}
+		length, err := binary.ReadUvarint(r)
+		if err != nil {
+			return truncated(err)
+		}
+		payload := make([]byte, length)
+		if _, err := io.ReadFull(r, payload); err != nil {
+			return truncated(err)
+		}
+		if err := frame(kind, seq, payload); err != nil {
+			return err
+		}
+	}
+}
+
+func truncated(err error) error {
+	if err == io.EOF || errors.Is(err, io.ErrUnexpectedEOF) {
+		slog.Warn("segment ends mid-frame")
+		return nil
+	}
+	return err
+}
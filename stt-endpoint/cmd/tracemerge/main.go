@@ -0,0 +1,278 @@
+// Command tracemerge joins the latency traces of one or more utterances
+// across the mic, the endpoint and the keyboard and prints a per-stage
+// breakdown.
+//
+// The mic and keyboard logs are serial captures containing the TRACE lines
+// they dump (see shared/TraceLog/TraceLog.h); the endpoint log is its
+// standard slog output, where each traced request ends with a "trace" line
+// keyed by utterance_id. The three clocks are unrelated, so every interval
+// is measured on a single device; the end-to-end figure chains the mic's
+// release-to-ack time with the keyboard's receive-to-last-key time.
+//
+//	go run ./cmd/tracemerge -mic mic.log -endpoint endpoint.log -keyboard keyboard.log
+package main
+
+import (
+	"bufio"
+	"encoding/json"
+	"flag"
+	"fmt"
+	"log/slog"
+	"os"
+	"regexp"
+	"sort"
+	"strconv"
+	"strings"
+	"time"
+)
+
+// interval is one row of the breakdown: the time between two stages on the
+// same device.
+type interval struct {
+	device string
+	from   string
+	to     string
+}
+
+var intervals = []interval{
+	{"mic", "button_down", "connected"},
+	{"mic", "connected", "first_audio_byte"},
+	{"mic", "first_audio_byte", "last_audio_byte"},
+	{"mic", "last_audio_byte", "status_line"},
+	{"mic", "status_line", "json_parsed"},
+	{"mic", "json_parsed", "espnow_acked"},
+	{"endpoint", "first_audio", "last_audio"},
+	{"endpoint", "last_audio", "final_result"},
+	{"endpoint", "final_result", "response_written"},
+	{"keyboard", "message_received", "first_hid_report"},
+	{"keyboard", "first_hid_report", "last_hid_report"},
+}
+
+// Stages that repeat within an utterance (partial results send several
+// messages); for these the last occurrence is the one that matters.
+var lastOccurrence = map[string]bool{
+	"espnow_acked":     true,
+	"message_received": true,
+	"last_hid_report":  true,
+}
+
+// utterance holds stage times in microseconds on each device's own clock.
+type utterance struct {
+	id     string
+	stages map[string]map[string]uint32 // device -> stage -> us
+	order  int
+}
+
+type traces struct {
+	byID map[string]*utterance
+}
+
+func (t *traces) get(id string) *utterance {
+	u, ok := t.byID[id]
+	if !ok {
+		u = &utterance{id: id, stages: make(map[string]map[string]uint32), order: len(t.byID)}
+		t.byID[id] = u
+	}
+	return u
+}
+
+func (t *traces) add(device, id, stage string, us uint32) {
+	u := t.get(strings.ToLower(id))
+	m, ok := u.stages[device]
+	if !ok {
+		m = make(map[string]uint32)
+		u.stages[device] = m
+	}
+	if _, seen := m[stage]; seen && !lastOccurrence[stage] {
+		return
+	}
+	m[stage] = us
+}
+
+var traceLine = regexp.MustCompile(`TRACE (\S+) ([0-9a-fA-F]{8}) (\S+) (\d+) (\d+)`)
+
+// readDeviceLog reads TRACE lines from a mic or keyboard serial capture.
+func (t *traces) readDeviceLog(path string) error {
+	f, err := os.Open(path)
+	if err != nil {
+		return err
+	}
+	defer f.Close()
+
+	sc := bufio.NewScanner(f)
+	for sc.Scan() {
+		m := traceLine.FindStringSubmatch(sc.Text())
+		if m == nil {
+			continue
+		}
+		us, err := strconv.ParseUint(m[4], 10, 32)
+		if err != nil {
+			continue
+		}
+		t.add(m[1], m[2], m[3], uint32(us))
+	}
+	return sc.Err()
+}
+
+// readEndpointLog reads "trace" records from slog text or JSON output.
+func (t *traces) readEndpointLog(path string) error {
+	f, err := os.Open(path)
+	if err != nil {
+		return err
+	}
+	defer f.Close()
+
+	sc := bufio.NewScanner(f)
+	for sc.Scan() {
+		fields := endpointFields(sc.Text())
+		if fields == nil || fields["utterance_id"] == "" {
+			continue
+		}
+		id := fields["utterance_id"]
+		t.add("endpoint", id, "request", 0)
+		for k, v := range fields {
+			stage, ok := strings.CutSuffix(k, "_us")
+			if !ok {
+				continue
+			}
+			us, err := strconv.ParseUint(v, 10, 32)
+			if err != nil {
+				continue
+			}
+			t.add("endpoint", id, stage, uint32(us))
+		}
+	}
+	return sc.Err()
+}
+
+// endpointFields returns the attributes of a trace record, or nil for any
+// other line.
+func endpointFields(line string) map[string]string {
+	if strings.HasPrefix(strings.TrimSpace(line), "{") {
+		var rec map[string]any
+		if json.Unmarshal([]byte(line), &rec) != nil || rec["msg"] != "trace" {
+			return nil
+		}
+		fields := make(map[string]string, len(rec))
+		for k, v := range rec {
+			fields[k] = fmt.Sprint(v)
+		}
+		return fields
+	}
+
+	tokens := strings.Fields(line)
+	isTrace := false
+	fields := make(map[string]string)
+	for _, tok := range tokens {
+		if tok == "trace" || tok == "msg=trace" {
+			isTrace = true
+			continue
+		}
+		if k, v, ok := strings.Cut(tok, "="); ok {
+			fields[k] = v
+		}
+	}
+	if !isTrace {
+		return nil
+	}
+	return fields
+}
+
+func (u *utterance) between(device, from, to string) (time.Duration, bool) {
+	m := u.stages[device]
+	a, okA := m[from]
+	b, okB := m[to]
+	if !okA || !okB {
+		return 0, false
+	}
+	// uint32 microsecond clocks wrap every ~71 minutes
+	return time.Duration(b-a) * time.Microsecond, true
+}
+
+// releaseToTyped chains the mic's release-to-ack time with the keyboard's
+// receive-to-last-key time; the ack and the receive happen within the same
+// radio exchange, so no clock alignment is needed.
+func (u *utterance) releaseToTyped() (time.Duration, bool) {
+	mic, ok := u.between("mic", "last_audio_byte", "espnow_acked")
+	if !ok {
+		return 0, false
+	}
+	kb, ok := u.between("keyboard", "message_received", "last_hid_report")
+	if !ok {
+		return 0, false
+	}
+	return mic + kb, true
+}
+
+func ms(d time.Duration) string {
+	return fmt.Sprintf("%8.1f ms", float64(d)/float64(time.Millisecond))
+}
+
+func median(ds []time.Duration) time.Duration {
+	sort.Slice(ds, func(i, j int) bool { return ds[i] < ds[j] })
+	return ds[len(ds)/2]
+}
+
+func main() {
+	micPath := flag.String("mic", "", "mic serial log with TRACE lines")
+	keyboardPath := flag.String("keyboard", "", "keyboard serial log with TRACE lines")
+	endpointPath := flag.String("endpoint", "", "endpoint log")
+	flag.Parse()
+
+	t := &traces{byID: make(map[string]*utterance)}
+	for _, in := range []struct {
+		path string
+		read func(string) error
+	}{
+		{*micPath, t.readDeviceLog},
+		{*keyboardPath, t.readDeviceLog},
+		{*endpointPath, t.readEndpointLog},
+	} {
+		if in.path == "" {
+			continue
+		}
+		if err := in.read(in.path); err != nil {
+			slog.Error("failed to read log", "path", in.path, "error", err)
+			os.Exit(1)
+		}
+	}
+	if len(t.byID) == 0 {
+		slog.Error("no traced utterances found")
+		os.Exit(1)
+	}
+
+	list := make([]*utterance, 0, len(t.byID))
+	for _, u := range t.byID {
+		list = append(list, u)
+	}
+	sort.Slice(list, func(i, j int) bool { return list[i].order < list[j].order })
+
+	samples := make(map[interval][]time.Duration)
+	var endToEnd []time.Duration
+	for _, u := range list {
+		fmt.Printf("utterance %s\n", u.id)
+		for _, iv := range intervals {
+			d, ok := u.between(iv.device, iv.from, iv.to)
+			if !ok {
+				continue
+			}
+			samples[iv] = append(samples[iv], d)
+			fmt.Printf("  %-9s %-17s -> %-17s %s\n", iv.device, iv.from, iv.to, ms(d))
+		}
+		if d, ok := u.releaseToTyped(); ok {
+			endToEnd = append(endToEnd, d)
+			fmt.Printf("  %-9s %-17s -> %-17s %s\n", "total", "release", "typed", ms(d))
+		}
+		fmt.Println()
+	}
+
+	fmt.Printf("median over %d utterances\n", len(list))
+	for _, iv := range intervals {
+		if ds := samples[iv]; len(ds) > 0 {
+			fmt.Printf("  %-9s %-17s -> %-17s %s  (n=%d)\n", iv.device, iv.from, iv.to, ms(median(ds)), len(ds))
+		}
+	}
+	if len(endToEnd) > 0 {
+		fmt.Printf("  %-9s %-17s -> %-17s %s  (n=%d)\n", "total", "release", "typed", ms(median(endToEnd)), len(endToEnd))
+	}
+}
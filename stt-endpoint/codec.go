@@ -0,0 +1,221 @@
+package main
+
+import (
+	"encoding/binary"
+	"fmt"
+	"log/slog"
+	"net/http"
+	"strings"
+)
+
+// Encodings the mic can upload with, as sent in X-Dayne-Encoding.
+const (
+	encodingLinear16 = "l16"
+	encodingULaw     = "ulaw"
+	encodingIMAADPCM = "ima-adpcm"
+	encodingFramed   = "framed"
+)
+
+// audioEncoding returns the upload encoding of a request, falling back to the
+// Content-Type for clients that predate X-Dayne-Encoding.
+func audioEncoding(r *http.Request) string {
+	if enc := strings.ToLower(r.Header.Get("X-Dayne-Encoding")); enc != "" {
+		return enc
+	}
+	switch strings.ToLower(r.Header.Get("Content-Type")) {
+	case "audio/basic", "audio/pcmu":
+		return encodingULaw
+	case "audio/x-ima-adpcm":
+		return encodingIMAADPCM
+	}
+	return encodingLinear16
+}
+
+// audioDecoder turns uploaded bytes back into little-endian LINEAR16. Decoders
+// keep state across calls so they can be fed arbitrary slices of a stream. The
+// returned slice is only valid until the next call.
+type audioDecoder interface {
+	Decode(src []byte) []byte
+}
+
+// newAudioDecoder returns a decoder for encoding. sampleRate is the rate of
+// the decoded stream; only framed uploads can carry audio at other rates.
+func newAudioDecoder(encoding string, sampleRate int32) (audioDecoder, error) {
+	switch encoding {
+	case encodingFramed:
+		return &framedDecoder{outRate: int(sampleRate)}, nil
+	case encodingLinear16:
+		return linear16Decoder{}, nil
+	case encodingULaw:
+		return &ulawDecoder{}, nil
+	case encodingIMAADPCM:
+		return &imaADPCMDecoder{}, nil
+	}
+	return nil, fmt.Errorf("unsupported audio encoding %q", encoding)
+}
+
+type linear16Decoder struct{}
+
+func (linear16Decoder) Decode(src []byte) []byte { return src }
+
+type ulawDecoder struct {
+	out []byte
+}
+
+func (d *ulawDecoder) Decode(src []byte) []byte {
+	d.out = grow(d.out, len(src)*2)
+	for i, u := range src {
+		binary.LittleEndian.PutUint16(d.out[i*2:], uint16(ulawToLinear(u)))
+	}
+	return d.out
+}
+
+// ulawToLinear is the G.711 reference expansion.
+func ulawToLinear(u byte) int16 {
+	const bias = 0x84
+	u = ^u
+	exponent := (u >> 4) & 0x07
+	mantissa := int32(u & 0x0f)
+	sample := ((mantissa << 3) + bias) << exponent
+	sample -= bias
+	if u&0x80 != 0 {
+		return int16(-sample)
+	}
+	return int16(sample)
+}
+
+var imaStepTable = [89]int32{
+	7, 8, 9, 10, 11, 12, 13, 14, 16, 17, 19, 21, 23, 25, 28, 31, 34, 37, 41, 45,
+	50, 55, 60, 66, 73, 80, 88, 97, 107, 118, 130, 143, 157, 173, 190, 209, 230,
+	253, 279, 307, 337, 371, 408, 449, 494, 544, 598, 658, 724, 796, 876, 963,
+	1060, 1166, 1282, 1411, 1552, 1707, 1878, 2066, 2272, 2499, 2749, 3024, 3327,
+	3660, 4026, 4428, 4871, 5358, 5894, 6484, 7132, 7845, 8630, 9493, 10442,
+	11487, 12635, 13899, 15289, 16818, 18500, 20350, 22385, 24623, 27086, 29794,
+	32767,
+}
+
+var imaIndexTable = [16]int32{
+	-1, -1, -1, -1, 2, 4, 6, 8,
+	-1, -1, -1, -1, 2, 4, 6, 8,
+}
+
+// imaADPCMDecoder decodes the mic's headerless IMA-ADPCM stream: two samples
+// per byte, low nibble first, predictor and step index starting at zero.
+type imaADPCMDecoder struct {
+	predictor int32
+	index     int32
+	out       []byte
+}
+
+func (d *imaADPCMDecoder) Decode(src []byte) []byte {
+	d.out = grow(d.out, len(src)*4)
+	for i, b := range src {
+		binary.LittleEndian.PutUint16(d.out[i*4:], uint16(d.nibble(b&0x0f)))
+		binary.LittleEndian.PutUint16(d.out[i*4+2:], uint16(d.nibble(b>>4)))
+	}
+	return d.out
+}
+
+func (d *imaADPCMDecoder) nibble(code byte) int16 {
+	step := imaStepTable[d.index]
+	vpdiff := step >> 3
+	if code&4 != 0 {
+		vpdiff += step
+	}
+	if code&2 != 0 {
+		vpdiff += step >> 1
+	}
+	if code&1 != 0 {
+		vpdiff += step >> 2
+	}
+	if code&8 != 0 {
+		d.predictor -= vpdiff
+	} else {
+		d.predictor += vpdiff
+	}
+	d.predictor = min(max(d.predictor, -32768), 32767)
+	d.index = min(max(d.index+imaIndexTable[code], 0), 88)
+	return int16(d.predictor)
+}
+
+// Framed uploads come from mics that adapt their bitrate to the link. The
+// body is a series of blocks, each
+//
+//	[codec][sample rate / 1000][payload length, LE16][payload]
+//
+// with codec numbered as in the mic's AudioCodecType. Encoder state carries
+// over between blocks of the same format and starts over when it changes.
+// Blocks at a lower rate than the stream are upsampled, so the recognizer
+// always sees one rate. Blocks may be split across Decode calls.
+const framedHeaderLen = 4
+
+var framedCodecs = [...]string{encodingLinear16, encodingULaw, encodingIMAADPCM}
+
+type framedDecoder struct {
+	outRate int
+
+	pending []byte // start of a block not yet complete
+	codec   byte
+	rate    int
+	dec     audioDecoder
+	last    int16 // final sample of the previous block, for interpolation
+	out     []byte
+}
+
+func (d *framedDecoder) Decode(src []byte) []byte {
+	d.out = d.out[:0]
+	if len(d.pending) > 0 {
+		d.pending = append(d.pending, src...)
+		src = d.pending
+	}
+	for len(src) >= framedHeaderLen {
+		n := int(binary.LittleEndian.Uint16(src[2:]))
+		if len(src) < framedHeaderLen+n {
+			break
+		}
+		d.block(src[0], int(src[1])*1000, src[framedHeaderLen:framedHeaderLen+n])
+		src = src[framedHeaderLen+n:]
+	}
+	d.pending = append(d.pending[:0], src...)
+	return d.out
+}
+
+func (d *framedDecoder) block(codec byte, rate int, payload []byte) {
+	if d.dec == nil || codec != d.codec || rate != d.rate {
+		if int(codec) >= len(framedCodecs) || rate <= 0 || d.outRate%rate != 0 {
+			slog.Warn("skipping framed audio block", "codec", codec, "sample_rate", rate, "stream_rate", d.outRate)
+			return
+		}
+		if d.dec != nil {
+			slog.Info("upload format changed", "encoding", framedCodecs[codec], "sample_rate", rate)
+		}
+		d.dec, _ = newAudioDecoder(framedCodecs[codec], int32(rate))
+		d.codec, d.rate = codec, rate
+	}
+	pcm := d.dec.Decode(payload)
+	factor := d.outRate / rate
+	if factor == 1 {
+		d.out = append(d.out, pcm...)
+		if len(pcm) >= 2 {
+			d.last = int16(binary.LittleEndian.Uint16(pcm[len(pcm)-2:]))
+		}
+		return
+	}
+	// Linear interpolation from the previous sample, so rate changes do not click
+	for i := 0; i+1 < len(pcm); i += 2 {
+		s := int32(int16(binary.LittleEndian.Uint16(pcm[i:])))
+		prev := int32(d.last)
+		for k := 1; k <= factor; k++ {
+			v := prev + (s-prev)*int32(k)/int32(factor)
+			d.out = binary.LittleEndian.AppendUint16(d.out, uint16(int16(v)))
+		}
+		d.last = int16(s)
+	}
+}
+
+func grow(buf []byte, n int) []byte {
+	if cap(buf) < n {
+		return make([]byte, n)
+	}
+	return buf[:n]
+}
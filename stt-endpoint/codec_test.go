@@ -0,0 +1,246 @@
+package main
+
+import (
+	"bytes"
+	"encoding/binary"
+	"encoding/hex"
+	"math"
+	"net/http"
+	"strings"
+	"testing"
+)
+
+// imaFixture is 40 samples as the mic's AudioEncoder encodes them, and what
+// a reference IMA decoder makes of the result.
+var imaFixture = struct {
+	encoded []byte
+	decoded []int16
+}{
+	encoded: []byte{
+		0xff, 0xff, 0x3f, 0x77, 0x3f, 0xe7, 0xc3, 0xb3, 0xa5, 0x99,
+		0x95, 0x88, 0x09, 0x08, 0x10, 0x21, 0xf3, 0x20, 0x2d, 0x3b,
+	},
+	decoded: []int16{
+		-11, -41, -104, -240, -533, -239, 335, 1568, -1076, 1570,
+		6723, -2854, 6282, -4397, 5652, -3484, 9568, 882, -3855, -8161,
+		6196, 463, -1274, -2853, -7159, -5854, -7040, -5962, -4982, -2308,
+		123, 3806, 8493, -638, 667, 6599, -5266, 2630, -7419, 1717,
+	},
+}
+
+func samples(pcm []byte) []int16 {
+	out := make([]int16, len(pcm)/2)
+	for i := range out {
+		out[i] = int16(binary.LittleEndian.Uint16(pcm[i*2:]))
+	}
+	return out
+}
+
+func TestAudioEncoding(t *testing.T) {
+	tests := []struct {
+		encoding    string
+		contentType string
+		want        string
+	}{
+		{"", "", encodingLinear16},
+		{"", "audio/l16", encodingLinear16},
+		{"", "audio/basic", encodingULaw},
+		{"", "Audio/PCMU", encodingULaw},
+		{"", "audio/x-ima-adpcm", encodingIMAADPCM},
+		{"IMA-ADPCM", "audio/basic", encodingIMAADPCM},
+		{"framed", "application/x-dayne-framed", encodingFramed},
+	}
+	for _, tt := range tests {
+		r, _ := http.NewRequest(http.MethodPost, "/stream", nil)
+		if tt.encoding != "" {
+			r.Header.Set("X-Dayne-Encoding", tt.encoding)
+		}
+		if tt.contentType != "" {
+			r.Header.Set("Content-Type", tt.contentType)
+		}
+		if got := audioEncoding(r); got != tt.want {
+			t.Errorf("audioEncoding(%q, %q) = %q, want %q", tt.encoding, tt.contentType, got, tt.want)
+		}
+	}
+
+	if _, err := newAudioDecoder("opus", 16000); err == nil {
+		t.Error("newAudioDecoder accepted an unknown encoding")
+	}
+}
+
+func TestLinear16PassesThrough(t *testing.T) {
+	dec, _ := newAudioDecoder(encodingLinear16, 16000)
+	in := []byte{1, 2, 3, 4}
+	if got := dec.Decode(in); !bytes.Equal(got, in) {
+		t.Errorf("Decode = %v, want %v", got, in)
+	}
+}
+
+func TestULawDecodesMicCodes(t *testing.T) {
+	// Codes the mic's encoder gives for these samples
+	tests := []struct {
+		code byte
+		in   int16
+		want int16
+	}{
+		{0xff, 0, 0},
+		{0x7f, -1, 0},
+		{0xce, 1000, 988},
+		{0x4e, -1000, -988},
+		{0xa0, 8031, 7932},
+		{0x80, 32767, 32124},
+		{0x00, -32768, -32124},
+	}
+	for _, tt := range tests {
+		if got := ulawToLinear(tt.code); got != tt.want {
+			t.Errorf("ulawToLinear(%#02x) (sample %d) = %d, want %d", tt.code, tt.in, got, tt.want)
+		}
+	}
+
+	// Codes run from the most negative to -0, then from the most positive to
+	// +0, and the sign bit only flips the sign
+	for c := 0; c < 0x7f; c++ {
+		if ulawToLinear(byte(c)) >= ulawToLinear(byte(c+1)) {
+			t.Fatalf("code %#02x does not decode below %#02x", c, c+1)
+		}
+		if ulawToLinear(byte(c)) != -ulawToLinear(byte(c|0x80)) {
+			t.Fatalf("codes %#02x and %#02x are not opposites", c, c|0x80)
+		}
+	}
+
+	dec, _ := newAudioDecoder(encodingULaw, 16000)
+	got := samples(dec.Decode([]byte{0x00, 0xff, 0x80}))
+	if want := []int16{-32124, 0, 32124}; !equalSamples(got, want) {
+		t.Errorf("Decode = %v, want %v", got, want)
+	}
+}
+
+func TestIMAADPCMDecodesMicStream(t *testing.T) {
+	dec, _ := newAudioDecoder(encodingIMAADPCM, 16000)
+	if got := samples(dec.Decode(imaFixture.encoded)); !equalSamples(got, imaFixture.decoded) {
+		t.Errorf("Decode = %v, want %v", got, imaFixture.decoded)
+	}
+
+	// Predictor and step carry over, so any split decodes the same
+	for cut := 0; cut <= len(imaFixture.encoded); cut++ {
+		dec, _ := newAudioDecoder(encodingIMAADPCM, 16000)
+		got := samples(dec.Decode(imaFixture.encoded[:cut]))
+		got = append(got, samples(dec.Decode(imaFixture.encoded[cut:]))...)
+		if !equalSamples(got, imaFixture.decoded) {
+			t.Fatalf("split at %d: Decode = %v, want %v", cut, got, imaFixture.decoded)
+		}
+	}
+}
+
+func TestIMAADPCMClampsAtFullScale(t *testing.T) {
+	// Largest positive step every time: the predictor saturates instead of
+	// wrapping, and the step index stays in the table
+	dec := &imaADPCMDecoder{}
+	got := samples(dec.Decode(bytes.Repeat([]byte{0x77}, 64)))
+	if got[len(got)-1] != 32767 || dec.index != 88 {
+		t.Errorf("after 128 positive steps: sample %d, index %d", got[len(got)-1], dec.index)
+	}
+	got = samples(dec.Decode(bytes.Repeat([]byte{0xff}, 64)))
+	if got[len(got)-1] != -32768 {
+		t.Errorf("after 128 negative steps: sample %d", got[len(got)-1])
+	}
+}
+
+// framedFixture is the mic's UplinkEncoder sending 352 samples of a 200 Hz
+// tone in 36-byte chunks: two blocks of PCM, two of mu-law after a step
+// down, then ADPCM at 8 kHz.
+var framedFixture = strings.Join([]string{
+	"001020000000eb00d501bc029f037c0452051f06e3069c074908e9087b09fe09710ad40a",
+	"00102000250b650b930baf0bb80baf0b930b650b250bd40a710afe097b09e90849089c07",
+	"01102000c2c5c8cbcfd5dde9ff695d554f4b4845423f3e3d3c3a3a393838373737373738",
+	"0110200038393a3a3c3d3e3f4245484b4f555d69ffe9ddd5cfcbc8c5c2bfbebdbcbabab9",
+	"020820007777778699a9aaaaab9b9a0822544334344332221180aadccbbcbccbaaab9908",
+	"0208200031544334344322231180aadccbbcbccbaaab990822544334344322231180aadc",
+}, "")
+
+func framedTone(i int) float64 {
+	return math.Round(3000 * math.Sin(2*math.Pi*200*float64(i)/16000))
+}
+
+func TestFramedDecodesMicUpload(t *testing.T) {
+	body, _ := hex.DecodeString(framedFixture)
+	dec, _ := newAudioDecoder(encodingFramed, 16000)
+	got := samples(dec.Decode(body))
+	if len(got) != 352 {
+		t.Fatalf("decoded %d samples, want 352 at the stream rate", len(got))
+	}
+
+	for i := 0; i < 32; i++ {
+		if float64(got[i]) != framedTone(i) {
+			t.Fatalf("PCM sample %d = %d, want %v", i, got[i], framedTone(i))
+		}
+	}
+	for i := 32; i < 96; i++ {
+		if err := math.Abs(float64(got[i]) - framedTone(i)); err > math.Abs(framedTone(i))/16+16 {
+			t.Fatalf("mu-law sample %d = %d, want about %v", i, got[i], framedTone(i))
+		}
+	}
+	// ADPCM restarts from a small step at the change of codec, and the
+	// mic's half-rate filter centres each sample one input sample late.
+	// Past the first few ms it follows the tone closely.
+	var signal, noise float64
+	for i := 112; i < 352; i++ {
+		want := framedTone(i - 1)
+		signal += want * want
+		noise += (float64(got[i]) - want) * (float64(got[i]) - want)
+	}
+	if snr := 10 * math.Log10(signal/noise); snr < 30 {
+		t.Errorf("half-rate ADPCM SNR %.1f dB, want 30", snr)
+	}
+
+	// Blocks split across reads, header included, decode the same
+	for cut := 0; cut <= len(body); cut++ {
+		dec, _ := newAudioDecoder(encodingFramed, 16000)
+		split := samples(dec.Decode(body[:cut]))
+		split = append(split, samples(dec.Decode(body[cut:]))...)
+		if !equalSamples(split, got) {
+			t.Fatalf("split at %d decodes differently", cut)
+		}
+	}
+}
+
+func framedBlock(codec byte, rateKHz byte, pcm ...int16) []byte {
+	payload := make([]byte, 0, 2*len(pcm))
+	for _, s := range pcm {
+		payload = binary.LittleEndian.AppendUint16(payload, uint16(s))
+	}
+	block := []byte{codec, rateKHz, 0, 0}
+	binary.LittleEndian.PutUint16(block[2:], uint16(len(payload)))
+	return append(block, payload...)
+}
+
+func TestFramedUpsamplesAndSkipsUnknownBlocks(t *testing.T) {
+	var body []byte
+	body = append(body, framedBlock(0, 16, 10, 20)...)
+	// Half rate: interpolated from the last sample so the change does not click
+	body = append(body, framedBlock(0, 8, 100, 200)...)
+	body = append(body, framedBlock(9, 16, 1, 2)...) // unknown codec
+	body = append(body, framedBlock(0, 11, 1, 2)...) // rate that does not divide
+	body = append(body, framedBlock(0, 32, 1, 2)...) // above the stream rate
+	body = append(body, framedBlock(0, 0, 1, 2)...)  // no rate
+	body = append(body, framedBlock(0, 16, -7)...)
+
+	dec, _ := newAudioDecoder(encodingFramed, 16000)
+	got := samples(dec.Decode(body))
+	want := []int16{10, 20, 60, 100, 150, 200, -7}
+	if !equalSamples(got, want) {
+		t.Errorf("Decode = %v, want %v", got, want)
+	}
+}
+
+func equalSamples(a, b []int16) bool {
+	if len(a) != len(b) {
+		return false
+	}
+	for i := range a {
+		if a[i] != b[i] {
+			return false
+		}
+	}
+	return true
+}
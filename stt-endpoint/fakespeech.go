@@ -0,0 +1,175 @@
+package main
+
+import (
+	"context"
+	"fmt"
+	"io"
+	"strings"
+	"sync"
+	"time"
+
+	speechpb "cloud.google.com/go/speech/apiv2/speechpb"
+	"github.com/googleapis/gax-go/v2"
+	"google.golang.org/grpc"
+)
+
+// speechClient is the part of the Speech v2 client the handlers use, so a
+// local fake can stand in for it.
+type speechClient interface {
+	Recognize(ctx context.Context, req *speechpb.RecognizeRequest, opts ...gax.CallOption) (*speechpb.RecognizeResponse, error)
+	StreamingRecognize(ctx context.Context, opts ...gax.CallOption) (speechpb.Speech_StreamingRecognizeClient, error)
+}
+
+// fakeBytesPerWord is how much LINEAR16 audio the fake turns into one word:
+// 400 ms at 16 kHz.
+const fakeBytesPerWord = 12800
+
+// fakeStreamLimitBytes mirrors the API's per-stream audio limit (five
+// minutes at 16 kHz) so stream rotation is exercised offline.
+const fakeStreamLimitBytes = 5 * 60 * 16000 * 2
+
+// fakeAudioTimeout mirrors the API aborting a stream that has had no audio
+// for about ten seconds, which pooled streams have to stay clear of.
+const fakeAudioTimeout = 10 * time.Second
+
+// fakeSpeechClient is an offline stand-in for Speech-to-Text, enabled with
+// STT_FAKE_SPEECH=1. It "recognizes" one word per 400 ms of audio, emits
+// interim results as audio arrives and a final result after a configurable
+// processing latency, so timing can be measured without the cloud. Stream
+// setup takes setupLatency (STT_FAKE_SPEECH_SETUP_LATENCY).
+type fakeSpeechClient struct {
+	latency      time.Duration
+	setupLatency time.Duration
+}
+
+func newFakeSpeechClient(latency, setupLatency time.Duration) *fakeSpeechClient {
+	return &fakeSpeechClient{latency: latency, setupLatency: setupLatency}
+}
+
+func fakeTranscript(audioBytes int) string {
+	n := audioBytes / fakeBytesPerWord
+	words := make([]string, n)
+	for i := range words {
+		words[i] = fmt.Sprintf("word%d", i+1)
+	}
+	return strings.Join(words, " ")
+}
+
+func (c *fakeSpeechClient) Recognize(ctx context.Context, req *speechpb.RecognizeRequest, opts ...gax.CallOption) (*speechpb.RecognizeResponse, error) {
+	select {
+	case <-time.After(c.latency):
+	case <-ctx.Done():
+		return nil, ctx.Err()
+	}
+
+	var audio []byte
+	if content, ok := req.AudioSource.(*speechpb.RecognizeRequest_Content); ok {
+		audio = content.Content
+	}
+	return &speechpb.RecognizeResponse{
+		Results: []*speechpb.SpeechRecognitionResult{{
+			Alternatives: []*speechpb.SpeechRecognitionAlternative{{Transcript: fakeTranscript(len(audio))}},
+		}},
+	}, nil
+}
+
+func (c *fakeSpeechClient) StreamingRecognize(ctx context.Context, opts ...gax.CallOption) (speechpb.Speech_StreamingRecognizeClient, error) {
+	select {
+	case <-time.After(c.setupLatency):
+	case <-ctx.Done():
+		return nil, ctx.Err()
+	}
+	return &fakeSpeechStream{
+		ctx:       ctx,
+		latency:   c.latency,
+		created:   time.Now(),
+		responses: make(chan *speechpb.StreamingRecognizeResponse, 64),
+	}, nil
+}
+
+// fakeSpeechStream implements the bidi stream. Only Send, CloseSend, Recv and
+// Context are used by the handlers; the embedded interface covers the rest.
+type fakeSpeechStream struct {
+	grpc.ClientStream
+
+	ctx       context.Context
+	latency   time.Duration
+	created   time.Time
+	responses chan *speechpb.StreamingRecognizeResponse
+
+	mu         sync.Mutex
+	audioBytes int
+	words      int
+	closed     bool
+}
+
+func fakeResult(transcript string, final bool) *speechpb.StreamingRecognizeResponse {
+	result := &speechpb.StreamingRecognitionResult{
+		Alternatives: []*speechpb.SpeechRecognitionAlternative{{Transcript: transcript}},
+		IsFinal:      final,
+	}
+	if !final {
+		result.Stability = 0.9
+	}
+	return &speechpb.StreamingRecognizeResponse{Results: []*speechpb.StreamingRecognitionResult{result}}
+}
+
+func (s *fakeSpeechStream) Context() context.Context { return s.ctx }
+
+func (s *fakeSpeechStream) Send(req *speechpb.StreamingRecognizeRequest) error {
+	s.mu.Lock()
+	defer s.mu.Unlock()
+	if s.closed {
+		return io.EOF
+	}
+	if s.audioBytes == 0 && len(req.GetAudio()) > 0 && time.Since(s.created) > fakeAudioTimeout {
+		return fmt.Errorf("fake speech: no audio for %v", fakeAudioTimeout)
+	}
+	s.audioBytes += len(req.GetAudio())
+	if s.audioBytes > fakeStreamLimitBytes {
+		return fmt.Errorf("fake speech: stream exceeded %d bytes of audio", fakeStreamLimitBytes)
+	}
+	if words := s.audioBytes / fakeBytesPerWord; words > s.words {
+		s.words = words
+		select {
+		case s.responses <- fakeResult(fakeTranscript(s.audioBytes), false):
+		default: // reader is behind; interim results are droppable
+		}
+	}
+	return nil
+}
+
+func (s *fakeSpeechStream) CloseSend() error {
+	s.mu.Lock()
+	defer s.mu.Unlock()
+	if s.closed {
+		return nil
+	}
+	s.closed = true
+	transcript := fakeTranscript(s.audioBytes)
+	go func() {
+		defer close(s.responses)
+		select {
+		case <-time.After(s.latency):
+		case <-s.ctx.Done():
+			return
+		}
+		select {
+		case s.responses <- fakeResult(transcript, true):
+		case <-s.ctx.Done():
+		}
+	}()
+	return nil
+}
+
+func (s *fakeSpeechStream) Recv() (*speechpb.StreamingRecognizeResponse, error) {
+	select {
+	case resp, ok := <-s.responses:
+		if !ok {
+			return nil, io.EOF
+		}
+		return resp, nil
+	case <-s.ctx.Done():
+		return nil, s.ctx.Err()
+	}
+}
@@ -4,12 +4,16 @@ import (
 	"context"
 	_ "embed"
 	"encoding/json"
+	"errors"
+	"expvar"
 	"fmt"
 	"io"
 	"log/slog"
 	"net/http"
 	"os"
-	"path/filepath"
+	"os/signal"
+	"runtime"
+	"syscall"
 	"time"
 
 	speech "cloud.google.com/go/speech/apiv2"
@@ -43,21 +47,104 @@ func main() {
 	ctx := context.Background()
 	mux := http.NewServeMux()
 
-	client, err := speech.NewClient(ctx)
-	if err != nil {
-		panic(err)
+	var client speechClient
+	if os.Getenv("STT_FAKE_SPEECH") != "" {
+		latency, _ := time.ParseDuration(os.Getenv("STT_FAKE_SPEECH_LATENCY"))
+		setupLatency, _ := time.ParseDuration(os.Getenv("STT_FAKE_SPEECH_SETUP_LATENCY"))
+		slog.Warn("using fake speech client", "latency", latency, "setup_latency", setupLatency)
+		client = newFakeSpeechClient(latency, setupLatency)
+	} else {
+		cloudClient, err := speech.NewClient(ctx)
+		if err != nil {
+			panic(err)
+		}
+		defer cloudClient.Close()
+		client = cloudClient
+	}
+
+	// Archival never blocks a request; STT_ARCHIVE_WRITE_DELAY slows every
+	// segment write to check that
+	writeDelay, _ := time.ParseDuration(os.Getenv("STT_ARCHIVE_WRITE_DELAY"))
+	if writeDelay > 0 {
+		slog.Warn("slowing archive writes", "delay", writeDelay)
+	}
+	archive := newArchiver(outputDir, writeDelay)
+	defer archive.close()
+
+	// openStream creates a StreamingRecognize stream and sends its config
+	openStream := func(ctx context.Context, key streamKey) (speechpb.Speech_StreamingRecognizeClient, error) {
+		stream, err := client.StreamingRecognize(ctx)
+		if err != nil {
+			return nil, fmt.Errorf("create stream: %w", err)
+		}
+		// Send initial config for LINEAR16
+		if err := stream.Send(&speechpb.StreamingRecognizeRequest{
+			Recognizer: recognizerName,
+			StreamingRequest: &speechpb.StreamingRecognizeRequest_StreamingConfig{
+				StreamingConfig: &speechpb.StreamingRecognitionConfig{
+					Config: &speechpb.RecognitionConfig{
+						DecodingConfig: &speechpb.RecognitionConfig_ExplicitDecodingConfig{
+							ExplicitDecodingConfig: &speechpb.ExplicitDecodingConfig{
+								Encoding:          speechpb.ExplicitDecodingConfig_LINEAR16,
+								SampleRateHertz:   key.sampleRate,
+								AudioChannelCount: 1,
+							},
+						},
+						LanguageCodes: []string{"en-US"},
+						Model:         key.model,
+					},
+					StreamingFeatures: &speechpb.StreamingRecognitionFeatures{
+						InterimResults: key.interim,
+					},
+				},
+			},
+		}); err != nil {
+			return nil, fmt.Errorf("send config: %w", err)
+		}
+		return stream, nil
+	}
+
+	// Streams for recently used configs are opened ahead of the request
+	// (STT_STREAM_POOL_SIZE=0 turns this off); hit rate is at /debug/vars
+	poolSize := 2
+	if v := os.Getenv("STT_STREAM_POOL_SIZE"); v != "" {
+		if _, err := fmt.Sscanf(v, "%d", &poolSize); err != nil {
+			slog.Warn("failed to parse stream pool size, using default", "error", err, "value", v)
+			poolSize = 2
+		}
+	}
+	poolIdle := 8 * time.Second // the API aborts streams that get no audio for ~10 s
+	if d, err := time.ParseDuration(os.Getenv("STT_STREAM_POOL_IDLE")); err == nil && d > 0 {
+		poolIdle = d
 	}
-	defer client.Close()
+	poolCtx, stopPool := context.WithCancel(ctx)
+	defer stopPool()
+	pool := newStreamPool(poolCtx, poolSize, poolIdle, 2*time.Minute, openStream)
+	slog.Info("stream pool", "size", poolSize, "idle", poolIdle)
 
 	mux.HandleFunc("/healthz", func(w http.ResponseWriter, r *http.Request) {
 		w.WriteHeader(http.StatusOK)
 	})
+	expvar.Publish("goroutines", expvar.Func(func() any { return runtime.NumGoroutine() }))
+	mux.Handle("/debug/vars", expvar.Handler())
+	// One-shot recognition buffers the whole upload; long audio belongs on
+	// /stream, which keeps memory flat
+	const maxRecognizeBytes = 10 << 20
 	mux.HandleFunc("/", func(w http.ResponseWriter, r *http.Request) {
-		body, err := io.ReadAll(r.Body)
+		trace := newUtteranceTrace(r)
+		defer trace.log()
+
+		body, err := io.ReadAll(http.MaxBytesReader(w, r.Body, maxRecognizeBytes))
+		var tooLarge *http.MaxBytesError
+		if errors.As(err, &tooLarge) {
+			http.Error(w, "audio too long, use /stream", http.StatusRequestEntityTooLarge)
+			return
+		}
 		if err != nil {
 			http.Error(w, "failed to read request body", http.StatusBadRequest)
 			return
 		}
+		trace.mark("last_audio")
 
 		// Read audio parameters from custom headers
 		sampleRateStr := r.Header.Get("X-Dayne-Sample-Rate")
@@ -68,19 +155,24 @@ func main() {
 		if _, err := fmt.Sscanf(sampleRateStr, "%d", &sampleRate); err != nil {
 			slog.Warn("failed to parse sample rate, using default", "error", err, "value", sampleRateStr)
 		}
-		slog.Info("received audio", "sample_rate", sampleRate, "size", len(body))
-
-		// Save audio file with unique timestamp-based filename
-		timestamp := time.Now().Format("20060102-150405.000")
-		filename := fmt.Sprintf("audio-%s.raw", timestamp)
-		filepath := filepath.Join(outputDir, filename)
-
-		if err := os.WriteFile(filepath, body, 0644); err != nil {
-			slog.Error("failed to write audio file", "error", err, "path", filepath)
-			http.Error(w, "failed to save audio file", http.StatusInternalServerError)
+		encoding := audioEncoding(r)
+		decoder, err := newAudioDecoder(encoding, sampleRate)
+		if err != nil {
+			http.Error(w, err.Error(), http.StatusUnsupportedMediaType)
 			return
 		}
-		slog.Info("saved audio file", "path", filepath, "size", len(body))
+		slog.Info("received audio", "sample_rate", sampleRate, "encoding", encoding, "size", len(body))
+		body = decoder.Decode(body)
+
+		// Queue the audio for the archive in frame-sized pieces
+		archived := archive.begin(archiveMeta{UtteranceID: trace.id, Path: r.URL.Path,
+			SampleRate: sampleRate, Encoding: encoding, Received: trace.start})
+		for rest := body; len(rest) > 0; {
+			n := min(len(rest), 32<<10)
+			archived.write(rest[:n])
+			rest = rest[n:]
+		}
+		archived.close()
 
 		start := time.Now()
 		req := &speechpb.RecognizeRequest{
@@ -107,6 +199,7 @@ func main() {
 			return
 		}
 		slog.Info("recognized speech", "duration", time.Since(start), "results", len(resp.Results))
+		trace.mark("final_result")
 
 		transcript := "..."
 		if len(resp.Results) > 0 && len(resp.Results[0].Alternatives) > 0 {
@@ -122,10 +215,14 @@ func main() {
 		w.Header().Set("Content-Type", "application/json")
 		w.WriteHeader(http.StatusOK)
 		w.Write(data)
+		trace.mark("response_written")
 	})
 
 	// Streaming endpoint
 	mux.HandleFunc("/stream", func(w http.ResponseWriter, r *http.Request) {
+		trace := newUtteranceTrace(r)
+		defer trace.log()
+
 		// Read audio parameters from custom headers
 		sampleRateStr := r.Header.Get("X-Dayne-Sample-Rate")
 		if sampleRateStr == "" {
@@ -135,52 +232,80 @@ func main() {
 		if _, err := fmt.Sscanf(sampleRateStr, "%d", &sampleRate); err != nil {
 			slog.Warn("failed to parse sample rate, using default", "error", err, "value", sampleRateStr)
 		}
-		slog.Info("starting stream", "sample_rate", sampleRate)
-
-		start := time.Now()
-		stream, err := client.StreamingRecognize(r.Context())
+		encoding := audioEncoding(r)
+		decoder, err := newAudioDecoder(encoding, sampleRate)
 		if err != nil {
-			slog.Error("failed to create stream", "error", err)
-			http.Error(w, "failed to create stream", http.StatusInternalServerError)
+			http.Error(w, err.Error(), http.StatusUnsupportedMediaType)
 			return
 		}
+		slog.Info("starting stream", "sample_rate", sampleRate, "encoding", encoding, "utterance_id", trace.id)
 
-		// Send initial config for LINEAR16
-		if err := stream.Send(&speechpb.StreamingRecognizeRequest{
-			Recognizer: recognizerName,
-			StreamingRequest: &speechpb.StreamingRecognizeRequest_StreamingConfig{
-				StreamingConfig: &speechpb.StreamingRecognitionConfig{
-					Config: &speechpb.RecognitionConfig{
-						DecodingConfig: &speechpb.RecognitionConfig_ExplicitDecodingConfig{
-							ExplicitDecodingConfig: &speechpb.ExplicitDecodingConfig{
-								Encoding:          speechpb.ExplicitDecodingConfig_LINEAR16,
-								SampleRateHertz:   sampleRate,
-								AudioChannelCount: 1,
-							},
-						},
-						LanguageCodes: []string{"en-US"},
-						Model:         "short",
-					},
-				},
-			},
-		}); err != nil {
-			slog.Error("failed to send config", "error", err)
-			http.Error(w, "failed to send config", http.StatusInternalServerError)
-			return
+		// Mics that accept NDJSON get interim results while still uploading
+		partial := wantsPartialResults(r)
+
+		// Long dictation uses the long-form model; either way the session
+		// rotates streams before the API's per-stream limit
+		model := "short"
+		if r.Header.Get("X-Dayne-Long-Form") == "1" {
+			model = "long"
 		}
 
+		start := time.Now()
+		ctx, cancel := context.WithCancel(r.Context())
+		defer cancel()
+
 		// Stream audio chunks from request body directly to STT
-		// Also save to file
-		timestamp := time.Now().Format("20060102-150405.000")
-		filename := fmt.Sprintf("audio-%s.raw", timestamp)
-		filepath := filepath.Join(outputDir, filename)
-		file, err := os.Create(filepath)
+		// Also queue them for the archive
+		archived := archive.begin(archiveMeta{UtteranceID: trace.id, Path: r.URL.Path,
+			SampleRate: sampleRate, Encoding: encoding, Received: trace.start})
+		defer archived.close()
+
+		// Results are received concurrently with the upload. In partial mode
+		// each update is written out as an NDJSON line as soon as it arrives,
+		// so the response has to be committed before the body is read.
+		var lines *ndjsonWriter
+		if partial {
+			if err := http.NewResponseController(w).EnableFullDuplex(); err != nil {
+				slog.Warn("full duplex not supported", "error", err)
+			}
+			lines = newNDJSONWriter(w)
+		}
+
+		// Errors after the NDJSON headers went out can only end the stream
+		fail := func(msg string) {
+			if lines != nil {
+				lines.write(transcriptUpdate{Error: msg, Final: true})
+				return
+			}
+			http.Error(w, msg, http.StatusInternalServerError)
+		}
+
+		key := streamKey{sampleRate: sampleRate, model: model, interim: partial}
+		openStream := func(ctx context.Context) (speechpb.Speech_StreamingRecognizeClient, error) {
+			stream, hit, err := pool.take(ctx, key)
+			if err == nil {
+				trace.mark("stream_ready")
+				slog.Info("recognition stream ready", "utterance_id", trace.id, "pool_hit", hit)
+			}
+			return stream, err
+		}
+		rotateBytes := int(streamRotateAfter.Seconds()) * int(sampleRate) * 2
+		session, err := newStreamingSession(ctx, rotateBytes, openStream, func(update transcriptUpdate) {
+			trace.mark("first_result")
+			if lines != nil {
+				lines.write(update)
+			}
+		})
 		if err != nil {
-			slog.Error("failed to create audio file", "error", err)
-			http.Error(w, "failed to create audio file", http.StatusInternalServerError)
+			slog.Error("failed to start recognition", "error", err)
+			fail("failed to start recognition")
 			return
 		}
-		defer file.Close()
+		// Never return while a receiver may still write to w
+		defer func() {
+			cancel()
+			session.wait()
+		}()
 
 		chunkSize := 8192
 		buffer := make([]byte, chunkSize)
@@ -189,72 +314,53 @@ func main() {
 		for {
 			n, err := r.Body.Read(buffer)
 			if n > 0 {
+				trace.mark("first_audio")
 				totalBytes += n
-				chunk := buffer[:n]
+				chunk := decoder.Decode(buffer[:n])
 
-				// Write to file
-				if _, writeErr := file.Write(chunk); writeErr != nil {
-					slog.Error("failed to write to audio file", "error", writeErr)
-				}
+				// Copied and queued; never waits on the disk
+				archived.write(chunk)
 
 				// Send to STT stream
-				if sendErr := stream.Send(&speechpb.StreamingRecognizeRequest{
-					StreamingRequest: &speechpb.StreamingRecognizeRequest_Audio{
-						Audio: chunk,
-					},
-				}); sendErr != nil {
+				if sendErr := session.send(chunk); sendErr != nil {
 					slog.Error("failed to send audio chunk", "error", sendErr)
-					http.Error(w, "failed to send audio chunk", http.StatusInternalServerError)
+					fail("failed to send audio chunk")
 					return
 				}
 			}
 			if err == io.EOF {
+				trace.mark("last_audio")
 				break
 			}
 			if err != nil {
 				slog.Error("failed to read request body", "error", err)
-				http.Error(w, "failed to read request body", http.StatusInternalServerError)
+				fail("failed to read request body")
 				return
 			}
 		}
 
-		slog.Info("saved audio file for streaming", "path", filepath, "size", totalBytes)
+		slog.Info("queued audio for archive", "seq", archived.seq, "size", totalBytes)
 
-		if err := stream.CloseSend(); err != nil {
-			slog.Error("failed to close send", "error", err)
+		transcript, recvErr := session.close()
+		if recvErr != nil {
+			slog.Error("failed to receive stream response", "error", recvErr)
+			fail("failed to receive stream response")
 			return
 		}
 
-		// Collect all final results
-		var finalResults *speechpb.StreamingRecognitionResult
-		for {
-			resp, err := stream.Recv()
-			if err == io.EOF {
-				break
-			}
-			if err != nil {
-				slog.Error("failed to receive stream response", "error", err)
-				http.Error(w, "failed to receive stream response", http.StatusInternalServerError)
-				return
-			}
+		slog.Info("streaming recognition completed", "duration", time.Since(start), "transcript", transcript)
+		trace.mark("final_result")
 
-			// Collect only final results
-			for _, result := range resp.Results {
-				slog.Info("result", slog.Bool("isFinal", result.IsFinal), slog.Any("alternatives", result.Alternatives))
-				if result.IsFinal {
-					finalResults = result
-					break
-				}
-			}
+		if transcript == "" {
+			transcript = "..."
+		}
+		if lines != nil {
+			lines.write(transcriptUpdate{Text: transcript, Final: true})
+			trace.mark("response_written")
+			return
 		}
-
-		slog.Info("streaming recognition completed", "duration", time.Since(start), "results", finalResults)
 
 		// Send all results as single JSON response
-		transcript := "..."
-		if finalResults != nil && len(finalResults.Alternatives) > 0 {
-			transcript = finalResults.Alternatives[0].Transcript
-		}
 		data, err := json.Marshal(map[string]any{
 			"text": transcript,
 		})
@@ -265,6 +371,7 @@ func main() {
 		w.Header().Set("Content-Type", "application/json")
 		w.WriteHeader(http.StatusOK)
 		w.Write(data)
+		trace.mark("response_written")
 	})
 
 	port := os.Getenv("PORT")
@@ -272,8 +379,36 @@ func main() {
 		port = "7878"
 	}
 
+	// Mics may keep one connection open for their whole 30 s awake window and
+	// send back-to-back utterances on it, so idle connections outlive that.
+	server := &http.Server{
+		Addr:              ":" + port,
+		Handler:           mux,
+		ReadHeaderTimeout: 10 * time.Second,
+		IdleTimeout:       60 * time.Second,
+	}
+
+	// On SIGTERM let requests finish, then drain the archive so the last
+	// segment is complete on disk
+	stop, stopped := signal.NotifyContext(ctx, os.Interrupt, syscall.SIGTERM)
+	defer stopped()
+	drained := make(chan struct{})
+	go func() {
+		defer close(drained)
+		<-stop.Done()
+		shutdownCtx, cancel := context.WithTimeout(context.Background(), 10*time.Second)
+		defer cancel()
+		if err := server.Shutdown(shutdownCtx); err != nil {
+			slog.Warn("requests still running at shutdown", "error", err)
+		}
+	}()
+
 	slog.Info("starting server", "port", port)
-	if err := http.ListenAndServe(":"+port, mux); err != nil {
+	if err := server.ListenAndServe(); err != nil && err != http.ErrServerClosed {
 		panic(err)
 	}
+	// ListenAndServe returns as soon as Shutdown starts; wait for the handlers
+	// before the deferred archive.close()
+	<-drained
+	slog.Info("server stopped, draining archive")
 }
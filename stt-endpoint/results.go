@@ -0,0 +1,108 @@
+package main
+
+import (
+	"encoding/json"
+	"io"
+	"log/slog"
+	"net/http"
+	"strings"
+	"sync"
+
+	speechpb "cloud.google.com/go/speech/apiv2/speechpb"
+)
+
+// stableThreshold is the Speech stability above which an interim result is
+// forwarded as stable text that is unlikely to be revised.
+const stableThreshold = 0.8
+
+// transcriptUpdate is one NDJSON line of a partial-results response. Text is
+// the full current hypothesis; Stable is the prefix of it the mic may type.
+// The last line has Final set and carries the complete transcript (or Error).
+type transcriptUpdate struct {
+	Text   string `json:"text"`
+	Stable string `json:"stable,omitempty"`
+	Final  bool   `json:"final"`
+	Error  string `json:"error,omitempty"`
+}
+
+// wantsPartialResults reports whether the client asked for an NDJSON stream
+// of interim results instead of a single JSON object.
+func wantsPartialResults(r *http.Request) bool {
+	return strings.Contains(r.Header.Get("Accept"), "application/x-ndjson")
+}
+
+// collectStreamingResults reads the recognition stream to the end and returns
+// all final results joined together. onUpdate is called after every response
+// that changes the hypothesis.
+func collectStreamingResults(stream speechpb.Speech_StreamingRecognizeClient, onUpdate func(transcriptUpdate)) (string, error) {
+	var finals []string
+	for {
+		resp, err := stream.Recv()
+		if err == io.EOF {
+			return strings.Join(finals, " "), nil
+		}
+		if err != nil {
+			return strings.Join(finals, " "), err
+		}
+
+		// Results after the finals are interim, most stable first
+		var interim, stable []string
+		stablePrefix := true
+		for _, result := range resp.Results {
+			slog.Info("result", slog.Bool("isFinal", result.IsFinal), slog.Any("alternatives", result.Alternatives))
+			if len(result.Alternatives) == 0 {
+				continue
+			}
+			text := strings.TrimSpace(result.Alternatives[0].Transcript)
+			if text == "" {
+				continue
+			}
+			if result.IsFinal {
+				finals = append(finals, text)
+				continue
+			}
+			interim = append(interim, text)
+			if stablePrefix && result.Stability >= stableThreshold {
+				stable = append(stable, text)
+			} else {
+				stablePrefix = false
+			}
+		}
+
+		withFinals := func(extra []string) string {
+			return strings.Join(append(append([]string(nil), finals...), extra...), " ")
+		}
+		onUpdate(transcriptUpdate{
+			Text:   withFinals(interim),
+			Stable: withFinals(stable),
+		})
+	}
+}
+
+// ndjsonWriter streams transcriptUpdates as newline-delimited JSON, flushing
+// each line so it reaches the mic immediately.
+type ndjsonWriter struct {
+	mu  sync.Mutex
+	rc  *http.ResponseController
+	enc *json.Encoder
+}
+
+func newNDJSONWriter(w http.ResponseWriter) *ndjsonWriter {
+	w.Header().Set("Content-Type", "application/x-ndjson")
+	w.WriteHeader(http.StatusOK)
+	rc := http.NewResponseController(w)
+	rc.Flush()
+	return &ndjsonWriter{rc: rc, enc: json.NewEncoder(w)}
+}
+
+func (n *ndjsonWriter) write(update transcriptUpdate) {
+	n.mu.Lock()
+	defer n.mu.Unlock()
+	if err := n.enc.Encode(update); err != nil {
+		slog.Warn("failed to write transcript update", "error", err)
+		return
+	}
+	if err := n.rc.Flush(); err != nil {
+		slog.Warn("failed to flush transcript update", "error", err)
+	}
+}
@@ -0,0 +1,199 @@
+package main
+
+import (
+	"context"
+	"errors"
+	"io"
+	"net/http"
+	"net/http/httptest"
+	"reflect"
+	"strings"
+	"testing"
+	"time"
+
+	speechpb "cloud.google.com/go/speech/apiv2/speechpb"
+	"google.golang.org/grpc"
+)
+
+// scriptedStream replays responses, then ends with err (io.EOF if nil).
+type scriptedStream struct {
+	grpc.ClientStream
+	responses []*speechpb.StreamingRecognizeResponse
+	err       error
+}
+
+func (s *scriptedStream) Recv() (*speechpb.StreamingRecognizeResponse, error) {
+	if len(s.responses) == 0 {
+		if s.err != nil {
+			return nil, s.err
+		}
+		return nil, io.EOF
+	}
+	resp := s.responses[0]
+	s.responses = s.responses[1:]
+	return resp, nil
+}
+
+func (s *scriptedStream) Send(*speechpb.StreamingRecognizeRequest) error { return nil }
+func (s *scriptedStream) CloseSend() error                               { return nil }
+
+type result struct {
+	text      string
+	stability float32
+	final     bool
+}
+
+func response(results ...result) *speechpb.StreamingRecognizeResponse {
+	resp := &speechpb.StreamingRecognizeResponse{}
+	for _, r := range results {
+		resp.Results = append(resp.Results, &speechpb.StreamingRecognitionResult{
+			Alternatives: []*speechpb.SpeechRecognitionAlternative{{Transcript: r.text}},
+			Stability:    r.stability,
+			IsFinal:      r.final,
+		})
+	}
+	return resp
+}
+
+func TestCollectStreamingResults(t *testing.T) {
+	stream := &scriptedStream{responses: []*speechpb.StreamingRecognizeResponse{
+		response(result{"hello", 0.9, false}, result{"wor", 0.1, false}),
+		response(result{" hello world ", 0, true}),
+		// Stability only counts up to the first unstable result
+		response(result{"how", 0.2, false}, result{"are", 0.9, false}),
+		response(result{"", 0, true}, result{"how are you", 0, true}),
+	}}
+	var updates []transcriptUpdate
+	transcript, err := collectStreamingResults(stream, func(u transcriptUpdate) {
+		updates = append(updates, u)
+	})
+	if err != nil {
+		t.Fatal(err)
+	}
+	if want := "hello world how are you"; transcript != want {
+		t.Errorf("transcript = %q, want %q", transcript, want)
+	}
+	want := []transcriptUpdate{
+		{Text: "hello wor", Stable: "hello"},
+		{Text: "hello world", Stable: "hello world"},
+		{Text: "hello world how are", Stable: "hello world"},
+		{Text: "hello world how are you", Stable: "hello world how are you"},
+	}
+	if !reflect.DeepEqual(updates, want) {
+		t.Errorf("updates = %+v, want %+v", updates, want)
+	}
+}
+
+func TestCollectStreamingResultsKeepsFinalsOnError(t *testing.T) {
+	broken := errors.New("stream reset")
+	stream := &scriptedStream{
+		responses: []*speechpb.StreamingRecognizeResponse{response(result{"so far", 0, true})},
+		err:       broken,
+	}
+	transcript, err := collectStreamingResults(stream, func(transcriptUpdate) {})
+	if transcript != "so far" || err != broken {
+		t.Errorf("got %q, %v; want %q, %v", transcript, err, "so far", broken)
+	}
+}
+
+func TestWantsPartialResults(t *testing.T) {
+	r, _ := http.NewRequest(http.MethodPost, "/stream", nil)
+	if wantsPartialResults(r) {
+		t.Error("no Accept header asked for partial results")
+	}
+	r.Header.Set("Accept", "application/json, application/x-ndjson")
+	if !wantsPartialResults(r) {
+		t.Error("Accept with application/x-ndjson did not ask for partial results")
+	}
+}
+
+func TestNDJSONWriterWritesOneLinePerUpdate(t *testing.T) {
+	rec := httptest.NewRecorder()
+	lines := newNDJSONWriter(rec)
+	lines.write(transcriptUpdate{Text: "hello wor", Stable: "hello"})
+	lines.write(transcriptUpdate{Text: "hello world", Final: true})
+
+	if got := rec.Header().Get("Content-Type"); got != "application/x-ndjson" {
+		t.Errorf("Content-Type = %q", got)
+	}
+	want := `{"text":"hello wor","stable":"hello","final":false}` + "\n" +
+		`{"text":"hello world","final":true}` + "\n"
+	if rec.Body.String() != want {
+		t.Errorf("body = %q, want %q", rec.Body.String(), want)
+	}
+	if !rec.Flushed {
+		t.Error("updates were not flushed")
+	}
+}
+
+func TestFakeSpeechStreamsInterimThenFinal(t *testing.T) {
+	client := newFakeSpeechClient(10*time.Millisecond, 0)
+	stream, err := client.StreamingRecognize(context.Background())
+	if err != nil {
+		t.Fatal(err)
+	}
+	audio := make([]byte, fakeBytesPerWord/2)
+	for i := 0; i < 5; i++ {
+		if err := stream.Send(&speechpb.StreamingRecognizeRequest{
+			StreamingRequest: &speechpb.StreamingRecognizeRequest_Audio{Audio: audio},
+		}); err != nil {
+			t.Fatal(err)
+		}
+	}
+	stream.CloseSend()
+	if err := stream.Send(&speechpb.StreamingRecognizeRequest{}); err != io.EOF {
+		t.Errorf("Send after CloseSend = %v, want io.EOF", err)
+	}
+
+	var updates []transcriptUpdate
+	transcript, err := collectStreamingResults(stream, func(u transcriptUpdate) {
+		updates = append(updates, u)
+	})
+	if err != nil || transcript != "word1 word2" {
+		t.Fatalf("got %q, %v", transcript, err)
+	}
+	want := []transcriptUpdate{
+		{Text: "word1", Stable: "word1"},
+		{Text: "word1 word2", Stable: "word1 word2"},
+		{Text: "word1 word2", Stable: "word1 word2"},
+	}
+	if !reflect.DeepEqual(updates, want) {
+		t.Errorf("updates = %+v, want %+v", updates, want)
+	}
+}
+
+func TestFakeSpeechEnforcesStreamLimits(t *testing.T) {
+	client := newFakeSpeechClient(0, 0)
+	stream, _ := client.StreamingRecognize(context.Background())
+	send := func(n int) error {
+		return stream.Send(&speechpb.StreamingRecognizeRequest{
+			StreamingRequest: &speechpb.StreamingRecognizeRequest_Audio{Audio: make([]byte, n)},
+		})
+	}
+	if err := send(fakeStreamLimitBytes); err != nil {
+		t.Fatalf("five minutes of audio: %v", err)
+	}
+	if err := send(2); err == nil || !strings.Contains(err.Error(), "exceeded") {
+		t.Errorf("audio past the limit: %v", err)
+	}
+
+	// A stream that waited too long for its first audio has been aborted
+	stale, _ := client.StreamingRecognize(context.Background())
+	stale.(*fakeSpeechStream).created = time.Now().Add(-fakeAudioTimeout - time.Second)
+	err := stale.Send(&speechpb.StreamingRecognizeRequest{
+		StreamingRequest: &speechpb.StreamingRecognizeRequest_Audio{Audio: make([]byte, 2)},
+	})
+	if err == nil {
+		t.Error("stale stream accepted audio")
+	}
+}
+
+func TestFakeSpeechRecvEndsWithContext(t *testing.T) {
+	ctx, cancel := context.WithCancel(context.Background())
+	stream, _ := newFakeSpeechClient(time.Hour, 0).StreamingRecognize(ctx)
+	stream.CloseSend()
+	cancel()
+	if _, err := stream.Recv(); !errors.Is(err, context.Canceled) {
+		t.Errorf("Recv after cancel = %v", err)
+	}
+}
@@ -0,0 +1,168 @@
+package main
+
+import (
+	"context"
+	"strings"
+	"sync"
+	"time"
+
+	speechpb "cloud.google.com/go/speech/apiv2/speechpb"
+)
+
+// streamRotateAfter is how much audio one StreamingRecognize stream gets
+// before the session moves on to a fresh one. The API ends streams at about
+// five minutes, so long dictation is carried by a chain of streams.
+const streamRotateAfter = 270 * time.Second
+
+// streamingSession feeds one upload into as many consecutive
+// StreamingRecognize streams as it needs. When a stream has had
+// rotateBytes of audio the next one is opened first and the old one is
+// half-closed, so no audio waits on the handover; the old stream's last
+// results still arrive and are committed in order. Only the current
+// hypothesis and the committed text are kept, so memory does not grow
+// with the length of the audio beyond the transcript itself.
+type streamingSession struct {
+	ctx         context.Context
+	open        func(context.Context) (speechpb.Speech_StreamingRecognizeClient, error)
+	rotateBytes int
+	onUpdate    func(transcriptUpdate)
+
+	wg sync.WaitGroup
+
+	mu        sync.Mutex
+	committed []string   // transcripts of finished segments, in order
+	pending   []*segment // segments whose results are not all in, oldest first
+	current   *segment   // the segment receiving audio
+	err       error
+}
+
+type segment struct {
+	stream speechpb.Speech_StreamingRecognizeClient
+	bytes  int
+
+	finished   bool
+	transcript string
+	err        error
+	held       *transcriptUpdate // latest update while an older segment finishes
+}
+
+func newStreamingSession(ctx context.Context, rotateBytes int,
+	open func(context.Context) (speechpb.Speech_StreamingRecognizeClient, error),
+	onUpdate func(transcriptUpdate)) (*streamingSession, error) {
+	s := &streamingSession{ctx: ctx, open: open, rotateBytes: rotateBytes, onUpdate: onUpdate}
+	if err := s.startSegment(); err != nil {
+		return nil, err
+	}
+	return s, nil
+}
+
+func (s *streamingSession) startSegment() error {
+	stream, err := s.open(s.ctx)
+	if err != nil {
+		return err
+	}
+	seg := &segment{stream: stream}
+	s.mu.Lock()
+	s.pending = append(s.pending, seg)
+	s.current = seg
+	s.mu.Unlock()
+
+	s.wg.Add(1)
+	go func() {
+		defer s.wg.Done()
+		transcript, err := collectStreamingResults(stream, func(update transcriptUpdate) {
+			s.update(seg, update)
+		})
+		s.finish(seg, transcript, err)
+	}()
+	return nil
+}
+
+// send forwards LINEAR16 audio, rotating to a new stream when the current
+// one is full.
+func (s *streamingSession) send(audio []byte) error {
+	if s.rotateBytes > 0 && s.current.bytes > 0 && s.current.bytes+len(audio) > s.rotateBytes {
+		old := s.current
+		if err := s.startSegment(); err != nil {
+			return err
+		}
+		if err := old.stream.CloseSend(); err != nil {
+			return err
+		}
+	}
+	s.current.bytes += len(audio)
+	return s.current.stream.Send(&speechpb.StreamingRecognizeRequest{
+		StreamingRequest: &speechpb.StreamingRecognizeRequest_Audio{Audio: audio},
+	})
+}
+
+// close ends the upload and waits for every segment's final results. It
+// returns the whole transcript and the first receive error, if any.
+func (s *streamingSession) close() (string, error) {
+	closeErr := s.current.stream.CloseSend()
+	s.wg.Wait()
+	s.mu.Lock()
+	defer s.mu.Unlock()
+	if s.err == nil {
+		s.err = closeErr
+	}
+	return strings.Join(s.committed, " "), s.err
+}
+
+// wait blocks until every receiver has returned; the caller cancels the
+// context first when abandoning the session.
+func (s *streamingSession) wait() {
+	s.wg.Wait()
+}
+
+// prefixed adds the committed text of earlier segments to an update.
+// Committed finals are stable, so they also lead the stable prefix.
+func (s *streamingSession) prefixed(update transcriptUpdate) transcriptUpdate {
+	if len(s.committed) == 0 {
+		return update
+	}
+	prefix := strings.Join(s.committed, " ")
+	join := func(rest string) string {
+		if rest == "" {
+			return prefix
+		}
+		return prefix + " " + rest
+	}
+	update.Text = join(update.Text)
+	update.Stable = join(update.Stable)
+	return update
+}
+
+func (s *streamingSession) update(seg *segment, update transcriptUpdate) {
+	s.mu.Lock()
+	defer s.mu.Unlock()
+	if len(s.pending) > 0 && s.pending[0] != seg {
+		// An older stream is still finishing; its text goes first
+		seg.held = &update
+		return
+	}
+	s.onUpdate(s.prefixed(update))
+}
+
+func (s *streamingSession) finish(seg *segment, transcript string, err error) {
+	s.mu.Lock()
+	defer s.mu.Unlock()
+	seg.finished = true
+	seg.transcript = transcript
+	seg.err = err
+
+	for len(s.pending) > 0 && s.pending[0].finished {
+		done := s.pending[0]
+		s.pending = s.pending[1:]
+		if done.transcript != "" {
+			s.committed = append(s.committed, done.transcript)
+		}
+		if done.err != nil && s.err == nil {
+			s.err = done.err
+		}
+		if len(s.pending) > 0 && s.pending[0].held != nil {
+			s.onUpdate(s.prefixed(*s.pending[0].held))
+			s.pending[0].held = nil
+		}
+	}
+}
@@ -0,0 +1,330 @@
+package main
+
+import (
+	"context"
+	"fmt"
+	"io"
+	"reflect"
+	"runtime"
+	"sync"
+	"testing"
+	"time"
+
+	speechpb "cloud.google.com/go/speech/apiv2/speechpb"
+	"google.golang.org/grpc"
+)
+
+// heldStream is a recognition stream whose responses the test releases.
+// Every open, send and half-close is logged in order across streams.
+type heldStream struct {
+	grpc.ClientStream
+	name      string
+	log       *eventLog
+	responses chan *speechpb.StreamingRecognizeResponse
+	err       error // returned once responses is closed; io.EOF if nil
+
+	mu     sync.Mutex
+	audio  int
+	closed bool
+}
+
+type eventLog struct {
+	mu     sync.Mutex
+	events []string
+}
+
+func (l *eventLog) add(format string, args ...any) {
+	l.mu.Lock()
+	defer l.mu.Unlock()
+	l.events = append(l.events, fmt.Sprintf(format, args...))
+}
+
+func (l *eventLog) get() []string {
+	l.mu.Lock()
+	defer l.mu.Unlock()
+	return append([]string(nil), l.events...)
+}
+
+func (s *heldStream) Send(req *speechpb.StreamingRecognizeRequest) error {
+	s.mu.Lock()
+	defer s.mu.Unlock()
+	s.audio += len(req.GetAudio())
+	s.log.add("%s send %d", s.name, len(req.GetAudio()))
+	return nil
+}
+
+func (s *heldStream) CloseSend() error {
+	s.mu.Lock()
+	defer s.mu.Unlock()
+	if !s.closed {
+		s.closed = true
+		s.log.add("%s close", s.name)
+	}
+	return nil
+}
+
+func (s *heldStream) Recv() (*speechpb.StreamingRecognizeResponse, error) {
+	resp, ok := <-s.responses
+	if !ok {
+		if s.err != nil {
+			return nil, s.err
+		}
+		return nil, io.EOF
+	}
+	return resp, nil
+}
+
+// heldOpener hands out heldStreams named a, b, c, ...
+type heldOpener struct {
+	log     eventLog
+	mu      sync.Mutex
+	streams []*heldStream
+}
+
+func (o *heldOpener) open(context.Context) (speechpb.Speech_StreamingRecognizeClient, error) {
+	o.mu.Lock()
+	defer o.mu.Unlock()
+	s := &heldStream{
+		name:      string(rune('a' + len(o.streams))),
+		log:       &o.log,
+		responses: make(chan *speechpb.StreamingRecognizeResponse, 8),
+	}
+	o.streams = append(o.streams, s)
+	o.log.add("%s open", s.name)
+	return s, nil
+}
+
+func (o *heldOpener) stream(i int) *heldStream {
+	o.mu.Lock()
+	defer o.mu.Unlock()
+	return o.streams[i]
+}
+
+type updateLog struct {
+	mu      sync.Mutex
+	updates []transcriptUpdate
+}
+
+func (u *updateLog) add(update transcriptUpdate) {
+	u.mu.Lock()
+	defer u.mu.Unlock()
+	u.updates = append(u.updates, update)
+}
+
+func (u *updateLog) get() []transcriptUpdate {
+	u.mu.Lock()
+	defer u.mu.Unlock()
+	return append([]transcriptUpdate(nil), u.updates...)
+}
+
+func TestSessionRotatesBeforeTheNextStreamIsFull(t *testing.T) {
+	opener := &heldOpener{}
+	session, err := newStreamingSession(context.Background(), 1000, opener.open, func(transcriptUpdate) {})
+	if err != nil {
+		t.Fatal(err)
+	}
+	for i := 0; i < 7; i++ {
+		if err := session.send(make([]byte, 300)); err != nil {
+			t.Fatal(err)
+		}
+	}
+	// A chunk bigger than a whole stream still goes somewhere
+	if err := session.send(make([]byte, 1500)); err != nil {
+		t.Fatal(err)
+	}
+	for _, s := range opener.streams {
+		close(s.responses)
+	}
+	if _, err := session.close(); err != nil {
+		t.Fatal(err)
+	}
+
+	// The next stream is open before the full one is half-closed, so audio
+	// never waits on the handover
+	want := []string{
+		"a open", "a send 300", "a send 300", "a send 300",
+		"b open", "a close", "b send 300", "b send 300", "b send 300",
+		"c open", "b close", "c send 300",
+		"d open", "c close", "d send 1500", "d close",
+	}
+	if got := opener.log.get(); !reflect.DeepEqual(got, want) {
+		t.Errorf("events =\n%v\nwant\n%v", got, want)
+	}
+}
+
+func TestSessionCommitsSegmentsInOrder(t *testing.T) {
+	opener := &heldOpener{}
+	var updates updateLog
+	session, _ := newStreamingSession(context.Background(), 100, opener.open, updates.add)
+	session.send(make([]byte, 100))
+	session.send(make([]byte, 100))
+	a, b := opener.stream(0), opener.stream(1)
+
+	// b runs ahead of a: its text waits until a's final is in
+	a.responses <- response(result{"one", 0.9, false})
+	b.responses <- response(result{"three", 0.9, false})
+	b.responses <- response(result{"three four", 0, true})
+	close(b.responses)
+	waitFor(t, func() bool { return len(updates.get()) == 1 })
+	time.Sleep(20 * time.Millisecond)
+	if got := updates.get(); len(got) != 1 {
+		t.Fatalf("b's results overtook a's: %+v", got)
+	}
+
+	a.responses <- response(result{"one two", 0, true})
+	close(a.responses)
+	transcript, err := session.close()
+	if err != nil || transcript != "one two three four" {
+		t.Fatalf("close = %q, %v", transcript, err)
+	}
+	want := []transcriptUpdate{
+		{Text: "one", Stable: "one"},
+		{Text: "one two", Stable: "one two"},
+		// b's latest update, released with a's text in front of it
+		{Text: "one two three four", Stable: "one two three four"},
+	}
+	if got := updates.get(); !reflect.DeepEqual(got, want) {
+		t.Errorf("updates = %+v, want %+v", got, want)
+	}
+}
+
+func TestSessionKeepsTextAndReportsTheFirstStreamError(t *testing.T) {
+	opener := &heldOpener{}
+	session, _ := newStreamingSession(context.Background(), 100, opener.open, func(transcriptUpdate) {})
+	for i := 0; i < 3; i++ {
+		session.send(make([]byte, 100))
+	}
+	a, b, c := opener.stream(0), opener.stream(1), opener.stream(2)
+
+	// c fails first, but a's error is the earlier one in the audio
+	c.err = fmt.Errorf("c: quota exceeded")
+	close(c.responses)
+	a.err = fmt.Errorf("a: stream reset")
+	a.responses <- response(result{"one", 0, true})
+	close(a.responses)
+	b.responses <- response(result{"two", 0, true})
+	close(b.responses)
+
+	transcript, err := session.close()
+	if transcript != "one two" || err != a.err {
+		t.Errorf("close = %q, %v; want %q, %v", transcript, err, "one two", a.err)
+	}
+}
+
+// Six minutes at 16 kHz through the offline recognizer, which like the API
+// refuses more than five minutes on one stream
+func TestLongDictationOutlastsTheStreamLimit(t *testing.T) {
+	const sampleRate = 16000
+	const chunk = 8192
+	rotateBytes := int(streamRotateAfter.Seconds()) * sampleRate * 2
+	if rotateBytes >= fakeStreamLimitBytes {
+		t.Fatalf("rotation at %d bytes is past the %d byte limit", rotateBytes, fakeStreamLimitBytes)
+	}
+
+	client := newFakeSpeechClient(0, 0)
+	var streamsMu sync.Mutex
+	var streams []*fakeSpeechStream
+	open := func(ctx context.Context) (speechpb.Speech_StreamingRecognizeClient, error) {
+		stream, err := client.StreamingRecognize(ctx)
+		if err == nil {
+			streamsMu.Lock()
+			streams = append(streams, stream.(*fakeSpeechStream))
+			streamsMu.Unlock()
+		}
+		return stream, err
+	}
+	// The replay runs far faster than real time, so the fake's buffer of
+	// interim results would fill with copies of the growing transcript. Let
+	// the session read them, as it keeps up with a real-time stream, before
+	// measuring.
+	settledHeap := func() uint64 {
+		waitFor(t, func() bool {
+			streamsMu.Lock()
+			defer streamsMu.Unlock()
+			for _, stream := range streams {
+				if len(stream.responses) > 0 {
+					return false
+				}
+			}
+			return true
+		})
+		return heapInUse()
+	}
+	// Only the latest update is kept, so the log itself does not grow
+	var mu sync.Mutex
+	var last transcriptUpdate
+	updates := 0
+	onUpdate := func(update transcriptUpdate) {
+		mu.Lock()
+		defer mu.Unlock()
+		last = update
+		updates++
+	}
+	session, err := newStreamingSession(context.Background(), rotateBytes, open, onUpdate)
+	if err != nil {
+		t.Fatal(err)
+	}
+	audio := make([]byte, chunk)
+	total := 6 * 60 * sampleRate * 2
+	oneMinute := 60 * sampleRate * 2
+	var heapAtOneMinute, heapAtEnd uint64
+	for sent := 0; sent < total; sent += chunk {
+		if sent >= oneMinute && heapAtOneMinute == 0 {
+			heapAtOneMinute = settledHeap()
+		}
+		if err := session.send(audio); err != nil {
+			t.Fatalf("after %d bytes: %v", sent, err)
+		}
+	}
+	heapAtEnd = settledHeap()
+	transcript, err := session.close()
+	if err != nil {
+		t.Fatal(err)
+	}
+
+	first := rotateBytes / chunk * chunk
+	want := fakeTranscript(first) + " " + fakeTranscript((total+chunk-1)/chunk*chunk-first)
+	if transcript != want {
+		t.Errorf("transcript has %d bytes, want %d", len(transcript), len(want))
+	}
+	// The second stream's words come after the first stream's, not in place
+	// of them
+	mu.Lock()
+	if updates == 0 || last.Text != want {
+		t.Errorf("last of %d updates does not carry the whole transcript", updates)
+	}
+	mu.Unlock()
+
+	// Five more minutes of audio, through a stream rotation, may only add the
+	// transcript text; audio is never buffered beyond the chunk in flight
+	growth := int64(heapAtEnd) - int64(heapAtOneMinute)
+	t.Logf("heap in use: %d KB after one minute, %d KB after six", heapAtOneMinute/1024,
+		heapAtEnd/1024)
+	if growth > maxDictationHeapGrowth {
+		t.Errorf("heap grew by %d KB, want at most %d KB", growth/1024, maxDictationHeapGrowth/1024)
+	}
+}
+
+// maxDictationHeapGrowth bounds heap growth over a long dictation: the
+// transcript (about 8 KB here), a second stream and allocator slack.
+const maxDictationHeapGrowth = 512 << 10
+
+// heapInUse is the live heap after a collection, so garbage left by earlier
+// sends does not count as growth.
+func heapInUse() uint64 {
+	runtime.GC()
+	var m runtime.MemStats
+	runtime.ReadMemStats(&m)
+	return m.HeapInuse
+}
+
+func waitFor(t *testing.T, condition func() bool) {
+	t.Helper()
+	deadline := time.Now().Add(2 * time.Second)
+	for !condition() {
+		if time.Now().After(deadline) {
+			t.Fatal("timed out")
+		}
+		time.Sleep(time.Millisecond)
+	}
+}
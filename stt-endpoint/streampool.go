@@ -0,0 +1,184 @@
+package main
+
+import (
+	"context"
+	"expvar"
+	"log/slog"
+	"sync"
+	"time"
+
+	speechpb "cloud.google.com/go/speech/apiv2/speechpb"
+)
+
+// streamKey is everything that goes into a stream's StreamingConfig. Audio is
+// decoded to LINEAR16 before it is sent, so the upload encoding is not part
+// of it.
+type streamKey struct {
+	sampleRate int32
+	model      string
+	interim    bool
+}
+
+type pooledStream struct {
+	stream  speechpb.Speech_StreamingRecognizeClient
+	cancel  context.CancelFunc
+	created time.Time
+}
+
+var (
+	streamPoolHits    = expvar.NewInt("stream_pool_hits")
+	streamPoolMisses  = expvar.NewInt("stream_pool_misses")
+	streamPoolExpired = expvar.NewInt("stream_pool_expired")
+)
+
+func init() {
+	expvar.Publish("stream_pool_hit_rate", expvar.Func(func() any {
+		hits, misses := streamPoolHits.Value(), streamPoolMisses.Value()
+		if hits+misses == 0 {
+			return 0.0
+		}
+		return float64(hits) / float64(hits+misses)
+	}))
+}
+
+// streamPool keeps a few StreamingRecognize streams open and configured for
+// each key that was used recently, so a request starts sending audio without
+// waiting for stream setup. A stream that has sat unused for idle is closed
+// (the API aborts streams that get no audio) and, while its key has been
+// taken within keepWarm, replaced in the background.
+type streamPool struct {
+	ctx      context.Context
+	open     func(context.Context, streamKey) (speechpb.Speech_StreamingRecognizeClient, error)
+	size     int
+	idle     time.Duration
+	keepWarm time.Duration
+
+	mu       sync.Mutex
+	ready    map[streamKey][]*pooledStream
+	filling  map[streamKey]int
+	lastUsed map[streamKey]time.Time
+}
+
+func newStreamPool(ctx context.Context, size int, idle, keepWarm time.Duration,
+	open func(context.Context, streamKey) (speechpb.Speech_StreamingRecognizeClient, error)) *streamPool {
+	p := &streamPool{
+		ctx:      ctx,
+		open:     open,
+		size:     size,
+		idle:     idle,
+		keepWarm: keepWarm,
+		ready:    make(map[streamKey][]*pooledStream),
+		filling:  make(map[streamKey]int),
+		lastUsed: make(map[streamKey]time.Time),
+	}
+	if size > 0 {
+		go p.expire()
+	}
+	return p
+}
+
+// take returns a configured stream for key, from the pool when one is ready
+// or opened on the spot otherwise. The stream ends when ctx does.
+func (p *streamPool) take(ctx context.Context, key streamKey) (speechpb.Speech_StreamingRecognizeClient, bool, error) {
+	if p.size <= 0 {
+		stream, err := p.open(ctx, key)
+		return stream, false, err
+	}
+
+	p.mu.Lock()
+	p.lastUsed[key] = time.Now()
+	var ps *pooledStream
+	for streams := p.ready[key]; len(streams) > 0 && ps == nil; streams = p.ready[key] {
+		ps = streams[len(streams)-1]
+		p.ready[key] = streams[:len(streams)-1]
+		if time.Since(ps.created) > p.idle {
+			p.discard(ps)
+			ps = nil
+		}
+	}
+	p.mu.Unlock()
+	p.refill(key)
+
+	if ps == nil {
+		streamPoolMisses.Add(1)
+		stream, err := p.open(ctx, key)
+		return stream, false, err
+	}
+	streamPoolHits.Add(1)
+	// Pooled streams belong to the pool's context; tie this one to the request
+	context.AfterFunc(ctx, ps.cancel)
+	return ps.stream, true, nil
+}
+
+// refill opens streams in the background until key has size of them ready or
+// on the way.
+func (p *streamPool) refill(key streamKey) {
+	p.mu.Lock()
+	need := p.size - len(p.ready[key]) - p.filling[key]
+	if need <= 0 {
+		p.mu.Unlock()
+		return
+	}
+	p.filling[key] += need
+	p.mu.Unlock()
+
+	for i := 0; i < need; i++ {
+		go func() {
+			ctx, cancel := context.WithCancel(p.ctx)
+			stream, err := p.open(ctx, key)
+			p.mu.Lock()
+			defer p.mu.Unlock()
+			p.filling[key]--
+			if err != nil {
+				cancel()
+				slog.Warn("failed to pre-open stream", "error", err, "sample_rate", key.sampleRate, "model", key.model)
+				return
+			}
+			p.ready[key] = append(p.ready[key], &pooledStream{stream: stream, cancel: cancel, created: time.Now()})
+		}()
+	}
+}
+
+// discard closes a stream that will never get audio. Called with mu held.
+func (p *streamPool) discard(ps *pooledStream) {
+	ps.cancel()
+	streamPoolExpired.Add(1)
+}
+
+func (p *streamPool) expire() {
+	ticker := time.NewTicker(p.idle / 2)
+	defer ticker.Stop()
+	for {
+		select {
+		case <-p.ctx.Done():
+			return
+		case <-ticker.C:
+		}
+
+		var warm []streamKey
+		p.mu.Lock()
+		for key, streams := range p.ready {
+			kept := streams[:0]
+			for _, ps := range streams {
+				if time.Since(ps.created) > p.idle {
+					p.discard(ps)
+				} else {
+					kept = append(kept, ps)
+				}
+			}
+			p.ready[key] = kept
+			if time.Since(p.lastUsed[key]) < p.keepWarm {
+				warm = append(warm, key)
+			} else if len(kept) == 0 && p.filling[key] == 0 {
+				delete(p.ready, key)
+				delete(p.filling, key)
+				delete(p.lastUsed, key)
+			}
+		}
+		p.mu.Unlock()
+
+		for _, key := range warm {
+			p.refill(key)
+		}
+	}
+}
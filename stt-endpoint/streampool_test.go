@@ -0,0 +1,216 @@
+package main
+
+import (
+	"context"
+	"errors"
+	"sync"
+	"testing"
+	"time"
+
+	speechpb "cloud.google.com/go/speech/apiv2/speechpb"
+)
+
+// countedStream remembers which open made it and the context it lives in.
+type countedStream struct {
+	scriptedStream
+	n   int
+	key streamKey
+	ctx context.Context
+}
+
+type countingOpener struct {
+	mu      sync.Mutex
+	streams []*countedStream
+	fail    bool
+}
+
+func (o *countingOpener) open(ctx context.Context, key streamKey) (speechpb.Speech_StreamingRecognizeClient, error) {
+	o.mu.Lock()
+	defer o.mu.Unlock()
+	if o.fail {
+		return nil, errors.New("unavailable")
+	}
+	s := &countedStream{n: len(o.streams) + 1, key: key, ctx: ctx}
+	o.streams = append(o.streams, s)
+	return s, nil
+}
+
+func (o *countingOpener) opened() int {
+	o.mu.Lock()
+	defer o.mu.Unlock()
+	return len(o.streams)
+}
+
+func (p *streamPool) readyCount(key streamKey) int {
+	p.mu.Lock()
+	defer p.mu.Unlock()
+	return len(p.ready[key])
+}
+
+// waitReady waits for n streams ready for key and returns the newest.
+func (p *streamPool) waitReady(t *testing.T, key streamKey, n int) *countedStream {
+	t.Helper()
+	waitFor(t, func() bool { return p.readyCount(key) == n })
+	p.mu.Lock()
+	defer p.mu.Unlock()
+	return p.ready[key][n-1].stream.(*countedStream)
+}
+
+func newTestPool(t *testing.T, size int, idle, keepWarm time.Duration) (*streamPool, *countingOpener) {
+	ctx, cancel := context.WithCancel(context.Background())
+	t.Cleanup(cancel)
+	opener := &countingOpener{}
+	return newStreamPool(ctx, size, idle, keepWarm, opener.open), opener
+}
+
+var short16k = streamKey{sampleRate: 16000, model: "short"}
+
+func TestStreamPoolMissThenHit(t *testing.T) {
+	pool, opener := newTestPool(t, 2, time.Minute, time.Minute)
+	hits, misses := streamPoolHits.Value(), streamPoolMisses.Value()
+
+	// Nothing ready yet: opened for the request, and the pool fills behind it
+	first, hit, err := pool.take(context.Background(), short16k)
+	if err != nil || hit {
+		t.Fatalf("first take: hit %v, err %v", hit, err)
+	}
+	waitFor(t, func() bool { return pool.readyCount(short16k) == 2 })
+
+	ctx, cancel := context.WithCancel(context.Background())
+	stream, hit, err := pool.take(ctx, short16k)
+	if err != nil || !hit {
+		t.Fatalf("second take: hit %v, err %v", hit, err)
+	}
+	pooled := stream.(*countedStream)
+	if stream == first || pooled.key != short16k {
+		t.Errorf("took stream %d for %+v", pooled.n, pooled.key)
+	}
+	// Topped up again, never past size
+	waitFor(t, func() bool { return opener.opened() == 4 })
+	time.Sleep(20 * time.Millisecond)
+	if n := pool.readyCount(short16k); n != 2 || opener.opened() != 4 {
+		t.Errorf("%d ready after %d opens", n, opener.opened())
+	}
+
+	// The pooled stream now ends with the request
+	if pooled.ctx.Err() != nil {
+		t.Fatal("pooled stream ended before its request")
+	}
+	cancel()
+	waitFor(t, func() bool { return pooled.ctx.Err() != nil })
+
+	if streamPoolHits.Value()-hits != 1 || streamPoolMisses.Value()-misses != 1 {
+		t.Errorf("hits +%d, misses +%d", streamPoolHits.Value()-hits, streamPoolMisses.Value()-misses)
+	}
+}
+
+func TestStreamPoolKeepsConfigsApart(t *testing.T) {
+	pool, _ := newTestPool(t, 1, time.Minute, time.Minute)
+	long8k := streamKey{sampleRate: 8000, model: "long", interim: true}
+	pool.take(context.Background(), short16k)
+	waitFor(t, func() bool { return pool.readyCount(short16k) == 1 })
+
+	stream, hit, _ := pool.take(context.Background(), long8k)
+	if hit || stream.(*countedStream).key != long8k {
+		t.Errorf("8 kHz long-form request got a %+v stream (hit %v)", stream.(*countedStream).key, hit)
+	}
+}
+
+func TestStreamPoolDisabled(t *testing.T) {
+	pool, opener := newTestPool(t, 0, time.Minute, time.Minute)
+	for i := 0; i < 3; i++ {
+		if _, hit, err := pool.take(context.Background(), short16k); hit || err != nil {
+			t.Fatalf("take: hit %v, err %v", hit, err)
+		}
+	}
+	time.Sleep(20 * time.Millisecond)
+	if opener.opened() != 3 {
+		t.Errorf("opened %d streams for 3 requests", opener.opened())
+	}
+}
+
+// The API aborts a stream that gets no audio for about ten seconds, so one
+// that has sat for idle is never handed out
+func TestStreamPoolNeverHandsOutStaleStreams(t *testing.T) {
+	const idle = 200 * time.Millisecond
+	pool, _ := newTestPool(t, 1, idle, time.Minute)
+	expired := streamPoolExpired.Value()
+	pool.take(context.Background(), short16k)
+	stale := pool.waitReady(t, short16k, 1)
+
+	// Age it past idle without letting the background sweep get to it
+	pool.mu.Lock()
+	pool.ready[short16k][0].created = time.Now().Add(-2 * idle)
+	pool.mu.Unlock()
+
+	stream, hit, _ := pool.take(context.Background(), short16k)
+	if hit || stream.(*countedStream) == stale {
+		t.Error("took a stream older than idle")
+	}
+	if stale.ctx.Err() == nil || streamPoolExpired.Value()-expired != 1 {
+		t.Error("stale stream was not closed")
+	}
+}
+
+func TestStreamPoolReplacesIdleStreamsWhileKeyIsWarm(t *testing.T) {
+	const idle = 60 * time.Millisecond
+	pool, opener := newTestPool(t, 1, idle, time.Minute)
+	pool.take(context.Background(), short16k)
+	first := pool.waitReady(t, short16k, 1)
+
+	// The sweep closes it and opens a fresh one in its place
+	waitFor(t, func() bool { return first.ctx.Err() != nil })
+	waitFor(t, func() bool { return pool.readyCount(short16k) == 1 && opener.opened() >= 3 })
+	if _, hit, _ := pool.take(context.Background(), short16k); !hit {
+		t.Error("no warm stream after the idle one was replaced")
+	}
+}
+
+func TestStreamPoolForgetsColdKeys(t *testing.T) {
+	const idle = 40 * time.Millisecond
+	pool, opener := newTestPool(t, 1, idle, 10*time.Millisecond)
+	pool.take(context.Background(), short16k)
+	waitFor(t, func() bool { return pool.readyCount(short16k) == 1 })
+
+	waitFor(t, func() bool {
+		pool.mu.Lock()
+		defer pool.mu.Unlock()
+		_, ready := pool.ready[short16k]
+		_, used := pool.lastUsed[short16k]
+		return !ready && !used
+	})
+	opened := opener.opened()
+	time.Sleep(3 * idle)
+	if opener.opened() != opened {
+		t.Errorf("kept opening streams for a key nobody uses")
+	}
+}
+
+func TestStreamPoolSurvivesOpenFailures(t *testing.T) {
+	pool, opener := newTestPool(t, 2, time.Minute, time.Minute)
+	pool.take(context.Background(), short16k)
+	waitFor(t, func() bool { return pool.readyCount(short16k) == 2 })
+
+	opener.mu.Lock()
+	opener.fail = true
+	opener.mu.Unlock()
+	pool.take(context.Background(), short16k)
+	pool.take(context.Background(), short16k)
+	// Both refills fail; nothing stays counted as on the way
+	waitFor(t, func() bool {
+		pool.mu.Lock()
+		defer pool.mu.Unlock()
+		return pool.filling[short16k] == 0
+	})
+	if _, _, err := pool.take(context.Background(), short16k); err == nil {
+		t.Error("take succeeded with an empty pool and a failing API")
+	}
+
+	opener.mu.Lock()
+	opener.fail = false
+	opener.mu.Unlock()
+	waitFor(t, func() bool {
+		pool.take(context.Background(), short16k)
+		return pool.readyCount(short16k) > 0
+	})
+}
@@ -0,0 +1,66 @@
+package main
+
+import (
+	"log/slog"
+	"net/http"
+	"sync"
+	"time"
+)
+
+// utteranceHeader carries the mic's per-utterance trace id. The same id is
+// in the mic's and keyboard's TRACE dumps, so cmd/tracemerge can join the
+// endpoint's stage timings with theirs.
+const utteranceHeader = "X-Dayne-Utterance-Id"
+
+// utteranceTrace records when each stage of one request was first reached,
+// relative to the request arriving, and logs them as one "trace" line.
+type utteranceTrace struct {
+	id    string
+	start time.Time
+
+	mu     sync.Mutex
+	stages []slog.Attr
+	seen   map[string]bool
+}
+
+func newUtteranceTrace(r *http.Request) *utteranceTrace {
+	return &utteranceTrace{
+		id:    r.Header.Get(utteranceHeader),
+		start: time.Now(),
+		seen:  make(map[string]bool),
+	}
+}
+
+// mark records stage the first time it is reached. Safe for concurrent use.
+func (t *utteranceTrace) mark(stage string) {
+	if t.id == "" {
+		return
+	}
+	elapsed := time.Since(t.start).Microseconds()
+	t.mu.Lock()
+	defer t.mu.Unlock()
+	if t.seen[stage] {
+		return
+	}
+	t.seen[stage] = true
+	t.stages = append(t.stages, slog.Int64(stage+"_us", elapsed))
+}
+
+// log writes the recorded stages; requests without an id are not traced.
+func (t *utteranceTrace) log() {
+	if t.id == "" {
+		return
+	}
+	t.mu.Lock()
+	defer t.mu.Unlock()
+	attrs := append([]any{slog.String("utterance_id", t.id)}, attrsToAny(t.stages)...)
+	slog.Info("trace", attrs...)
+}
+
+func attrsToAny(attrs []slog.Attr) []any {
+	out := make([]any, len(attrs))
+	for i, a := range attrs {
+		out[i] = a
+	}
+	return out
+}
@@ -0,0 +1,70 @@
+package main
+
+import (
+	"bytes"
+	"encoding/json"
+	"log/slog"
+	"net/http"
+	"sync"
+	"testing"
+)
+
+// captureLog sends the default logger to a buffer for the rest of the test.
+func captureLog(t *testing.T) *bytes.Buffer {
+	var buf bytes.Buffer
+	previous := slog.Default()
+	slog.SetDefault(slog.New(slog.NewJSONHandler(&buf, nil)))
+	t.Cleanup(func() { slog.SetDefault(previous) })
+	return &buf
+}
+
+func TestUtteranceTraceLogsEachStageOnce(t *testing.T) {
+	buf := captureLog(t)
+	r, _ := http.NewRequest(http.MethodPost, "/stream", nil)
+	r.Header.Set(utteranceHeader, "0badcafe")
+	trace := newUtteranceTrace(r)
+
+	// Handlers mark from the request and from result goroutines at once
+	var wg sync.WaitGroup
+	for i := 0; i < 8; i++ {
+		wg.Add(1)
+		go func() {
+			defer wg.Done()
+			trace.mark("first_audio")
+			trace.mark("first_result")
+		}()
+	}
+	wg.Wait()
+	trace.mark("final_result")
+	trace.log()
+
+	var line map[string]any
+	if err := json.Unmarshal(buf.Bytes(), &line); err != nil {
+		t.Fatalf("want one JSON line, got %q: %v", buf.String(), err)
+	}
+	if line["msg"] != "trace" || line["utterance_id"] != "0badcafe" {
+		t.Errorf("line = %v", line)
+	}
+	for _, stage := range []string{"first_audio_us", "first_result_us", "final_result_us"} {
+		if _, ok := line[stage].(float64); !ok {
+			t.Errorf("%s missing from %v", stage, line)
+		}
+	}
+	if len(trace.stages) != 3 {
+		t.Errorf("recorded %d stages, want 3", len(trace.stages))
+	}
+	if line["final_result_us"].(float64) < line["first_audio_us"].(float64) {
+		t.Errorf("stages out of order: %v", line)
+	}
+}
+
+func TestUntracedRequestLogsNothing(t *testing.T) {
+	buf := captureLog(t)
+	r, _ := http.NewRequest(http.MethodPost, "/", nil)
+	trace := newUtteranceTrace(r)
+	trace.mark("first_audio")
+	trace.log()
+	if buf.Len() != 0 || len(trace.stages) != 0 {
+		t.Errorf("untraced request logged %q", buf.String())
+	}
+}
@@ -0,0 +1,180 @@
+#include "AudioCodec.h"
+
+#include <string.h>
+
+static const int16_t kImaStepTable[89] = {
+  7, 8, 9, 10, 11, 12, 13, 14, 16, 17, 19, 21, 23, 25, 28, 31, 34, 37, 41, 45,
+  50, 55, 60, 66, 73, 80, 88, 97, 107, 118, 130, 143, 157, 173, 190, 209, 230,
+  253, 279, 307, 337, 371, 408, 449, 494, 544, 598, 658, 724, 796, 876, 963,
+  1060, 1166, 1282, 1411, 1552, 1707, 1878, 2066, 2272, 2499, 2749, 3024, 3327,
+  3660, 4026, 4428, 4871, 5358, 5894, 6484, 7132, 7845, 8630, 9493, 10442,
+  11487, 12635, 13899, 15289, 16818, 18500, 20350, 22385, 24623, 27086, 29794,
+  32767
+};
+
+static const int8_t kImaIndexTable[16] = {
+  -1, -1, -1, -1, 2, 4, 6, 8,
+  -1, -1, -1, -1, 2, 4, 6, 8
+};
+
+void AudioEncoder::begin(AudioCodecType type) {
+  codecType = type;
+  reset();
+}
+
+void AudioEncoder::reset() {
+  predictor = 0;
+  stepIndex = 0;
+  hasPendingNibble = false;
+  pendingNibble = 0;
+}
+
+size_t AudioEncoder::maxEncodedSize(size_t samples) const {
+  switch (codecType) {
+    case CODEC_ULAW:
+      return samples;
+    case CODEC_IMA_ADPCM:
+      return (samples + 2) / 2;
+    case CODEC_PCM16:
+    default:
+      return samples * 2;
+  }
+}
+
+const char* AudioEncoder::contentType() const {
+  switch (codecType) {
+    case CODEC_ULAW:
+      return "audio/basic";
+    case CODEC_IMA_ADPCM:
+      return "audio/x-ima-adpcm";
+    case CODEC_PCM16:
+    default:
+      return "audio/l16";
+  }
+}
+
+const char* AudioEncoder::encodingName() const {
+  switch (codecType) {
+    case CODEC_ULAW:
+      return "ulaw";
+    case CODEC_IMA_ADPCM:
+      return "ima-adpcm";
+    case CODEC_PCM16:
+    default:
+      return "l16";
+  }
+}
+
+uint8_t AudioEncoder::bitsPerSample() const {
+  switch (codecType) {
+    case CODEC_ULAW:
+      return 8;
+    case CODEC_IMA_ADPCM:
+      return 4;
+    case CODEC_PCM16:
+    default:
+      return 16;
+  }
+}
+
+// G.711 mu-law, same segment layout as the reference implementation
+uint8_t AudioEncoder::encodeULaw(int16_t sample) {
+  const int32_t BIAS = 0x84;
+  const int32_t CLIP = 32635;
+
+  int32_t s = sample;
+  uint8_t sign = 0;
+  if (s < 0) {
+    sign = 0x80;
+    s = -s;
+  }
+  if (s > CLIP) s = CLIP;
+  s += BIAS;
+
+  uint8_t exponent = 7;
+  for (int32_t mask = 0x4000; (s & mask) == 0 && exponent > 0; mask >>= 1) {
+    exponent--;
+  }
+  uint8_t mantissa = (s >> (exponent + 3)) & 0x0F;
+  return ~(sign | (exponent << 4) | mantissa);
+}
+
+uint8_t AudioEncoder::encodeAdpcmNibble(int16_t sample) {
+  int32_t step = kImaStepTable[stepIndex];
+  int32_t diff = (int32_t)sample - predictor;
+  uint8_t code = 0;
+  if (diff < 0) {
+    code = 8;
+    diff = -diff;
+  }
+
+  // Reconstruct exactly what the decoder will: step/8 + the selected bits
+  int32_t vpdiff = step >> 3;
+  if (diff >= step) {
+    code |= 4;
+    diff -= step;
+    vpdiff += step;
+  }
+  step >>= 1;
+  if (diff >= step) {
+    code |= 2;
+    diff -= step;
+    vpdiff += step;
+  }
+  step >>= 1;
+  if (diff >= step) {
+    code |= 1;
+    vpdiff += step;
+  }
+
+  predictor += (code & 8) ? -vpdiff : vpdiff;
+  if (predictor > 32767) predictor = 32767;
+  if (predictor < -32768) predictor = -32768;
+
+  stepIndex += kImaIndexTable[code];
+  if (stepIndex < 0) stepIndex = 0;
+  if (stepIndex > 88) stepIndex = 88;
+
+  return code;
+}
+
+size_t AudioEncoder::encode(const int16_t* in, size_t samples, uint8_t* out) {
+  switch (codecType) {
+    case CODEC_ULAW:
+      for (size_t i = 0; i < samples; i++) {
+        out[i] = encodeULaw(in[i]);
+      }
+      return samples;
+
+    case CODEC_IMA_ADPCM: {
+      size_t produced = 0;
+      size_t i = 0;
+      if (hasPendingNibble && samples > 0) {
+        out[produced++] = pendingNibble | (encodeAdpcmNibble(in[i++]) << 4);
+        hasPendingNibble = false;
+      }
+      for (; i + 1 < samples; i += 2) {
+        uint8_t lo = encodeAdpcmNibble(in[i]);
+        uint8_t hi = encodeAdpcmNibble(in[i + 1]);
+        out[produced++] = lo | (hi << 4);
+      }
+      if (i < samples) {
+        pendingNibble = encodeAdpcmNibble(in[i]);
+        hasPendingNibble = true;
+      }
+      return produced;
+    }
+
+    case CODEC_PCM16:
+    default:
+      memcpy(out, in, samples * 2);
+      return samples * 2;
+  }
+}
+
+size_t AudioEncoder::flush(uint8_t* out) {
+  if (codecType != CODEC_IMA_ADPCM || !hasPendingNibble) return 0;
+  out[0] = pendingNibble;
+  hasPendingNibble = false;
+  return 1;
+}
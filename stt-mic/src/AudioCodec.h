@@ -0,0 +1,52 @@
+#ifndef AUDIO_CODEC_H
+#define AUDIO_CODEC_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Upload encodings. The numeric values are used by the STT_MIC_CODEC build flag.
+enum AudioCodecType {
+  CODEC_PCM16 = 0,     // 16-bit little-endian linear PCM, audio/l16
+  CODEC_ULAW = 1,      // 8-bit G.711 mu-law
+  CODEC_IMA_ADPCM = 2  // 4-bit IMA-ADPCM, low nibble first, no block headers
+};
+
+// Streaming fixed-point encoder for the upload path. Keeps the ADPCM
+// predictor state across calls, so one encoder instance covers exactly one
+// utterance; call reset() before the next one.
+class AudioEncoder {
+public:
+  explicit AudioEncoder(AudioCodecType type = CODEC_PCM16) : codecType(type) {}
+
+  void begin(AudioCodecType type);
+  void reset();
+  AudioCodecType type() const { return codecType; }
+
+  // Encodes samples into out and returns the number of bytes produced.
+  // out must hold at least maxEncodedSize(samples) bytes. For ADPCM an odd
+  // trailing sample is held back until the next call or flush().
+  size_t encode(const int16_t* in, size_t samples, uint8_t* out);
+
+  // Emits a held-back ADPCM nibble, if any. Returns 0 or 1.
+  size_t flush(uint8_t* out);
+
+  size_t maxEncodedSize(size_t samples) const;
+
+  // Values for the Content-Type and X-Dayne-Encoding request headers
+  const char* contentType() const;
+  const char* encodingName() const;
+  uint8_t bitsPerSample() const;
+
+  static uint8_t encodeULaw(int16_t sample);
+
+private:
+  uint8_t encodeAdpcmNibble(int16_t sample);
+
+  AudioCodecType codecType;
+  int32_t predictor = 0;
+  int8_t stepIndex = 0;
+  bool hasPendingNibble = false;
+  uint8_t pendingNibble = 0;
+};
+
+#endif
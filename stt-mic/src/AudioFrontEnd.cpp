@@ -0,0 +1,39 @@
+#include "AudioFrontEnd.h"
+
+void AudioFrontEnd::begin(uint8_t shift, int32_t gainQ8) {
+  inputShift = shift;
+  gain = gainQ8;
+  reset();
+}
+
+void AudioFrontEnd::reset() {
+  prevIn = 0;
+  prevOut = 0;
+}
+
+// min(max(v, -32768), 32767) without branches
+static inline int16_t saturate16(int32_t v) {
+  int32_t over = v - 32767;
+  v -= over & ~(over >> 31);
+  int32_t under = v + 32768;
+  v -= under & (under >> 31);
+  return (int16_t)v;
+}
+
+void AudioFrontEnd::process(const int32_t* in, int16_t* out, size_t samples) {
+  int32_t x1 = prevIn;
+  int32_t y1 = prevOut;
+  const uint8_t shift = inputShift;
+  const int32_t g = gain;
+
+  for (size_t i = 0; i < samples; i++) {
+    int32_t x = in[i] >> shift;
+    int32_t y = ((x - x1) << 8) + y1 - (y1 >> 7);
+    x1 = x;
+    y1 = y;
+    out[i] = saturate16(((y >> 8) * g) >> 8);
+  }
+
+  prevIn = x1;
+  prevOut = y1;
+}
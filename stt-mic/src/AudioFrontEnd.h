@@ -0,0 +1,31 @@
+#ifndef AUDIO_FRONT_END_H
+#define AUDIO_FRONT_END_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Fused microphone front end: 32-bit I2S word -> 16-bit sample, DC-blocking
+// high-pass and saturating gain in one pass over a DMA block.
+//
+// The high-pass is y[n] = x[n] - x[n-1] + y[n-1] - y[n-1] / 128, about 20 Hz
+// at 16 kHz, kept in Q8 so it needs no multiplier. The loop has no
+// data-dependent branches.
+class AudioFrontEnd {
+public:
+  // shift: right shift from the I2S word to 16-bit range (16 for a 24-bit
+  // left-justified MEMS mic). gainQ8: 256 = unity.
+  void begin(uint8_t shift, int32_t gainQ8);
+  void reset();
+
+  // out may alias in (processing in place over the DMA buffer is safe since
+  // each 16-bit write lands at or behind the 32-bit word being read).
+  void process(const int32_t* in, int16_t* out, size_t samples);
+
+private:
+  uint8_t inputShift = 16;
+  int32_t gain = 256;
+  int32_t prevIn = 0;   // x[n-1]
+  int32_t prevOut = 0;  // y[n-1], Q8
+};
+
+#endif
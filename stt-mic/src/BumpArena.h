@@ -0,0 +1,110 @@
+#ifndef BUMP_ARENA_H
+#define BUMP_ARENA_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+// Bump allocator over a caller-supplied block, for short-lived per-utterance
+// objects (JsonDocument pools and strings) that would otherwise churn the
+// heap.
+//
+// Each allocation carries a small size header so reallocate() can copy. The
+// newest block grows and shrinks in place and freeing it hands its space
+// back; other frees are only counted. Once every block is free the arena
+// rewinds to empty, so as long as a caller's objects all die before the next
+// ones are made (one JsonDocument at a time) the arena never fills up.
+class BumpArena {
+public:
+  static const size_t ALIGN = 8;
+
+  BumpArena() {}
+  BumpArena(uint8_t* storage, size_t capacity) { begin(storage, capacity); }
+
+  void begin(uint8_t* storage, size_t capacity) {
+    // Keep every block ALIGN-aligned whatever the storage address
+    size_t skew = (ALIGN - (uintptr_t)storage % ALIGN) % ALIGN;
+    buf = storage + skew;
+    cap = capacity > skew ? (capacity - skew) / ALIGN * ALIGN : 0;
+    reset();
+  }
+
+  void reset() {
+    top = 0;
+    last = nullptr;
+    live = 0;
+  }
+
+  void* allocate(size_t size) {
+    size_t need = HEADER + roundUp(size);
+    if (need > cap - top) {
+      failures++;
+      return nullptr;
+    }
+    uint8_t* block = buf + top;
+    memcpy(block, &size, sizeof(size));
+    top += need;
+    if (top > highWater) highWater = top;
+    live++;
+    last = block + HEADER;
+    return last;
+  }
+
+  void deallocate(void* ptr) {
+    if (ptr == nullptr || live == 0) return;
+    if (--live == 0) {
+      reset();
+    } else if (ptr == last) {
+      top = (uint8_t*)ptr - HEADER - buf;
+      last = nullptr;
+    }
+  }
+
+  void* reallocate(void* ptr, size_t size) {
+    if (ptr == nullptr) return allocate(size);
+
+    if (ptr == last) {
+      size_t start = (uint8_t*)ptr - buf;
+      if (roundUp(size) > cap - start) {
+        failures++;
+        return nullptr;
+      }
+      memcpy((uint8_t*)ptr - HEADER, &size, sizeof(size));
+      top = start + roundUp(size);
+      if (top > highWater) highWater = top;
+      return ptr;
+    }
+
+    size_t old = blockSize(ptr);
+    void* moved = allocate(size);
+    if (moved == nullptr) return nullptr;
+    memcpy(moved, ptr, old < size ? old : size);
+    deallocate(ptr);
+    return moved;
+  }
+
+  size_t capacity() const { return cap; }
+  size_t used() const { return top; }
+
+  size_t highWater = 0;   // most bytes ever in use, headers included
+  uint32_t failures = 0;  // allocations refused because the arena was full
+
+private:
+  static const size_t HEADER = (sizeof(size_t) + ALIGN - 1) / ALIGN * ALIGN;
+
+  static size_t roundUp(size_t n) { return (n + ALIGN - 1) / ALIGN * ALIGN; }
+
+  static size_t blockSize(const void* ptr) {
+    size_t size;
+    memcpy(&size, (const uint8_t*)ptr - HEADER, sizeof(size));
+    return size;
+  }
+
+  uint8_t* buf = nullptr;
+  size_t cap = 0;
+  size_t top = 0;
+  void* last = nullptr;  // newest block still live, or null
+  size_t live = 0;
+};
+
+#endif
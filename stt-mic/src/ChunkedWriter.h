@@ -0,0 +1,85 @@
+#ifndef CHUNKED_WRITER_H
+#define CHUNKED_WRITER_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+// HTTP/1.1 chunked-transfer framing over a single contiguous send buffer.
+//
+// The buffer is laid out as [size header][payload][CRLF]. Callers read audio
+// straight into payload(), then send() writes the hex size right-aligned in
+// front of it and the trailer behind it, so each chunk goes out as one write
+// (one TLS record / TCP segment) without copying the payload.
+//
+// The sink is any type with size_t write(const uint8_t*, size_t), e.g. an
+// Arduino Client or a POSIX socket wrapper.
+class ChunkedWriter {
+public:
+  static const size_t HEADER_RESERVE = 6;  // up to 4 hex digits + CRLF
+  static const size_t TRAILER_SIZE = 2;
+  static const size_t MAX_PAYLOAD = 0xFFFF;
+
+  ChunkedWriter(uint8_t* buffer, size_t size) : buf(buffer), bufSize(size) {}
+
+  uint8_t* payload() { return buf + HEADER_RESERVE; }
+
+  size_t payloadCapacity() const {
+    size_t cap = bufSize - HEADER_RESERVE - TRAILER_SIZE;
+    return cap > MAX_PAYLOAD ? MAX_PAYLOAD : cap;
+  }
+
+  void resetStats() {
+    bytesOnAir = 0;
+    payloadBytes = 0;
+    records = 0;
+  }
+
+  // Frames len bytes already placed at payload() and sends them as one chunk.
+  template <typename Sink>
+  bool send(Sink& sink, size_t len) {
+    if (len == 0 || len > payloadCapacity()) return false;
+
+    static const char hex[] = "0123456789ABCDEF";
+    uint8_t* p = payload();
+    *--p = '\n';
+    *--p = '\r';
+    for (size_t v = len; v != 0; v >>= 4) {
+      *--p = hex[v & 0xF];
+    }
+    uint8_t* end = payload() + len;
+    end[0] = '\r';
+    end[1] = '\n';
+
+    size_t recordLen = (end + TRAILER_SIZE) - p;
+    if (!writeRecord(sink, p, recordLen)) return false;
+    payloadBytes += len;
+    return true;
+  }
+
+  // Sends the zero-length terminating chunk.
+  template <typename Sink>
+  bool finish(Sink& sink) {
+    static const uint8_t last[] = {'0', '\r', '\n', '\r', '\n'};
+    return writeRecord(sink, last, sizeof(last));
+  }
+
+  // Sends an arbitrary record (e.g. the request headers) through the same counters.
+  template <typename Sink>
+  bool writeRecord(Sink& sink, const uint8_t* data, size_t len) {
+    size_t written = sink.write(data, len);
+    bytesOnAir += written;
+    records++;
+    return written == len;
+  }
+
+  uint32_t bytesOnAir = 0;    // everything handed to the socket
+  uint32_t payloadBytes = 0;  // audio bytes only
+  uint32_t records = 0;       // write() calls, i.e. TLS records / segments
+
+private:
+  uint8_t* buf;
+  size_t bufSize;
+};
+
+#endif
@@ -0,0 +1,240 @@
+#include "HttpResponseParser.h"
+
+#include <ctype.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+
+void HttpResponseParser::reset() {
+  bodyLen = 0;
+  truncated = false;
+  if (bodyCap > 0) body[0] = '\0';
+  state = STATUS_LINE;
+  parseResult = NEED_MORE;
+  lineLen = 0;
+  statusCode = 0;
+  contentLength = -1;
+  chunked = false;
+  connectionClose = false;
+  remaining = 0;
+  chunkSizeValid = false;
+}
+
+// Accumulates one CRLF-terminated line; returns true once it is complete.
+// Lines longer than the buffer keep their prefix, which is all we match on.
+bool HttpResponseParser::lineByte(uint8_t c) {
+  if (c == '\n') {
+    if (lineLen > 0 && line[lineLen - 1] == '\r') lineLen--;
+    line[lineLen] = '\0';
+    return true;
+  }
+  if (lineLen < LINE_MAX - 1) {
+    line[lineLen++] = (char)c;
+  }
+  return false;
+}
+
+static const char* headerValue(const char* line, const char* name) {
+  size_t n = strlen(name);
+  if (strncasecmp(line, name, n) != 0 || line[n] != ':') return nullptr;
+  const char* v = line + n + 1;
+  while (*v == ' ' || *v == '\t') v++;
+  return v;
+}
+
+static bool containsToken(const char* value, const char* token) {
+  size_t n = strlen(token);
+  for (const char* p = value; *p; p++) {
+    if (strncasecmp(p, token, n) == 0) return true;
+  }
+  return false;
+}
+
+void HttpResponseParser::handleStatusLine() {
+  // "HTTP/1.1 200 OK"
+  if (strncmp(line, "HTTP/1.", 7) != 0) {
+    fail();
+    return;
+  }
+  const char* sp = strchr(line, ' ');
+  if (sp == nullptr || !isdigit((unsigned char)sp[1])) {
+    fail();
+    return;
+  }
+  statusCode = atoi(sp + 1);
+  if (line[7] == '0') connectionClose = true;  // HTTP/1.0 closes by default
+  state = HEADER_LINE;
+}
+
+void HttpResponseParser::handleHeaderLine() {
+  if (lineLen == 0) {
+    startBody();
+    return;
+  }
+
+  const char* v;
+  if ((v = headerValue(line, "Content-Length")) != nullptr) {
+    contentLength = strtol(v, nullptr, 10);
+  } else if ((v = headerValue(line, "Transfer-Encoding")) != nullptr) {
+    chunked = containsToken(v, "chunked");
+  } else if ((v = headerValue(line, "Connection")) != nullptr) {
+    connectionClose = containsToken(v, "close");
+  }
+}
+
+void HttpResponseParser::startBody() {
+  bool noBody = statusCode == 204 || statusCode == 304 || (statusCode >= 100 && statusCode < 200);
+  if (noBody) {
+    state = COMPLETE;
+  } else if (chunked) {
+    state = CHUNK_SIZE;
+    remaining = 0;
+    chunkSizeValid = false;
+  } else if (contentLength >= 0) {
+    remaining = (size_t)contentLength;
+    state = remaining == 0 ? COMPLETE : BODY_LENGTH;
+  } else {
+    state = BODY_UNTIL_CLOSE;
+  }
+  if (state == COMPLETE) parseResult = DONE;
+}
+
+void HttpResponseParser::appendBody(const uint8_t* data, size_t len) {
+  if (bodyCap == 0) return;
+  size_t room = bodyCap - 1 - bodyLen;
+  if (len > room) {
+    len = room;
+    truncated = true;
+  }
+  memcpy(body + bodyLen, data, len);
+  bodyLen += len;
+  body[bodyLen] = '\0';
+}
+
+void HttpResponseParser::discardBody(size_t n) {
+  if (n == 0) return;
+  if (n > bodyLen) n = bodyLen;
+  memmove(body, body + n, bodyLen - n);
+  bodyLen -= n;
+  body[bodyLen] = '\0';
+  truncated = false;
+}
+
+static int hexValue(uint8_t c) {
+  if (c >= '0' && c <= '9') return c - '0';
+  if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+  if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+  return -1;
+}
+
+HttpResponseParser::Result HttpResponseParser::feed(const uint8_t* data, size_t len,
+                                                    size_t* consumed) {
+  size_t i = 0;
+  while (i < len && parseResult == NEED_MORE) {
+    switch (state) {
+      case STATUS_LINE:
+        if (lineByte(data[i++])) {
+          handleStatusLine();
+          lineLen = 0;
+        }
+        break;
+
+      case HEADER_LINE:
+        if (lineByte(data[i++])) {
+          handleHeaderLine();
+          lineLen = 0;
+        }
+        break;
+
+      case BODY_LENGTH:
+      case CHUNK_DATA: {
+        size_t n = len - i;
+        if (n > remaining) n = remaining;
+        appendBody(data + i, n);
+        i += n;
+        remaining -= n;
+        if (remaining == 0) {
+          if (state == BODY_LENGTH) {
+            state = COMPLETE;
+            parseResult = DONE;
+          } else {
+            state = CHUNK_DATA_END;
+          }
+        }
+        break;
+      }
+
+      case BODY_UNTIL_CLOSE:
+        appendBody(data + i, len - i);
+        i = len;
+        break;
+
+      case CHUNK_SIZE: {
+        // "1A;ext=1\r\n": hex digits, optional extensions, CRLF
+        uint8_t c = data[i++];
+        int h = hexValue(c);
+        if (h >= 0 && lineLen == 0) {
+          if (remaining > 0xFFFFFF) {
+            fail();
+            break;
+          }
+          remaining = (remaining << 4) | (size_t)h;
+          chunkSizeValid = true;
+        } else if (c == '\n') {
+          if (!chunkSizeValid) {
+            fail();
+            break;
+          }
+          lineLen = 0;
+          chunkSizeValid = false;
+          state = remaining == 0 ? CHUNK_TRAILER : CHUNK_DATA;
+        } else if (c != '\r') {
+          lineLen = 1;  // past the digits; skip extensions
+        }
+        break;
+      }
+
+      case CHUNK_DATA_END:
+        // CRLF after the chunk payload
+        if (data[i] == '\n') {
+          state = CHUNK_SIZE;
+          remaining = 0;
+        } else if (data[i] != '\r') {
+          fail();
+        }
+        i++;
+        break;
+
+      case CHUNK_TRAILER:
+        // Optional trailer headers, ended by an empty line
+        if (lineByte(data[i++])) {
+          bool empty = lineLen == 0;
+          lineLen = 0;
+          if (empty) {
+            state = COMPLETE;
+            parseResult = DONE;
+          }
+        }
+        break;
+
+      case COMPLETE:
+        parseResult = DONE;
+        break;
+    }
+  }
+
+  if (consumed) *consumed = i;
+  return parseResult;
+}
+
+HttpResponseParser::Result HttpResponseParser::finish() {
+  if (parseResult == NEED_MORE) {
+    if (state == BODY_UNTIL_CLOSE) {
+      state = COMPLETE;
+      parseResult = DONE;
+    } else {
+      fail();
+    }
+  }
+  return parseResult;
+}
@@ -0,0 +1,83 @@
+#ifndef HTTP_RESPONSE_PARSER_H
+#define HTTP_RESPONSE_PARSER_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Zero-allocation, push-style HTTP/1.1 response parser.
+//
+// Bytes are fed in as they arrive from the socket, in any split. The parser
+// tracks the status code, the headers that frame the body (Content-Length,
+// Transfer-Encoding: chunked, Connection: close) and copies the decoded body
+// into a caller-supplied buffer, NUL-terminated. It stops consuming at the
+// end of the response so a kept-alive connection is left positioned at the
+// next one.
+class HttpResponseParser {
+public:
+  enum Result { NEED_MORE, DONE, FAILED };
+
+  HttpResponseParser(char* bodyBuffer, size_t bodyCapacity)
+    : body(bodyBuffer), bodyCap(bodyCapacity) { reset(); }
+
+  void reset();
+
+  // Consumes up to len bytes and returns the parse state. *consumed (if not
+  // null) receives how many bytes belonged to this response.
+  Result feed(const uint8_t* data, size_t len, size_t* consumed = nullptr);
+
+  // Call when the peer closes the connection. Completes a body delimited by
+  // connection close; anything else still in flight is a failure.
+  Result finish();
+
+  Result result() const { return parseResult; }
+  bool headersComplete() const { return state > HEADER_LINE; }
+  int status() const { return statusCode; }
+  bool keepAlive() const { return !connectionClose && state != BODY_UNTIL_CLOSE; }
+  const char* bodyText() const { return body; }
+  size_t bodyLength() const { return bodyLen; }
+  bool bodyTruncated() const { return truncated; }
+
+  // Drops the first n body bytes, e.g. once streamed lines have been handled,
+  // making room for more of a long body.
+  void discardBody(size_t n);
+
+private:
+  enum State {
+    STATUS_LINE,
+    HEADER_LINE,
+    BODY_LENGTH,
+    BODY_UNTIL_CLOSE,
+    CHUNK_SIZE,
+    CHUNK_DATA,
+    CHUNK_DATA_END,
+    CHUNK_TRAILER,
+    COMPLETE
+  };
+
+  static const size_t LINE_MAX = 96;
+
+  bool lineByte(uint8_t c);
+  void handleStatusLine();
+  void handleHeaderLine();
+  void startBody();
+  void appendBody(const uint8_t* data, size_t len);
+  void fail() { parseResult = FAILED; }
+
+  char* body;
+  size_t bodyCap;
+  size_t bodyLen;
+  bool truncated;
+
+  State state;
+  Result parseResult;
+  char line[LINE_MAX];
+  size_t lineLen;
+  int statusCode;
+  long contentLength;
+  bool chunked;
+  bool connectionClose;
+  size_t remaining;     // bytes left in the body or current chunk
+  bool chunkSizeValid;
+};
+
+#endif
@@ -0,0 +1,97 @@
+#ifndef POWER_LEDGER_H
+#define POWER_LEDGER_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+enum PowerState : uint8_t {
+  POWER_ACTIVE = 0,   // radio always on, polling the button
+  POWER_MODEM_SLEEP,  // standby: radio wakes for beacons, CPU idles
+  POWER_LIGHT_SLEEP,  // standby: as above, and the chip light-sleeps between beacons
+  POWER_DEEP_SLEEP,   // WiFi, TCP and RAM lost; the button reboots the chip
+  POWER_STATE_COUNT
+};
+
+// Time spent in each power state, how often it was entered, and how long a
+// button press took to start capture from it. Combined with per-state
+// current estimates this gives the average draw, so the standby timeouts can
+// be tuned against wake latency.
+//
+// Plain data with a magic number, so it can live in RTC memory and keep
+// counting across deep sleep. Times come from a clock that also keeps
+// running through deep sleep.
+struct PowerLedger {
+  static const uint32_t MAGIC = 0x50574c47;
+
+  struct StateStats {
+    uint64_t timeMs;
+    uint32_t entries;
+    uint32_t wakes;  // button presses that started capture from this state
+    uint32_t wakeMinUs;
+    uint32_t wakeMaxUs;
+    uint64_t wakeSumUs;
+  };
+
+  uint32_t magic;
+  PowerState state;
+  uint64_t sinceMs;
+  uint64_t startMs;
+  StateStats states[POWER_STATE_COUNT];
+
+  // Starts counting from nowMs unless the ledger survived a deep sleep
+  void begin(uint64_t nowMs) {
+    if (magic == MAGIC && state < POWER_STATE_COUNT && nowMs >= sinceMs) return;
+    for (size_t i = 0; i < POWER_STATE_COUNT; i++) {
+      states[i] = StateStats();
+    }
+    magic = MAGIC;
+    state = POWER_ACTIVE;
+    sinceMs = nowMs;
+    startMs = nowMs;
+    states[POWER_ACTIVE].entries = 1;
+  }
+
+  void enter(PowerState next, uint64_t nowMs) {
+    if (next == state) return;
+    states[state].timeMs += nowMs - sinceMs;
+    states[next].entries++;
+    state = next;
+    sinceMs = nowMs;
+  }
+
+  void recordWake(PowerState from, uint32_t latencyUs) {
+    StateStats& s = states[from];
+    if (s.wakes == 0 || latencyUs < s.wakeMinUs) s.wakeMinUs = latencyUs;
+    if (latencyUs > s.wakeMaxUs) s.wakeMaxUs = latencyUs;
+    s.wakeSumUs += latencyUs;
+    s.wakes++;
+  }
+
+  uint64_t timeIn(PowerState s, uint64_t nowMs) const {
+    return states[s].timeMs + (s == state ? nowMs - sinceMs : 0);
+  }
+
+  uint32_t averageWakeUs(PowerState s) const {
+    return states[s].wakes ? (uint32_t)(states[s].wakeSumUs / states[s].wakes) : 0;
+  }
+
+  // Average draw since the ledger started, from per-state currents in uA
+  uint32_t averageCurrentUa(const uint32_t currentUa[POWER_STATE_COUNT], uint64_t nowMs) const {
+    uint64_t total = nowMs - startMs;
+    if (total == 0) return currentUa[state];
+    uint64_t charge = 0;  // uA * ms
+    for (size_t i = 0; i < POWER_STATE_COUNT; i++) {
+      charge += timeIn((PowerState)i, nowMs) * currentUa[i];
+    }
+    return (uint32_t)(charge / total);
+  }
+
+  static const char* name(PowerState s) {
+    static const char* const names[POWER_STATE_COUNT] = {
+      "active", "modem sleep", "light sleep", "deep sleep"
+    };
+    return s < POWER_STATE_COUNT ? names[s] : "?";
+  }
+};
+
+#endif
@@ -0,0 +1,100 @@
+#ifndef RING_BUFFER_H
+#define RING_BUFFER_H
+
+#include <atomic>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+// Lock-free single-producer/single-consumer byte ring.
+//
+// Storage is supplied by the caller so it can be a static DRAM array or a
+// PSRAM block; capacity must be a power of two. Exactly one task may call
+// write() and exactly one task may call read()/skip(). reset() is only safe
+// while neither side is active.
+class RingBuffer {
+public:
+  RingBuffer() {}
+  RingBuffer(uint8_t* storage, size_t capacity) { begin(storage, capacity); }
+
+  bool begin(uint8_t* storage, size_t capacity) {
+    if (storage == nullptr || capacity == 0 || (capacity & (capacity - 1)) != 0) {
+      return false;
+    }
+    buf = storage;
+    mask = capacity - 1;
+    reset();
+    return true;
+  }
+
+  void reset() {
+    head.store(0, std::memory_order_relaxed);
+    tail.store(0, std::memory_order_relaxed);
+  }
+
+  size_t capacity() const { return buf ? mask + 1 : 0; }
+
+  // Bytes ready to be read
+  size_t available() const {
+    return head.load(std::memory_order_acquire) - tail.load(std::memory_order_relaxed);
+  }
+
+  // Bytes that can be written without overrunning the reader
+  size_t space() const {
+    return capacity() - (head.load(std::memory_order_relaxed) - tail.load(std::memory_order_acquire));
+  }
+
+  // Producer side. Copies as much of data as fits and returns the count.
+  size_t write(const uint8_t* data, size_t len) {
+    size_t h = head.load(std::memory_order_relaxed);
+    size_t t = tail.load(std::memory_order_acquire);
+    size_t n = capacity() - (h - t);
+    if (len < n) n = len;
+    if (n == 0) return 0;
+
+    size_t off = h & mask;
+    size_t first = capacity() - off;
+    if (first > n) first = n;
+    memcpy(buf + off, data, first);
+    memcpy(buf, data + first, n - first);
+
+    head.store(h + n, std::memory_order_release);
+    return n;
+  }
+
+  // Consumer side. Copies up to len bytes into dst and returns the count.
+  size_t read(uint8_t* dst, size_t len) {
+    size_t t = tail.load(std::memory_order_relaxed);
+    size_t h = head.load(std::memory_order_acquire);
+    size_t n = h - t;
+    if (len < n) n = len;
+    if (n == 0) return 0;
+
+    size_t off = t & mask;
+    size_t first = capacity() - off;
+    if (first > n) first = n;
+    memcpy(dst, buf + off, first);
+    memcpy(dst + first, buf, n - first);
+
+    tail.store(t + n, std::memory_order_release);
+    return n;
+  }
+
+  // Consumer side. Discards up to len bytes and returns the count.
+  size_t skip(size_t len) {
+    size_t t = tail.load(std::memory_order_relaxed);
+    size_t n = head.load(std::memory_order_acquire) - t;
+    if (len < n) n = len;
+    tail.store(t + n, std::memory_order_release);
+    return n;
+  }
+
+private:
+  uint8_t* buf = nullptr;
+  size_t mask = 0;
+  // Free-running counters; only the low bits index the storage.
+  std::atomic<size_t> head{0};
+  std::atomic<size_t> tail{0};
+};
+
+#endif
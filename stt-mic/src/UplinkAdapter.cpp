@@ -0,0 +1,166 @@
+#include "UplinkAdapter.h"
+
+void UplinkEncoder::begin(uint32_t streamRate, UplinkFormat format) {
+  rate = streamRate;
+  current = format;
+  reset();
+}
+
+void UplinkEncoder::reset() {
+  encoder.begin(current.codec);
+  previous = 0;
+  held = 0;
+  hasHeld = false;
+}
+
+void UplinkEncoder::setFormat(UplinkFormat format) {
+  if (format == current) return;
+  current = format;
+  // A block boundary never splits a sample pair, so nothing is held here
+  reset();
+}
+
+size_t UplinkEncoder::samplesPerBlock(size_t capacity) const {
+  if (capacity <= HEADER_SIZE) return 0;
+  size_t payload = capacity - HEADER_SIZE;
+  size_t samples;
+  switch (current.codec) {
+    case CODEC_ULAW:
+      samples = payload;
+      break;
+    case CODEC_IMA_ADPCM:
+      samples = payload * 2;
+      break;
+    case CODEC_PCM16:
+    default:
+      samples = payload / 2;
+      break;
+  }
+  samples &= ~(size_t)1;
+  return samples * current.decimation;
+}
+
+void UplinkEncoder::beginBlock(uint8_t* out) {
+  block = out;
+  blockLen = HEADER_SIZE;
+}
+
+void UplinkEncoder::append(const int16_t* samples, size_t count) {
+  if (current.decimation == 1) {
+    blockLen += encode(samples, count);
+    return;
+  }
+
+  int16_t half[64];
+  size_t halfCount = 0;
+  for (size_t i = 0; i < count; i++) {
+    if (!hasHeld) {
+      held = samples[i];
+      hasHeld = true;
+      continue;
+    }
+    int32_t sum = (int32_t)previous + 2 * (int32_t)held + samples[i] + 2;
+    half[halfCount++] = (int16_t)(sum >> 2);
+    previous = samples[i];
+    hasHeld = false;
+    if (halfCount == sizeof(half) / sizeof(half[0])) {
+      blockLen += encode(half, halfCount);
+      halfCount = 0;
+    }
+  }
+  if (halfCount > 0) {
+    blockLen += encode(half, halfCount);
+  }
+}
+
+size_t UplinkEncoder::endBlock(bool last) {
+  if (last) {
+    if (hasHeld) {
+      blockLen += encode(&held, 1);
+      hasHeld = false;
+    }
+    blockLen += encoder.flush(block + blockLen);
+  }
+
+  size_t payload = blockLen - HEADER_SIZE;
+  block[0] = (uint8_t)current.codec;
+  block[1] = (uint8_t)(sampleRate() / 1000);
+  block[2] = (uint8_t)(payload & 0xff);
+  block[3] = (uint8_t)(payload >> 8);
+  return blockLen;
+}
+
+size_t UplinkEncoder::encode(const int16_t* samples, size_t count) {
+  return encoder.encode(samples, count, block + blockLen);
+}
+
+UplinkFormat UplinkAdapter::formatAt(uint8_t level) {
+  switch (level) {
+    case 0:
+      return {CODEC_PCM16, 1};
+    case 1:
+      return {CODEC_ULAW, 1};
+    case 2:
+      return {CODEC_IMA_ADPCM, 1};
+    default:
+      return {CODEC_IMA_ADPCM, 2};
+  }
+}
+
+void UplinkAdapter::begin(uint32_t streamRate, uint8_t topLevel, uint16_t headroomMs) {
+  rate = streamRate;
+  top = topLevel < LEVELS ? topLevel : LEVELS - 1;
+  current = top;
+  headroom = headroomMs;
+  fellBehind = false;
+  startUtterance();
+}
+
+void UplinkAdapter::startUtterance() {
+  if (!fellBehind && current > top) {
+    current--;
+  }
+  fellBehind = false;
+  // The pre-roll is drained first; only a backlog that grows counts
+  haveBacklog = false;
+}
+
+uint32_t UplinkAdapter::bytesPerSecond(uint8_t level) const {
+  UplinkFormat format = formatAt(level);
+  uint32_t samples = rate / format.decimation;
+  switch (format.codec) {
+    case CODEC_ULAW:
+      return samples;
+    case CODEC_IMA_ADPCM:
+      return samples / 2;
+    case CODEC_PCM16:
+    default:
+      return samples * 2;
+  }
+}
+
+bool UplinkAdapter::update(const Window& window) {
+  bool growing = haveBacklog && window.backlogMs >= lastBacklog &&
+                 window.backlogMs > window.blockMs + headroom;
+  lastBacklog = window.backlogMs;
+  haveBacklog = true;
+
+  // Writes only block when the socket buffer is full, so a window spent
+  // mostly blocked measures what the link actually carries
+  bool saturated = window.writeMs > 0 && window.writeMs * 2 >= window.elapsedMs;
+  bool tooSlow = false;
+  if (saturated) {
+    measured = (uint32_t)((uint64_t)window.sentBytes * 1000 / window.writeMs);
+    // Leave an eighth for chunk framing and rate wobble
+    tooSlow = (uint64_t)measured * 8 < (uint64_t)bytesPerSecond(current) * 9;
+  }
+
+  if (!growing && !tooSlow) return false;
+  fellBehind = true;
+  if (current + 1 >= LEVELS) return false;
+  current++;
+  stepDowns++;
+  // Give the new format a window before judging the backlog again
+  haveBacklog = false;
+  return true;
+}
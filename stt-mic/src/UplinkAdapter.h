@@ -0,0 +1,123 @@
+#ifndef UPLINK_ADAPTER_H
+#define UPLINK_ADAPTER_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "AudioCodec.h"
+
+// Adaptive upload format for marginal WiFi, sent as X-Dayne-Encoding: framed.
+//
+// The capture ring holds PCM at the stream rate and the upload path encodes
+// each chunk payload as one block:
+//
+//   [codec][sample rate / 1000][payload length, LE16][encoded audio]
+//
+// so the format can change between any two chunks and the endpoint follows
+// it. Codec state carries over between blocks of the same format and starts
+// over when it changes.
+//
+// No Arduino dependencies, so a constrained link can be simulated on a host.
+struct UplinkFormat {
+  AudioCodecType codec;
+  uint8_t decimation;  // 1 = stream rate, 2 = half rate
+
+  bool operator==(const UplinkFormat& other) const {
+    return codec == other.codec && decimation == other.decimation;
+  }
+  bool operator!=(const UplinkFormat& other) const { return !(*this == other); }
+};
+
+class UplinkEncoder {
+public:
+  static const size_t HEADER_SIZE = 4;
+
+  void begin(uint32_t streamRate, UplinkFormat format);
+  void reset();
+
+  // Takes effect at the next block
+  void setFormat(UplinkFormat format);
+  UplinkFormat format() const { return current; }
+  uint32_t sampleRate() const { return rate / current.decimation; }
+  const char* encodingName() const { return encoder.encodingName(); }
+
+  // Stream-rate samples that fill a block of capacity bytes. Always a
+  // multiple of 2 * decimation, so no sample pair or ADPCM byte straddles
+  // two blocks.
+  size_t samplesPerBlock(size_t capacity) const;
+
+  // Builds one block in out: beginBlock(), append() the stream-rate samples,
+  // then endBlock() for its total length. out must hold the capacity the
+  // sample count was taken from. Pass last = true on the final block of an
+  // utterance to flush a held-back odd sample.
+  void beginBlock(uint8_t* out);
+  void append(const int16_t* samples, size_t count);
+  size_t endBlock(bool last);
+
+private:
+  size_t encode(const int16_t* samples, size_t count);
+
+  uint32_t rate = 16000;
+  UplinkFormat current = {CODEC_PCM16, 1};
+  AudioEncoder encoder;
+
+  // 2:1 decimator: [1 2 1] / 4 over the previous odd sample and the pair
+  int16_t previous = 0;
+  int16_t held = 0;
+  bool hasHeld = false;
+
+  uint8_t* block = nullptr;
+  size_t blockLen = 0;
+};
+
+// Picks the upload format. Levels run from the configured top format down to
+// ADPCM at half rate:
+//
+//   0 PCM16    1 mu-law    2 IMA-ADPCM    3 IMA-ADPCM at half rate
+//
+// Once per window the upload path reports how much audio is waiting in the
+// ring and how the socket behaved. The adapter steps down a level when the
+// backlog grows past what one block holds plus headroom, or when the link
+// was saturated and carried less than the current level needs. Within an
+// utterance it only steps down; an utterance that never fell behind lets the
+// next one start a level higher, up to the top.
+class UplinkAdapter {
+public:
+  static const uint8_t LEVELS = 4;
+
+  struct Window {
+    uint32_t elapsedMs;  // since the previous window
+    uint32_t backlogMs;  // audio in the ring now
+    uint32_t blockMs;    // audio one full block holds at the current level
+    uint32_t sentBytes;  // bytes on air, framing included
+    uint32_t writeMs;    // time spent blocked in socket writes
+  };
+
+  static UplinkFormat formatAt(uint8_t level);
+
+  void begin(uint32_t streamRate, uint8_t topLevel, uint16_t headroomMs);
+  void startUtterance();
+
+  // Returns true when the level changed
+  bool update(const Window& window);
+
+  uint8_t level() const { return current; }
+  UplinkFormat format() const { return formatAt(current); }
+  uint32_t bytesPerSecond(uint8_t level) const;
+  // Link throughput seen in the last saturated window, 0 if none yet
+  uint32_t measuredBytesPerSecond() const { return measured; }
+
+  uint32_t stepDowns = 0;
+
+private:
+  uint32_t rate = 16000;
+  uint8_t top = 0;
+  uint8_t current = 0;
+  uint16_t headroom = 250;
+  uint32_t lastBacklog = 0;
+  bool haveBacklog = false;
+  bool fellBehind = false;
+  uint32_t measured = 0;
+};
+
+#endif
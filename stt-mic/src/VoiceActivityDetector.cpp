@@ -0,0 +1,125 @@
+#include "VoiceActivityDetector.h"
+
+#include <string.h>
+
+bool VoiceActivityDetector::begin(size_t frameSamples, int16_t* history, size_t historySamples,
+                                  uint16_t hangoverFrames) {
+  if (frameSamples == 0) return false;
+  frameLen = frameSamples;
+  historyBuf = history;
+  historyFrames = history ? historySamples / frameSamples : 0;
+  hangoverLen = hangoverFrames;
+  reset();
+  return true;
+}
+
+void VoiceActivityDetector::reset() {
+  historyHead = 0;
+  historyCount = 0;
+  hangoverLeft = 0;
+  settleLeft = settleFrames;
+  state = SILENCE;
+  noiseFloor = -1;
+  counters = Stats();
+}
+
+bool VoiceActivityDetector::isSpeech(const int16_t* frame) {
+  int32_t sum = 0;
+  uint32_t crossings = 0;
+  int16_t prev = frame[0];
+  for (size_t i = 0; i < frameLen; i++) {
+    int32_t x = frame[i];
+    sum += x < 0 ? -x : x;
+    crossings += (uint32_t)((x ^ prev) < 0);
+    prev = (int16_t)x;
+  }
+  int32_t level = sum / (int32_t)frameLen;
+  uint32_t crossingsPer128 = crossings * 128 / frameLen;
+
+  // The high-pass starts with a step from the DC offset; its decay would
+  // seed a floor far above the real background
+  if (settleLeft > 0) {
+    settleLeft--;
+    return false;
+  }
+  if (noiseFloor < 0) {
+    noiseFloor = level;
+  }
+
+  bool speech = level > minLevel &&
+                ((level << 4) > noiseFloor * speechRatioQ4 ||
+                 ((level << 4) > noiseFloor * fricativeRatioQ4 &&
+                  crossingsPer128 >= fricativeCrossingsPer128));
+
+  // Floor follows quiet frames quickly and creeps up slowly otherwise, so a
+  // long utterance does not teach it that speech is background noise.
+  if (level < noiseFloor) {
+    noiseFloor += (level - noiseFloor) >> 3;
+  } else if (!speech) {
+    noiseFloor += ((level - noiseFloor) >> 6) + 1;
+  }
+
+  return speech;
+}
+
+void VoiceActivityDetector::pushHistory(const int16_t* frame) {
+  if (historyFrames == 0) {
+    counters.samplesDropped += frameLen;
+    return;
+  }
+  if (historyCount == historyFrames) {
+    // Oldest padding frame falls out unsent
+    historyHead = (historyHead + 1) % historyFrames;
+    historyCount--;
+    counters.samplesDropped += frameLen;
+  }
+  size_t slot = (historyHead + historyCount) % historyFrames;
+  memcpy(historyBuf + slot * frameLen, frame, frameLen * sizeof(int16_t));
+  historyCount++;
+}
+
+size_t VoiceActivityDetector::drainHistory(int16_t* out) {
+  size_t produced = 0;
+  while (historyCount > 0) {
+    memcpy(out + produced, historyBuf + historyHead * frameLen, frameLen * sizeof(int16_t));
+    produced += frameLen;
+    historyHead = (historyHead + 1) % historyFrames;
+    historyCount--;
+  }
+  historyHead = 0;
+  return produced;
+}
+
+size_t VoiceActivityDetector::process(const int16_t* frame, int16_t* out) {
+  counters.framesIn++;
+  bool speech = isSpeech(frame);
+  if (speech) counters.framesSpeech++;
+
+  switch (state) {
+    case SILENCE:
+      if (!speech) {
+        pushHistory(frame);
+        return 0;
+      } else {
+        size_t produced = drainHistory(out);
+        memcpy(out + produced, frame, frameLen * sizeof(int16_t));
+        state = SPEECH;
+        hangoverLeft = hangoverLen;
+        return produced + frameLen;
+      }
+
+    case SPEECH:
+      if (speech) {
+        hangoverLeft = hangoverLen;
+      } else if (hangoverLeft == 0) {
+        state = SILENCE;
+        pushHistory(frame);
+        return 0;
+      } else {
+        hangoverLeft--;
+      }
+      memcpy(out, frame, frameLen * sizeof(int16_t));
+      return frameLen;
+  }
+  return 0;
+}
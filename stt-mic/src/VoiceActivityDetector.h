@@ -0,0 +1,71 @@
+#ifndef VOICE_ACTIVITY_DETECTOR_H
+#define VOICE_ACTIVITY_DETECTOR_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Fixed-point energy + zero-crossing voice activity detector that trims
+// silence from the upload stream.
+//
+// Frames are fed in one at a time. Before the first speech frame, and again
+// once a pause outlasts the hangover, frames are held in a short history
+// instead of being sent. When speech starts the history goes out first
+// (padding), so word onsets are not clipped. Leading silence shrinks to the
+// padding, internal pauses to hangover + padding, and trailing silence to
+// the hangover.
+//
+// No Arduino dependencies, so it can be run over saved audio-*.raw files on
+// a host.
+class VoiceActivityDetector {
+public:
+  struct Stats {
+    uint32_t framesIn = 0;
+    uint32_t framesSpeech = 0;
+    uint32_t samplesDropped = 0;
+  };
+
+  // history is caller-owned storage for the padding; its length in samples
+  // (rounded down to whole frames) sets the padding window.
+  bool begin(size_t frameSamples, int16_t* history, size_t historySamples, uint16_t hangoverFrames);
+  void reset();
+
+  // Feeds exactly frameSamples samples. Writes the samples to upload into
+  // out, which must hold maxOutputSamples(), and returns their count.
+  size_t process(const int16_t* frame, int16_t* out);
+
+  size_t maxOutputSamples() const { return (historyFrames + 1) * frameLen; }
+  bool inSpeech() const { return state != SILENCE; }
+  const Stats& stats() const { return counters; }
+
+  // Mean |x| below this is always silence, whatever the noise floor says
+  uint16_t minLevel = 48;
+  // Speech when the level exceeds the noise floor by this factor (Q4)
+  uint16_t speechRatioQ4 = 48;
+  // Unvoiced speech: smaller level rise but many zero crossings
+  uint16_t fricativeRatioQ4 = 24;
+  uint16_t fricativeCrossingsPer128 = 40;
+  // Frames held as silence at the start while the front end's high-pass
+  // settles; the noise floor is seeded from the first frame after them
+  uint16_t settleFrames = 5;
+
+private:
+  enum State { SILENCE, SPEECH };
+
+  bool isSpeech(const int16_t* frame);
+  void pushHistory(const int16_t* frame);
+  size_t drainHistory(int16_t* out);
+
+  size_t frameLen = 0;
+  int16_t* historyBuf = nullptr;
+  size_t historyFrames = 0;
+  size_t historyHead = 0;   // oldest frame
+  size_t historyCount = 0;
+  uint16_t hangoverLen = 0;
+  uint16_t hangoverLeft = 0;
+  uint16_t settleLeft = 0;
+  State state = SILENCE;
+  int32_t noiseFloor = -1;  // mean |x|, -1 until the front end settles
+  Stats counters;
+};
+
+#endif
@@ -5,17 +5,100 @@
 #include <ArduinoJson.h>
 #include "driver/i2s.h"
 #include "esp_sleep.h"
+#include "esp_pm.h"
+#include <sys/time.h>
+#include "esp_heap_caps.h"
 #include <esp_now.h>
 #include <esp_wifi.h>
 #include "AudioTools.h"
 
-#include "../include/secrets.h"
+#include <secrets.h>
+#include "RingBuffer.h"
+#include "AudioCodec.h"
+#include "UplinkAdapter.h"
+#include "ChunkedWriter.h"
+#include "VoiceActivityDetector.h"
+#include "AudioFrontEnd.h"
+#include "HttpResponseParser.h"
+#include "BumpArena.h"
+#include "PowerLedger.h"
+#include <EspNowTransport.h>
+#include <TraceLog.h>
 
 // ESP-NOW configuration
 uint8_t serverMacAddress[] = STT_KEYBOARD_SERVER_MAC;
 
+#ifndef STT_MIC_SLEEP_TIMEOUT_MS
 #define STT_MIC_SLEEP_TIMEOUT_MS 30000  // 30 seconds of inactivity
-#define STT_MIC_MAX_ESPNOW_PAYLOAD 250  // Maximum ESP-NOW payload size
+#endif
+
+// Warm standby between activity and deep sleep: WiFi power save with the
+// association and any kept-alive connection left up, so a press starts
+// capture without a reboot
+#ifndef STT_MIC_STANDBY
+#define STT_MIC_STANDBY 1
+#endif
+#ifndef STT_MIC_STANDBY_AFTER_MS
+#define STT_MIC_STANDBY_AFTER_MS 5000
+#endif
+// Also light-sleep between beacons. Needs a core built with tickless idle,
+// and stops the I2S clock, so the mic's start-up time is added to a wake.
+#ifndef STT_MIC_STANDBY_LIGHT_SLEEP
+#define STT_MIC_STANDBY_LIGHT_SLEEP 0
+#endif
+#define STT_MIC_ACTIVE_WIFI_PS WIFI_PS_NONE        // lowest latency while in use
+#define STT_MIC_STANDBY_WIFI_PS WIFI_PS_MAX_MODEM  // wake every listen interval (3 beacons)
+#define STT_MIC_ACTIVE_POLL_MS 100
+
+// Estimated draw per power state for the power report, in uA. Replace with
+// figures measured on the board.
+#ifndef STT_MIC_CURRENT_ACTIVE_UA
+#define STT_MIC_CURRENT_ACTIVE_UA 85000
+#endif
+#ifndef STT_MIC_CURRENT_MODEM_SLEEP_UA
+#define STT_MIC_CURRENT_MODEM_SLEEP_UA 25000
+#endif
+#ifndef STT_MIC_CURRENT_LIGHT_SLEEP_UA
+#define STT_MIC_CURRENT_LIGHT_SLEEP_UA 2000
+#endif
+#ifndef STT_MIC_CURRENT_DEEP_SLEEP_UA
+#define STT_MIC_CURRENT_DEEP_SLEEP_UA 50
+#endif
+
+// Keep the endpoint connection open between utterances while awake
+#ifndef STT_MIC_KEEP_ALIVE
+#define STT_MIC_KEEP_ALIVE 0
+#endif
+
+// Ask /stream for NDJSON interim results and type stable text while talking
+#ifndef STT_MIC_PARTIAL_RESULTS
+#define STT_MIC_PARTIAL_RESULTS 0
+#endif
+
+// Hold-to-talk with no length cap: the endpoint rotates recognition
+// streams behind one upload, so only the transcript grows with the audio
+#ifndef STT_MIC_LONG_DICTATION
+#define STT_MIC_LONG_DICTATION 0
+#endif
+
+// Longest utterance before the upload is ended; 0 means no limit
+#ifndef STT_MIC_MAX_UTTERANCE_MS
+#if STT_MIC_LONG_DICTATION
+#define STT_MIC_MAX_UTTERANCE_MS 0
+#else
+#define STT_MIC_MAX_UTTERANCE_MS 10000
+#endif
+#endif
+
+// Record per-stage latency events and dump them after each utterance
+#ifndef STT_MIC_TRACE
+#define STT_MIC_TRACE 1
+#endif
+
+#define STT_MIC_ESPNOW_WINDOW 4         // frames in flight before waiting for acks
+#define STT_MIC_ESPNOW_TIMEOUT_MS 1000  // give up when no ack arrives for this long
+#define STT_MIC_KEYBOARD_STATUS_MS 50   // wait for the keyboard's queue status after acks
+#define STT_MIC_KEYBOARD_BUSY_MS 10000  // longest wait for room in a full keyboard queue
 
 // I2S mic pins
 #define STT_MIC_I2S_WS  3    // LRCLK
@@ -29,40 +112,214 @@ uint8_t serverMacAddress[] = STT_KEYBOARD_SERVER_MAC;
 #define STT_MIC_CHANNELS       1      // Mono
 #define STT_MIC_BITS_PER_SAMPLE 16    // 16-bit samples
 
+// Upload encoding: CODEC_PCM16, CODEC_ULAW or CODEC_IMA_ADPCM
+#ifndef STT_MIC_CODEC
+#define STT_MIC_CODEC CODEC_PCM16
+#endif
+
+// Adaptive uplink: the upload format starts at STT_MIC_CODEC and steps down
+// (mu-law, ADPCM, ADPCM at half rate) when the link falls behind real time.
+// Every chunk says its own format (X-Dayne-Encoding: framed).
+#ifndef STT_MIC_ADAPTIVE_UPLINK
+#define STT_MIC_ADAPTIVE_UPLINK 0
+#endif
+#define STT_MIC_UPLINK_WINDOW_MS 250    // how often the link is judged
+#define STT_MIC_UPLINK_HEADROOM_MS 250  // backlog allowed beyond one chunk
+
+// Front end: I2S word -> 16-bit shift, DC-blocking high-pass, gain
+#define STT_MIC_I2S_SHIFT 16  // 24-bit left-justified sample in a 32-bit word
+#ifndef STT_MIC_GAIN_Q8
+#define STT_MIC_GAIN_Q8 256   // 256 = unity
+#endif
+
+// Voice activity detection: trims leading/trailing silence and long pauses
+#ifndef STT_MIC_VAD
+#define STT_MIC_VAD 1
+#endif
+#ifndef STT_MIC_VAD_PAD_MS
+#define STT_MIC_VAD_PAD_MS 200       // silence kept in front of speech
+#endif
+#ifndef STT_MIC_VAD_HANGOVER_MS
+#define STT_MIC_VAD_HANGOVER_MS 300  // silence kept after speech
+#endif
+
 // Buffer settings
 #define STT_MIC_CHUNK_SIZE 256  // Reduced from 512 to save memory
+#define STT_MIC_SEND_BUFFER 1460  // One HTTP chunk per TCP segment / TLS record
+
+// Pre-roll: audio captured while the connection is still being set up.
+// The capture ring is sized to hold this much plus a few send chunks,
+// rounded up to a power of two. 840 ms of 16 kHz PCM16 plus four chunks
+// is 32720 bytes, just inside 32 KiB; 1000 ms would need a 64 KiB ring,
+// which on the C3 comes out of internal DRAM.
+#ifndef STT_MIC_PREROLL_MAX_MS
+#define STT_MIC_PREROLL_MAX_MS 840
+#endif
+#define STT_MIC_PREROLL_MAX_BYTES \
+  ((uint32_t)STT_MIC_PREROLL_MAX_MS * STT_MIC_SAMPLE_RATE / 1000 * (STT_MIC_BITS_PER_SAMPLE / 8) * STT_MIC_CHANNELS)
+
+// Capture task settings
+#define STT_MIC_CAPTURE_STACK 4096
+#define STT_MIC_CAPTURE_PRIORITY (configMAX_PRIORITIES - 2)
 
 // Audio-tools objects
 I2SStream i2sStream;
-NumberFormatConverterStream converter(i2sStream);
-FilteredStream<int32_t, int16_t> filtered(converter, STT_MIC_CHUNK_SIZE / 4);
+AudioFrontEnd frontEnd;
+uint32_t frontEndCycles = 0;
+uint32_t frontEndFrames = 0;
+
+// Capture -> upload pipeline. The capture task is the only writer and the
+// upload path in loop() is the only reader. Storage is allocated in setup(),
+// from PSRAM when the board has it.
+RingBuffer audioRing;
+TaskHandle_t captureTaskHandle = nullptr;
+volatile bool captureActive = false;
+volatile bool captureIdle = true;
+volatile uint32_t captureOverruns = 0;  // bytes dropped because the ring was full
+uint32_t uploadUnderruns = 0;           // polls that found less than a full chunk
+uint32_t captureStartTime = 0;          // millis() when the button went down
+
+// Chunk framing: audio is read from the ring straight into the send buffer
+static uint8_t sendBuffer[STT_MIC_SEND_BUFFER];
+ChunkedWriter chunkWriter(sendBuffer, sizeof(sendBuffer));
+
+// Capture stages between the front end and the ring: VAD, then encoder.
+// One capture block is one VAD frame.
+#define STT_MIC_FRAME_SAMPLES (STT_MIC_CHUNK_SIZE / 2)
+#define STT_MIC_FRAME_MS (STT_MIC_FRAME_SAMPLES * 1000 / STT_MIC_SAMPLE_RATE)
+#define STT_MIC_VAD_PAD_SAMPLES \
+  (STT_MIC_VAD_PAD_MS / STT_MIC_FRAME_MS * STT_MIC_FRAME_SAMPLES)
+#define STT_MIC_STAGE_MAX_SAMPLES (STT_MIC_VAD_PAD_SAMPLES + STT_MIC_FRAME_SAMPLES)
+
+VoiceActivityDetector vad;
+// At least one sample so PAD_MS = 0 still compiles; begin() gets the real size
+static int16_t vadHistory[STT_MIC_VAD_PAD_SAMPLES > 0 ? STT_MIC_VAD_PAD_SAMPLES : 1];
+// Short I2S reads are collected here until a whole VAD frame is ready
+static int16_t vadFrame[STT_MIC_FRAME_SAMPLES];
+size_t vadFill = 0;
+static int16_t vadOut[STT_MIC_STAGE_MAX_SAMPLES];
+uint32_t vadCycles = 0;
+
+AudioEncoder encoder((AudioCodecType)STT_MIC_CODEC);
+static uint8_t encoded[STT_MIC_STAGE_MAX_SAMPLES * 2];
+uint32_t codecCycles = 0;
+uint32_t codecSamples = 0;
+
+// With the adaptive uplink the ring holds PCM and chunks are encoded as they
+// are sent. The adapter's level carries over from one utterance to the next.
+UplinkEncoder uplinkEncoder;
+UplinkAdapter uplinkAdapter;
 
 uint32_t lastActivityTime = 0;
 
+// Latency trace, correlated with the endpoint and keyboard by utterance id
+TraceLog<64> traceLog;
+uint32_t utteranceId = 0;
+
 // ESP-NOW variables
 bool espnowReady = false;
-volatile bool espnowSendSuccess = false;
+static uint8_t espnowStatusStorage[64];
+RingBuffer espnowStatusRing(espnowStatusStorage, sizeof(espnowStatusStorage));
+espnow_transport::SendWindow espnowWindow;
+// Survives deep sleep so ids keep advancing; the keyboard also keys on utterance
+RTC_DATA_ATTR uint8_t espnowMessageId = 0;
+// Last queue status from the keyboard, packed so the WiFi task updates it in
+// one store: bits 0-7 message id, 8-15 free slots, 16 queued, 17-31 how many
+// statuses have arrived (0 until the keyboard first answers; older keyboards
+// never do).
+volatile uint32_t keyboardStatus = 0;
 
-// WiFi client objects (global to preserve TLS session cache)
-WiFiClient httpClient;
-WiFiClientSecure httpsClient;
+// Response handling. Once the audio is uploaded, the wait for the transcript
+// and its delivery to the keyboard move to the response task, so the button
+// can start the next utterance straight away. Each outstanding utterance
+// holds one slot (its own connection and parser); slots are used round robin
+// and completed in FIFO order, so transcripts are typed in utterance order.
+#ifndef STT_MIC_RESPONSE_MAX
+#if STT_MIC_LONG_DICTATION
+#define STT_MIC_RESPONSE_MAX 8192          // minutes of dictation in one transcript
+#else
+#define STT_MIC_RESPONSE_MAX 2048          // largest JSON body / NDJSON line we keep
+#endif
+#endif
+#define STT_MIC_RESPONSE_TIMEOUT_MS 5000   // release to first response byte
+#define STT_MIC_RESPONSE_IDLE_MS 2000      // gap allowed once bytes are flowing
+#ifndef STT_MIC_RESPONSE_SLOTS
+#define STT_MIC_RESPONSE_SLOTS 2           // utterances in flight at once
+#endif
+#define STT_MIC_RESPONSE_STACK 6144
+#define STT_MIC_RESPONSE_PRIORITY 1        // same as loop()
 
-// ESP-NOW callbacks
-void onDataSent(const uint8_t *mac_addr, esp_now_send_status_t status) {
-  espnowSendSuccess = (status == ESP_NOW_SEND_SUCCESS);
-  Serial.print("ESP-NOW callback - MAC: ");
-  for (int i = 0; i < 6; i++) {
-    Serial.printf("%02X", mac_addr[i]);
-    if (i < 5) Serial.print(":");
+struct ResponseSlot {
+  // Client objects live as long as the slot to preserve the TLS session cache
+  WiFiClient httpClient;
+  WiFiClientSecure httpsClient;
+  WiFiClient* client = nullptr;
+  bool connectionReusable = false;  // last response left the connection usable
+  bool reused = false;
+
+  char body[STT_MIC_RESPONSE_MAX];
+  HttpResponseParser parser{body, sizeof(body)};
+  uint32_t lastByte = 0;
+  bool headersTraced = false;
+
+  // Text already typed on the keyboard for this utterance, so updated
+  // hypotheses can be sent as backspaces + new suffix
+  char typedText[STT_MIC_RESPONSE_MAX];
+  size_t typedLen = 0;
+
+  uint32_t utterance = 0;
+  uint32_t releaseTime = 0;
+  volatile bool busy = false;  // set by loop() when claimed, cleared when delivered
+};
+static ResponseSlot responseSlots[STT_MIC_RESPONSE_SLOTS];
+uint8_t nextResponseSlot = 0;
+QueueHandle_t responseQueue = nullptr;  // slot indexes, oldest utterance first
+TaskHandle_t responseTaskHandle = nullptr;
+void responseTask(void* param);  // waits for transcripts, defined after the upload path
+
+// JsonDocuments are served from a fixed arena instead of the heap. Only one
+// document is alive at a time (transcripts are parsed by one task at a time,
+// like sendTextToKeyboard()), so the arena rewinds after every parse.
+#ifndef STT_MIC_JSON_ARENA
+#define STT_MIC_JSON_ARENA (2 * STT_MIC_RESPONSE_MAX + 2048)
+#endif
+static uint8_t jsonArenaStorage[STT_MIC_JSON_ARENA];
+BumpArena jsonArena(jsonArenaStorage, sizeof(jsonArenaStorage));
+
+class JsonArenaAllocator : public ArduinoJson::Allocator {
+public:
+  void* allocate(size_t size) override { return jsonArena.allocate(size); }
+  void deallocate(void* ptr) override { jsonArena.deallocate(ptr); }
+  void* reallocate(void* ptr, size_t size) override { return jsonArena.reallocate(ptr, size); }
+};
+JsonArenaAllocator jsonAllocator;
+
+bool responsesPending(const ResponseSlot* except = nullptr) {
+  for (size_t i = 0; i < STT_MIC_RESPONSE_SLOTS; i++) {
+    if (&responseSlots[i] != except && responseSlots[i].busy) return true;
   }
-  Serial.print(" Status: ");
-  if (status == ESP_NOW_SEND_SUCCESS) {
-    Serial.println("SUCCESS");
-  } else {
-    Serial.print("FAILED (");
-    Serial.print(status);
-    Serial.println(")");
+  return false;
+}
+
+// ESP-NOW callbacks
+// Runs in the WiFi task: only hand the status to sendTextToKeyboard(), which
+// matches statuses to frames in send order.
+void onDataSent(const uint8_t*, esp_now_send_status_t status) {
+  uint8_t delivered = (status == ESP_NOW_SEND_SUCCESS);
+  espnowStatusRing.write(&delivered, 1);
+}
+
+// Runs in the WiFi task. The only frames the keyboard sends are queue
+// statuses.
+void onDataRecv(const uint8_t* mac_addr, const uint8_t* data, int len) {
+  espnow_transport::Status status;
+  if (memcmp(mac_addr, serverMacAddress, 6) != 0 ||
+      !espnow_transport::decodeStatus(data, len, &status)) {
+    return;
   }
+  uint32_t count = (keyboardStatus >> 17) % 0x7FFF + 1;  // never wraps to 0
+  keyboardStatus = (count << 17) | (status.queued ? 1UL << 16 : 0) |
+                   ((uint32_t)status.freeSlots << 8) | status.messageId;
 }
 
 bool initESPNow() {
@@ -81,8 +338,9 @@ bool initESPNow() {
   
   Serial.println("ESP-NOW initialized");
   
-  // Register send callback
+  // Register send and receive callbacks
   esp_now_register_send_cb(onDataSent);
+  esp_now_register_recv_cb(onDataRecv);
   
   // Add peer (server)
   esp_now_peer_info_t peerInfo = {};
@@ -100,51 +358,470 @@ bool initESPNow() {
   return true;
 }
 
-void sendTextToKeyboard(const char* text) {
-  if (!espnowReady) {
-    Serial.println("ESP-NOW not ready");
-    return;
+// Sends one message of at most MAX_MESSAGE bytes, returns true once every
+// fragment was acknowledged and the keyboard queued it. The MAC acks only
+// say the frames arrived, so a keyboard that reports its queue is given no
+// message while the queue is full, and one it had to drop counts as failed.
+bool sendMessageToKeyboard(const char* text, size_t textLen, uint32_t utterance) {
+  using namespace espnow_transport;
+
+  size_t fragments = fragmentCount(textLen);
+  uint32_t start = millis();
+
+  uint32_t status = keyboardStatus;
+  while (status >> 17 && ((status >> 8) & 0xFF) == 0) {
+    if (millis() - start > STT_MIC_KEYBOARD_BUSY_MS) {
+      // The room status may have been lost; the next one says what happened
+      Serial.println("Keyboard queue still full, sending anyway");
+      break;
+    }
+    vTaskDelay(1);
+    status = keyboardStatus;
   }
-  
-  size_t textLen = strlen(text);
-  Serial.print("Sending text (");
-  Serial.print(textLen);
-  Serial.println(" bytes) via ESP-NOW...");
-  
-  size_t offset = 0;
-  
-  // Send in chunks if text is too long
-  while (offset < textLen) {
-    size_t chunkLen = min((size_t)STT_MIC_MAX_ESPNOW_PAYLOAD, textLen - offset);
-    
-    espnowSendSuccess = false;
-    esp_err_t result = esp_now_send(serverMacAddress, (uint8_t*)(text + offset), chunkLen);
-    
-    if (result == ESP_OK) {
-      // Wait for send callback (with timeout)
-      unsigned long timeout = millis();
-      while (!espnowSendSuccess && (millis() - timeout < 1000)) {
-        delay(10);
+  uint32_t statusesBefore = status >> 17;
+  uint8_t messageId = espnowMessageId++;
+
+  // Statuses left over from an aborted message no longer match any frame
+  espnowStatusRing.skip(espnowStatusRing.available());
+  espnowWindow.begin(fragments, STT_MIC_ESPNOW_WINDOW);
+
+  uint8_t frame[MAX_FRAME];
+  uint32_t lastProgress = millis();
+  while (!espnowWindow.done() && !espnowWindow.failed()) {
+    uint8_t delivered;
+    while (espnowStatusRing.read(&delivered, 1) == 1) {
+      espnowWindow.onStatus(delivered);
+      lastProgress = millis();
+    }
+
+    uint8_t seq;
+    while (espnowWindow.nextToSend(&seq)) {
+      size_t frameLen = encodeFrame(frame, messageId, utterance, (const uint8_t*)text, textLen,
+                                    seq);
+      esp_err_t result = esp_now_send(serverMacAddress, frame, frameLen);
+      if (result != ESP_OK) {
+        // ESP_ERR_ESPNOW_NO_MEM: the driver queue is full, retry next pass
+        break;
       }
-      
-      if (espnowSendSuccess) {
-        Serial.print("Sent ");
-        Serial.print(chunkLen);
-        Serial.println(" bytes via ESP-NOW");
-      } else {
-        Serial.print("ESP-NOW send timeout at offset ");
-        Serial.println(offset);
+      espnowWindow.onQueued(seq);
+    }
+
+    if (millis() - lastProgress > STT_MIC_ESPNOW_TIMEOUT_MS) {
+      break;
+    }
+    vTaskDelay(1);
+  }
+
+  // Until a keyboard has answered once it may be one that never does, so
+  // only the first message of a boot waits to find out
+  static bool keyboardAsked = false;
+  if (espnowWindow.done() && (statusesBefore > 0 || !keyboardAsked)) {
+    keyboardAsked = true;
+    uint32_t acked = millis();
+    for (;;) {
+      status = keyboardStatus;
+      if (status >> 17 != statusesBefore && (status & 0xFF) == messageId) {
+        if (!(status & (1UL << 16))) {
+          Serial.println("Keyboard queue full, message dropped");
+          return false;
+        }
         break;
       }
+      // A lost status leaves the acks to go by
+      if (millis() - acked > STT_MIC_KEYBOARD_STATUS_MS) break;
+      vTaskDelay(1);
+    }
+  }
+
+  if (espnowWindow.done()) {
+    traceLog.record(TRACE_ESPNOW_ACKED, utterance, micros(), fragments);
+    Serial.printf("Sent %u bytes in %u frames via ESP-NOW (%lu retransmits) in %lu ms\n",
+                  (unsigned)textLen, (unsigned)fragments,
+                  (unsigned long)espnowWindow.retransmits, millis() - start);
+    return true;
+  }
+  Serial.printf("ESP-NOW send %s after %lu ms (%lu retransmits)\n",
+                espnowWindow.failed() ? "failed" : "timed out", millis() - start,
+                (unsigned long)espnowWindow.retransmits);
+  return false;
+}
+
+// Only one task sends at a time: the response task, or loop() while no
+// earlier utterance is outstanding. Text longer than one message goes out as
+// consecutive messages split at character boundaries, which the keyboard
+// types back to back. Returns how many bytes of text were acknowledged,
+// which is short of strlen(text) if ESP-NOW is down or a message failed.
+size_t sendTextToKeyboard(const char* text, uint32_t utterance) {
+  using namespace espnow_transport;
+
+  if (!espnowReady) {
+    Serial.println("ESP-NOW not ready");
+    return 0;
+  }
+
+  size_t sent = 0;
+  size_t remaining = strlen(text);
+  while (remaining > 0) {
+    size_t len = utf8Prefix(text, remaining, MAX_MESSAGE);
+    if (len == 0 || !sendMessageToKeyboard(text, len, utterance)) break;
+    text += len;
+    remaining -= len;
+    sent += len;
+  }
+  return sent;
+}
+
+// -------------------- CAPTURE TASK -----------------------
+void captureTask(void* param) {
+  (void)param;
+  int32_t raw[STT_MIC_FRAME_SAMPLES];
+  int16_t* block = (int16_t*)raw;  // front end converts in place
+
+  for (;;) {
+    if (!captureActive) {
+      captureIdle = true;
+      ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+      continue;
+    }
+    captureIdle = false;
+
+    size_t bytesRead = i2sStream.readBytes((uint8_t*)raw, sizeof(raw));
+    size_t sampleCount = bytesRead / sizeof(int32_t);
+    if (sampleCount == 0) continue;
+
+    uint32_t feStart = ESP.getCycleCount();
+    frontEnd.process(raw, block, sampleCount);
+    frontEndCycles += ESP.getCycleCount() - feStart;
+    frontEndFrames++;
+
+    const int16_t* samples = block;
+
+#if STT_MIC_VAD
+    {
+      // A read never exceeds one frame, so at most one frame completes here
+      size_t take = STT_MIC_FRAME_SAMPLES - vadFill;
+      if (take > sampleCount) take = sampleCount;
+      memcpy(vadFrame + vadFill, block, take * sizeof(int16_t));
+      vadFill += take;
+      if (vadFill < STT_MIC_FRAME_SAMPLES) continue;
+
+      uint32_t cycles = ESP.getCycleCount();
+      size_t rest = sampleCount - take;
+      sampleCount = vad.process(vadFrame, vadOut);
+      vadCycles += ESP.getCycleCount() - cycles;
+      memcpy(vadFrame, block + take, rest * sizeof(int16_t));
+      vadFill = rest;
+      samples = vadOut;
+      if (sampleCount == 0) continue;
+    }
+#endif
+
+    const uint8_t* out = (const uint8_t*)samples;
+    size_t outLen = sampleCount * 2;
+
+    if (!STT_MIC_ADAPTIVE_UPLINK && encoder.type() != CODEC_PCM16) {
+      uint32_t cycles = ESP.getCycleCount();
+      outLen = encoder.encode(samples, sampleCount, encoded);
+      codecCycles += ESP.getCycleCount() - cycles;
+      codecSamples += sampleCount;
+      out = encoded;
+    }
+
+    size_t written = audioRing.write(out, outLen);
+    if (written < outLen) {
+      captureOverruns += outLen - written;
+    }
+  }
+}
+
+bool allocateCaptureRing() {
+  const size_t needed = STT_MIC_PREROLL_MAX_BYTES + 4 * STT_MIC_SEND_BUFFER;
+  size_t size = 1;
+  while (size < needed) {
+    size <<= 1;
+  }
+
+  bool psram = true;
+  uint8_t* storage = (uint8_t*)heap_caps_malloc(size, MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT);
+  if (storage == nullptr) {
+    psram = false;
+    storage = (uint8_t*)heap_caps_malloc(size, MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT);
+  }
+  if (storage == nullptr || !audioRing.begin(storage, size)) {
+    size_t largest = heap_caps_get_largest_free_block(MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT);
+    Serial.printf("Capture ring: no %u bytes free (largest internal block %u)\n",
+                  (unsigned)size, (unsigned)largest);
+    return false;
+  }
+
+  Serial.printf("Capture ring: %u bytes in %s for %u\n", (unsigned)size,
+                psram ? "PSRAM" : "DRAM", (unsigned)needed);
+  if (!psram && size - needed > size / 4) {
+    Serial.printf("Capture ring: %u bytes of DRAM unused; lower STT_MIC_PREROLL_MAX_MS\n",
+                  (unsigned)(size - needed));
+  }
+  return true;
+}
+
+void startCapture() {
+  captureStartTime = millis();
+  utteranceId = esp_random() | 1;  // 0 means "untraced" on the keyboard
+  traceLog.record(TRACE_BUTTON_DOWN, utteranceId, micros());
+  audioRing.reset();
+  captureOverruns = 0;
+  uploadUnderruns = 0;
+  frontEnd.reset();
+  frontEndCycles = 0;
+  frontEndFrames = 0;
+  vad.reset();
+  vadFill = 0;
+  vadCycles = 0;
+  encoder.reset();
+  codecCycles = 0;
+  codecSamples = 0;
+  uplinkAdapter.startUtterance();
+  uplinkEncoder.begin(STT_MIC_SAMPLE_RATE, uplinkAdapter.format());
+  captureIdle = false;
+  captureActive = true;
+  xTaskNotifyGive(captureTaskHandle);
+}
+
+// Blocks until the capture task has pushed its last block, so everything
+// recorded is in the ring once this returns.
+void stopCapture() {
+  captureActive = false;
+  while (!captureIdle) {
+    vTaskDelay(1);
+  }
+}
+
+// -------------------- WIFI -----------------------
+// Association and lease from the last successful connect. Lives in RTC slow
+// memory so it survives deep sleep (but not a power cycle).
+#define STT_MIC_WIFI_CACHE_MAGIC 0x57494649
+#define STT_MIC_WIFI_FAST_TIMEOUT_MS 2000
+// A static address is not renewed, so it is only ours until the lease that
+// gave it runs out. Home routers lease for an hour or more; past this age
+// the address is fetched again over DHCP.
+#ifndef STT_MIC_WIFI_LEASE_REUSE_MS
+#define STT_MIC_WIFI_LEASE_REUSE_MS (30UL * 60 * 1000)
+#endif
+
+struct WiFiCache {
+  uint32_t magic;
+  uint8_t bssid[6];
+  uint8_t channel;
+  uint32_t ip;
+  uint32_t gateway;
+  uint32_t subnet;
+  uint32_t dns;
+  uint64_t leasedAtMs;  // powerClockMs() when DHCP handed out ip
+};
+RTC_DATA_ATTR WiFiCache wifiCache;
+
+uint64_t powerClockMs();
+
+// Milliseconds since boot at which each setup phase finished
+struct BootTiming {
+  uint32_t audioReady;
+  uint32_t wifiConnected;
+  uint32_t setupDone;
+  bool usedCache;
+};
+BootTiming bootTiming = {};
+bool firstUploadSinceBoot = true;
+
+bool waitForWiFi(uint32_t timeoutMs) {
+  uint32_t start = millis();
+  while (WiFi.status() != WL_CONNECTED) {
+    if (timeoutMs && millis() - start > timeoutMs) return false;
+    delay(10);
+  }
+  return true;
+}
+
+void connectWiFi() {
+  WiFi.persistent(false);  // we keep our own cache; skip the NVS write
+  WiFi.mode(WIFI_STA);
+
+  bool connected = false;
+  bool dhcp = true;
+  if (wifiCache.magic == STT_MIC_WIFI_CACHE_MAGIC) {
+    // Fast path: known AP and channel, no scan. The lease is reused as a
+    // static address while young enough, which also skips DHCP. The age
+    // comes out huge if the clock went backwards, which counts as too old.
+    dhcp = powerClockMs() - wifiCache.leasedAtMs > STT_MIC_WIFI_LEASE_REUSE_MS;
+    if (dhcp) {
+      Serial.println("Connecting (cached AP, lease too old for reuse)");
     } else {
-      Serial.print("ESP-NOW send error: ");
-      Serial.println(result);
-      break;
+      Serial.println("Connecting (cached)");
+      WiFi.config(IPAddress(wifiCache.ip), IPAddress(wifiCache.gateway),
+                  IPAddress(wifiCache.subnet), IPAddress(wifiCache.dns));
     }
-    
-    offset += chunkLen;
-    delay(50);  // Small delay between chunks
+    WiFi.begin(STT_MIC_WIFI_SSID, STT_MIC_WIFI_PASS, wifiCache.channel, wifiCache.bssid);
+    connected = waitForWiFi(STT_MIC_WIFI_FAST_TIMEOUT_MS);
+    bootTiming.usedCache = connected;
+    if (!connected) {
+      Serial.println("Cached WiFi failed, rescanning");
+      wifiCache.magic = 0;
+      dhcp = true;
+      WiFi.disconnect();
+      WiFi.config(INADDR_NONE, INADDR_NONE, INADDR_NONE);
+    }
+  }
+
+  if (!connected) {
+    WiFi.begin(STT_MIC_WIFI_SSID, STT_MIC_WIFI_PASS);
+    Serial.print("Connecting");
+    while (WiFi.status() != WL_CONNECTED) {
+      delay(200);
+      Serial.print(".");
+    }
+    Serial.println();
+  }
+
+  if (dhcp) {
+    memcpy(wifiCache.bssid, WiFi.BSSID(), sizeof(wifiCache.bssid));
+    wifiCache.channel = WiFi.channel();
+    wifiCache.ip = (uint32_t)WiFi.localIP();
+    wifiCache.gateway = (uint32_t)WiFi.gatewayIP();
+    wifiCache.subnet = (uint32_t)WiFi.subnetMask();
+    wifiCache.dns = (uint32_t)WiFi.dnsIP();
+    wifiCache.leasedAtMs = powerClockMs();
+    wifiCache.magic = STT_MIC_WIFI_CACHE_MAGIC;
   }
+
+  bootTiming.wifiConnected = millis();
+  Serial.println("WiFi connected.");
+}
+
+// -------------------- POWER -----------------------
+// Active -> standby after STT_MIC_STANDBY_AFTER_MS without activity -> deep
+// sleep after STT_MIC_SLEEP_TIMEOUT_MS. The ledger lives in RTC memory so
+// deep sleep is counted too.
+RTC_DATA_ATTR PowerLedger powerLedger;
+const uint32_t powerCurrentUa[POWER_STATE_COUNT] = {
+  STT_MIC_CURRENT_ACTIVE_UA, STT_MIC_CURRENT_MODEM_SLEEP_UA,
+  STT_MIC_CURRENT_LIGHT_SLEEP_UA, STT_MIC_CURRENT_DEEP_SLEEP_UA
+};
+bool lightSleepUsable = STT_MIC_STANDBY_LIGHT_SLEEP;
+uint32_t cpuMaxMhz = 0;
+
+// The button interrupt is level-triggered so it can also wake light sleep.
+// It disarms itself and waitForButton() re-arms it.
+TaskHandle_t loopTaskHandle = nullptr;
+volatile uint32_t buttonPressMicros = 0;
+
+// System time keeps running through light and deep sleep
+uint64_t powerClockMs() {
+  struct timeval tv;
+  gettimeofday(&tv, nullptr);
+  return (uint64_t)tv.tv_sec * 1000 + tv.tv_usec / 1000;
+}
+
+void IRAM_ATTR onButtonLow() {
+  gpio_intr_disable((gpio_num_t)STT_MIC_BUTTON_PIN);
+  buttonPressMicros = micros();
+  BaseType_t woken = pdFALSE;
+  vTaskNotifyGiveFromISR(loopTaskHandle, &woken);
+  portYIELD_FROM_ISR(woken);
+}
+
+// Blocks until the button goes down or timeoutMs passes
+void waitForButton(uint32_t timeoutMs) {
+  if (digitalRead(STT_MIC_BUTTON_PIN) == LOW) return;
+  buttonPressMicros = 0;
+  ulTaskNotifyTake(pdTRUE, 0);
+  gpio_intr_enable((gpio_num_t)STT_MIC_BUTTON_PIN);
+  ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(timeoutMs));
+}
+
+bool configureLightSleep(bool enable) {
+#if ESP_IDF_VERSION_MAJOR >= 5
+  esp_pm_config_t pm = {};
+#else
+  esp_pm_config_esp32c3_t pm = {};
+#endif
+  pm.max_freq_mhz = cpuMaxMhz;
+  pm.min_freq_mhz = enable ? 40 : cpuMaxMhz;  // XTAL
+  pm.light_sleep_enable = enable;
+  return esp_pm_configure(&pm) == ESP_OK;
+}
+
+void reportPower() {
+  uint64_t now = powerClockMs();
+  Serial.printf("Power: est. average %lu uA over %lu s\n",
+                (unsigned long)powerLedger.averageCurrentUa(powerCurrentUa, now),
+                (unsigned long)((now - powerLedger.startMs) / 1000));
+  for (uint8_t i = 0; i < POWER_STATE_COUNT; i++) {
+    PowerState state = (PowerState)i;
+    const PowerLedger::StateStats& stats = powerLedger.states[i];
+    if (stats.entries == 0) continue;
+    Serial.printf("Power:   %-11s %7lu s, %4lu entries, %4lu wakes, wake %lu/%lu/%lu us min/avg/max\n",
+                  PowerLedger::name(state),
+                  (unsigned long)(powerLedger.timeIn(state, now) / 1000),
+                  (unsigned long)stats.entries, (unsigned long)stats.wakes,
+                  (unsigned long)stats.wakeMinUs, (unsigned long)powerLedger.averageWakeUs(state),
+                  (unsigned long)stats.wakeMaxUs);
+  }
+}
+
+void enterStandby() {
+  WiFi.setSleep(STT_MIC_STANDBY_WIFI_PS);
+  PowerState state = POWER_MODEM_SLEEP;
+  if (lightSleepUsable) {
+    i2s_stop(I2S_NUM_0);  // a running I2S driver holds the chip awake
+    gpio_wakeup_enable((gpio_num_t)STT_MIC_BUTTON_PIN, GPIO_INTR_LOW_LEVEL);
+    esp_sleep_enable_gpio_wakeup();
+    if (configureLightSleep(true)) {
+      state = POWER_LIGHT_SLEEP;
+    } else {
+      Serial.println("Light sleep unavailable in this core, standby uses modem sleep only");
+      lightSleepUsable = false;
+      i2s_start(I2S_NUM_0);
+    }
+  }
+  powerLedger.enter(state, powerClockMs());
+  Serial.printf("Standby (%s) after %lu ms idle\n", PowerLedger::name(state),
+                millis() - lastActivityTime);
+  reportPower();
+  Serial.flush();
+}
+
+// Fast enough to run between the press and startCapture()
+void leaveStandby() {
+  if (powerLedger.state == POWER_LIGHT_SLEEP) {
+    configureLightSleep(false);
+    gpio_wakeup_disable((gpio_num_t)STT_MIC_BUTTON_PIN);
+    gpio_set_intr_type((gpio_num_t)STT_MIC_BUTTON_PIN, GPIO_INTR_LOW_LEVEL);
+    i2s_start(I2S_NUM_0);
+  }
+  WiFi.setSleep(STT_MIC_ACTIVE_WIFI_PS);
+  powerLedger.enter(POWER_ACTIVE, powerClockMs());
+}
+
+void enterDeepSleep() {
+  Serial.println("Entering deep sleep due to inactivity...");
+  powerLedger.enter(POWER_DEEP_SLEEP, powerClockMs());
+  reportPower();
+  Serial.flush();  // Make sure message is sent
+
+  // Let the endpoint release a kept-alive connection
+  for (ResponseSlot& slot : responseSlots) {
+    slot.httpClient.stop();
+    slot.httpsClient.stop();
+  }
+  delay(100);
+
+  // Turn off LED
+  digitalWrite(STT_MIC_LED_PIN, LOW);
+
+  // Hold GPIO state during deep sleep
+  gpio_hold_en((gpio_num_t)STT_MIC_LED_PIN);
+  gpio_deep_sleep_hold_en();
+
+  // Enter deep sleep
+  esp_deep_sleep_start();
 }
 
 void setup() {
@@ -159,6 +836,14 @@ void setup() {
   uint64_t wakeup_pin_mask = (1ULL << STT_MIC_BUTTON_PIN);
   esp_deep_sleep_enable_gpio_wakeup(wakeup_pin_mask, ESP_GPIO_WAKEUP_GPIO_LOW);
 
+  // Button interrupt for waking the loop, and the power ledger, which
+  // carries on from before a deep sleep
+  loopTaskHandle = xTaskGetCurrentTaskHandle();
+  attachInterrupt(digitalPinToInterrupt(STT_MIC_BUTTON_PIN), onButtonLow, ONLOW);
+  cpuMaxMhz = getCpuFrequencyMhz();
+  powerLedger.begin(powerClockMs());
+  powerLedger.enter(POWER_ACTIVE, powerClockMs());
+
   // Check if we woke from deep sleep
   esp_sleep_wakeup_cause_t wakeup_reason = esp_sleep_get_wakeup_cause();
   if (wakeup_reason == ESP_SLEEP_WAKEUP_GPIO) {
@@ -167,22 +852,6 @@ void setup() {
     gpio_hold_dis((gpio_num_t)STT_MIC_LED_PIN);  // Disable hold on LED pin
   }
 
-  // WiFi
-  WiFi.begin(STT_MIC_WIFI_SSID, STT_MIC_WIFI_PASS);
-  Serial.print("Connecting");
-  while (WiFi.status() != WL_CONNECTED) {
-    delay(200);
-    Serial.print(".");
-  }
-  Serial.println("\nWiFi connected.");
-  
-  // determine the channel we're on
-  uint8_t channel;
-  wifi_second_chan_t second;
-  esp_wifi_get_channel(&channel, &second);
-  Serial.print("WiFi connected on channel: ");
-  Serial.println(channel);
-
   // Configure I2S stream with audio-tools
   auto i2s_config = i2sStream.defaultConfig(RX_MODE);
   i2s_config.sample_rate = STT_MIC_SAMPLE_RATE;
@@ -197,9 +866,41 @@ void setup() {
   
   i2sStream.begin(i2s_config);
   
-  // Setup converter: 32-bit input to 16-bit output
-  converter.begin(32, 16);  // from_bits, to_bits
-  filtered.begin();
+  // 32-bit I2S words are converted to 16-bit by the front end in the capture task
+  frontEnd.begin(STT_MIC_I2S_SHIFT, STT_MIC_GAIN_Q8);
+
+  // About five high-pass time constants of 128 samples
+  vad.settleFrames = (5 * 128 + STT_MIC_FRAME_SAMPLES - 1) / STT_MIC_FRAME_SAMPLES;
+  vad.begin(STT_MIC_FRAME_SAMPLES, vadHistory, STT_MIC_VAD_PAD_SAMPLES,
+            STT_MIC_VAD_HANGOVER_MS / STT_MIC_FRAME_MS);
+
+  if (!allocateCaptureRing()) {
+    Serial.println("Capture ring allocation failed");
+  }
+  uplinkAdapter.begin(STT_MIC_SAMPLE_RATE, STT_MIC_CODEC, STT_MIC_UPLINK_HEADROOM_MS);
+  xTaskCreate(captureTask, "capture", STT_MIC_CAPTURE_STACK, nullptr,
+              STT_MIC_CAPTURE_PRIORITY, &captureTaskHandle);
+  responseQueue = xQueueCreate(STT_MIC_RESPONSE_SLOTS, sizeof(uint8_t));
+  xTaskCreate(responseTask, "response", STT_MIC_RESPONSE_STACK, nullptr,
+              STT_MIC_RESPONSE_PRIORITY, &responseTaskHandle);
+  bootTiming.audioReady = millis();
+
+  // A button wake means the user is already talking; record while WiFi comes up
+  if (wakeup_reason == ESP_SLEEP_WAKEUP_GPIO && digitalRead(STT_MIC_BUTTON_PIN) == LOW) {
+    startCapture();
+    powerLedger.recordWake(POWER_DEEP_SLEEP, micros());  // from boot; ROM start-up not included
+  }
+
+  // WiFi
+  connectWiFi();
+  WiFi.setSleep(STT_MIC_ACTIVE_WIFI_PS);
+  
+  // determine the channel we're on
+  uint8_t channel;
+  wifi_second_chan_t second;
+  esp_wifi_get_channel(&channel, &second);
+  Serial.print("WiFi connected on channel: ");
+  Serial.println(channel);
 
   // Initialize ESP-NOW
   Serial.println("Initializing ESP-NOW...");
@@ -209,113 +910,480 @@ void setup() {
     Serial.println("ESP-NOW initialization failed");
   }
   
-  Serial.println("Setup complete.");
+  bootTiming.setupDone = millis();
+  Serial.printf("Setup complete. Boot: audio %lu ms, wifi %lu ms (%s), setup %lu ms\n",
+                bootTiming.audioReady, bootTiming.wifiConnected,
+                bootTiming.usedCache ? "cached" : "scan", bootTiming.setupDone);
   
   // Initialize last activity time
   lastActivityTime = millis();
 }
 
 // -------------------- STREAMING RECORD & UPLOAD -----------------------
+// Opens a new connection and sends the request headers as a single write.
+bool openRequest(WiFiClient* client, bool connect) {
+  if (connect) {
+    client->stop();
+    if (!client->connect(STT_ENDPOINT_HOST, STT_ENDPOINT_PORT)) {
+      return false;
+    }
+  }
+
+  chunkWriter.resetStats();
+  const char* contentType = encoder.contentType();
+  const char* encodingName = encoder.encodingName();
+  int bitsPerSample = encoder.bitsPerSample();
+  if (STT_MIC_ADAPTIVE_UPLINK) {
+    contentType = "application/x-dayne-framed";
+    encodingName = "framed";
+    bitsPerSample = STT_MIC_BITS_PER_SAMPLE;  // of the decoded stream
+  }
+
+  char headers[512];
+  int headerLen = snprintf(headers, sizeof(headers),
+                           "POST %s HTTP/1.1\r\n"
+                           "Host: %s:%d\r\n"
+                           "Content-Type: %s\r\n"
+                           "X-Dayne-Encoding: %s\r\n"
+                           "X-Dayne-Sample-Rate: %d\r\n"
+                           "X-Dayne-Channels: %d\r\n"
+                           "X-Dayne-Bits-Per-Sample: %d\r\n"
+                           "X-Dayne-Utterance-Id: %08lx\r\n"
+                           "%s"
+                           "Transfer-Encoding: chunked\r\n"
+                           "Accept: %s\r\n"
+                           "Connection: %s\r\n"
+                           "\r\n",
+                           STT_ENDPOINT_PATH, STT_ENDPOINT_HOST, (int)STT_ENDPOINT_PORT,
+                           contentType, encodingName,
+                           STT_MIC_SAMPLE_RATE, STT_MIC_CHANNELS, bitsPerSample,
+                           (unsigned long)utteranceId,
+                           STT_MIC_LONG_DICTATION ? "X-Dayne-Long-Form: 1\r\n" : "",
+                           STT_MIC_PARTIAL_RESULTS ? "application/x-ndjson" : "application/json",
+                           STT_MIC_KEEP_ALIVE ? "keep-alive" : "close");
+  return chunkWriter.writeRecord(*client, (const uint8_t*)headers, headerLen);
+}
+
+// Ring bytes that make one full chunk
+size_t uploadChunkBytes() {
+  if (STT_MIC_ADAPTIVE_UPLINK) {
+    return uplinkEncoder.samplesPerBlock(chunkWriter.payloadCapacity()) * 2;
+  }
+  return chunkWriter.payloadCapacity();
+}
+
+// Encodes up to one block of PCM from the ring into out. last marks the
+// end of the utterance: a short block is sent and the encoder flushed.
+size_t fillUplinkBlock(uint8_t* out, size_t capacity, bool last) {
+  size_t samples = uplinkEncoder.samplesPerBlock(capacity);
+  size_t available = audioRing.available() / 2;
+  if (available < samples) {
+    if (!last) return 0;
+    samples = available;
+  }
+
+  uint32_t cycles = ESP.getCycleCount();
+  uplinkEncoder.beginBlock(out);
+  int16_t pcm[STT_MIC_FRAME_SAMPLES];
+  for (size_t done = 0; done < samples;) {
+    size_t n = samples - done;
+    if (n > STT_MIC_FRAME_SAMPLES) n = STT_MIC_FRAME_SAMPLES;
+    audioRing.read((uint8_t*)pcm, n * 2);
+    uplinkEncoder.append(pcm, n);
+    done += n;
+  }
+  size_t len = uplinkEncoder.endBlock(last && audioRing.available() == 0);
+  codecCycles += ESP.getCycleCount() - cycles;
+  codecSamples += samples;
+  return len;
+}
+
+// Moves up to one chunk of audio from the ring into the send buffer and
+// sends it as a single framed write. last is set once capture has stopped.
+bool sendAudioChunk(WiFiClient* client, size_t* bytesSent, bool last) {
+  size_t len;
+  if (STT_MIC_ADAPTIVE_UPLINK) {
+    len = fillUplinkBlock(chunkWriter.payload(), chunkWriter.payloadCapacity(), last);
+  } else {
+    len = audioRing.read(chunkWriter.payload(), chunkWriter.payloadCapacity());
+  }
+  *bytesSent = len;
+  if (len == 0) return true;
+  return chunkWriter.send(*client, len);
+}
+
+static bool utf8Continuation(char c) { return ((uint8_t)c & 0xC0) == 0x80; }
+
+// Brings the keyboard from what it has typed to target with the fewest
+// keystrokes: backspace over the part that changed, then type the rest.
+// One backspace erases one character, so the split never falls inside one.
+void typeTranscript(ResponseSlot& slot, const char* target) {
+  static char keys[STT_MIC_RESPONSE_MAX + 64];
+  for (;;) {
+    size_t common = 0;
+    while (common < slot.typedLen && target[common] != '\0' &&
+           target[common] == slot.typedText[common]) {
+      common++;
+    }
+    while (common > 0 && utf8Continuation(slot.typedText[common])) common--;
+
+    size_t erase = 0;
+    for (size_t i = common; i < slot.typedLen; i++) {
+      if (!utf8Continuation(slot.typedText[i])) erase++;
+    }
+    // Whole characters, no more than keys or typedText can hold; a suffix
+    // cut short here goes out on the next pass
+    size_t room = sizeof(slot.typedText) - 1 - common;
+    if (room > sizeof(keys) - 1 - erase) room = sizeof(keys) - 1 - erase;
+    size_t suffixLen = strlen(target + common);
+    size_t typeLen = espnow_transport::utf8Prefix(target + common, suffixLen, room);
+    if (erase == 0 && typeLen == 0) return;
+
+    memset(keys, '\b', erase);
+    memcpy(keys + erase, target + common, typeLen);
+    keys[erase + typeLen] = '\0';
+    size_t sent = sendTextToKeyboard(keys, slot.utterance);
+
+    // Track what the keyboard was given, not what was asked for, so the
+    // next update is diffed against what is on screen
+    for (size_t erased = sent < erase ? sent : erase; erased > 0; erased--) {
+      do {
+        slot.typedLen--;
+      } while (slot.typedLen > 0 && utf8Continuation(slot.typedText[slot.typedLen]));
+    }
+    if (sent > erase) {
+      memcpy(slot.typedText + common, target + common, sent - erase);
+      slot.typedLen = common + sent - erase;
+    }
+    slot.typedText[slot.typedLen] = '\0';
+
+    if (sent < erase + typeLen || typeLen == suffixLen || typeLen == 0) return;
+  }
+}
+
+// Handles one NDJSON update from /stream
+void handleTranscriptLine(ResponseSlot& slot, const char* line, size_t len) {
+  JsonDocument doc(&jsonAllocator);
+  DeserializationError error = deserializeJson(doc, line, len);
+  if (error) {
+    Serial.print("Transcript line parse error: ");
+    Serial.println(error.c_str());
+    return;
+  }
+  if (!doc["error"].isNull()) {
+    Serial.print("Endpoint error: ");
+    Serial.println(doc["error"].as<const char*>());
+    return;
+  }
+
+  if (doc["final"] | false) {
+    traceLog.record(TRACE_JSON_PARSED, slot.utterance, micros());
+    const char* transcription = doc["text"] | "";
+    Serial.println("\n=== Transcription ===");
+    Serial.println(transcription);
+    Serial.println("=====================\n");
+    typeTranscript(slot, transcription);
+  } else if (!doc["stable"].isNull()) {
+    typeTranscript(slot, doc["stable"]);
+  }
+}
+
+void processTranscriptLines(ResponseSlot& slot) {
+  HttpResponseParser& parser = slot.parser;
+  const char* body = parser.bodyText();
+  size_t len = parser.bodyLength();
+  size_t start = 0;
+  for (size_t i = 0; i < len; i++) {
+    if (body[i] != '\n') continue;
+    handleTranscriptLine(slot, body + start, i - start);
+    start = i + 1;
+  }
+  // A line that overflowed the buffer can never complete; drop it
+  if (start == 0 && parser.bodyTruncated()) {
+    start = len;
+  }
+  parser.discardBody(start);
+}
+
+// Feeds whatever response bytes have arrived into the slot's parser without
+// blocking, so it can be called from inside the upload loop.
+HttpResponseParser::Result pumpResponse(ResponseSlot& slot) {
+  uint8_t rx[256];
+  HttpResponseParser& parser = slot.parser;
+  HttpResponseParser::Result result = parser.result();
+  int avail;
+  while (result == HttpResponseParser::NEED_MORE && (avail = slot.client->available()) > 0) {
+    int n = slot.client->read(rx, min(avail, (int)sizeof(rx)));
+    if (n <= 0) break;
+    result = parser.feed(rx, n);
+    slot.lastByte = millis();
+  }
+  if (!slot.headersTraced && parser.headersComplete()) {
+    slot.headersTraced = true;
+    traceLog.record(TRACE_STATUS_LINE, slot.utterance, micros(), parser.status());
+  }
+  if (STT_MIC_PARTIAL_RESULTS && parser.headersComplete() && parser.status() == 200) {
+    processTranscriptLines(slot);
+  }
+  return result;
+}
+
+// Waits for the rest of the slot's response and types the transcript. Runs
+// in the response task, one slot at a time in utterance order.
+void completeResponse(ResponseSlot& slot) {
+  uint32_t funcStart = millis();
+  WiFiClient* client = slot.client;
+  HttpResponseParser& parser = slot.parser;
+
+  // Wait at least the full timeout from release, and keep waiting while
+  // bytes are still trickling in
+  HttpResponseParser::Result result = pumpResponse(slot);
+  while (result == HttpResponseParser::NEED_MORE) {
+    if (!client->connected()) {
+      result = parser.finish();
+      break;
+    }
+    if (millis() - slot.releaseTime > STT_MIC_RESPONSE_TIMEOUT_MS &&
+        millis() - slot.lastByte > STT_MIC_RESPONSE_IDLE_MS) {
+      break;
+    }
+    vTaskDelay(1);
+    result = pumpResponse(slot);
+  }
+
+  if (result != HttpResponseParser::DONE) {
+    Serial.printf("[%lu] Response %s\n", millis() - funcStart,
+                  result == HttpResponseParser::FAILED ? "malformed" : "timeout");
+    client->stop();
+    return;
+  }
+
+  Serial.printf("[%lu] HTTP Status: %d\n", millis() - funcStart, parser.status());
+
+  slot.connectionReusable = STT_MIC_KEEP_ALIVE && parser.status() == 200 && parser.keepAlive();
+  if (!slot.connectionReusable) {
+    client->stop();
+  }
+  Serial.printf("[%lu] Release to response: %lu ms (%s connection)\n", millis() - funcStart,
+                millis() - slot.releaseTime, slot.reused ? "reused" : "new");
+  if (STT_MIC_PARTIAL_RESULTS && parser.status() == 200) {
+    // Every line, including the final transcript, was handled by pumpResponse()
+    return;
+  }
+
+  Serial.printf("[%lu] Response: ", millis() - funcStart);
+  Serial.println(parser.bodyText());
+  if (parser.bodyTruncated()) {
+    Serial.printf("[%lu] Response truncated to %u bytes\n", millis() - funcStart,
+                  (unsigned)parser.bodyLength());
+  }
+
+  // Parse JSON
+  JsonDocument doc(&jsonAllocator);
+  DeserializationError error = deserializeJson(doc, parser.bodyText(), parser.bodyLength());
+
+  if (error) {
+    Serial.printf("[%lu] JSON parse error: ", millis() - funcStart);
+    Serial.println(error.c_str());
+  } else if (!doc["text"].isNull()) {
+    traceLog.record(TRACE_JSON_PARSED, slot.utterance, micros());
+    const char* transcription = doc["text"];
+    Serial.printf("[%lu] \n=== Transcription ===\n", millis() - funcStart);
+    Serial.println(transcription);
+    Serial.println("=====================\n");
+
+    sendTextToKeyboard(transcription, slot.utterance);
+  }
+}
+
+// Heap after an utterance has been delivered. Steady state means the free
+// size stops moving between utterances and the largest block stays put.
+void reportHeap() {
+  static uint32_t lastFree = 0;
+  uint32_t freeNow = heap_caps_get_free_size(MALLOC_CAP_8BIT);
+  Serial.printf("Heap: %lu free (%+ld), %lu low water, %lu largest block\n",
+                (unsigned long)freeNow, lastFree ? (long)freeNow - (long)lastFree : 0L,
+                (unsigned long)heap_caps_get_minimum_free_size(MALLOC_CAP_8BIT),
+                (unsigned long)heap_caps_get_largest_free_block(MALLOC_CAP_8BIT));
+  Serial.printf("JSON arena: %u/%u bytes peak, %lu refused\n", (unsigned)jsonArena.highWater,
+                (unsigned)jsonArena.capacity(), (unsigned long)jsonArena.failures);
+  lastFree = freeNow;
+}
+
+// -------------------- RESPONSE TASK -----------------------
+void responseTask(void* param) {
+  (void)param;
+  uint8_t index;
+  for (;;) {
+    if (xQueueReceive(responseQueue, &index, portMAX_DELAY) != pdTRUE) continue;
+    ResponseSlot& slot = responseSlots[index];
+    completeResponse(slot);
+#if STT_MIC_TRACE
+    traceLog.dump(Serial, "mic");
+#endif
+    reportHeap();
+    lastActivityTime = millis();
+    slot.busy = false;
+  }
+}
+
+// Claims the next slot in round-robin order. If its previous utterance is
+// still being answered this waits for it; capture keeps filling the ring
+// meanwhile, so only a wait longer than the pre-roll loses audio.
+ResponseSlot& claimResponseSlot() {
+  ResponseSlot& slot = responseSlots[nextResponseSlot];
+  nextResponseSlot = (nextResponseSlot + 1) % STT_MIC_RESPONSE_SLOTS;
+  if (slot.busy) {
+    uint32_t start = millis();
+    while (slot.busy) {
+      vTaskDelay(1);
+    }
+    Serial.printf("Waited %lu ms for a free response slot\n", millis() - start);
+  }
+  slot.busy = true;
+  return slot;
+}
+
 void recordAndStreamUpload() {
   uint32_t funcStart = millis();
   
   if (WiFi.status() != WL_CONNECTED) {
     Serial.printf("[%lu] WiFi lost.\n", millis() - funcStart);
+    stopCapture();
     return;
   }
 
-  Serial.printf("[%lu] Streaming audio...\n", millis() - funcStart);
+  ResponseSlot& slot = claimResponseSlot();
+  Serial.printf("[%lu] Streaming audio (slot %u)...\n", millis() - funcStart,
+                (unsigned)(&slot - responseSlots));
 
   // Determine if we need HTTPS or HTTP
   bool useHttps = (strcmp(STT_ENDPOINT_PROTOCOL, "https") == 0);
 
-  // Use global client objects to preserve TLS session cache
   WiFiClient* client;
   
   if (useHttps) {
     Serial.printf("[%lu] Using HTTPS...\n", millis() - funcStart);
-    httpsClient.setInsecure();  // Skip certificate verification (use for development)
+    slot.httpsClient.setInsecure();  // Skip certificate verification (use for development)
     // For production, use: httpsClient.setCACert(root_ca);
-    client = &httpsClient;
+    client = &slot.httpsClient;
   } else {
     Serial.printf("[%lu] Using HTTP...\n", millis() - funcStart);
-    client = &httpClient;
+    client = &slot.httpClient;
   }
+  slot.client = client;
   
-  Serial.printf("[%lu] starting connection\n", millis() - funcStart);
-  if (!client->connect(STT_ENDPOINT_HOST, STT_ENDPOINT_PORT)) {
+  // Reuse the previous connection when keep-alive left one open. If the
+  // server has since dropped it, fall back to a fresh connect.
+  bool reused = STT_MIC_KEEP_ALIVE && slot.connectionReusable && client->connected();
+  slot.connectionReusable = false;
+
+  slot.parser.reset();
+  slot.headersTraced = false;
+  slot.lastByte = millis();
+  slot.typedLen = 0;
+  slot.utterance = utteranceId;
+
+  Serial.printf("[%lu] %s\n", millis() - funcStart,
+                reused ? "Reusing connection" : "starting connection");
+  bool requestOpen = openRequest(client, !reused);
+  if (!requestOpen && reused) {
+    Serial.printf("[%lu] Kept-alive connection closed, reconnecting\n", millis() - funcStart);
+    reused = false;
+    requestOpen = openRequest(client, true);
+  }
+  if (!requestOpen) {
     Serial.printf("[%lu] Connection failed\n", millis() - funcStart);
+    client->stop();
     digitalWrite(STT_MIC_LED_PIN, LOW);
+    stopCapture();
+    slot.busy = false;
     return;
   }
+  slot.reused = reused;
   
-  Serial.printf("[%lu] Connection established\n", millis() - funcStart);
-
-  // Send HTTP headers manually
-  client->print("POST ");
-  client->print(STT_ENDPOINT_PATH);
-  client->println(" HTTP/1.1");
-  client->print("Host: ");
-  client->print(STT_ENDPOINT_HOST);
-  client->print(":");
-  client->println(STT_ENDPOINT_PORT);
-  client->println("Content-Type: audio/l16");
-  client->print("X-Dayne-Sample-Rate: ");
-  client->println(STT_MIC_SAMPLE_RATE);
-  client->print("X-Dayne-Channels: ");
-  client->println(STT_MIC_CHANNELS);
-  client->print("X-Dayne-Bits-Per-Sample: ");
-  client->println(STT_MIC_BITS_PER_SAMPLE);
-  client->println("Transfer-Encoding: chunked");
-  client->println("Connection: close");
-  client->println();  // End of headers
-  client->flush();  // Ensure headers are sent before starting audio
-
-  // Give server time to process headers
-  delay(20);
+  traceLog.record(TRACE_CONNECTED, utteranceId, micros(), reused);
+  Serial.printf("[%lu] Connection %s\n", millis() - funcStart, reused ? "reused" : "established");
+
+  // Capture has been running since the button went down; whatever piled up
+  // while connecting is the pre-roll and goes out first at line rate.
+  size_t prerollBytes = audioRing.available();
+  uint32_t prerollMs = millis() - captureStartTime;
+  Serial.printf("[%lu] Pre-roll: %u bytes over %lu ms (cap %u)\n", millis() - funcStart,
+                (unsigned)prerollBytes, prerollMs, (unsigned)STT_MIC_PREROLL_MAX_BYTES);
   
   Serial.printf("[%lu] Starting audio streaming...\n", millis() - funcStart);
   digitalWrite(STT_MIC_LED_PIN, HIGH);
 
-  // Stream audio while button is pressed
-  uint32_t startTime = millis();
+  // Stream audio while button is pressed. The capture task fills the ring
+  // from I2S; here we only drain it in full-record chunks so a slow write
+  // never stalls the microphone.
+  uint32_t startTime = captureStartTime;
+  uint32_t streamStart = millis();
   size_t totalBytes = 0;
   size_t totalChunks = 0;
-  uint8_t chunk[STT_MIC_CHUNK_SIZE];
-  
+  bool writeFailed = false;
+  UplinkAdapter::Window window = {};
+  uint32_t windowStart = millis();
+  uint32_t windowBytesOnAir = chunkWriter.bytesOnAir;
+
   while (digitalRead(STT_MIC_BUTTON_PIN) == LOW) {
-    // Read from filtered stream (already converted to 16-bit)
-    size_t bytesRead = filtered.readBytes(chunk, STT_MIC_CHUNK_SIZE);
-    
-    if (bytesRead > 0) {
-      // Send as HTTP chunk: size in hex + CRLF + data + CRLF
-      char chunkSize[16];
-      sprintf(chunkSize, "%X\r\n", bytesRead);
-      
-      size_t headerWritten = client->print(chunkSize);
-      size_t dataWritten = client->write(chunk, bytesRead);
-      size_t trailerWritten = client->print("\r\n");
-      
-      // Check if write succeeded
-      if (headerWritten == 0 || dataWritten != bytesRead || trailerWritten == 0) {
-        Serial.printf("[%lu] Write failed!\n", millis() - funcStart);
-        Serial.print("Header: "); Serial.print(headerWritten);
-        Serial.print(", Data: "); Serial.print(dataWritten);
-        Serial.print(", Trailer: "); Serial.println(trailerWritten);
-        break;
-      }
-      
-      totalBytes += bytesRead;
-      totalChunks++;
-      
-      // Flush after every few chunks to ensure data is sent
-      if (totalChunks % 10 == 0) {
-        client->flush();
+    // Interim results (or an early error) can arrive while still uploading.
+    // Interim text is only typed once earlier utterances are delivered; until
+    // then it waits in the socket.
+    if (!(STT_MIC_PARTIAL_RESULTS && responsesPending(&slot)) &&
+        pumpResponse(slot) != HttpResponseParser::NEED_MORE) {
+      Serial.printf("[%lu] Server responded before end of audio\n", millis() - funcStart);
+      writeFailed = true;
+      break;
+    }
+
+    if (audioRing.available() < uploadChunkBytes()) {
+      uploadUnderruns++;
+      vTaskDelay(1);
+      continue;
+    }
+
+    size_t bytesRead;
+    uint32_t writeStart = millis();
+    if (!sendAudioChunk(client, &bytesRead, false)) {
+      Serial.printf("[%lu] Write failed!\n", millis() - funcStart);
+      writeFailed = true;
+      break;
+    }
+    window.writeMs += millis() - writeStart;
+    if (totalChunks == 0) {
+      traceLog.record(TRACE_FIRST_AUDIO_BYTE, utteranceId, micros());
+    }
+    if (firstUploadSinceBoot) {
+      firstUploadSinceBoot = false;
+      Serial.printf("[%lu] Wake to first audio byte: %lu ms\n", millis() - funcStart, millis());
+    }
+
+    totalBytes += bytesRead;
+    totalChunks++;
+
+    // Judge the link on what it carried since the last window: a backlog
+    // that keeps growing, or a saturated socket slower than the format
+    if (STT_MIC_ADAPTIVE_UPLINK && millis() - windowStart >= STT_MIC_UPLINK_WINDOW_MS) {
+      const uint32_t pcmBytesPerMs = STT_MIC_SAMPLE_RATE / 1000 * 2;
+      window.elapsedMs = millis() - windowStart;
+      window.backlogMs = audioRing.available() / pcmBytesPerMs;
+      window.blockMs = uploadChunkBytes() / pcmBytesPerMs;
+      window.sentBytes = chunkWriter.bytesOnAir - windowBytesOnAir;
+      if (uplinkAdapter.update(window)) {
+        uplinkEncoder.setFormat(uplinkAdapter.format());
+        Serial.printf("[%lu] Uplink: stepped down to %s @ %lu Hz (backlog %lu ms, link %lu B/s)\n",
+                      millis() - funcStart, uplinkEncoder.encodingName(),
+                      (unsigned long)uplinkEncoder.sampleRate(), (unsigned long)window.backlogMs,
+                      (unsigned long)uplinkAdapter.measuredBytesPerSecond());
       }
+      window = {};
+      windowStart = millis();
+      windowBytesOnAir = chunkWriter.bytesOnAir;
     }
     
-    // Safety timeout (max 10 seconds)
-    if (millis() - startTime > 10000) {
+    if (STT_MIC_MAX_UTTERANCE_MS > 0 && millis() - startTime > STT_MIC_MAX_UTTERANCE_MS) {
       Serial.printf("[%lu] Max streaming time reached\n", millis() - funcStart);
       break;
     }
@@ -325,122 +1393,138 @@ void recordAndStreamUpload() {
       Serial.printf("[%lu] Connection lost at ", millis() - funcStart);
       Serial.print(totalBytes);
       Serial.println(" bytes");
+      writeFailed = true;
       break;
     }
-    
-    yield();
+  }
+
+  stopCapture();
+
+  // Upload whatever was captured before the button was released
+  while (!writeFailed && audioRing.available() > 0) {
+    size_t bytesRead;
+    if (!sendAudioChunk(client, &bytesRead, true)) {
+      Serial.printf("[%lu] Write failed!\n", millis() - funcStart);
+      break;
+    }
+    totalBytes += bytesRead;
+    totalChunks++;
+  }
+
+  // Capture has stopped, so the encoder is ours: an odd sample count leaves
+  // the last ADPCM nibble held back until flushed
+  if (!writeFailed && !STT_MIC_ADAPTIVE_UPLINK) {
+    size_t tail = encoder.flush(chunkWriter.payload());
+    if (tail > 0 && chunkWriter.send(*client, tail)) {
+      totalBytes += tail;
+      totalChunks++;
+    }
   }
   
   Serial.printf("[%lu] Sending final chunk...\n", millis() - funcStart);
   // Send final chunk (size 0) to signal end
-  client->print("0\r\n\r\n");
+  chunkWriter.finish(*client);
   client->flush();  // Ensure final chunk is sent
+  traceLog.record(TRACE_LAST_AUDIO_BYTE, utteranceId, micros(), chunkWriter.records);
   Serial.printf("[%lu] Final chunk flushed\n", millis() - funcStart);
   
-  uint32_t duration = millis() - startTime;
+  uint32_t releaseTime = millis();
+  uint32_t duration = releaseTime - startTime;
   digitalWrite(STT_MIC_LED_PIN, LOW);
   Serial.printf("[%lu] Streaming stopped. Duration: ", millis() - funcStart);
   Serial.print(duration);
   Serial.print(" ms, Bytes: ");
   Serial.print(totalBytes);
   Serial.print(", Chunks: ");
-  Serial.println(totalChunks);
-
-  // Read response
-  Serial.printf("[%lu] Reading response...\n", millis() - funcStart);
-  
-  // Read status line immediately (don't wait for available())
-  String statusLine = "";
-  unsigned long timeout = millis();
-  while (statusLine.length() == 0 && (millis() - timeout < 5000)) {
-    if (client->connected()) {
-      statusLine = client->readStringUntil('\n');
-    }
-    if (statusLine.length() == 0) delay(10);
+  Serial.print(totalChunks);
+  Serial.print(", Overruns: ");
+  Serial.print(captureOverruns);
+  Serial.print(" bytes, Underruns: ");
+  Serial.println(uploadUnderruns);
+  uint32_t streamMs = millis() - streamStart;
+  Serial.printf("[%lu] On air: %lu bytes (%lu payload), %lu records, %lu records/s\n",
+                millis() - funcStart, (unsigned long)chunkWriter.bytesOnAir,
+                (unsigned long)chunkWriter.payloadBytes, (unsigned long)chunkWriter.records,
+                streamMs ? (unsigned long)chunkWriter.records * 1000 / streamMs : 0UL);
+  if (frontEndFrames > 0) {
+    Serial.printf("[%lu] Front end: %lu cycles/frame\n", millis() - funcStart,
+                  (unsigned long)(frontEndCycles / frontEndFrames));
   }
-  
-  if (statusLine.length() == 0) {
-    Serial.printf("[%lu] Response timeout\n", millis() - funcStart);
-    client->stop();
-    return;
+#if STT_MIC_VAD
+  const VoiceActivityDetector::Stats& vadStats = vad.stats();
+  if (vadStats.framesIn > 0) {
+    Serial.printf("[%lu] VAD: %lu/%lu speech frames, %lu bytes saved, %lu cycles/frame\n",
+                  millis() - funcStart, (unsigned long)vadStats.framesSpeech,
+                  (unsigned long)vadStats.framesIn, (unsigned long)vadStats.samplesDropped * 2,
+                  (unsigned long)(vadCycles / vadStats.framesIn));
   }
-  
-  Serial.printf("[%lu] HTTP Status: ", millis() - funcStart);
-  Serial.println(statusLine);
-
-  // Skip headers
-  timeout = millis();
-  while (client->connected() && (millis() - timeout < 2000)) {
-    String line = client->readStringUntil('\n');
-    if (line == "\r") break;  // End of headers
-    if (line.length() == 0) delay(10);
-  }
-
-  // Read response body
-  String response = "";
-  timeout = millis();
-  while (client->connected() && (millis() - timeout < 2000)) {
-    if (client->available()) {
-      char c = client->read();
-      response += c;
-    } else {
-      delay(10);
-    }
-    // Check if we have complete JSON
-    if (response.endsWith("}")) break;
+#endif
+  if (codecSamples > 0) {
+    Serial.printf("[%lu] Codec %s: %lu cycles/sample\n", millis() - funcStart,
+                  STT_MIC_ADAPTIVE_UPLINK ? uplinkEncoder.encodingName() : encoder.encodingName(),
+                  (unsigned long)(codecCycles / codecSamples));
   }
-  
-  client->stop();
-  Serial.printf("[%lu] Response: ", millis() - funcStart);
-  Serial.println(response);
-  
-  // Parse JSON
-  JsonDocument doc;
-  DeserializationError error = deserializeJson(doc, response);
-  
-  if (error) {
-    Serial.printf("[%lu] JSON parse error: ", millis() - funcStart);
-    Serial.println(error.c_str());
-  } else if (!doc["text"].isNull()) {
-    const char* transcription = doc["text"];
-    Serial.printf("[%lu] \n=== Transcription ===\n", millis() - funcStart);
-    Serial.println(transcription);
-    Serial.println("=====================\n");
-    
-    sendTextToKeyboard(transcription);
+  if (STT_MIC_ADAPTIVE_UPLINK) {
+    Serial.printf("[%lu] Uplink: ended at %s @ %lu Hz, %lu step-downs since boot\n",
+                  millis() - funcStart, uplinkEncoder.encodingName(),
+                  (unsigned long)uplinkEncoder.sampleRate(), (unsigned long)uplinkAdapter.stepDowns);
   }
+
+  // The response task waits for the transcript and types it, after any
+  // earlier utterance, while loop() goes back to watching the button
+  slot.releaseTime = releaseTime;
+  uint8_t index = &slot - responseSlots;
+  xQueueSend(responseQueue, &index, portMAX_DELAY);
+  Serial.printf("[%lu] Response handed to response task\n", millis() - funcStart);
 }
 
 // ------------------------- LOOP --------------------------
 void loop() {
 
-  if (digitalRead(STT_MIC_BUTTON_PIN) == LOW) {
-    delay(30);  // debounce
+  // A capture started by a button wake is already debounced and is uploaded
+  // even if the button was released while WiFi was still connecting
+  bool wakeCapture = captureActive;
+
+  if (wakeCapture || digitalRead(STT_MIC_BUTTON_PIN) == LOW) {
+    // Start capturing immediately so nothing is lost to debounce or connect
+    if (!wakeCapture) {
+      PowerState pressedIn = powerLedger.state;
+      if (pressedIn != POWER_ACTIVE) {
+        leaveStandby();
+      }
+      startCapture();
+      if (buttonPressMicros != 0) {
+        powerLedger.recordWake(pressedIn, micros() - buttonPressMicros);
+        buttonPressMicros = 0;
+      }
+      delay(30);  // debounce
+    }
 
-    if (digitalRead(STT_MIC_BUTTON_PIN) == LOW) {
+    if (wakeCapture || digitalRead(STT_MIC_BUTTON_PIN) == LOW) {
       lastActivityTime = millis();  // Update activity time
+      // Returns once the audio is sent; the response task finishes the rest
       recordAndStreamUpload();
-      delay(500);
       lastActivityTime = millis();  // Update after completion
+    } else {
+      stopCapture();
     }
   }
 
-  // Check for inactivity timeout
-  if (millis() - lastActivityTime > STT_MIC_SLEEP_TIMEOUT_MS) {
-    Serial.println("Entering deep sleep due to inactivity...");
-    Serial.flush();  // Make sure message is sent
-    delay(100);
-    
-    // Turn off LED
-    digitalWrite(STT_MIC_LED_PIN, LOW);
-    
-    // Hold GPIO state during deep sleep
-    gpio_hold_en((gpio_num_t)STT_MIC_LED_PIN);
-    gpio_deep_sleep_hold_en();
-
-    // Enter deep sleep
-    esp_deep_sleep_start();
+  // Check for inactivity timeouts; never while a transcript is still on its way
+  uint32_t idleMs = millis() - lastActivityTime;
+  uint32_t waitMs = STT_MIC_ACTIVE_POLL_MS;
+  if (!responsesPending()) {
+    if (idleMs > STT_MIC_SLEEP_TIMEOUT_MS) {
+      enterDeepSleep();
+    }
+    if (STT_MIC_STANDBY && powerLedger.state == POWER_ACTIVE && idleMs > STT_MIC_STANDBY_AFTER_MS) {
+      enterStandby();
+    }
+    if (powerLedger.state != POWER_ACTIVE) {
+      // Nothing to do until the press or the deep sleep deadline
+      waitMs = STT_MIC_SLEEP_TIMEOUT_MS + 1 - idleMs;
+    }
   }
-  
-  delay(100);  // Small delay to avoid busy loop
+
+  waitForButton(waitMs);
 }
@@ -0,0 +1,240 @@
+#include <unity.h>
+
+#include "../../src/AudioCodec.h"
+
+#include <chrono>
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+
+void setUp() {}
+void tearDown() {}
+
+// Segment-table mu-law encoder after Sun's g711.c, on the 14-bit magnitude.
+// G.711 is sign-magnitude, so the magnitude is taken before the shift.
+static uint8_t referenceLinearToULaw(int16_t pcm) {
+  static const int16_t segEnd[8] = {0x3F, 0x7F, 0xFF, 0x1FF, 0x3FF, 0x7FF, 0xFFF, 0x1FFF};
+  int32_t v = pcm;
+  uint8_t mask = 0xFF;
+  if (v < 0) {
+    v = -v;
+    mask = 0x7F;
+  }
+  v >>= 2;
+  if (v > 8159) v = 8159;
+  v += 0x84 >> 2;
+  int seg = 0;
+  while (seg < 8 && v > segEnd[seg]) seg++;
+  if (seg >= 8) return 0x7F ^ mask;
+  uint8_t uval = (uint8_t)((seg << 4) | ((v >> (seg + 1)) & 0xF));
+  return uval ^ mask;
+}
+
+static int16_t referenceULawToLinear(uint8_t u) {
+  u = ~u;
+  int32_t t = ((u & 0x0F) << 3) + 0x84;
+  t <<= (u & 0x70) >> 4;
+  return (int16_t)((u & 0x80) ? 0x84 - t : t - 0x84);
+}
+
+// Standard IMA-ADPCM expansion, as in stt-endpoint's imaADPCMDecoder
+struct ImaDecoder {
+  int32_t predictor = 0;
+  int32_t index = 0;
+
+  int16_t nibble(uint8_t code) {
+    static const int16_t steps[89] = {
+        7,     8,     9,     10,    11,    12,    13,    14,    16,    17,    19,    21,    23,
+        25,    28,    31,    34,    37,    41,    45,    50,    55,    60,    66,    73,    80,
+        88,    97,    107,   118,   130,   143,   157,   173,   190,   209,   230,   253,   279,
+        307,   337,   371,   408,   449,   494,   544,   598,   658,   724,   796,   876,   963,
+        1060,  1166,  1282,  1411,  1552,  1707,  1878,  2066,  2272,  2499,  2749,  3024,  3327,
+        3660,  4026,  4428,  4871,  5358,  5894,  6484,  7132,  7845,  8630,  9493,  10442, 11487,
+        12635, 13899, 15289, 16818, 18500, 20350, 22385, 24623, 27086, 29794, 32767};
+    static const int8_t indexAdjust[16] = {-1, -1, -1, -1, 2, 4, 6, 8,
+                                           -1, -1, -1, -1, 2, 4, 6, 8};
+    int32_t step = steps[index];
+    int32_t diff = step >> 3;
+    if (code & 4) diff += step;
+    if (code & 2) diff += step >> 1;
+    if (code & 1) diff += step >> 2;
+    predictor += (code & 8) ? -diff : diff;
+    if (predictor > 32767) predictor = 32767;
+    if (predictor < -32768) predictor = -32768;
+    index += indexAdjust[code];
+    if (index < 0) index = 0;
+    if (index > 88) index = 88;
+    return (int16_t)predictor;
+  }
+
+  size_t decode(const uint8_t* in, size_t bytes, int16_t* out) {
+    for (size_t i = 0; i < bytes; i++) {
+      out[2 * i] = nibble(in[i] & 0x0F);
+      out[2 * i + 1] = nibble(in[i] >> 4);
+    }
+    return bytes * 2;
+  }
+};
+
+static const size_t SPEECH_SAMPLES = 4000;
+static int16_t speech[SPEECH_SAMPLES];
+
+// Two tones and a decaying burst: large and small steps for the predictor
+static void makeSpeech() {
+  for (size_t i = 0; i < SPEECH_SAMPLES; i++) {
+    double t = i / 16000.0;
+    double v = 9000 * sin(2 * M_PI * 220 * t) + 3000 * sin(2 * M_PI * 1800 * t);
+    if (i > 2500) v += 15000 * exp(-(i - 2500) / 200.0) * sin(2 * M_PI * 3100 * t);
+    speech[i] = (int16_t)v;
+  }
+}
+
+void test_ulaw_matches_g711_reference_for_every_sample() {
+  size_t mismatches = 0;
+  for (int32_t s = -32768; s <= 32767; s++) {
+    if (AudioEncoder::encodeULaw((int16_t)s) != referenceLinearToULaw((int16_t)s)) mismatches++;
+  }
+  TEST_ASSERT_EQUAL(0, mismatches);
+}
+
+void test_ulaw_round_trips_every_code() {
+  for (int code = 0; code < 256; code++) {
+    if (code == 0x7F) continue;  // -0 comes back as +0 (0xFF)
+    TEST_ASSERT_EQUAL_HEX8(code, AudioEncoder::encodeULaw(referenceULawToLinear((uint8_t)code)));
+  }
+  TEST_ASSERT_EQUAL_HEX8(0xFF, AudioEncoder::encodeULaw(referenceULawToLinear(0x7F)));
+}
+
+void test_ima_decoder_reproduces_the_encoder_predictor() {
+  AudioEncoder encoder(CODEC_IMA_ADPCM);
+  uint8_t encoded[SPEECH_SAMPLES / 2];
+  TEST_ASSERT_EQUAL(SPEECH_SAMPLES / 2, encoder.encode(speech, SPEECH_SAMPLES, encoded));
+
+  // Decoding and encoding the decoded signal again gives the same bits:
+  // the decoder's output is exactly what the encoder predicted
+  ImaDecoder decoder;
+  static int16_t decoded[SPEECH_SAMPLES];
+  decoder.decode(encoded, sizeof(encoded), decoded);
+  AudioEncoder again(CODEC_IMA_ADPCM);
+  uint8_t reencoded[SPEECH_SAMPLES / 2];
+  again.encode(decoded, SPEECH_SAMPLES, reencoded);
+  TEST_ASSERT_EQUAL_UINT8_ARRAY(encoded, reencoded, sizeof(encoded));
+
+  // And it tracks the input: better than 20 dB SNR
+  double signal = 0;
+  double noise = 0;
+  for (size_t i = 0; i < SPEECH_SAMPLES; i++) {
+    signal += (double)speech[i] * speech[i];
+    noise += (double)(speech[i] - decoded[i]) * (speech[i] - decoded[i]);
+  }
+  TEST_ASSERT_GREATER_THAN(20.0, 10 * log10(signal / noise));
+}
+
+void test_ima_split_calls_match_one_call() {
+  AudioEncoder whole(CODEC_IMA_ADPCM);
+  uint8_t expected[SPEECH_SAMPLES / 2 + 1];
+  size_t expectedLen = whole.encode(speech, SPEECH_SAMPLES - 1, expected);
+  expectedLen += whole.flush(expected + expectedLen);
+  TEST_ASSERT_EQUAL(SPEECH_SAMPLES / 2, expectedLen);
+
+  // Odd-sized pieces leave a nibble pending across most calls
+  AudioEncoder split(CODEC_IMA_ADPCM);
+  uint8_t actual[SPEECH_SAMPLES / 2 + 1];
+  size_t actualLen = 0;
+  const size_t pieces[] = {1, 3, 128, 7, 255, 2, 31};
+  size_t done = 0;
+  for (size_t p = 0; done < SPEECH_SAMPLES - 1; p++) {
+    size_t n = pieces[p % 7];
+    if (n > SPEECH_SAMPLES - 1 - done) n = SPEECH_SAMPLES - 1 - done;
+    size_t produced = split.encode(speech + done, n, actual + actualLen);
+    TEST_ASSERT_LESS_OR_EQUAL(split.maxEncodedSize(n), produced);
+    actualLen += produced;
+    done += n;
+  }
+  actualLen += split.flush(actual + actualLen);
+  TEST_ASSERT_EQUAL(0, split.flush(actual + actualLen));
+
+  TEST_ASSERT_EQUAL(expectedLen, actualLen);
+  TEST_ASSERT_EQUAL_UINT8_ARRAY(expected, actual, expectedLen);
+}
+
+void test_reset_starts_a_new_utterance() {
+  AudioEncoder encoder(CODEC_IMA_ADPCM);
+  uint8_t first[64];
+  uint8_t second[64];
+  encoder.encode(speech, 128, first);
+  encoder.encode(speech + 1000, 33, second);  // leaves a nibble pending
+  encoder.reset();
+  TEST_ASSERT_EQUAL(0, encoder.flush(second));
+  TEST_ASSERT_EQUAL(64, encoder.encode(speech, 128, second));
+  TEST_ASSERT_EQUAL_UINT8_ARRAY(first, second, sizeof(first));
+}
+
+void test_pcm16_passes_through() {
+  AudioEncoder encoder(CODEC_PCM16);
+  uint8_t out[SPEECH_SAMPLES * 2];
+  TEST_ASSERT_EQUAL(SPEECH_SAMPLES * 2, encoder.encode(speech, SPEECH_SAMPLES, out));
+  TEST_ASSERT_EQUAL_MEMORY(speech, out, sizeof(out));
+  TEST_ASSERT_EQUAL(0, encoder.flush(out));
+}
+
+void test_headers_describe_the_encoding() {
+  AudioEncoder encoder;
+  TEST_ASSERT_EQUAL_STRING("l16", encoder.encodingName());
+  TEST_ASSERT_EQUAL(16, encoder.bitsPerSample());
+  encoder.begin(CODEC_ULAW);
+  TEST_ASSERT_EQUAL_STRING("audio/basic", encoder.contentType());
+  TEST_ASSERT_EQUAL_STRING("ulaw", encoder.encodingName());
+  TEST_ASSERT_EQUAL(8, encoder.bitsPerSample());
+  encoder.begin(CODEC_IMA_ADPCM);
+  TEST_ASSERT_EQUAL_STRING("audio/x-ima-adpcm", encoder.contentType());
+  TEST_ASSERT_EQUAL_STRING("ima-adpcm", encoder.encodingName());
+  TEST_ASSERT_EQUAL(4, encoder.bitsPerSample());
+}
+
+// Host time per sample for each codec, fed a capture frame at a time as the
+// capture task does. The device log reports the same cost in cycles.
+static double encodeNsPerSample(AudioCodecType type) {
+  const size_t frame = 128;
+  const int rounds = 500;
+  AudioEncoder encoder(type);
+  static uint8_t out[frame * 2];
+  volatile uint32_t sink = 0;
+  auto start = std::chrono::steady_clock::now();
+  for (int n = 0; n < rounds; n++) {
+    for (size_t done = 0; done + frame <= SPEECH_SAMPLES; done += frame) {
+      size_t len = encoder.encode(speech + done, frame, out);
+      sink = sink + out[len - 1];
+    }
+  }
+  double ns =
+      std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+  return ns / (rounds * (SPEECH_SAMPLES / frame * frame));
+}
+
+void test_benchmark_encode_cost() {
+  double ulawNs = encodeNsPerSample(CODEC_ULAW);
+  double imaNs = encodeNsPerSample(CODEC_IMA_ADPCM);
+
+  char line[96];
+  snprintf(line, sizeof(line), "ns/sample: ulaw %.2f, ima-adpcm %.2f", ulawNs, imaNs);
+  TEST_MESSAGE(line);
+  // No assertion on the times: they only give the relative cost on this host
+  TEST_ASSERT_TRUE(ulawNs > 0 && imaNs > 0);
+}
+
+int main(int argc, char** argv) {
+  (void)argc;
+  (void)argv;
+  makeSpeech();
+  UNITY_BEGIN();
+  RUN_TEST(test_ulaw_matches_g711_reference_for_every_sample);
+  RUN_TEST(test_ulaw_round_trips_every_code);
+  RUN_TEST(test_ima_decoder_reproduces_the_encoder_predictor);
+  RUN_TEST(test_ima_split_calls_match_one_call);
+  RUN_TEST(test_reset_starts_a_new_utterance);
+  RUN_TEST(test_pcm16_passes_through);
+  RUN_TEST(test_headers_describe_the_encoding);
+  RUN_TEST(test_benchmark_encode_cost);
+  return UNITY_END();
+}
@@ -0,0 +1,234 @@
+#include <unity.h>
+
+#include "../../src/AudioFrontEnd.h"
+
+#include <chrono>
+#include <math.h>
+#include <random>
+#include <stdio.h>
+#include <vector>
+
+void setUp() {}
+void tearDown() {}
+
+// The same filter written the obvious way, with branches for the clamp
+struct ReferenceFrontEnd {
+  int shift;
+  int32_t gain;
+  int32_t x1 = 0;
+  int32_t y1 = 0;
+
+  int16_t next(int32_t word) {
+    int32_t x = word >> shift;
+    int32_t floorDiv = y1 / 128 - ((y1 < 0 && y1 % 128) ? 1 : 0);
+    int32_t y = (x - x1) * 256 + y1 - floorDiv;
+    x1 = x;
+    y1 = y;
+    int32_t v = (y >> 8) * gain >> 8;
+    if (v > 32767) return 32767;
+    if (v < -32768) return -32768;
+    return (int16_t)v;
+  }
+};
+
+// 24-bit left-justified words from a MEMS mic: tone plus a large DC offset
+static std::vector<int32_t> micWords(size_t samples, double amplitude, int32_t offset) {
+  std::vector<int32_t> words(samples);
+  for (size_t i = 0; i < samples; i++) {
+    double s = amplitude * sin(2 * M_PI * 1000 * i / 16000.0);
+    words[i] = (int32_t)((int32_t)s + offset) * 256;
+  }
+  return words;
+}
+
+static double rms(const int16_t* s, size_t n) {
+  double sum = 0;
+  for (size_t i = 0; i < n; i++) sum += (double)s[i] * s[i];
+  return sqrt(sum / n);
+}
+
+void test_matches_reference_bit_for_bit() {
+  std::mt19937 rng(5);
+  const int32_t gains[] = {256, 64, 1024, 4096};
+  for (int32_t gain : gains) {
+    AudioFrontEnd frontEnd;
+    frontEnd.begin(16, gain);
+    ReferenceFrontEnd reference{16, gain};
+    std::vector<int32_t> words(8192);
+    for (int32_t& w : words) w = (int32_t)rng();
+    // Full-scale steps too, where y swings furthest
+    for (size_t i = 0; i < 64; i++) words[i] = (i & 8) ? INT32_MAX : INT32_MIN;
+
+    std::vector<int16_t> out(words.size());
+    frontEnd.process(words.data(), out.data(), words.size());
+    for (size_t i = 0; i < words.size(); i++) {
+      TEST_ASSERT_EQUAL_INT16(reference.next(words[i]), out[i]);
+    }
+  }
+}
+
+void test_block_boundaries_do_not_matter() {
+  std::vector<int32_t> words = micWords(4000, 3000, 40000);
+  AudioFrontEnd whole;
+  whole.begin(8, 512);
+  std::vector<int16_t> expected(words.size());
+  whole.process(words.data(), expected.data(), words.size());
+
+  AudioFrontEnd split;
+  split.begin(8, 512);
+  std::vector<int16_t> actual(words.size());
+  size_t done = 0;
+  for (size_t n = 1; done < words.size(); n = n * 3 % 509 + 1) {
+    if (n > words.size() - done) n = words.size() - done;
+    split.process(words.data() + done, actual.data() + done, n);
+    done += n;
+  }
+  TEST_ASSERT_EQUAL_INT16_ARRAY(expected.data(), actual.data(), words.size());
+}
+
+void test_in_place_over_the_dma_buffer() {
+  std::vector<int32_t> words = micWords(1024, 2000, -12345);
+  AudioFrontEnd separate;
+  separate.begin(8, 256);
+  std::vector<int16_t> expected(words.size());
+  separate.process(words.data(), expected.data(), words.size());
+
+  AudioFrontEnd inPlace;
+  inPlace.begin(8, 256);
+  int16_t* out = reinterpret_cast<int16_t*>(words.data());
+  inPlace.process(words.data(), out, words.size());
+  TEST_ASSERT_EQUAL_INT16_ARRAY(expected.data(), out, words.size());
+}
+
+void test_dc_offset_is_removed() {
+  // Offset ten times the tone; after 0.25 s only the tone is left
+  std::vector<int32_t> words = micWords(16000, 1000, 10000);
+  AudioFrontEnd frontEnd;
+  frontEnd.begin(8, 256);
+  std::vector<int16_t> out(words.size());
+  frontEnd.process(words.data(), out.data(), words.size());
+
+  const int16_t* tail = out.data() + 4000;
+  size_t n = out.size() - 4000;
+  double mean = 0;
+  for (size_t i = 0; i < n; i++) mean += tail[i];
+  mean /= n;
+  TEST_ASSERT_LESS_THAN(20.0, fabs(mean));
+  // 1 kHz is far above the corner, so the tone passes at about unity gain
+  TEST_ASSERT_FLOAT_WITHIN(30.0, 1000 / sqrt(2.0), rms(tail, n));
+}
+
+void test_gain_saturates_instead_of_wrapping() {
+  std::vector<int32_t> words = micWords(4000, 20000, 0);
+  AudioFrontEnd frontEnd;
+  frontEnd.begin(8, 256 * 8);
+  std::vector<int16_t> out(words.size());
+  frontEnd.process(words.data(), out.data(), words.size());
+
+  int16_t lo = 0;
+  int16_t hi = 0;
+  for (size_t i = 2000; i < out.size(); i++) {
+    // A wrapped sample would flip sign against the input
+    if (words[i] > (1000 << 8)) TEST_ASSERT_GREATER_THAN(0, out[i]);
+    if (words[i] < -(1000 << 8)) TEST_ASSERT_LESS_THAN(0, out[i]);
+    if (out[i] < lo) lo = out[i];
+    if (out[i] > hi) hi = out[i];
+  }
+  TEST_ASSERT_EQUAL_INT16(32767, hi);
+  TEST_ASSERT_EQUAL_INT16(-32768, lo);
+}
+
+void test_reset_clears_the_filter_state() {
+  std::vector<int32_t> words = micWords(512, 3000, 20000);
+  AudioFrontEnd frontEnd;
+  frontEnd.begin(8, 256);
+  std::vector<int16_t> first(words.size());
+  frontEnd.process(words.data(), first.data(), words.size());
+  frontEnd.reset();
+  std::vector<int16_t> second(words.size());
+  frontEnd.process(words.data(), second.data(), words.size());
+  TEST_ASSERT_EQUAL_INT16_ARRAY(first.data(), second.data(), words.size());
+}
+
+// The chain the fused kernel replaced: one virtual call per sample per stage,
+// with a buffer between each
+struct Stage {
+  virtual ~Stage() {}
+  virtual int32_t apply(int32_t v) = 0;
+};
+
+struct ShiftStage : Stage {
+  int32_t apply(int32_t v) override { return v >> 16; }
+};
+
+struct HighPassStage : Stage {
+  int32_t x1 = 0;
+  int32_t y1 = 0;
+  int32_t apply(int32_t x) override {
+    int32_t y = ((x - x1) << 8) + y1 - (y1 >> 7);
+    x1 = x;
+    y1 = y;
+    return y >> 8;
+  }
+};
+
+struct GainStage : Stage {
+  int32_t apply(int32_t v) override {
+    v = v * 256 >> 8;
+    return v > 32767 ? 32767 : v < -32768 ? -32768 : v;
+  }
+};
+
+static double elapsedNs(std::chrono::steady_clock::time_point start) {
+  return std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+}
+
+void test_benchmark_against_stream_chain() {
+  const size_t block = 512;
+  const int blocks = 4000;
+  std::vector<int32_t> words = micWords(block, 3000, 500);
+  std::vector<int32_t> a(block);
+  std::vector<int32_t> b(block);
+  std::vector<int16_t> out(block);
+
+  ShiftStage shift;
+  HighPassStage highPass;
+  GainStage gain;
+  Stage* volatile stages[3] = {&shift, &highPass, &gain};
+  auto start = std::chrono::steady_clock::now();
+  for (int n = 0; n < blocks; n++) {
+    for (size_t i = 0; i < block; i++) a[i] = stages[0]->apply(words[i]);
+    for (size_t i = 0; i < block; i++) b[i] = stages[1]->apply(a[i]);
+    for (size_t i = 0; i < block; i++) out[i] = (int16_t)stages[2]->apply(b[i]);
+  }
+  double chainNs = elapsedNs(start);
+  int16_t chainLast = out[block - 1];
+
+  AudioFrontEnd frontEnd;
+  frontEnd.begin(16, 256);
+  start = std::chrono::steady_clock::now();
+  for (int n = 0; n < blocks; n++) frontEnd.process(words.data(), out.data(), block);
+  double fusedNs = elapsedNs(start);
+
+  char line[96];
+  snprintf(line, sizeof(line), "ns/sample: chain %.2f, fused %.2f", chainNs / (blocks * block),
+           fusedNs / (blocks * block));
+  TEST_MESSAGE(line);
+  // No assertion on the times: a loaded host can reorder them. The chain and
+  // the fused pass must still agree on the output.
+  TEST_ASSERT_EQUAL_INT16(chainLast, out[block - 1]);
+}
+
+int main(int argc, char** argv) {
+  (void)argc;
+  (void)argv;
+  UNITY_BEGIN();
+  RUN_TEST(test_matches_reference_bit_for_bit);
+  RUN_TEST(test_block_boundaries_do_not_matter);
+  RUN_TEST(test_in_place_over_the_dma_buffer);
+  RUN_TEST(test_dc_offset_is_removed);
+  RUN_TEST(test_gain_saturates_instead_of_wrapping);
+  RUN_TEST(test_reset_clears_the_filter_state);
+  RUN_TEST(test_benchmark_against_stream_chain);
+  return UNITY_END();
+}
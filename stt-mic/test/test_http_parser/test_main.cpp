@@ -0,0 +1,269 @@
+#include <unity.h>
+
+#include "../../src/HttpResponseParser.h"
+
+#include <chrono>
+#include <random>
+#include <stdio.h>
+#include <string.h>
+#include <string>
+
+static const char TEXT_BODY[] = "{\"text\":\"if (x) { y(); } // done\\nnext line }\"}";
+
+static const char CONTENT_LENGTH_RESPONSE[] =
+    "HTTP/1.1 200 OK\r\n"
+    "Content-Type: application/json\r\n"
+    "content-length: 47\r\n"
+    "Connection: keep-alive\r\n"
+    "\r\n"
+    "{\"text\":\"if (x) { y(); } // done\\nnext line }\"}";
+
+static const char CHUNKED_RESPONSE[] =
+    "HTTP/1.1 200 OK\r\n"
+    "Transfer-Encoding: chunked\r\n"
+    "\r\n"
+    "9\r\n{\"text\":\"\r\n"
+    "1a;name=value\r\nif (x) { y(); } // done\\nn\r\n"
+    "C\r\next line }\"}\r\n"
+    "0\r\n"
+    "X-Trailer: 1\r\n"
+    "\r\n";
+
+static char body[256];
+static HttpResponseParser parser(body, sizeof(body));
+
+void setUp() {
+  parser.reset();
+}
+
+void tearDown() {}
+
+static HttpResponseParser::Result feedString(HttpResponseParser& p, const std::string& s) {
+  return p.feed((const uint8_t*)s.data(), s.size());
+}
+
+static void assertTextBody(const HttpResponseParser& p) {
+  TEST_ASSERT_EQUAL(HttpResponseParser::DONE, p.result());
+  TEST_ASSERT_EQUAL(200, p.status());
+  TEST_ASSERT_EQUAL(strlen(TEXT_BODY), p.bodyLength());
+  TEST_ASSERT_EQUAL_STRING(TEXT_BODY, p.bodyText());
+  TEST_ASSERT_FALSE(p.bodyTruncated());
+}
+
+// Every response split at every point into two reads gives the same result
+static void assertAnySplit(const char* response) {
+  size_t len = strlen(response);
+  for (size_t cut = 0; cut <= len; cut++) {
+    parser.reset();
+    size_t a = 0;
+    size_t b = 0;
+    HttpResponseParser::Result first = parser.feed((const uint8_t*)response, cut, &a);
+    TEST_ASSERT_NOT_EQUAL(HttpResponseParser::FAILED, first);
+    parser.feed((const uint8_t*)response + cut, len - cut, &b);
+    TEST_ASSERT_EQUAL(len, a + b);
+    assertTextBody(parser);
+  }
+}
+
+void test_content_length_split_anywhere() {
+  assertAnySplit(CONTENT_LENGTH_RESPONSE);
+  TEST_ASSERT_TRUE(parser.keepAlive());
+}
+
+void test_chunked_split_anywhere() {
+  assertAnySplit(CHUNKED_RESPONSE);
+}
+
+void test_byte_at_a_time() {
+  const char* responses[] = {CONTENT_LENGTH_RESPONSE, CHUNKED_RESPONSE};
+  for (const char* response : responses) {
+    parser.reset();
+    for (const char* p = response; *p; p++) {
+      TEST_ASSERT_EQUAL(p[1] ? HttpResponseParser::NEED_MORE : HttpResponseParser::DONE,
+                        parser.feed((const uint8_t*)p, 1));
+    }
+    assertTextBody(parser);
+  }
+}
+
+void test_stops_at_the_end_of_a_kept_alive_response() {
+  std::string two = std::string(CONTENT_LENGTH_RESPONSE) + CHUNKED_RESPONSE;
+  size_t consumed = 0;
+  parser.feed((const uint8_t*)two.data(), two.size(), &consumed);
+  TEST_ASSERT_EQUAL(strlen(CONTENT_LENGTH_RESPONSE), consumed);
+  assertTextBody(parser);
+
+  parser.reset();
+  parser.feed((const uint8_t*)two.data() + consumed, two.size() - consumed, &consumed);
+  TEST_ASSERT_EQUAL(strlen(CHUNKED_RESPONSE), consumed);
+  assertTextBody(parser);
+}
+
+void test_body_until_close() {
+  feedString(parser, "HTTP/1.0 200 OK\r\n\r\n{\"text\":\"old server\"}");
+  TEST_ASSERT_EQUAL(HttpResponseParser::NEED_MORE, parser.result());
+  TEST_ASSERT_FALSE(parser.keepAlive());
+  TEST_ASSERT_EQUAL(HttpResponseParser::DONE, parser.finish());
+  TEST_ASSERT_EQUAL_STRING("{\"text\":\"old server\"}", parser.bodyText());
+}
+
+void test_close_mid_body_fails() {
+  feedString(parser, "HTTP/1.1 200 OK\r\nContent-Length: 100\r\n\r\n{\"text\":");
+  TEST_ASSERT_EQUAL(HttpResponseParser::FAILED, parser.finish());
+}
+
+void test_connection_close_and_no_body_statuses() {
+  feedString(parser, "HTTP/1.1 204 No Content\r\nConnection: close\r\n\r\n");
+  TEST_ASSERT_EQUAL(HttpResponseParser::DONE, parser.result());
+  TEST_ASSERT_EQUAL(204, parser.status());
+  TEST_ASSERT_FALSE(parser.keepAlive());
+  TEST_ASSERT_EQUAL(0, parser.bodyLength());
+}
+
+void test_error_status_keeps_its_body() {
+  feedString(parser, "HTTP/1.1 503 Service Unavailable\r\nContent-Length: 9\r\n\r\n{\"e\":\"x\"}");
+  TEST_ASSERT_EQUAL(HttpResponseParser::DONE, parser.result());
+  TEST_ASSERT_EQUAL(503, parser.status());
+  TEST_ASSERT_EQUAL_STRING("{\"e\":\"x\"}", parser.bodyText());
+}
+
+void test_long_body_is_truncated_and_discard_makes_room() {
+  char small[16];
+  HttpResponseParser p(small, sizeof(small));
+  feedString(p, "HTTP/1.1 200 OK\r\nContent-Length: 30\r\n\r\n0123456789abcdefghij");
+  TEST_ASSERT_TRUE(p.bodyTruncated());
+  TEST_ASSERT_EQUAL(15, p.bodyLength());
+  TEST_ASSERT_EQUAL_STRING("0123456789abcde", p.bodyText());
+
+  p.discardBody(10);
+  TEST_ASSERT_EQUAL_STRING("abcde", p.bodyText());
+  TEST_ASSERT_FALSE(p.bodyTruncated());
+  feedString(p, "klmnopqrst");
+  TEST_ASSERT_EQUAL(HttpResponseParser::DONE, p.result());
+  TEST_ASSERT_EQUAL_STRING("abcdeklmnopqrst", p.bodyText());
+}
+
+void test_malformed_input_fails() {
+  const char* bad[] = {
+      "SMTP ready\r\n",
+      "HTTP/1.1 OK\r\n",
+      "HTTP/1.1 200 OK\r\nTransfer-Encoding: chunked\r\n\r\nzz\r\n",
+      "HTTP/1.1 200 OK\r\nTransfer-Encoding: chunked\r\n\r\n\r\n",
+      "HTTP/1.1 200 OK\r\nTransfer-Encoding: chunked\r\n\r\n3\r\nabcX",
+      "HTTP/1.1 200 OK\r\nTransfer-Encoding: chunked\r\n\r\nFFFFFFFFFF\r\n",
+  };
+  for (const char* b : bad) {
+    parser.reset();
+    TEST_ASSERT_EQUAL_MESSAGE(HttpResponseParser::FAILED, feedString(parser, b), b);
+  }
+}
+
+// Random bytes and randomly damaged responses in random splits: the parser
+// never writes past its buffer and always ends in a consistent state
+void test_fuzz() {
+  std::mt19937 rng(9);
+  static char fuzzBody[64 + 1];
+  const char guard = (char)0xA5;
+  const std::string seeds[] = {CONTENT_LENGTH_RESPONSE, CHUNKED_RESPONSE};
+
+  for (int round = 0; round < 20000; round++) {
+    std::string input;
+    if (round % 4 == 0) {
+      input.resize(rng() % 300);
+      for (char& c : input) c = (char)rng();
+    } else {
+      input = seeds[round & 1];
+      for (int m = rng() % 4; m >= 0; m--) input[rng() % input.size()] = (char)rng();
+      if (rng() % 3 == 0) input.resize(rng() % input.size());
+    }
+
+    fuzzBody[64] = guard;
+    HttpResponseParser p(fuzzBody, 64);
+    size_t at = 0;
+    while (at < input.size() && p.result() == HttpResponseParser::NEED_MORE) {
+      size_t n = 1 + rng() % 40;
+      if (n > input.size() - at) n = input.size() - at;
+      size_t consumed = 0;
+      p.feed((const uint8_t*)input.data() + at, n, &consumed);
+      TEST_ASSERT_LESS_OR_EQUAL(n, consumed);
+      at += consumed;
+      if (consumed < n) break;
+    }
+    p.finish();
+
+    TEST_ASSERT_EQUAL_HEX8(guard, fuzzBody[64]);
+    TEST_ASSERT_LESS_OR_EQUAL(63, p.bodyLength());
+    TEST_ASSERT_EQUAL_HEX8(0, fuzzBody[p.bodyLength()]);
+    TEST_ASSERT_NOT_EQUAL(HttpResponseParser::NEED_MORE, p.result());
+  }
+}
+
+// The loop the parser replaced: header lines into a String, then the body a
+// character at a time until it ends in '}'
+static std::string legacyRead(const char* response, size_t len) {
+  size_t i = 0;
+  std::string line;
+  for (;;) {
+    line = "";
+    while (i < len && response[i] != '\n') line += response[i++];
+    i++;
+    if (line == "\r" || i >= len) break;
+  }
+  std::string text;
+  while (i < len) {
+    text += std::string(1, response[i++]);
+    if (!text.empty() && text.back() == '}') break;
+  }
+  return text;
+}
+
+void test_benchmark_against_string_loop() {
+  const char* response = CONTENT_LENGTH_RESPONSE;
+  size_t len = strlen(response);
+  const int rounds = 200000;
+
+  // The heuristic stops at the first '}' inside the transcript
+  TEST_ASSERT_TRUE(legacyRead(response, len) != TEXT_BODY);
+
+  volatile size_t sink = 0;
+  auto start = std::chrono::steady_clock::now();
+  for (int n = 0; n < rounds; n++) sink = sink + legacyRead(response, len).size();
+  double legacyNs =
+      std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+
+  start = std::chrono::steady_clock::now();
+  for (int n = 0; n < rounds; n++) {
+    parser.reset();
+    parser.feed((const uint8_t*)response, len);
+    sink = sink + parser.bodyLength();
+  }
+  double parserNs =
+      std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+
+  char line[96];
+  snprintf(line, sizeof(line), "ns/response: String loop %.0f, parser %.0f", legacyNs / rounds,
+           parserNs / rounds);
+  TEST_MESSAGE(line);
+  // No assertion on the times: on the device the old loop's cost was its
+  // delay(10) polls and heap churn, which a host run does not reproduce
+  assertTextBody(parser);
+}
+
+int main(int argc, char** argv) {
+  (void)argc;
+  (void)argv;
+  UNITY_BEGIN();
+  RUN_TEST(test_content_length_split_anywhere);
+  RUN_TEST(test_chunked_split_anywhere);
+  RUN_TEST(test_byte_at_a_time);
+  RUN_TEST(test_stops_at_the_end_of_a_kept_alive_response);
+  RUN_TEST(test_body_until_close);
+  RUN_TEST(test_close_mid_body_fails);
+  RUN_TEST(test_connection_close_and_no_body_statuses);
+  RUN_TEST(test_error_status_keeps_its_body);
+  RUN_TEST(test_long_body_is_truncated_and_discard_makes_room);
+  RUN_TEST(test_malformed_input_fails);
+  RUN_TEST(test_fuzz);
+  RUN_TEST(test_benchmark_against_string_loop);
+  return UNITY_END();
+}
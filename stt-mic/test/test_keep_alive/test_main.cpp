@@ -0,0 +1,158 @@
+// Successive utterances on kept-alive connections, one per response slot,
+// against the HostFakes loopback server.
+#define STT_MIC_KEEP_ALIVE 1
+
+#include <unity.h>
+
+#include "../../src/main.cpp"
+
+#include <HostFakes.h>
+#include <math.h>
+#include <mutex>
+#include <stdio.h>
+#include <string>
+#include <thread>
+#include <vector>
+
+static std::mutex keyboardMutex;
+static std::vector<std::string> keyboardMessages;
+static char keyboardBuffer[espnow_transport::MAX_MESSAGE + 1];
+static espnow_transport::Reassembler keyboard(keyboardBuffer, sizeof(keyboardBuffer));
+
+static void keyboardReceive(const uint8_t* data, size_t len) {
+  std::lock_guard<std::mutex> lock(keyboardMutex);
+  if (keyboard.accept(data, len) == espnow_transport::Reassembler::COMPLETE) {
+    keyboardMessages.push_back(std::string(keyboard.message(), keyboard.messageLength()));
+  }
+}
+
+static size_t typedCount() {
+  std::lock_guard<std::mutex> lock(keyboardMutex);
+  return keyboardMessages.size();
+}
+
+static int16_t quietThenTone(uint64_t n) {
+  int16_t s = (int16_t)(n * 7919 % 41) - 20;
+  if (n < STT_MIC_SAMPLE_RATE * 3 / 10) return s;
+  return s + (int16_t)(6000 * sin(2 * M_PI * 440 * n / STT_MIC_SAMPLE_RATE));
+}
+
+// One utterance, waiting until it is typed. Returns when the button went down.
+static unsigned long utterance(uint32_t holdMs) {
+  size_t before = typedCount();
+  fake::setI2sSource(quietThenTone);  // the VAD needs the quiet start every time
+  unsigned long pressMs = millis();
+  fake::setPin(STT_MIC_BUTTON_PIN, LOW);
+  std::thread release([holdMs] {
+    delay(holdMs);
+    fake::setPin(STT_MIC_BUTTON_PIN, HIGH);
+  });
+  startCapture();
+  recordAndStreamUpload();
+  release.join();
+  TEST_ASSERT_TRUE(fake::waitFor([before] { return typedCount() > before; }, 3000));
+  TEST_ASSERT_TRUE(fake::waitFor([] { return !responsesPending(); }, 3000));
+  return pressMs;
+}
+
+static bool serverKeepsAlive;
+static int connectsBefore;
+
+// Connects since setUp(); the fake counts across tests
+static int connects() {
+  return fake::tcpConnects() - connectsBefore;
+}
+
+void setUp() {
+  fake::reset();
+  fake::setEspNowPeer(keyboardReceive);
+  fake::setPin(STT_MIC_BUTTON_PIN, HIGH);
+  serverKeepsAlive = true;
+  fake::setHttpHandler([](const fake::HttpRequest& r) {
+    return fake::httpResponse(200, "{\"text\":\"" + std::to_string(r.body.size()) + "\"}",
+                              "application/json", serverKeepsAlive);
+  });
+  {
+    std::lock_guard<std::mutex> lock(keyboardMutex);
+    keyboardMessages.clear();
+  }
+  // Nothing left open from the previous test
+  fake::dropConnections();
+  for (ResponseSlot& slot : responseSlots) slot.connectionReusable = false;
+  connectsBefore = fake::tcpConnects();
+}
+
+void tearDown() {}
+
+// Each response slot keeps its own connection, so utterances take turns
+// between STT_MIC_RESPONSE_SLOTS of them
+void test_utterances_reuse_the_slot_connections() {
+  const int count = 3 * STT_MIC_RESPONSE_SLOTS;
+  for (int i = 0; i < count; i++) utterance(300);
+
+  std::vector<fake::HttpRequest> requests = fake::httpRequests();
+  TEST_ASSERT_EQUAL(count, requests.size());
+  TEST_ASSERT_EQUAL(STT_MIC_RESPONSE_SLOTS, connects());
+  for (int i = 0; i < count; i++) {
+    TEST_ASSERT_EQUAL_STRING("keep-alive", requests[i].header("Connection").c_str());
+    TEST_ASSERT_EQUAL(requests[i % STT_MIC_RESPONSE_SLOTS].connection, requests[i].connection);
+    TEST_ASSERT_GREATER_THAN(0, requests[i].body.size());
+  }
+}
+
+void test_dropped_connections_are_reopened() {
+  for (int i = 0; i < STT_MIC_RESPONSE_SLOTS; i++) utterance(300);
+  fake::dropConnections();
+  for (int i = 0; i < 2 * STT_MIC_RESPONSE_SLOTS; i++) utterance(300);
+
+  // Every utterance was delivered; each slot reconnected once
+  TEST_ASSERT_EQUAL(3 * STT_MIC_RESPONSE_SLOTS, typedCount());
+  TEST_ASSERT_EQUAL(2 * STT_MIC_RESPONSE_SLOTS, connects());
+}
+
+void test_server_close_is_honoured() {
+  serverKeepsAlive = false;
+  for (int i = 0; i < 2 * STT_MIC_RESPONSE_SLOTS; i++) utterance(300);
+  TEST_ASSERT_EQUAL(2 * STT_MIC_RESPONSE_SLOTS, connects());
+  TEST_ASSERT_EQUAL(2 * STT_MIC_RESPONSE_SLOTS, fake::httpRequests().size());
+}
+
+void test_reuse_saves_the_handshake() {
+  fake::tcpLink.latencyMs = 40;
+  const int rounds = 3;
+
+  // Press to request start, averaged, with and without reuse
+  double ms[2] = {};
+  for (int keep = 0; keep < 2; keep++) {
+    serverKeepsAlive = keep;
+    fake::dropConnections();
+    // Open the connections that later rounds may reuse
+    for (int i = 0; i < STT_MIC_RESPONSE_SLOTS; i++) utterance(200);
+    size_t first = fake::httpRequests().size();
+    std::vector<unsigned long> pressed;
+    for (int i = 0; i < rounds; i++) pressed.push_back(utterance(200));
+    std::vector<fake::HttpRequest> requests = fake::httpRequests();
+    for (int i = 0; i < rounds; i++) ms[keep] += requests[first + i].startMs - pressed[i];
+    ms[keep] /= rounds;
+  }
+
+  char line[80];
+  snprintf(line, sizeof(line), "press to request: %.1f ms new, %.1f ms reused", ms[0], ms[1]);
+  TEST_MESSAGE(line);
+  // A fresh connect costs a round trip before the request can go out
+  TEST_ASSERT_GREATER_THAN(ms[1] + 1.5 * fake::tcpLink.latencyMs, ms[0]);
+}
+
+int main(int argc, char** argv) {
+  (void)argc;
+  (void)argv;
+  fake::serialEcho = getenv("STT_TEST_SERIAL") != nullptr;
+  setup();
+
+  UNITY_BEGIN();
+  RUN_TEST(test_utterances_reuse_the_slot_connections);
+  RUN_TEST(test_dropped_connections_are_reopened);
+  RUN_TEST(test_server_close_is_honoured);
+  RUN_TEST(test_reuse_saves_the_handshake);
+  return UNITY_END();
+}
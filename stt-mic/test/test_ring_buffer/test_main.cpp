@@ -0,0 +1,169 @@
+#include <unity.h>
+
+#include "../../src/RingBuffer.h"
+
+#include <chrono>
+#include <random>
+#include <stdio.h>
+#include <thread>
+
+void setUp() {}
+void tearDown() {}
+
+void test_capacity_must_be_a_power_of_two() {
+  uint8_t storage[64];
+  RingBuffer ring;
+  TEST_ASSERT_FALSE(ring.begin(storage, 48));
+  TEST_ASSERT_FALSE(ring.begin(nullptr, 64));
+  TEST_ASSERT_FALSE(ring.begin(storage, 0));
+  TEST_ASSERT_EQUAL(0, ring.capacity());
+  TEST_ASSERT_TRUE(ring.begin(storage, 64));
+  TEST_ASSERT_EQUAL(64, ring.capacity());
+  TEST_ASSERT_EQUAL(64, ring.space());
+}
+
+void test_write_stops_at_full_and_read_at_empty() {
+  uint8_t storage[16];
+  RingBuffer ring(storage, sizeof(storage));
+  uint8_t data[20];
+  for (uint8_t i = 0; i < sizeof(data); i++) data[i] = i;
+
+  TEST_ASSERT_EQUAL(16, ring.write(data, sizeof(data)));
+  TEST_ASSERT_EQUAL(0, ring.space());
+  TEST_ASSERT_EQUAL(0, ring.write(data, 1));
+
+  uint8_t out[20];
+  TEST_ASSERT_EQUAL(16, ring.read(out, sizeof(out)));
+  TEST_ASSERT_EQUAL_UINT8_ARRAY(data, out, 16);
+  TEST_ASSERT_EQUAL(0, ring.read(out, 1));
+  TEST_ASSERT_EQUAL(0, ring.available());
+}
+
+void test_wrap_keeps_byte_order() {
+  uint8_t storage[16];
+  RingBuffer ring(storage, sizeof(storage));
+  uint8_t data[12];
+  uint8_t out[12];
+  uint8_t next = 0;
+  uint8_t expect = 0;
+
+  // Odd sizes walk the read and write offsets across the end many times
+  for (int round = 0; round < 100; round++) {
+    size_t n = 1 + round % 11;
+    for (size_t i = 0; i < n; i++) data[i] = next++;
+    TEST_ASSERT_EQUAL(n, ring.write(data, n));
+    TEST_ASSERT_EQUAL(n, ring.read(out, n));
+    for (size_t i = 0; i < n; i++) TEST_ASSERT_EQUAL_UINT8(expect++, out[i]);
+  }
+}
+
+void test_skip_discards_oldest() {
+  uint8_t storage[8];
+  RingBuffer ring(storage, sizeof(storage));
+  const uint8_t data[] = {1, 2, 3, 4, 5, 6};
+  ring.write(data, sizeof(data));
+
+  TEST_ASSERT_EQUAL(4, ring.skip(4));
+  uint8_t out[4];
+  TEST_ASSERT_EQUAL(2, ring.read(out, sizeof(out)));
+  TEST_ASSERT_EQUAL_UINT8(5, out[0]);
+  TEST_ASSERT_EQUAL_UINT8(6, out[1]);
+  TEST_ASSERT_EQUAL(0, ring.skip(1));
+}
+
+// One producer and one consumer moving a counting pattern in random-sized
+// pieces: every byte arrives once and in order
+void test_spsc_stress() {
+  static uint8_t storage[1024];
+  RingBuffer ring(storage, sizeof(storage));
+  const size_t total = 4 * 1024 * 1024;
+
+  std::thread producer([&ring, total] {
+    std::mt19937 rng(1);
+    uint8_t chunk[300];
+    size_t sent = 0;
+    while (sent < total) {
+      size_t n = 1 + rng() % sizeof(chunk);
+      if (n > total - sent) n = total - sent;
+      for (size_t i = 0; i < n; i++) chunk[i] = (uint8_t)((sent + i) * 7);
+      size_t done = 0;
+      while (done < n) {
+        done += ring.write(chunk + done, n - done);
+        if (done < n) std::this_thread::yield();
+      }
+      sent += n;
+    }
+  });
+
+  std::mt19937 rng(2);
+  uint8_t chunk[300];
+  size_t received = 0;
+  size_t mismatches = 0;
+  while (received < total) {
+    size_t n = ring.read(chunk, 1 + rng() % sizeof(chunk));
+    if (n == 0) {
+      std::this_thread::yield();
+      continue;
+    }
+    for (size_t i = 0; i < n; i++) {
+      if (chunk[i] != (uint8_t)((received + i) * 7)) mismatches++;
+    }
+    received += n;
+  }
+  producer.join();
+
+  TEST_ASSERT_EQUAL(0, mismatches);
+  TEST_ASSERT_EQUAL(0, ring.available());
+}
+
+// Capture-sized writes against upload-sized reads through a ring the size
+// of the device's, timed end to end
+void test_spsc_throughput() {
+  static uint8_t storage[32 * 1024];
+  RingBuffer ring(storage, sizeof(storage));
+  const size_t total = 256 * 1024 * 1024;
+
+  auto start = std::chrono::steady_clock::now();
+  std::thread producer([&ring, total] {
+    uint8_t block[256] = {};  // one capture frame of PCM16
+    for (size_t sent = 0; sent < total; sent += sizeof(block)) {
+      size_t done = 0;
+      while (done < sizeof(block)) {
+        done += ring.write(block + done, sizeof(block) - done);
+        if (done < sizeof(block)) std::this_thread::yield();
+      }
+    }
+  });
+
+  uint8_t chunk[1460];
+  size_t received = 0;
+  while (received < total) {
+    size_t n = ring.read(chunk, sizeof(chunk));
+    if (n == 0) std::this_thread::yield();
+    received += n;
+  }
+  producer.join();
+  double seconds =
+      std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+  char line[96];
+  snprintf(line, sizeof(line), "SPSC 256 B writes, 1460 B reads: %.0f MB/s",
+           total / seconds / 1e6);
+  TEST_MESSAGE(line);
+  // No assertion on the rate: it depends on the host and its load. 16 kHz
+  // PCM16 needs 32 kB/s.
+  TEST_ASSERT_EQUAL(total, received);
+}
+
+int main(int argc, char** argv) {
+  (void)argc;
+  (void)argv;
+  UNITY_BEGIN();
+  RUN_TEST(test_capacity_must_be_a_power_of_two);
+  RUN_TEST(test_write_stops_at_full_and_read_at_empty);
+  RUN_TEST(test_wrap_keeps_byte_order);
+  RUN_TEST(test_skip_discards_oldest);
+  RUN_TEST(test_spsc_stress);
+  RUN_TEST(test_spsc_throughput);
+  return UNITY_END();
+}
@@ -0,0 +1,374 @@
+// Adaptive uplink: the framed block format, the adapter's decisions, and the
+// whole sketch uploading over a link slower than 16-bit 16 kHz.
+#define STT_MIC_ADAPTIVE_UPLINK 1
+
+#include <unity.h>
+
+#include "../../src/main.cpp"
+
+#include <HostFakes.h>
+#include <math.h>
+#include <mutex>
+#include <stdio.h>
+#include <string>
+#include <thread>
+#include <vector>
+
+static const size_t CAPACITY = 200;
+static const size_t SIGNAL_SAMPLES = 3001;  // odd, so half rate holds one back
+static int16_t input[SIGNAL_SAMPLES];
+
+void setUp() {
+  fake::reset();
+  fake::setPin(STT_MIC_BUTTON_PIN, HIGH);
+}
+
+void tearDown() {
+  TEST_ASSERT_TRUE(fake::waitFor([] { return !responsesPending(); }, 8000));
+}
+
+// One block as the endpoint sees it
+struct Block {
+  AudioCodecType codec;
+  uint32_t rate;
+  std::string payload;
+};
+
+// Splits a framed body into blocks; fails on a header that does not fit
+static std::vector<Block> parseBlocks(const std::string& body) {
+  std::vector<Block> blocks;
+  size_t at = 0;
+  while (at < body.size()) {
+    TEST_ASSERT_LESS_OR_EQUAL(body.size(), at + UplinkEncoder::HEADER_SIZE);
+    const uint8_t* h = (const uint8_t*)body.data() + at;
+    size_t len = h[2] | (size_t)h[3] << 8;
+    TEST_ASSERT_LESS_OR_EQUAL(body.size(), at + UplinkEncoder::HEADER_SIZE + len);
+    TEST_ASSERT_LESS_OR_EQUAL(CODEC_IMA_ADPCM, h[0]);
+    blocks.push_back({(AudioCodecType)h[0], h[1] * 1000u,
+                      body.substr(at + UplinkEncoder::HEADER_SIZE, len)});
+    at += UplinkEncoder::HEADER_SIZE + len;
+  }
+  return blocks;
+}
+
+// Encodes count samples as blocks of CAPACITY, the last one marked last
+static std::string encodeBlocks(UplinkEncoder& encoder, const int16_t* samples, size_t count) {
+  std::string body;
+  uint8_t out[CAPACITY];
+  size_t perBlock = encoder.samplesPerBlock(CAPACITY);
+  for (size_t done = 0; done < count;) {
+    size_t n = count - done < perBlock ? count - done : perBlock;
+    encoder.beginBlock(out);
+    // Appended in uneven pieces, as the ring hands them out
+    for (size_t k = 0; k < n;) {
+      size_t piece = n - k < 37 ? n - k : 37;
+      encoder.append(samples + done + k, piece);
+      k += piece;
+    }
+    done += n;
+    size_t len = encoder.endBlock(done == count);
+    TEST_ASSERT_LESS_OR_EQUAL(CAPACITY, len);
+    body.append((const char*)out, len);
+  }
+  return body;
+}
+
+// What the half-rate path should send: [1 2 1] / 4 over each pair, then an
+// odd last sample as it is
+static std::vector<int16_t> halfRate(const int16_t* samples, size_t count) {
+  std::vector<int16_t> half;
+  int32_t previous = 0;
+  for (size_t i = 0; i + 1 < count; i += 2) {
+    half.push_back((int16_t)((previous + 2 * samples[i] + samples[i + 1] + 2) >> 2));
+    previous = samples[i + 1];
+  }
+  if (count & 1) half.push_back(samples[count - 1]);
+  return half;
+}
+
+static std::string encodeOneShot(AudioCodecType codec, const std::vector<int16_t>& samples) {
+  AudioEncoder encoder(codec);
+  std::vector<uint8_t> out(encoder.maxEncodedSize(samples.size()) + 1);
+  size_t len = encoder.encode(samples.data(), samples.size(), out.data());
+  len += encoder.flush(out.data() + len);
+  return std::string((const char*)out.data(), len);
+}
+
+static std::string payloads(const std::vector<Block>& blocks) {
+  std::string all;
+  for (const Block& b : blocks) all += b.payload;
+  return all;
+}
+
+void test_blocks_carry_their_format_and_fit_the_chunk() {
+  for (uint8_t level = 0; level < UplinkAdapter::LEVELS; level++) {
+    UplinkFormat format = UplinkAdapter::formatAt(level);
+    UplinkEncoder encoder;
+    encoder.begin(16000, format);
+    size_t perBlock = encoder.samplesPerBlock(CAPACITY);
+    TEST_ASSERT_EQUAL(0, perBlock % (2 * format.decimation));
+    TEST_ASSERT_EQUAL(0, encoder.samplesPerBlock(UplinkEncoder::HEADER_SIZE));
+
+    std::vector<Block> blocks = parseBlocks(encodeBlocks(encoder, input, SIGNAL_SAMPLES));
+    TEST_ASSERT_EQUAL((SIGNAL_SAMPLES + perBlock - 1) / perBlock, blocks.size());
+    for (const Block& b : blocks) {
+      TEST_ASSERT_EQUAL(format.codec, b.codec);
+      TEST_ASSERT_EQUAL(16000 / format.decimation, b.rate);
+    }
+    // Every block but the last is full
+    for (size_t i = 0; i + 1 < blocks.size(); i++) {
+      TEST_ASSERT_GREATER_OR_EQUAL(CAPACITY - UplinkEncoder::HEADER_SIZE - 1,
+                                   blocks[i].payload.size());
+    }
+  }
+}
+
+// Codec state carries across blocks: the payloads joined are exactly one
+// encode of the whole signal
+void test_payloads_join_into_one_stream() {
+  std::vector<int16_t> full(input, input + SIGNAL_SAMPLES);
+  for (uint8_t level = 0; level < UplinkAdapter::LEVELS; level++) {
+    UplinkFormat format = UplinkAdapter::formatAt(level);
+    UplinkEncoder encoder;
+    encoder.begin(16000, format);
+    std::string sent = payloads(parseBlocks(encodeBlocks(encoder, input, SIGNAL_SAMPLES)));
+    std::vector<int16_t> expected =
+        format.decimation == 2 ? halfRate(input, SIGNAL_SAMPLES) : full;
+    TEST_ASSERT_TRUE_MESSAGE(sent == encodeOneShot(format.codec, expected),
+                             encoder.encodingName());
+  }
+}
+
+// A new format starts its codec and decimator from scratch at the block
+// boundary, so the endpoint can decode from there without earlier state
+void test_format_change_starts_a_fresh_stream() {
+  const size_t split = 1000;
+  UplinkEncoder encoder;
+  encoder.begin(16000, UplinkAdapter::formatAt(2));
+  size_t perBlock = encoder.samplesPerBlock(CAPACITY);
+  std::string body = encodeBlocks(encoder, input, perBlock * 3);
+  encoder.setFormat(UplinkAdapter::formatAt(3));
+  encoder.setFormat(UplinkAdapter::formatAt(3));  // same format: no restart
+  body += encodeBlocks(encoder, input + split, SIGNAL_SAMPLES - split);
+
+  std::vector<Block> blocks = parseBlocks(body);
+  std::string before;
+  std::string after;
+  for (const Block& b : blocks) (b.rate == 16000 ? before : after) += b.payload;
+  TEST_ASSERT_EQUAL(16000, blocks.front().rate);
+  TEST_ASSERT_EQUAL(8000, blocks.back().rate);
+  TEST_ASSERT_EQUAL(8000, encoder.sampleRate());
+  TEST_ASSERT_TRUE(before == encodeOneShot(CODEC_IMA_ADPCM,
+                                           std::vector<int16_t>(input, input + perBlock * 3)));
+  TEST_ASSERT_TRUE(after == encodeOneShot(CODEC_IMA_ADPCM,
+                                          halfRate(input + split, SIGNAL_SAMPLES - split)));
+}
+
+void test_adapter_levels_and_rates() {
+  UplinkAdapter adapter;
+  adapter.begin(16000, 0, 250);
+  const uint32_t rates[] = {32000, 16000, 8000, 4000};
+  for (uint8_t level = 0; level < UplinkAdapter::LEVELS; level++) {
+    TEST_ASSERT_EQUAL(rates[level], adapter.bytesPerSecond(level));
+  }
+  adapter.begin(16000, 9, 250);
+  TEST_ASSERT_EQUAL(UplinkAdapter::LEVELS - 1, adapter.level());
+}
+
+void test_growing_backlog_steps_down_a_level_per_judgement() {
+  UplinkAdapter adapter;
+  adapter.begin(16000, 0, 250);
+  // The first window only notes the backlog: it may be the pre-roll
+  TEST_ASSERT_FALSE(adapter.update({250, 900, 45, 0, 0}));
+  // Shrinking, or within one block plus headroom, is fine
+  TEST_ASSERT_FALSE(adapter.update({250, 800, 45, 0, 0}));
+  TEST_ASSERT_FALSE(adapter.update({250, 290, 45, 0, 0}));
+  TEST_ASSERT_FALSE(adapter.update({250, 295, 45, 0, 0}));
+  TEST_ASSERT_TRUE(adapter.update({250, 296, 45, 0, 0}));
+  TEST_ASSERT_EQUAL(1, adapter.level());
+  // The new format gets a window before the backlog counts again
+  TEST_ASSERT_FALSE(adapter.update({250, 400, 90, 0, 0}));
+  TEST_ASSERT_TRUE(adapter.update({250, 400, 90, 0, 0}));
+  TEST_ASSERT_FALSE(adapter.update({250, 500, 180, 0, 0}));
+  TEST_ASSERT_TRUE(adapter.update({250, 600, 180, 0, 0}));
+  TEST_ASSERT_EQUAL(3, adapter.level());
+  // Nowhere lower to go
+  TEST_ASSERT_FALSE(adapter.update({250, 700, 360, 0, 0}));
+  TEST_ASSERT_FALSE(adapter.update({250, 800, 360, 0, 0}));
+  TEST_ASSERT_EQUAL(3, adapter.stepDowns);
+}
+
+void test_saturated_slow_socket_steps_down_at_once() {
+  UplinkAdapter adapter;
+  adapter.begin(16000, 0, 250);
+  // Blocked half the window at 20 kB/s: slower than PCM needs
+  TEST_ASSERT_TRUE(adapter.update({250, 0, 45, 2500, 125}));
+  TEST_ASSERT_EQUAL(20000, adapter.measuredBytesPerSecond());
+  // 20 kB/s carries mu-law with more than an eighth to spare
+  TEST_ASSERT_FALSE(adapter.update({250, 0, 45, 2500, 125}));
+  // 17 kB/s does not
+  TEST_ASSERT_TRUE(adapter.update({250, 0, 45, 2125, 125}));
+  TEST_ASSERT_EQUAL(2, adapter.level());
+  // A window barely blocked says nothing about the link, however little it sent
+  TEST_ASSERT_FALSE(adapter.update({250, 0, 90, 10, 124}));
+  TEST_ASSERT_FALSE(adapter.update({250, 0, 90, 0, 0}));
+  TEST_ASSERT_EQUAL(17000, adapter.measuredBytesPerSecond());
+}
+
+void test_clean_utterances_climb_back_one_level_each() {
+  UplinkAdapter adapter;
+  adapter.begin(16000, 1, 250);
+  adapter.update({250, 0, 45, 1000, 250});
+  adapter.update({250, 0, 45, 1000, 250});
+  TEST_ASSERT_EQUAL(3, adapter.level());
+
+  // It fell behind this utterance, so the next starts where this one ended
+  adapter.startUtterance();
+  TEST_ASSERT_EQUAL(3, adapter.level());
+  adapter.startUtterance();
+  TEST_ASSERT_EQUAL(2, adapter.level());
+  adapter.startUtterance();
+  TEST_ASSERT_EQUAL(1, adapter.level());
+  // Never above the configured top
+  adapter.startUtterance();
+  TEST_ASSERT_EQUAL(1, adapter.level());
+}
+
+// -------------------- the sketch over a constrained link --------------------
+
+static std::mutex keyboardMutex;
+static std::vector<std::string> keyboardMessages;
+static char keyboardBuffer[espnow_transport::MAX_MESSAGE + 1];
+static espnow_transport::Reassembler keyboard(keyboardBuffer, sizeof(keyboardBuffer));
+
+static void keyboardReceive(const uint8_t* data, size_t len) {
+  std::lock_guard<std::mutex> lock(keyboardMutex);
+  if (keyboard.accept(data, len) == espnow_transport::Reassembler::COMPLETE) {
+    keyboardMessages.push_back(std::string(keyboard.message(), keyboard.messageLength()));
+  }
+}
+
+static size_t typedCount() {
+  std::lock_guard<std::mutex> lock(keyboardMutex);
+  return keyboardMessages.size();
+}
+
+static int16_t quietThenTone(uint64_t n) {
+  int16_t s = (int16_t)(n * 7919 % 41) - 20;
+  if (n < STT_MIC_SAMPLE_RATE * 3 / 10) return s;
+  return s + (int16_t)(6000 * sin(2 * M_PI * 440 * n / STT_MIC_SAMPLE_RATE));
+}
+
+// Stream-rate samples a body carries. ADPCM may end in a padding nibble and
+// half rate in one sample sent as is, so this can exceed what was captured
+// by up to three.
+static size_t streamSamples(const std::vector<Block>& blocks) {
+  size_t samples = 0;
+  for (const Block& b : blocks) {
+    size_t n = b.codec == CODEC_PCM16 ? b.payload.size() / 2
+               : b.codec == CODEC_ULAW ? b.payload.size()
+                                        : b.payload.size() * 2;
+    samples += n * (STT_MIC_SAMPLE_RATE / b.rate);
+  }
+  return samples;
+}
+
+// Holds the button for holdMs and waits for the transcript
+static fake::HttpRequest utterance(uint32_t holdMs) {
+  size_t before = typedCount();
+  fake::setEspNowPeer(keyboardReceive);
+  fake::setI2sSource(quietThenTone);
+  fake::setHttpHandler([](const fake::HttpRequest&) {
+    return fake::httpResponse(200, "{\"text\":\"ok\"}");
+  });
+  fake::setPin(STT_MIC_BUTTON_PIN, LOW);
+  std::thread release([holdMs] {
+    delay(holdMs);
+    fake::setPin(STT_MIC_BUTTON_PIN, HIGH);
+  });
+  startCapture();
+  recordAndStreamUpload();
+  release.join();
+  TEST_ASSERT_TRUE(fake::waitFor([before] { return typedCount() > before; }, 5000));
+  std::vector<fake::HttpRequest> requests = fake::httpRequests();
+  TEST_ASSERT_EQUAL(1, requests.size());
+  return requests[0];
+}
+
+// 12 kB/s carries neither PCM nor mu-law at 16 kHz. The upload steps down
+// until it keeps up, and every captured sample still reaches the server.
+void test_constrained_link_loses_no_audio() {
+  fake::tcpLink.latencyMs = 40;
+  fake::tcpLink.bytesPerSecond = 12000;
+  uplinkAdapter.begin(STT_MIC_SAMPLE_RATE, 0, STT_MIC_UPLINK_HEADROOM_MS);
+
+  fake::HttpRequest request = utterance(2500);
+  TEST_ASSERT_EQUAL_STRING("framed", request.header("X-Dayne-Encoding").c_str());
+
+  std::vector<Block> blocks = parseBlocks(request.body);
+  TEST_ASSERT_EQUAL(CODEC_PCM16, blocks.front().codec);
+  TEST_ASSERT_GREATER_THAN(0, uplinkAdapter.stepDowns);
+  TEST_ASSERT_GREATER_OR_EQUAL(2, uplinkAdapter.level());
+  TEST_ASSERT_LESS_OR_EQUAL(12000, uplinkAdapter.bytesPerSecond(uplinkAdapter.level()));
+
+  TEST_ASSERT_EQUAL(0, captureOverruns);
+  size_t sent = streamSamples(blocks);
+  TEST_ASSERT_GREATER_OR_EQUAL(codecSamples, sent);
+  TEST_ASSERT_LESS_OR_EQUAL(codecSamples + 3, sent);
+  // Most of the 2.5 s hold survives the VAD's trimming
+  TEST_ASSERT_GREATER_THAN(STT_MIC_SAMPLE_RATE * 2, codecSamples);
+
+  char line[120];
+  snprintf(line, sizeof(line), "%zu blocks, %zu bytes for %u samples; ended at %s @ %u Hz",
+           blocks.size(), request.body.size(), (unsigned)codecSamples,
+           uplinkEncoder.encodingName(), (unsigned)uplinkEncoder.sampleRate());
+  TEST_MESSAGE(line);
+}
+
+void test_fast_link_climbs_back_to_pcm() {
+  uplinkAdapter.begin(STT_MIC_SAMPLE_RATE, 0, STT_MIC_UPLINK_HEADROOM_MS);
+  fake::tcpLink.bytesPerSecond = 12000;
+  utterance(1000);
+  uint8_t slowest = uplinkAdapter.level();
+  uint32_t stepDowns = uplinkAdapter.stepDowns;  // counted since boot
+  TEST_ASSERT_GREATER_THAN(0, slowest);
+
+  // The utterance after one that fell behind starts where it ended; each
+  // clean one after that starts a level higher
+  fake::tcpLink.bytesPerSecond = 0;
+  for (int expect = slowest; expect >= 0; expect--) {
+    fake::reset();
+    fake::setPin(STT_MIC_BUTTON_PIN, HIGH);
+    std::vector<Block> blocks = parseBlocks(utterance(600).body);
+    UplinkFormat format = UplinkAdapter::formatAt(expect);
+    for (const Block& b : blocks) {
+      TEST_ASSERT_EQUAL(format.codec, b.codec);
+      TEST_ASSERT_EQUAL(STT_MIC_SAMPLE_RATE / format.decimation, b.rate);
+    }
+    TEST_ASSERT_EQUAL(0, captureOverruns);
+  }
+  TEST_ASSERT_EQUAL(0, uplinkAdapter.level());
+  TEST_ASSERT_EQUAL(stepDowns, uplinkAdapter.stepDowns);
+}
+
+int main(int argc, char** argv) {
+  (void)argc;
+  (void)argv;
+  fake::serialEcho = getenv("STT_TEST_SERIAL") != nullptr;
+  for (size_t i = 0; i < SIGNAL_SAMPLES; i++) {
+    input[i] = (int16_t)(8000 * sin(i * 0.05) + 3000 * sin(i * 0.71) + (int)(i * 7919 % 61) - 30);
+  }
+  setup();
+
+  UNITY_BEGIN();
+  RUN_TEST(test_blocks_carry_their_format_and_fit_the_chunk);
+  RUN_TEST(test_payloads_join_into_one_stream);
+  RUN_TEST(test_format_change_starts_a_fresh_stream);
+  RUN_TEST(test_adapter_levels_and_rates);
+  RUN_TEST(test_growing_backlog_steps_down_a_level_per_judgement);
+  RUN_TEST(test_saturated_slow_socket_steps_down_at_once);
+  RUN_TEST(test_clean_utterances_climb_back_one_level_each);
+  RUN_TEST(test_constrained_link_loses_no_audio);
+  RUN_TEST(test_fast_link_climbs_back_to_pcm);
+  return UNITY_END();
+}
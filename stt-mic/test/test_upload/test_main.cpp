@@ -0,0 +1,325 @@
+// The whole mic sketch on the host: button, I2S, HTTP and ESP-NOW are the
+// HostFakes stand-ins, everything else is the code that ships.
+#include <unity.h>
+
+#include "../../src/main.cpp"
+
+#include <HostFakes.h>
+#include <math.h>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+static std::mutex keyboardMutex;
+static std::vector<std::string> keyboardMessages;
+static char keyboardBuffer[espnow_transport::MAX_MESSAGE + 1];
+static espnow_transport::Reassembler keyboard(keyboardBuffer, sizeof(keyboardBuffer));
+
+static size_t keyboardFree;  // slots left in the keyboard's queue
+
+// Answers the mic the way esp-keyboard does
+static void keyboardStatusReply(uint8_t messageId, size_t freeSlots, bool queued) {
+  espnow_transport::Status status = {messageId, (uint8_t)freeSlots, queued};
+  uint8_t frame[espnow_transport::STATUS_SIZE];
+  size_t len = espnow_transport::encodeStatus(frame, status);
+  fake::espNowReceive(serverMacAddress, frame, len);
+}
+
+// Stands in for esp-keyboard: reassembles what arrives over the air, queues
+// it unless the queue is full, and reports back. Nothing is typed until a
+// test frees slots.
+static void keyboardReceive(const uint8_t* data, size_t len) {
+  uint8_t messageId;
+  size_t freeSlots;
+  bool queued;
+  {
+    std::lock_guard<std::mutex> lock(keyboardMutex);
+    if (keyboard.accept(data, len) != espnow_transport::Reassembler::COMPLETE) return;
+    queued = keyboardFree > 0;
+    if (queued) {
+      keyboardMessages.push_back(std::string(keyboard.message(), keyboard.messageLength()));
+      keyboardFree--;
+    }
+    messageId = keyboard.messageId();
+    freeSlots = keyboardFree;
+  }
+  keyboardStatusReply(messageId, freeSlots, queued);
+}
+
+static std::vector<std::string> typed() {
+  std::lock_guard<std::mutex> lock(keyboardMutex);
+  return keyboardMessages;
+}
+
+// What the host shows after every message so far; a backspace erases one
+// character
+static std::string screen() {
+  std::string text;
+  for (const std::string& message : typed()) {
+    for (char c : message) {
+      if (c != '\b') {
+        text += c;
+        continue;
+      }
+      while (!text.empty() && ((uint8_t)text.back() & 0xC0) == 0x80) text.pop_back();
+      if (!text.empty()) text.pop_back();
+    }
+  }
+  return text;
+}
+
+// 16-bit mono at 16 kHz: quiet room noise, then a 440 Hz tone
+static void writeRecording(const char* path, uint32_t silenceMs, uint32_t toneMs) {
+  FILE* f = fopen(path, "wb");
+  TEST_ASSERT_NOT_NULL(f);
+  uint32_t silence = silenceMs * STT_MIC_SAMPLE_RATE / 1000;
+  uint32_t total = silence + toneMs * STT_MIC_SAMPLE_RATE / 1000;
+  for (uint32_t i = 0; i < total; i++) {
+    int16_t s = (int16_t)(i * 7919 % 41) - 20;
+    if (i >= silence) {
+      s += (int16_t)(6000 * sin(2 * M_PI * 440 * (i - silence) / STT_MIC_SAMPLE_RATE));
+    }
+    uint8_t le[2] = {(uint8_t)(s & 0xFF), (uint8_t)((uint16_t)s >> 8)};
+    fwrite(le, 1, 2, f);
+  }
+  fclose(f);
+}
+
+// Live version of the recording: 0.3 s of noise, then the tone. The VAD
+// needs the quiet start to learn the noise floor.
+static int16_t quietThenTone(uint64_t n) {
+  int16_t s = (int16_t)(n * 7919 % 41) - 20;
+  if (n < STT_MIC_SAMPLE_RATE * 3 / 10) return s;
+  return s + (int16_t)(6000 * sin(2 * M_PI * 440 * n / STT_MIC_SAMPLE_RATE));
+}
+
+// Holds the button for holdMs while loop() would run the upload
+static void pressAndUpload(uint32_t holdMs) {
+  fake::setPin(STT_MIC_BUTTON_PIN, LOW);
+  std::thread release([holdMs] {
+    delay(holdMs);
+    fake::setPin(STT_MIC_BUTTON_PIN, HIGH);
+  });
+  startCapture();
+  recordAndStreamUpload();
+  release.join();
+}
+
+void setUp() {
+  fake::reset();
+  fake::setEspNowPeer(keyboardReceive);
+  fake::setPin(STT_MIC_BUTTON_PIN, HIGH);
+  std::lock_guard<std::mutex> lock(keyboardMutex);
+  keyboardMessages.clear();
+  keyboardFree = 1000;
+}
+
+void tearDown() {
+  TEST_ASSERT_TRUE(fake::waitFor([] { return !responsesPending(); }, 8000));
+}
+
+void test_upload_streams_speech_and_types_transcript() {
+  const char* path = "test_upload.raw";
+  writeRecording(path, 600, 1400);
+  TEST_ASSERT_TRUE(fake::replayRaw(path));
+  fake::setHttpHandler([](const fake::HttpRequest&) {
+    return fake::httpResponse(200, "{\"text\":\"hello world\"}");
+  });
+
+  pressAndUpload(1500);
+  TEST_ASSERT_TRUE(fake::waitFor([] { return !typed().empty(); }, 3000));
+  remove(path);
+
+  std::vector<fake::HttpRequest> requests = fake::httpRequests();
+  TEST_ASSERT_EQUAL(1, requests.size());
+  const fake::HttpRequest& r = requests[0];
+  TEST_ASSERT_EQUAL_STRING("POST", r.method.c_str());
+  TEST_ASSERT_EQUAL_STRING(STT_ENDPOINT_PATH, r.path.c_str());
+  TEST_ASSERT_EQUAL_STRING(encoder.encodingName(), r.header("X-Dayne-Encoding").c_str());
+  TEST_ASSERT_EQUAL_STRING("close", r.header("Connection").c_str());
+
+  // Whole 16-bit samples in chunks of at most one send buffer
+  TEST_ASSERT_EQUAL(0, r.body.size() % 2);
+  for (size_t chunk : r.chunks) {
+    TEST_ASSERT_LESS_OR_EQUAL(chunkWriter.payloadCapacity(), chunk);
+  }
+
+  // Most of the leading silence is trimmed; the tone (0.9 s while held) is not
+  size_t uploaded = r.body.size() / 2;
+  TEST_ASSERT_LESS_THAN(fake::i2sSamplesRead() - 4000, uploaded);
+  TEST_ASSERT_GREATER_THAN(STT_MIC_SAMPLE_RATE * 8 / 10, uploaded);
+  TEST_ASSERT_GREATER_THAN(0, vad.stats().samplesDropped);
+
+  std::vector<std::string> messages = typed();
+  TEST_ASSERT_EQUAL(1, messages.size());
+  TEST_ASSERT_EQUAL_STRING("hello world", messages[0].c_str());
+}
+
+void test_short_reads_reach_the_vad() {
+  fake::i2sShortReads = true;
+  fake::setI2sSource(quietThenTone);
+  fake::setHttpHandler([](const fake::HttpRequest&) {
+    return fake::httpResponse(200, "{\"text\":\"short reads\"}");
+  });
+
+  pressAndUpload(800);
+  TEST_ASSERT_TRUE(fake::waitFor([] { return !typed().empty(); }, 3000));
+
+  // Every sample read went through the VAD in whole frames
+  const VoiceActivityDetector::Stats& stats = vad.stats();
+  TEST_ASSERT_GREATER_THAN(0, stats.framesSpeech);
+  TEST_ASSERT_UINT_WITHIN(STT_MIC_FRAME_SAMPLES, fake::i2sSamplesRead(),
+                          stats.framesIn * STT_MIC_FRAME_SAMPLES);
+  TEST_ASSERT_EQUAL_STRING("short reads", typed()[0].c_str());
+}
+
+void test_server_error_types_nothing() {
+  fake::setI2sSource(quietThenTone);
+  fake::setHttpHandler([](const fake::HttpRequest&) {
+    return fake::httpResponse(503, "{\"error\":\"recognizer unavailable\"}");
+  });
+
+  pressAndUpload(400);
+  TEST_ASSERT_TRUE(fake::waitFor([] { return !responsesPending(); }, 3000));
+
+  TEST_ASSERT_EQUAL(1, fake::httpRequests().size());
+  TEST_ASSERT_EQUAL(0, typed().size());
+}
+
+void test_slow_link_still_delivers_everything() {
+  fake::tcpLink.latencyMs = 40;
+  fake::tcpLink.bytesPerSecond = 40000;  // just above 16-bit 16 kHz
+  fake::tcpLink.lossRate = 0.02f;
+  fake::setI2sSource(quietThenTone);
+  fake::setHttpHandler([](const fake::HttpRequest& r) {
+    return fake::httpResponse(200, "{\"text\":\"" + std::to_string(r.body.size()) + "\"}");
+  });
+
+  pressAndUpload(1000);
+  TEST_ASSERT_TRUE(fake::waitFor([] { return !typed().empty(); }, 5000));
+
+  // The ring absorbed the stalls: nothing captured was dropped
+  TEST_ASSERT_EQUAL(0, captureOverruns);
+  std::vector<fake::HttpRequest> requests = fake::httpRequests();
+  TEST_ASSERT_EQUAL_STRING(std::to_string(requests[0].body.size()).c_str(), typed()[0].c_str());
+  TEST_ASSERT_EQUAL(chunkWriter.payloadBytes, requests[0].body.size());
+}
+
+void test_long_transcript_arrives_whole_over_lossy_link() {
+  fake::espNowLink.lossRate = 0.1f;
+  fake::espNowLink.ackLossRate = 0.05f;
+
+  // Three messages' worth, with two- and three-byte characters
+  std::string text;
+  while (text.size() < 2 * espnow_transport::MAX_MESSAGE + 500) {
+    text += "Grüße aus München – ";
+  }
+  sendTextToKeyboard(text.c_str(), 42);
+  TEST_ASSERT_TRUE(fake::waitFor([] { return fake::espNowIdle(); }, 1000));
+
+  std::vector<std::string> messages = typed();
+  TEST_ASSERT_EQUAL(3, messages.size());
+  std::string joined;
+  for (const std::string& m : messages) {
+    TEST_ASSERT_LESS_OR_EQUAL(espnow_transport::MAX_MESSAGE, m.size());
+    joined += m;
+  }
+  TEST_ASSERT_TRUE(joined == text);
+
+  fake::EspNowStats stats = fake::espNowStats();
+  TEST_ASSERT_GREATER_THAN(0, stats.lost);
+  TEST_ASSERT_GREATER_THAN(0, stats.acksLost);
+}
+
+void test_interim_updates_follow_what_reached_the_keyboard() {
+  ResponseSlot& slot = responseSlots[0];
+  slot.typedLen = 0;
+  slot.utterance = 7;
+  typeTranscript(slot, "Grüße aus");
+  // Differs inside the two-byte ß: one backspace per character
+  typeTranscript(slot, "Grüne aus");
+  TEST_ASSERT_EQUAL_STRING("Grüne aus", screen().c_str());
+  TEST_ASSERT_EQUAL_STRING("\b\b\b\b\b\bne aus", typed().back().c_str());
+
+  // Nothing gets through: the keyboard still shows the old text, and the
+  // next update is diffed against that
+  fake::espNowLink.lossRate = 1;
+  typeTranscript(slot, "Grüne aus Bonn");
+  fake::espNowLink.lossRate = 0;
+  TEST_ASSERT_EQUAL_STRING("Grüne aus", slot.typedText);
+  typeTranscript(slot, "Grüne aus Berlin");
+  TEST_ASSERT_TRUE(fake::waitFor([] { return fake::espNowIdle(); }, 1000));
+  TEST_ASSERT_EQUAL_STRING("Grüne aus Berlin", screen().c_str());
+}
+
+void test_full_keyboard_queue_holds_the_next_message() {
+  keyboardFree = 1;
+  TEST_ASSERT_EQUAL(4, sendTextToKeyboard("one ", 51));
+
+  // The keyboard said it is full: the next message waits until typing frees
+  // a slot instead of being acked and then dropped
+  std::thread typing([] {
+    delay(300);
+    uint8_t messageId;
+    {
+      std::lock_guard<std::mutex> lock(keyboardMutex);
+      keyboardFree++;
+      messageId = keyboard.messageId();
+    }
+    keyboardStatusReply(messageId, 1, true);
+  });
+  uint32_t start = millis();
+  TEST_ASSERT_EQUAL(3, sendTextToKeyboard("two", 51));
+  TEST_ASSERT_GREATER_OR_EQUAL(250, millis() - start);
+  typing.join();
+  TEST_ASSERT_EQUAL_STRING("one two", screen().c_str());
+
+  // A keyboard that has to drop a message anyway says so, and the text
+  // counts as not sent even though every frame was acked
+  {
+    std::lock_guard<std::mutex> lock(keyboardMutex);
+    keyboardFree = 0;
+  }
+  TEST_ASSERT_EQUAL(0, sendTextToKeyboard("three", 51));
+  TEST_ASSERT_EQUAL_STRING("one two", screen().c_str());
+}
+
+// Wake from deep sleep with the previous connect still in RTC memory
+void test_cached_lease_is_reused_only_while_young() {
+  const uint32_t oldIp = (uint32_t)IPAddress(192, 168, 1, 77);
+  wifiCache.magic = STT_MIC_WIFI_CACHE_MAGIC;
+  wifiCache.ip = oldIp;
+  wifiCache.leasedAtMs = powerClockMs() - 1000;
+  connectWiFi();
+  TEST_ASSERT_EQUAL_HEX32(oldIp, fake::wifiStaticIp);
+  TEST_ASSERT_TRUE(bootTiming.usedCache);
+
+  // Past the reuse window the address may be someone else's by now: ask
+  // DHCP, still on the cached AP, and remember the new lease
+  fake::wifiStaticIp = 0;
+  wifiCache.leasedAtMs = powerClockMs() - STT_MIC_WIFI_LEASE_REUSE_MS - 1;
+  connectWiFi();
+  TEST_ASSERT_EQUAL_HEX32(0, fake::wifiStaticIp);
+  TEST_ASSERT_TRUE(bootTiming.usedCache);
+  TEST_ASSERT_EQUAL_HEX32((uint32_t)WiFi.localIP(), wifiCache.ip);
+  TEST_ASSERT_TRUE(powerClockMs() - wifiCache.leasedAtMs < 1000);
+}
+
+int main(int argc, char** argv) {
+  (void)argc;
+  (void)argv;
+  fake::serialEcho = getenv("STT_TEST_SERIAL") != nullptr;
+  setup();
+
+  UNITY_BEGIN();
+  RUN_TEST(test_upload_streams_speech_and_types_transcript);
+  RUN_TEST(test_short_reads_reach_the_vad);
+  RUN_TEST(test_server_error_types_nothing);
+  RUN_TEST(test_slow_link_still_delivers_everything);
+  RUN_TEST(test_long_transcript_arrives_whole_over_lossy_link);
+  RUN_TEST(test_interim_updates_follow_what_reached_the_keyboard);
+  RUN_TEST(test_full_keyboard_queue_holds_the_next_message);
+  RUN_TEST(test_cached_lease_is_reused_only_while_young);
+  return UNITY_END();
+}
@@ -0,0 +1,310 @@
+#include <unity.h>
+
+#include "../../src/VoiceActivityDetector.h"
+
+#include <glob.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+#include <vector>
+
+static const size_t FRAME = 160;       // 10 ms at 16 kHz
+static const size_t PADDING = 3;       // frames of history
+static const uint16_t HANGOVER = 4;
+
+static VoiceActivityDetector vad;
+static int16_t history[PADDING * FRAME];
+static int16_t out[(PADDING + 1) * FRAME];
+static uint32_t sampleClock;
+
+// Each frame starts with its index so the output order can be checked
+static void quiet(int16_t* frame) {
+  for (size_t i = 0; i < FRAME; i++) frame[i] = (int16_t)(rand() % 41 - 20);
+  frame[0] = (int16_t)sampleClock++;
+}
+
+static void voiced(int16_t* frame) {
+  for (size_t i = 0; i < FRAME; i++) {
+    frame[i] = (int16_t)(3000 * sin(2 * M_PI * 200 * (sampleClock * FRAME + i) / 16000.0));
+  }
+  frame[0] = (int16_t)sampleClock++;
+}
+
+// A louder room: mean |x| around 40
+static void noisy(int16_t* frame) {
+  for (size_t i = 0; i < FRAME; i++) frame[i] = (int16_t)(rand() % 161 - 80);
+  frame[0] = (int16_t)sampleClock++;
+}
+
+// Twice the noisy room's level, too little for voiced speech, but crossing
+// zero every other sample like an "s"
+static void fricative(int16_t* frame) {
+  for (size_t i = 0; i < FRAME; i++) frame[i] = (int16_t)((i & 1) ? 80 : -80);
+  frame[0] = (int16_t)sampleClock++;
+}
+
+// Same level as the fricative but slow: a hum, not speech
+static void hum(int16_t* frame) {
+  for (size_t i = 0; i < FRAME; i++) frame[i] = (int16_t)((i / 40) & 1 ? 80 : -80);
+  frame[0] = (int16_t)sampleClock++;
+}
+
+// Runs frames through the detector and returns the frame indices sent
+static std::vector<int16_t> run(void (*make)(int16_t*), size_t frames) {
+  std::vector<int16_t> sent;
+  int16_t frame[FRAME];
+  for (size_t f = 0; f < frames; f++) {
+    make(frame);
+    size_t n = vad.process(frame, out);
+    TEST_ASSERT_EQUAL(0, n % FRAME);
+    TEST_ASSERT_LESS_OR_EQUAL(vad.maxOutputSamples(), n);
+    for (size_t i = 0; i < n; i += FRAME) sent.push_back(out[i]);
+  }
+  return sent;
+}
+
+void setUp() {
+  srand(1);
+  sampleClock = 0;
+  vad = VoiceActivityDetector();
+  TEST_ASSERT_TRUE(vad.begin(FRAME, history, sizeof(history) / sizeof(history[0]), HANGOVER));
+}
+
+void tearDown() {}
+
+void test_leading_silence_shrinks_to_the_padding() {
+  TEST_ASSERT_EQUAL(0, run(quiet, 50).size());
+  TEST_ASSERT_FALSE(vad.inSpeech());
+
+  std::vector<int16_t> sent = run(voiced, 1);
+  TEST_ASSERT_TRUE(vad.inSpeech());
+  // The last PADDING quiet frames, in order, then the speech frame
+  TEST_ASSERT_EQUAL(PADDING + 1, sent.size());
+  for (size_t i = 0; i <= PADDING; i++) TEST_ASSERT_EQUAL(50 - PADDING + i, sent[i]);
+  TEST_ASSERT_EQUAL((50 - PADDING) * FRAME, vad.stats().samplesDropped);
+}
+
+void test_trailing_silence_is_cut_to_the_hangover() {
+  run(quiet, 20);
+  run(voiced, 10);
+  std::vector<int16_t> tail = run(quiet, 30);
+  TEST_ASSERT_EQUAL(HANGOVER, tail.size());
+  TEST_ASSERT_FALSE(vad.inSpeech());
+}
+
+void test_internal_pause_is_compressed() {
+  run(quiet, 20);
+  run(voiced, 10);
+  std::vector<int16_t> pause = run(quiet, 40);
+  std::vector<int16_t> resumed = run(voiced, 1);
+
+  // Hangover while the pause starts, padding before the next word
+  TEST_ASSERT_EQUAL(HANGOVER, pause.size());
+  TEST_ASSERT_EQUAL(PADDING + 1, resumed.size());
+  TEST_ASSERT_EQUAL(resumed.back() - PADDING, resumed.front());
+}
+
+void test_short_pause_is_kept_whole() {
+  run(quiet, 20);
+  run(voiced, 10);
+  TEST_ASSERT_EQUAL(HANGOVER, run(quiet, HANGOVER).size());
+  TEST_ASSERT_EQUAL(1, run(voiced, 1).size());
+}
+
+void test_fricatives_count_as_speech() {
+  run(noisy, 20);
+  TEST_ASSERT_EQUAL(0, run(hum, 3).size());
+  std::vector<int16_t> sent = run(fricative, 5);
+  TEST_ASSERT_TRUE(vad.inSpeech());
+  TEST_ASSERT_EQUAL(PADDING + 5, sent.size());
+}
+
+void test_quiet_signal_below_min_level_is_never_speech() {
+  // Digital silence gives a zero floor, so any ratio would pass without minLevel
+  int16_t zeros[FRAME] = {};
+  for (int f = 0; f < 20; f++) TEST_ASSERT_EQUAL(0, vad.process(zeros, out));
+  int16_t faint[FRAME];
+  for (size_t i = 0; i < FRAME; i++) faint[i] = (int16_t)((i & 1) ? 40 : -40);
+  for (int f = 0; f < 20; f++) TEST_ASSERT_EQUAL(0, vad.process(faint, out));
+  TEST_ASSERT_EQUAL(0, vad.stats().framesSpeech);
+}
+
+void test_settling_step_does_not_seed_the_floor() {
+  // A large decaying offset, as the high-pass leaves at power-up
+  int16_t frame[FRAME];
+  for (uint16_t f = 0; f < vad.settleFrames; f++) {
+    for (size_t i = 0; i < FRAME; i++) frame[i] = (int16_t)(20000 >> f);
+    TEST_ASSERT_EQUAL(0, vad.process(frame, out));
+  }
+  TEST_ASSERT_EQUAL(0, vad.stats().framesSpeech);
+
+  // The floor comes from the quiet room, so ordinary speech still triggers
+  run(quiet, 10);
+  TEST_ASSERT_EQUAL(PADDING + 1, run(voiced, 1).size());
+}
+
+void test_every_sample_is_sent_dropped_or_held() {
+  size_t sent = 0;
+  for (int round = 0; round < 5; round++) {
+    sent += run(quiet, 17 + round * 5).size();
+    sent += run(voiced, 3 + round).size();
+  }
+  sent += run(quiet, 12).size();
+
+  const VoiceActivityDetector::Stats& stats = vad.stats();
+  TEST_ASSERT_EQUAL(sampleClock, stats.framesIn);
+  TEST_ASSERT_EQUAL(stats.framesIn * FRAME, sent * FRAME + stats.samplesDropped + PADDING * FRAME);
+}
+
+void test_reset_forgets_the_utterance() {
+  run(quiet, 20);
+  run(voiced, 5);
+  vad.reset();
+  TEST_ASSERT_FALSE(vad.inSpeech());
+  TEST_ASSERT_EQUAL(0, vad.stats().framesIn);
+  // Settling again: even loud frames are held at first
+  TEST_ASSERT_EQUAL(0, run(voiced, vad.settleFrames).size());
+}
+
+void test_without_history_silence_is_dropped_outright() {
+  TEST_ASSERT_TRUE(vad.begin(FRAME, nullptr, 0, HANGOVER));
+  TEST_ASSERT_EQUAL(FRAME, vad.maxOutputSamples());
+  run(quiet, 20);
+  TEST_ASSERT_EQUAL(1, run(voiced, 1).size());
+  TEST_ASSERT_EQUAL(20 * FRAME, vad.stats().samplesDropped);
+}
+
+// Recordings are 16-bit little-endian mono at 16 kHz, as archivecat -extract
+// writes them. They sit next to this file; drop more audio-*.raw files here
+// to run them too.
+static std::string recordingDir() {
+  std::string file = __FILE__;
+  return file.substr(0, file.find_last_of('/') + 1);
+}
+
+static std::vector<int16_t> readRaw(const std::string& path) {
+  std::vector<int16_t> samples;
+  FILE* f = fopen(path.c_str(), "rb");
+  if (!f) return samples;
+  uint8_t pair[2];
+  while (fread(pair, 1, 2, f) == 2) samples.push_back((int16_t)(pair[0] | (pair[1] << 8)));
+  fclose(f);
+  return samples;
+}
+
+struct Replay {
+  size_t frames = 0;
+  std::vector<bool> sent;  // per input frame
+  size_t samplesSent = 0;
+};
+
+// Runs a recording through the detector as the sketch configures it: 8 ms
+// frames, 200 ms of padding, 300 ms of hangover. Sent frames are matched
+// back to their input frame; the output keeps input order.
+static Replay replay(const std::vector<int16_t>& audio) {
+  static const size_t SKETCH_FRAME = 128;
+  static int16_t sketchHistory[25 * SKETCH_FRAME];
+  static int16_t sketchOut[26 * SKETCH_FRAME];
+  VoiceActivityDetector detector;
+  TEST_ASSERT_TRUE(detector.begin(SKETCH_FRAME, sketchHistory, 25 * SKETCH_FRAME, 37));
+
+  Replay r;
+  r.frames = audio.size() / SKETCH_FRAME;
+  r.sent.assign(r.frames, false);
+  size_t next = 0;  // first input frame not yet matched
+  for (size_t f = 0; f < r.frames; f++) {
+    size_t n = detector.process(&audio[f * SKETCH_FRAME], sketchOut);
+    for (size_t i = 0; i < n; i += SKETCH_FRAME) {
+      while (next <= f && memcmp(&audio[next * SKETCH_FRAME], sketchOut + i,
+                                 SKETCH_FRAME * sizeof(int16_t)) != 0) {
+        next++;
+      }
+      TEST_ASSERT_LESS_OR_EQUAL_MESSAGE(f, next, "sent a frame that was never fed");
+      r.sent[next++] = true;
+    }
+    r.samplesSent += n;
+  }
+
+  // Whatever was not sent was dropped or is still held as padding
+  const VoiceActivityDetector::Stats& stats = detector.stats();
+  TEST_ASSERT_EQUAL(r.frames, stats.framesIn);
+  TEST_ASSERT_LESS_OR_EQUAL(25 * SKETCH_FRAME,
+                            r.frames * SKETCH_FRAME - r.samplesSent - stats.samplesDropped);
+  return r;
+}
+
+// audio-see-two.raw: two words in a quiet room, "see" from 600 to 980 ms and
+// "two" from 1500 to 1820 ms, 2.2 s in all. Made with a formant synthesizer
+// over pink room noise and a little hum, since the mic's own captures are
+// not kept in the tree.
+void test_recording_keeps_words_and_trims_the_room() {
+  std::vector<int16_t> audio = readRaw(recordingDir() + "audio-see-two.raw");
+  TEST_ASSERT_EQUAL(35200, audio.size());
+  Replay r = replay(audio);
+
+  const int words[][2] = {{600, 980}, {1500, 1820}};
+  size_t wordFrames = 0;
+  for (const auto& word : words) {
+    size_t first = word[0] * 16 / 128;
+    size_t last = (word[1] * 16 - 1) / 128;
+    for (size_t f = first; f <= last; f++) {
+      char message[48];
+      snprintf(message, sizeof(message), "frame %u at %u ms", (unsigned)f, (unsigned)(f * 8));
+      TEST_ASSERT_TRUE_MESSAGE(r.sent[f], message);
+    }
+    wordFrames += last - first + 1;
+  }
+
+  // Leading silence shrinks to the padding, the pause to hangover and
+  // padding, and the tail to the hangover, give or take a frame each
+  size_t sentFrames = r.samplesSent / 128;
+  TEST_ASSERT_FALSE(r.sent[600 * 16 / 128 - 25 - 2]);
+  TEST_ASSERT_UINT_WITHIN(6, wordFrames + 25 + 37 + 25 + 37, sentFrames);
+
+  char line[96];
+  snprintf(line, sizeof(line), "audio-see-two.raw: kept %u of %u frames (%u in words)",
+           (unsigned)sentFrames, (unsigned)r.frames, (unsigned)wordFrames);
+  TEST_MESSAGE(line);
+}
+
+// Every recording here, with no ground truth: the accounting holds, output
+// stays in order, and some of it is kept
+void test_saved_recordings_replay() {
+  glob_t found;
+  if (glob((recordingDir() + "audio-*.raw").c_str(), 0, nullptr, &found) != 0) {
+    TEST_IGNORE_MESSAGE("no recordings");
+  }
+  for (size_t i = 0; i < found.gl_pathc; i++) {
+    std::vector<int16_t> audio = readRaw(found.gl_pathv[i]);
+    Replay r = replay(audio);
+    size_t sentFrames = r.samplesSent / 128;
+    TEST_ASSERT_GREATER_THAN(0, sentFrames);
+
+    char line[160];
+    snprintf(line, sizeof(line), "%s: kept %u of %u frames", strrchr(found.gl_pathv[i], '/') + 1,
+             (unsigned)sentFrames, (unsigned)r.frames);
+    TEST_MESSAGE(line);
+  }
+  globfree(&found);
+}
+
+int main(int argc, char** argv) {
+  (void)argc;
+  (void)argv;
+  UNITY_BEGIN();
+  RUN_TEST(test_leading_silence_shrinks_to_the_padding);
+  RUN_TEST(test_trailing_silence_is_cut_to_the_hangover);
+  RUN_TEST(test_internal_pause_is_compressed);
+  RUN_TEST(test_short_pause_is_kept_whole);
+  RUN_TEST(test_fricatives_count_as_speech);
+  RUN_TEST(test_quiet_signal_below_min_level_is_never_speech);
+  RUN_TEST(test_settling_step_does_not_seed_the_floor);
+  RUN_TEST(test_every_sample_is_sent_dropped_or_held);
+  RUN_TEST(test_reset_forgets_the_utterance);
+  RUN_TEST(test_without_history_silence_is_dropped_outright);
+  RUN_TEST(test_recording_keeps_words_and_trims_the_room);
+  RUN_TEST(test_saved_recordings_replay);
+  return UNITY_END();
+}
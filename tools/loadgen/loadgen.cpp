@@ -0,0 +1,387 @@
+// Load generator for stt-endpoint: N simulated mics replay saved LINEAR16
+// recordings (audio-*.raw, e.g. from `archivecat -extract`) at real-time
+// pace, using stt-mic's own chunk framing (ChunkedWriter), upload encoder
+// (AudioEncoder) and response parser (HttpResponseParser), and report
+// throughput, time-to-transcript percentiles and the endpoint's memory and
+// goroutine counts from /debug/vars.
+//
+// Build from the repo root:
+//
+//   g++ -std=gnu++17 -O2 -pthread -I stt-mic/src -o loadgen tools/loadgen/loadgen.cpp
+//       stt-mic/src/AudioCodec.cpp stt-mic/src/HttpResponseParser.cpp
+//
+// (one command line)
+//
+// Run against a local endpoint with the fake speech client:
+//
+//   STT_FAKE_SPEECH=1 STT_FAKE_SPEECH_LATENCY=300ms go run . /tmp/audio
+//   ./loadgen -devices 8 -utterances 5 -path /stream audio-*.raw
+//
+// Devices pick files round robin from their own offset and pace by sample
+// count, so the same arguments give the same load every run.
+
+#include <arpa/inet.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "AudioCodec.h"
+#include "ChunkedWriter.h"
+#include "HttpResponseParser.h"
+
+using Clock = std::chrono::steady_clock;
+
+// Match the mic: one TCP segment per chunk, 128-sample capture frames
+static const size_t SEND_BUFFER = 1460;
+static const size_t FRAME_SAMPLES = 128;
+
+struct Options {
+  std::string host = "127.0.0.1";
+  std::string port = "7878";
+  std::string path = "/stream";
+  int devices = 4;
+  int utterances = 5;
+  int sampleRate = 16000;
+  int thinkMs = 500;  // gap between a device's utterances
+  AudioCodecType codec = CODEC_PCM16;
+  bool partial = false;
+  double syntheticSeconds = 0;
+  std::vector<std::string> files;
+};
+
+struct Sample {
+  bool ok = false;
+  int status = 0;
+  double audioSeconds = 0;
+  double connectMs = 0;
+  double transcriptMs = 0;  // last audio byte -> complete response
+};
+
+struct EndpointVars {
+  bool valid = false;
+  long goroutines = 0;
+  long heapInuse = 0;
+  long totalAlloc = 0;
+};
+
+// ChunkedWriter sink over a blocking socket
+struct SocketSink {
+  int fd;
+  size_t write(const uint8_t* data, size_t len) {
+    size_t done = 0;
+    while (done < len) {
+      ssize_t n = ::send(fd, data + done, len - done, MSG_NOSIGNAL);
+      if (n <= 0) break;
+      done += n;
+    }
+    return done;
+  }
+};
+
+static int connectTo(const Options& opt) {
+  addrinfo hints = {};
+  hints.ai_family = AF_UNSPEC;
+  hints.ai_socktype = SOCK_STREAM;
+  addrinfo* res = nullptr;
+  if (getaddrinfo(opt.host.c_str(), opt.port.c_str(), &hints, &res) != 0) return -1;
+  int fd = -1;
+  for (addrinfo* ai = res; ai != nullptr; ai = ai->ai_next) {
+    fd = socket(ai->ai_family, ai->ai_socktype, ai->ai_protocol);
+    if (fd < 0) continue;
+    if (connect(fd, ai->ai_addr, ai->ai_addrlen) == 0) break;
+    close(fd);
+    fd = -1;
+  }
+  freeaddrinfo(res);
+  if (fd >= 0) {
+    int one = 1;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+  }
+  return fd;
+}
+
+// Reads until the parser has a complete response or the peer closes
+static HttpResponseParser::Result readResponse(int fd, HttpResponseParser& parser) {
+  uint8_t rx[4096];
+  HttpResponseParser::Result result = parser.result();
+  while (result == HttpResponseParser::NEED_MORE) {
+    ssize_t n = recv(fd, rx, sizeof(rx), 0);
+    if (n <= 0) return parser.finish();
+    result = parser.feed(rx, n);
+  }
+  return result;
+}
+
+static long jsonNumber(const char* body, const char* key) {
+  const char* p = strstr(body, key);
+  if (p == nullptr) return 0;
+  p = strchr(p + strlen(key), ':');
+  return p ? strtol(p + 1, nullptr, 10) : 0;
+}
+
+static EndpointVars fetchVars(const Options& opt) {
+  EndpointVars vars;
+  int fd = connectTo(opt);
+  if (fd < 0) return vars;
+  char req[256];
+  int len = snprintf(req, sizeof(req),
+                     "GET /debug/vars HTTP/1.1\r\nHost: %s\r\nConnection: close\r\n\r\n",
+                     opt.host.c_str());
+  SocketSink sink{fd};
+  static thread_local std::vector<char> body(256 * 1024);
+  HttpResponseParser parser(body.data(), body.size());
+  if (sink.write((const uint8_t*)req, len) == (size_t)len &&
+      readResponse(fd, parser) == HttpResponseParser::DONE && parser.status() == 200) {
+    vars.valid = true;
+    vars.goroutines = jsonNumber(parser.bodyText(), "\"goroutines\"");
+    vars.heapInuse = jsonNumber(parser.bodyText(), "\"HeapInuse\"");
+    vars.totalAlloc = jsonNumber(parser.bodyText(), "\"TotalAlloc\"");
+  }
+  close(fd);
+  return vars;
+}
+
+// One utterance, uploaded the way stt-mic does it
+static Sample runUtterance(const Options& opt, const std::vector<int16_t>& pcm, uint32_t utterance) {
+  Sample sample;
+  sample.audioSeconds = (double)pcm.size() / opt.sampleRate;
+
+  Clock::time_point connectStart = Clock::now();
+  int fd = connectTo(opt);
+  if (fd < 0) return sample;
+  sample.connectMs = std::chrono::duration<double, std::milli>(Clock::now() - connectStart).count();
+
+  uint8_t sendBuffer[SEND_BUFFER];
+  ChunkedWriter writer(sendBuffer, sizeof(sendBuffer));
+  AudioEncoder encoder(opt.codec);
+  SocketSink sink{fd};
+
+  char headers[512];
+  int headerLen = snprintf(headers, sizeof(headers),
+                           "POST %s HTTP/1.1\r\n"
+                           "Host: %s:%s\r\n"
+                           "Content-Type: %s\r\n"
+                           "X-Dayne-Encoding: %s\r\n"
+                           "X-Dayne-Sample-Rate: %d\r\n"
+                           "X-Dayne-Channels: 1\r\n"
+                           "X-Dayne-Bits-Per-Sample: %d\r\n"
+                           "X-Dayne-Utterance-Id: %08lx\r\n"
+                           "Transfer-Encoding: chunked\r\n"
+                           "Accept: %s\r\n"
+                           "Connection: close\r\n"
+                           "\r\n",
+                           opt.path.c_str(), opt.host.c_str(), opt.port.c_str(),
+                           encoder.contentType(), encoder.encodingName(), opt.sampleRate,
+                           encoder.bitsPerSample(), (unsigned long)utterance,
+                           opt.partial ? "application/x-ndjson" : "application/json");
+  bool ok = writer.writeRecord(sink, (const uint8_t*)headers, headerLen);
+
+  // Capture produces one frame every FRAME_SAMPLES / rate seconds; a chunk
+  // goes out whenever a full payload has built up, like the upload loop
+  std::vector<uint8_t> pending;
+  uint8_t encoded[FRAME_SAMPLES * 2];
+  Clock::time_point start = Clock::now();
+  for (size_t offset = 0; ok && offset < pcm.size(); offset += FRAME_SAMPLES) {
+    size_t n = std::min(FRAME_SAMPLES, pcm.size() - offset);
+    std::this_thread::sleep_until(start + std::chrono::microseconds(
+                                              (long long)(offset + n) * 1000000 / opt.sampleRate));
+    size_t len = encoder.encode(&pcm[offset], n, encoded);
+    if (offset + n == pcm.size()) len += encoder.flush(encoded + len);
+    pending.insert(pending.end(), encoded, encoded + len);
+
+    while (ok && pending.size() >= writer.payloadCapacity()) {
+      size_t chunk = writer.payloadCapacity();
+      memcpy(writer.payload(), pending.data(), chunk);
+      ok = writer.send(sink, chunk);
+      pending.erase(pending.begin(), pending.begin() + chunk);
+    }
+  }
+  // Button released: drain and terminate
+  while (ok && !pending.empty()) {
+    size_t chunk = std::min(pending.size(), writer.payloadCapacity());
+    memcpy(writer.payload(), pending.data(), chunk);
+    ok = writer.send(sink, chunk);
+    pending.erase(pending.begin(), pending.begin() + chunk);
+  }
+  ok = ok && writer.finish(sink);
+  Clock::time_point release = Clock::now();
+
+  char body[8192];
+  HttpResponseParser parser(body, sizeof(body));
+  if (ok && readResponse(fd, parser) == HttpResponseParser::DONE) {
+    sample.transcriptMs = std::chrono::duration<double, std::milli>(Clock::now() - release).count();
+    sample.status = parser.status();
+    sample.ok = sample.status == 200;
+  }
+  close(fd);
+  return sample;
+}
+
+static bool loadRaw(const std::string& path, std::vector<int16_t>* pcm) {
+  FILE* f = fopen(path.c_str(), "rb");
+  if (f == nullptr) return false;
+  int16_t buf[4096];
+  size_t n;
+  while ((n = fread(buf, sizeof(int16_t), 4096, f)) > 0) pcm->insert(pcm->end(), buf, buf + n);
+  fclose(f);
+  return !pcm->empty();
+}
+
+// A 440 Hz tone, for runs without recordings
+static std::vector<int16_t> synthetic(double seconds, int rate) {
+  std::vector<int16_t> pcm((size_t)(seconds * rate));
+  for (size_t i = 0; i < pcm.size(); i++) {
+    pcm[i] = (int16_t)(8000 * sin(2 * M_PI * 440 * i / rate));
+  }
+  return pcm;
+}
+
+static double percentile(std::vector<double> v, double p) {
+  if (v.empty()) return 0;
+  std::sort(v.begin(), v.end());
+  size_t rank = (size_t)ceil(p / 100 * v.size());
+  return v[rank == 0 ? 0 : rank - 1];
+}
+
+static void usage() {
+  fprintf(stderr,
+          "usage: loadgen [-host h] [-port p] [-path /|/stream] [-devices n] [-utterances n]\n"
+          "               [-rate hz] [-think ms] [-codec pcm16|ulaw|ima-adpcm] [-partial]\n"
+          "               [-synthetic seconds] audio-*.raw...\n");
+  exit(2);
+}
+
+int main(int argc, char** argv) {
+  Options opt;
+  for (int i = 1; i < argc; i++) {
+    std::string arg = argv[i];
+    auto next = [&]() -> const char* {
+      if (i + 1 >= argc) usage();
+      return argv[++i];
+    };
+    if (arg == "-host") opt.host = next();
+    else if (arg == "-port") opt.port = next();
+    else if (arg == "-path") opt.path = next();
+    else if (arg == "-devices") opt.devices = atoi(next());
+    else if (arg == "-utterances") opt.utterances = atoi(next());
+    else if (arg == "-rate") opt.sampleRate = atoi(next());
+    else if (arg == "-think") opt.thinkMs = atoi(next());
+    else if (arg == "-partial") opt.partial = true;
+    else if (arg == "-synthetic") opt.syntheticSeconds = atof(next());
+    else if (arg == "-codec") {
+      std::string codec = next();
+      if (codec == "pcm16") opt.codec = CODEC_PCM16;
+      else if (codec == "ulaw") opt.codec = CODEC_ULAW;
+      else if (codec == "ima-adpcm") opt.codec = CODEC_IMA_ADPCM;
+      else usage();
+    } else if (!arg.empty() && arg[0] == '-') usage();
+    else opt.files.push_back(arg);
+  }
+  if (opt.devices < 1 || opt.utterances < 1) usage();
+
+  std::vector<std::vector<int16_t>> recordings;
+  for (const std::string& path : opt.files) {
+    std::vector<int16_t> pcm;
+    if (!loadRaw(path, &pcm)) {
+      fprintf(stderr, "cannot read %s\n", path.c_str());
+      return 1;
+    }
+    recordings.push_back(std::move(pcm));
+  }
+  if (opt.syntheticSeconds > 0) recordings.push_back(synthetic(opt.syntheticSeconds, opt.sampleRate));
+  if (recordings.empty()) usage();
+
+  // Two idle reads: the second gives what one /debug/vars poll allocates, so
+  // polling can be taken out of the per-request figure
+  EndpointVars calibrate = fetchVars(opt);
+  EndpointVars before = fetchVars(opt);
+  long pollAlloc = before.totalAlloc - calibrate.totalAlloc;
+  if (!before.valid) fprintf(stderr, "no /debug/vars on the endpoint; memory figures skipped\n");
+
+  // Sample the endpoint while the load runs
+  std::atomic<bool> running{true};
+  EndpointVars peak = before;
+  long polls = 1;  // counting the final read
+  std::thread sampler([&]() {
+    while (running) {
+      EndpointVars v = fetchVars(opt);
+      polls++;
+      if (v.valid) {
+        peak.goroutines = std::max(peak.goroutines, v.goroutines);
+        peak.heapInuse = std::max(peak.heapInuse, v.heapInuse);
+      }
+      std::this_thread::sleep_for(std::chrono::milliseconds(250));
+    }
+  });
+
+  std::mutex mu;
+  std::vector<Sample> samples;
+  std::vector<std::thread> devices;
+  Clock::time_point runStart = Clock::now();
+  for (int d = 0; d < opt.devices; d++) {
+    devices.emplace_back([&, d]() {
+      // Stagger starts across one think time so devices do not move in lockstep
+      std::this_thread::sleep_for(std::chrono::milliseconds(opt.thinkMs * d / opt.devices));
+      for (int u = 0; u < opt.utterances; u++) {
+        const std::vector<int16_t>& pcm = recordings[(d + u) % recordings.size()];
+        Sample s = runUtterance(opt, pcm, ((uint32_t)(d + 1) << 16) | (uint32_t)(u + 1));
+        {
+          std::lock_guard<std::mutex> lock(mu);
+          samples.push_back(s);
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(opt.thinkMs));
+      }
+    });
+  }
+  for (std::thread& t : devices) t.join();
+  double wallSeconds = std::chrono::duration<double>(Clock::now() - runStart).count();
+  running = false;
+  sampler.join();
+  EndpointVars after = fetchVars(opt);
+
+  std::vector<double> transcript;
+  std::vector<double> connect;
+  double audioSeconds = 0;
+  size_t failed = 0;
+  for (const Sample& s : samples) {
+    if (!s.ok) {
+      failed++;
+      continue;
+    }
+    transcript.push_back(s.transcriptMs);
+    connect.push_back(s.connectMs);
+    audioSeconds += s.audioSeconds;
+  }
+
+  printf("%s, %d devices x %d utterances, %s%s: %zu ok, %zu failed in %.1f s\n", opt.path.c_str(),
+         opt.devices, opt.utterances, AudioEncoder(opt.codec).encodingName(),
+         opt.partial ? ", partial results" : "", transcript.size(), failed, wallSeconds);
+  printf("throughput: %.2f utterances/s, %.2f s of audio per s\n", transcript.size() / wallSeconds,
+         audioSeconds / wallSeconds);
+  printf("time to transcript (ms): p50 %.1f  p95 %.1f  p99 %.1f  max %.1f\n",
+         percentile(transcript, 50), percentile(transcript, 95), percentile(transcript, 99),
+         percentile(transcript, 100));
+  printf("connect (ms): p50 %.1f  p99 %.1f\n", percentile(connect, 50), percentile(connect, 99));
+  if (before.valid && after.valid && !samples.empty()) {
+    printf("endpoint: goroutines %ld idle, %ld peak, %ld after; heap in use %.1f MB idle, %.1f MB peak; "
+           "%.1f KB allocated per request\n",
+           before.goroutines, peak.goroutines, after.goroutines, before.heapInuse / 1048576.0,
+           peak.heapInuse / 1048576.0,
+           (after.totalAlloc - before.totalAlloc - polls * pollAlloc) / 1024.0 / samples.size());
+  }
+  return failed == 0 ? 0 : 1;
+}